@@ -5,49 +5,89 @@
  */
  
 #include "ADXL345.h"
+#include "FastMath.h"
 
 const double ADXL345::FULL_RES_RESOLUTION = 3.90625; // mg/LSB
 const double ADXL345::LP_FILTER_ALPHA = 0.5;
 const double ADXL345::OFFSET_REGS_SCALE = 1 / 15.6;  // LSB/mg
+const double ADXL345::EVENT_THRESH_MG = 62.5;
+const double ADXL345::FREE_FALL_TIME_MS = 5.0;
+const double ADXL345::TAP_DURATION_MS = 0.625;
+const double ADXL345::TAP_TIME_MS = 1.25;
+const uint8_t ADXL345::EVENT_MASK[EVENT_NUM] = {SINGLE_TAP_ENABLE, DOUBLE_TAP_ENABLE, ACTIVITY_ENABLE,
+                                                INACTIVITY_ENABLE, FREE_FALL_ENABLE};
 
-ADXL345::ADXL345 ()
+ADXL345::ADXL345 (BusTransport* _bus, uint8_t _address)
   : m_initialized (false),
     m_rangeSetting (RANGE_2G),
     m_fullResSetting (false),
     m_resolution (3.90625),
     m_outRate (RATE_100HZ),
     m_lpFilter (false),
+    m_calibrationResolution (3.90625),
     m_calibrationVectorInit (false),
-    m_accCB (NULL),
-    m_prCB (NULL),
-    m_ovrnCB (NULL)
+    m_calibrated (false),
+    m_ovrnCB (NULL),
+    m_intEnable (0),
+    m_intMap (0),
+    m_powerCtrl (0),
+    m_i2c (_address, 0, &Wire, I2C_MAX_SPEED),
+    m_bus (_bus ? _bus : &m_i2c)
 {
-  m_lpFilterPrev.x = 0.0;
-  m_lpFilterPrev.y = 0.0;
-  m_lpFilterPrev.z = 0.0;
-  
-  m_calibrationDataRaw.x = 0;
-  m_calibrationDataRaw.y = 0;
-  m_calibrationDataRaw.z = 0;
+  m_lpFilterPrev = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_latestRaw = makeVec3<int16_t> (0, 0, 0);
+  m_calibrationDataRaw = makeVec3<int16_t> (0, 0, 0);
+  m_calBias = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_calMatrix = Mat3<float>::identity ();
 }
 
 ADXL345::~ADXL345 ()
 {
 }
 
-void ADXL345::registerAccelerationCallback (AccelerationCallback _cb)
+bool ADXL345::subscribe (RawCallback _cb)
 {
-  m_accCB = _cb;
+  return m_rawSubscribers.add (_cb);
 }
 
-void ADXL345::registerOverrunCallback (OverrunCallback _cb)
+bool ADXL345::subscribe (MilliGCallback _cb)
 {
-  m_ovrnCB = _cb;
+  return m_mGSubscribers.add (_cb);
+}
+
+bool ADXL345::subscribe (PitchRollCallback _cb)
+{
+  return m_prSubscribers.add (_cb);
+}
+
+bool ADXL345::subscribe (EventCallback _cb)
+{
+  return m_eventSubscribers.add (_cb);
 }
 
-void ADXL345::registerPitchRollCallback (PitchRollCallback _cb)
+void ADXL345::unsubscribe (RawCallback _cb)
 {
-  m_prCB = _cb;
+  m_rawSubscribers.remove (_cb);
+}
+
+void ADXL345::unsubscribe (MilliGCallback _cb)
+{
+  m_mGSubscribers.remove (_cb);
+}
+
+void ADXL345::unsubscribe (PitchRollCallback _cb)
+{
+  m_prSubscribers.remove (_cb);
+}
+
+void ADXL345::unsubscribe (EventCallback _cb)
+{
+  m_eventSubscribers.remove (_cb);
+}
+
+void ADXL345::registerOverrunCallback (OverrunCallback _cb)
+{
+  m_ovrnCB = _cb;
 }
 
 void ADXL345::init ()
@@ -55,7 +95,7 @@ void ADXL345::init ()
   if (m_initialized)
     return;
     
-  writeReg (POWER_CTRL_REG, MEASURE_ENABLE);
+  writeReg (POWER_CTRL_REG, m_powerCtrl | MEASURE_ENABLE);
   
   m_initialized = true;
 }
@@ -64,17 +104,21 @@ void ADXL345::init ()
 void ADXL345::initAsync (int _int1Pin, ISRFunc _int1ISR)
 { 
   // Disable all interrupts and enter standby mode
-  writeReg (POWER_CTRL_REG, 0);
+  writeReg (POWER_CTRL_REG, m_powerCtrl);
   m_initialized = false;
   writeReg (INT_ENABLE_REG, 0);
   
   // Setup hardware interrupt
   pinMode (_int1Pin, INPUT);
-  attachInterrupt( _int1Pin, _int1ISR, RISING);
+  if (_int1ISR)
+    attachInterrupt( _int1Pin, _int1ISR, RISING);
   
-  // Enable data ready interrupt on INT1 pin
-  writeReg (INT_MAP_REG, 0);
-  writeReg (INT_ENABLE_REG, DATA_RDY_ENABLE/* | OVERRUN_ENABLE*/);
+  // Enable data ready interrupt on INT1 pin, along with any events enabled
+  // so far.  Mapping comes first so nothing fires on the wrong pin.
+  m_intMap &= EVENT_MASK_ALL;
+  m_intEnable |= DATA_RDY_ENABLE/* | OVERRUN_ENABLE*/;
+  writeReg (INT_MAP_REG, m_intMap);
+  writeReg (INT_ENABLE_REG, m_intEnable);
   
   // Do normal initialization
   init ();
@@ -85,17 +129,14 @@ void ADXL345::calibrateOffset ()
   if (!m_initialized)
     return;
   
-  if (!m_calibrationVectorInit)
+  if (!m_calibrated && !m_calibrationVectorInit)
   {
     // Clear offset values so we don't double up on calibration
     writeReg (X_OFFSET_REG, 0);
     writeReg (Y_OFFSET_REG, 0);
     writeReg (Z_OFFSET_REG, 0);
     
-    vectord cum;
-    cum.x = 0;
-    cum.y = 0;
-    cum.z = 0;
+    vectord cum = makeVec3<imu_real> (0, 0, 0);
     for (int32_t i = 0; i < CALIBRATION_SAMPLES; i++)
     {
       // Wait for data to be ready
@@ -105,24 +146,43 @@ void ADXL345::calibrateOffset ()
         dataReady (drdy, ovrn);
         
       // Read data
-      vector16b rawData = readRaw ();
-      cum.x += rawData.x;
-      cum.y += rawData.y;
-      cum.z += rawData.z;
+      cum += scaleVec3<imu_real> (readRaw (), 1);
     }
     
     m_calibrationDataRaw.x = -((int32_t) cum.x) / CALIBRATION_SAMPLES;
     m_calibrationDataRaw.y = -((int32_t) cum.y) / CALIBRATION_SAMPLES;
     m_calibrationDataRaw.z = -((int32_t) cum.z) / CALIBRATION_SAMPLES;
+    m_calibrationResolution = m_resolution;
     
     m_calibrationVectorInit = true;
   }
- 
-  // Convert resolution
+  writeOffsets ();
+}
+
+void ADXL345::writeOffsets ()
+{
+  if (!m_initialized)
+    return;
+  
+  // The loaded model already covers the bias
+  if (m_calibrated)
+  {
+    writeReg (X_OFFSET_REG, 0);
+    writeReg (Y_OFFSET_REG, 0);
+    writeReg (Z_OFFSET_REG, 0);
+    return;
+  }
+  
+  // Left as they are until calibrateOffset () has taken a vector
+  if (!m_calibrationVectorInit)
+    return;
+  
+  // Convert resolution, the registers are in mg whatever the range
+  vectord offsetmG = scaleVec3<imu_real> (m_calibrationDataRaw, m_calibrationResolution * OFFSET_REGS_SCALE);
   vector16b offsetValues;
-  offsetValues.x = (int16_t) round(((double) m_calibrationDataRaw.x) * m_resolution * OFFSET_REGS_SCALE);
-  offsetValues.y = (int16_t) round(((double) m_calibrationDataRaw.y) * m_resolution * OFFSET_REGS_SCALE);
-  offsetValues.z = (int16_t) round((((double) m_calibrationDataRaw.z) * m_resolution * OFFSET_REGS_SCALE) + (OFFSET_REGS_SCALE * 1000.0));
+  offsetValues.x = (int16_t) round(offsetmG.x);
+  offsetValues.y = (int16_t) round(offsetmG.y);
+  offsetValues.z = (int16_t) round(offsetmG.z + (OFFSET_REGS_SCALE * 1000.0));
   
   // Write calibration data
   writeReg (X_OFFSET_REG, offsetValues.x);
@@ -130,48 +190,160 @@ void ADXL345::calibrateOffset ()
   writeReg (Z_OFFSET_REG, offsetValues.z);
 }
 
-void ADXL345::int1ISR ()
+bool ADXL345::loadCalibration (const CalibrationBlob& _blob)
+{
+  if (!calibrationValid (_blob, CAPTURE_ACC))
+    return false;
+  
+  unpackCalibration (_blob, m_calBias, m_calMatrix);
+  m_calibrated = true;
+  
+  // Clear the offset registers
+  writeOffsets ();
+  return true;
+}
+
+void ADXL345::clearCalibration ()
+{
+  m_calibrated = false;
+  m_calBias = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_calMatrix = Mat3<float>::identity ();
+  
+  // Back to the single position offsets
+  calibrateOffset ();
+}
+
+bool ADXL345::int1ISR ()
 { 
-  bool drdy, ovrn;
-  dataReady (drdy, ovrn);
+  // Events routed here are cleared by the same read, so dispatch them too
+  uint8_t tapStatus;
+  uint8_t source = readInterruptSource (tapStatus);
+  bool drdy = source & DATA_RDY_MASK;
+  bool ovrn = source & OVERRUN_MASK;
+  dispatchEvents (source, tapStatus);
 
-  if ((m_accCB || m_prCB) && drdy)
+  if (drdy)
   {
-    // Read raw acceleration data
+    // Read raw acceleration data, this also clears DATA_READY
     vector16b rawAcc = readRaw ();
+    m_latestRaw = rawAcc;
     
-    // Calculate mg acceleration
-    vectord accmG;
-    accmG.x = ((double) rawAcc.x) * m_resolution;
-    accmG.y = ((double) rawAcc.y) * m_resolution;
-    accmG.z = ((double) rawAcc.z) * m_resolution;
-    
-    // Filter signal if enabled
+    // Filter signal if enabled.  The correction is affine, so filtering
+    // before it gives the same mg as filtering after.
+    Vec3<float> filtered = scaleVec3<float> (rawAcc, 1.0f);
     if (m_lpFilter)
-    {
-      accmG.x = accmG.x * LP_FILTER_ALPHA + (m_lpFilterPrev.x * (1 - LP_FILTER_ALPHA));
-      accmG.y = accmG.y * LP_FILTER_ALPHA + (m_lpFilterPrev.y * (1 - LP_FILTER_ALPHA));
-      accmG.z = accmG.z * LP_FILTER_ALPHA + (m_lpFilterPrev.z * (1 - LP_FILTER_ALPHA));
-      
-      m_lpFilterPrev.x = accmG.x;
-      m_lpFilterPrev.y = accmG.y;
-      m_lpFilterPrev.z = accmG.z;
-    }
+      filtered = filtered * (float) LP_FILTER_ALPHA + m_lpFilterPrev * (float) (1 - LP_FILTER_ALPHA);
+    m_lpFilterPrev = filtered;
     
-    // Make callback
-    if (m_accCB)
-      m_accCB (rawAcc, accmG);
-    if (m_prCB)
+    // Make callbacks, only converting for subscribed outputs
+    m_rawSubscribers.publish (rawAcc);
+    if (!m_mGSubscribers.empty () || !m_prSubscribers.empty ())
     {
-      // Calculate pitch and roll
-      double pitch = (atan2 (accmG.y, sqrt (accmG.x * accmG.x + accmG.z * accmG.z)) * 180.0) / PI;
-      double roll = (atan2 (-accmG.x, accmG.z) * 180.0) / PI;
-      m_prCB (pitch, roll);
+      vectord accmG = correctedmG (filtered);
+      m_mGSubscribers.publish (accmG);
+      if (!m_prSubscribers.empty ())
+      {
+        imu_real pitch, roll;
+        pitchRoll (accmG, pitch, roll);
+        m_prSubscribers.publish (pitch, roll);
+      }
     }
   }
   
   if (m_ovrnCB && ovrn)
     m_ovrnCB ();
+  
+  return drdy;
+}
+
+void ADXL345::int2ISR ()
+{
+  uint8_t tapStatus;
+  uint8_t source = readInterruptSource (tapStatus);
+  dispatchEvents (source, tapStatus);
+}
+
+// _int2ISR should just call ADXL345::int2ISR
+void ADXL345::initEventAsync (int _int2Pin, ISRFunc _int2ISR)
+{
+  pinMode (_int2Pin, INPUT);
+  attachInterrupt (_int2Pin, _int2ISR, RISING);
+}
+
+void ADXL345::configureActivity (double _thresholdmG, uint8_t _axes, bool _acCoupled)
+{
+  writeReg (ACT_THRESH_REG, toRegUnits (_thresholdmG, EVENT_THRESH_MG));
+  
+  // Activity is the high nibble of the shared control reg
+  uint8_t val = readReg (ACT_INACT_CTRL) & 0x0F;
+  val |= (_axes & AXIS_ALL) << 4;
+  if (_acCoupled)
+    val |= ACT_AC_COUPLE;
+  writeReg (ACT_INACT_CTRL, val);
+}
+
+void ADXL345::configureInactivity (double _thresholdmG, uint8_t _timeS, uint8_t _axes, bool _acCoupled)
+{
+  writeReg (INACT_THRESH_REG, toRegUnits (_thresholdmG, EVENT_THRESH_MG));
+  writeReg (INACT_TIME_REG, _timeS);
+  
+  // Inactivity is the low nibble of the shared control reg
+  uint8_t val = readReg (ACT_INACT_CTRL) & 0xF0;
+  val |= _axes & AXIS_ALL;
+  if (_acCoupled)
+    val |= INACT_AC_COUPLE;
+  writeReg (ACT_INACT_CTRL, val);
+}
+
+void ADXL345::configureTap (double _thresholdmG, double _durationmS, double _latencymS, double _windowmS, uint8_t _axes)
+{
+  writeReg (TAP_THRESH_REG, toRegUnits (_thresholdmG, EVENT_THRESH_MG));
+  writeReg (TAP_DURATION_REG, toRegUnits (_durationmS, TAP_DURATION_MS));
+  
+  // Zero latency or window turns double tap detection off
+  writeReg (TAP_LATENCY_REG, toRegUnits (_latencymS, TAP_TIME_MS));
+  writeReg (TAP_WINDOW_REG, toRegUnits (_windowmS, TAP_TIME_MS));
+  writeReg (TAP_AXES_REG, _axes & AXIS_ALL);
+}
+
+void ADXL345::configureFreeFall (double _thresholdmG, double _timemS)
+{
+  writeReg (FF_THRESH_REG, toRegUnits (_thresholdmG, EVENT_THRESH_MG));
+  writeReg (FF_TIME_REG, toRegUnits (_timemS, FREE_FALL_TIME_MS));
+}
+
+void ADXL345::enableEvent (EVENT _event, bool _int2)
+{
+  if (_event >= EVENT_NUM)
+    return;
+  
+  uint8_t mask = EVENT_MASK[_event];
+  if (_int2)
+    m_intMap |= mask;
+  else
+    m_intMap &= ~mask;
+  m_intEnable |= mask;
+  
+  writeReg (INT_MAP_REG, m_intMap);
+  writeReg (INT_ENABLE_REG, m_intEnable);
+}
+
+void ADXL345::disableEvent (EVENT _event)
+{
+  if (_event >= EVENT_NUM)
+    return;
+  
+  m_intEnable &= ~EVENT_MASK[_event];
+  writeReg (INT_ENABLE_REG, m_intEnable);
+}
+
+void ADXL345::setLinkMode (bool _link)
+{
+  if (_link)
+    m_powerCtrl |= LINK_ENABLE;
+  else
+    m_powerCtrl &= ~LINK_ENABLE;
+  writeReg (POWER_CTRL_REG, (readReg (POWER_CTRL_REG) & ~LINK_ENABLE) | m_powerCtrl);
 }
 
 void ADXL345::setOutputRate (OUTPUT_RATE _rate)
@@ -212,8 +384,8 @@ void ADXL345::setRange (RANGE_SETTING _range)
   // Update the resolution
   updateResolution ();
   
-  // Recalculate calibration offsets
-  calibrateOffset ();
+  // Rescale the calibration offsets, if any
+  writeOffsets ();
 }
 
 void ADXL345::setFullRes (bool _fullRes)
@@ -236,8 +408,8 @@ void ADXL345::setFullRes (bool _fullRes)
   // Update the resolution
   updateResolution ();
   
-  // Recalculate calibration offsets
-  calibrateOffset ();
+  // Rescale the calibration offsets, if any
+  writeOffsets ();
 }
 
 void ADXL345::dataReady (bool &_drdy, bool &_ovrn)
@@ -255,53 +427,46 @@ void ADXL345::dataReady (bool &_drdy, bool &_ovrn)
 
 ADXL345::vector16b ADXL345::readRaw ()
 {
-  // Send request with auto-increment enabled
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (DATAX0_REG);
-  Wire.endTransmission ();
-  
   // Receive 6 byte successive transmission
-  Wire.requestFrom (ADDRESS, 6);
-  while (Wire.available () < 6);
-  uint8_t xl = Wire.read();
-  uint8_t xh = Wire.read ();
-  uint8_t yl = Wire.read ();
-  uint8_t yh = Wire.read ();
-  uint8_t zl = Wire.read ();
-  uint8_t zh = Wire.read ();
+  uint8_t buf[6];
+  m_bus->readBlock (DATAX0_REG, buf, 6);
   
   // Aggregate high and low bytes
   vector16b retval;
-  retval.x = (int16_t)(xh << 8 | xl);
-  retval.y = (int16_t)(yh << 8 | yl);
-  retval.z = (int16_t)(zh << 8 | zl);
+  unpackVec3LE (buf, &retval, 1);
   
   return retval;
 }
 
-uint8_t ADXL345::readReg (const uint8_t _reg)
+ADXL345::vector16b ADXL345::readLatestRaw ()
+{
+  noInterrupts ();
+  vector16b rawAcc = m_latestRaw;
+  interrupts ();
+  return rawAcc;
+}
+
+ADXL345::vectord ADXL345::readMilliG ()
 {
-  // Send request to read reg
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (_reg);
-  Wire.endTransmission ();
+  noInterrupts ();
+  Vec3<float> filtered = m_lpFilterPrev;
+  interrupts ();
+  return correctedmG (filtered);
+}
 
-  // Receive reg value back
-  uint8_t val;
-  Wire.requestFrom (ADDRESS, REG_WIDTH);
-  while (Wire.available ())
-      val = Wire.read();
-  
-  return val;
+void ADXL345::readPitchRoll (imu_real& _pitch, imu_real& _roll)
+{
+  pitchRoll (readMilliG (), _pitch, _roll);
+}
+
+uint8_t ADXL345::readReg (const uint8_t _reg)
+{
+  return m_bus->readReg (_reg);
 }
 
 void ADXL345::writeReg (const uint8_t _reg, const uint8_t _val)
 { 
-  // Send request to write
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (_reg);
-  Wire.write (_val);
-  Wire.endTransmission ();
+  m_bus->writeReg (_reg, _val);
 }
 
 void ADXL345::updateResolution ()
@@ -317,3 +482,67 @@ void ADXL345::updateResolution ()
     // Always 10 bits (512 is 2 ^ 9)
     m_resolution = (realRange / 512) * 1000.0;
 }
+
+ADXL345::vectord ADXL345::correctedmG (const Vec3<float>& _rawAcc)
+{
+  if (!m_calibrated)
+    return scaleVec3<imu_real> (_rawAcc, m_resolution);
+  
+  Vec3<float> corrected = m_calMatrix * (_rawAcc - m_calBias);
+  return scaleVec3<imu_real> (corrected, m_resolution);
+}
+
+void ADXL345::pitchRoll (const vectord& _accmG, imu_real& _pitch, imu_real& _roll)
+{
+  // Runs in the ISR for pitch/roll subscribers, float is plenty for mG
+  float x = _accmG.x;
+  float y = _accmG.y;
+  float z = _accmG.z;
+  _pitch = fastAtan2 (y, fastSqrt (x * x + z * z)) * (float) (180.0 / PI);
+  _roll = fastAtan2 (-x, z) * (float) (180.0 / PI);
+}
+
+uint8_t ADXL345::toRegUnits (double _value, double _lsb)
+{
+  double units = round (_value / _lsb);
+  if (units < 0.0)
+    return 0;
+  if (units > 255.0)
+    return 255;
+  return (uint8_t) units;
+}
+
+uint8_t ADXL345::readInterruptSource (uint8_t& _tapStatus)
+{
+  _tapStatus = 0;
+  if (!(m_intEnable & (SINGLE_TAP_ENABLE | DOUBLE_TAP_ENABLE | ACTIVITY_ENABLE)))
+    return readReg (INT_SOURCE_REG);
+  
+  // ACT_TAP_STATUS has to be read before INT_SOURCE clears the event, one
+  // burst from the first to the second gets both in order
+  uint8_t buf[INT_SOURCE_REG - ACT_TAP_STATUS_REG + 1];
+  m_bus->readBlock (ACT_TAP_STATUS_REG, buf, sizeof (buf));
+  _tapStatus = buf[0];
+  return buf[sizeof (buf) - 1];
+}
+
+void ADXL345::dispatchEvents (uint8_t _source, uint8_t _tapStatus)
+{
+  uint8_t events = _source & m_intEnable & EVENT_MASK_ALL;
+  if (!events || m_eventSubscribers.empty ())
+    return;
+  
+  for (uint8_t e = 0; e < EVENT_NUM; e++)
+  {
+    if (!(events & EVENT_MASK[e]))
+      continue;
+    
+    // Source axes line up with AXIS_X/Y/Z, activity's are one nibble up
+    uint8_t axes = 0;
+    if (e == EVENT_SINGLE_TAP || e == EVENT_DOUBLE_TAP)
+      axes = _tapStatus & AXIS_ALL;
+    else if (e == EVENT_ACTIVITY)
+      axes = (_tapStatus >> 4) & AXIS_ALL;
+    m_eventSubscribers.publish ((EVENT) e, axes);
+  }
+}
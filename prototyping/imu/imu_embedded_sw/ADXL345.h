@@ -8,6 +8,11 @@
 
 #include "Arduino.h"
 #include "Wire.h"
+#include "VectorMath.h"
+#include "BusTransport.h"
+#include "CalibrationBlob.h"
+#include "Subscribers.h"
+#include "ImuConfig.h"
 
 class ADXL345
 {
@@ -42,48 +47,120 @@ class ADXL345
     RATE_NUM
   } OUTPUT_RATE;
  
-  // Vector structs
-  typedef struct vectord_struct
+  // Events detected by the device itself
+  typedef enum EVENT_ENUM
   {
-      double  x; 
-      double  y;
-      double  z;
-  } vectord;
-  typedef struct vector16b_struct
-  {
-      int16_t x;
-      int16_t y;
-      int16_t z;
-  } vector16b;
-  
-  // Callback definitions
-  typedef void (*AccelerationCallback) (vector16b _rawAcc, vectord _accmG);
-  typedef void (*PitchRollCallback) (double _pitch, double _roll);
+    EVENT_SINGLE_TAP = 0,
+    EVENT_DOUBLE_TAP,
+    EVENT_ACTIVITY,
+    EVENT_INACTIVITY,
+    EVENT_FREE_FALL,
+    EVENT_NUM
+  } EVENT;
+  
+  // Axis selection for the event engines, also the axes an event reports
+  static const uint8_t AXIS_X   = 0x04;
+  static const uint8_t AXIS_Y   = 0x02;
+  static const uint8_t AXIS_Z   = 0x01;
+  static const uint8_t AXIS_ALL = 0x07;
+  
+  // Vector types
+  typedef Vec3<imu_real> vectord;
+  typedef Vec3<int16_t> vector16b;
+  
+  // Callback definitions.  The ISR only converts to mg or pitch and roll
+  // while they have subscribers.
+  typedef void (*RawCallback) (vector16b _rawAcc);
+  typedef void (*MilliGCallback) (vectord _accmG);
+  typedef void (*PitchRollCallback) (imu_real _pitch, imu_real _roll);
   typedef void (*OverrunCallback) (); 
+  typedef void (*EventCallback) (EVENT _event, uint8_t _axes); // _axes that triggered a tap or activity
+  
+  // Subscribers per output
+  static const uint8_t SUBSCRIBERS_MAX = ImuConfig::SUBSCRIBERS;
   
   // ISRs
-  typedef void (*ISRFunc) (); // should just call ADXL345::int1ISR
+  typedef void (*ISRFunc) (); // should just call ADXL345::int1ISR or ADXL345::int2ISR
+  
+  // SPI transport parameters (4-wire, mode 3, CS must be wired to a pin)
+  static const uint32_t SPI_CLOCK_HZ     = 5000000;
+  static const uint8_t  SPI_MULTI_BYTE   = 0x40;
+
+  // I2C addresses with ALT ADDRESS low (the breakout's) and high, so two
+  // parts can share a bus
+  static const uint8_t  ADDRESS          = 0x53;
+  static const uint8_t  ADDRESS_ALT      = 0x1D;
 
-  ADXL345 ();
+  // Uses I2C at _address unless a transport is given
+  ADXL345 (BusTransport* _bus = NULL, uint8_t _address = ADDRESS);
   ~ADXL345 ();
   
+  // Bus the device is attached to
+  BusTransport* getBus () {return m_bus;}
+  
+  // Fastest I2C speed mode the part takes
+  static const I2C_SPEED I2C_MAX_SPEED = I2C_FAST;
+  
+  // Speed mode of the device's transactions, clamped to what the part and
+  // its transport take.  Returns the mode in use, I2C_SPEED_NUM on SPI.
+  I2C_SPEED setI2CSpeed (I2C_SPEED _speed) {return m_bus->setSpeed (_speed);}
+  
+  // Subscribe to an output, from setup () or with interrupts off.  Returns
+  // false if the output already has SUBSCRIBERS_MAX subscribers.
+  bool subscribe (RawCallback _cb);
+  bool subscribe (MilliGCallback _cb);
+  bool subscribe (PitchRollCallback _cb);
+  bool subscribe (EventCallback _cb);
+  void unsubscribe (RawCallback _cb);
+  void unsubscribe (MilliGCallback _cb);
+  void unsubscribe (PitchRollCallback _cb);
+  void unsubscribe (EventCallback _cb);
+  
   // Register callbacks
-  void registerAccelerationCallback (AccelerationCallback _cb);
-  void registerPitchRollCallback (PitchRollCallback _cb);
   void registerOverrunCallback (OverrunCallback _cb);
   
   // Initialize
   void init ();
   
   // Asynchrnous initialization
+  // A NULL _int1ISR leaves INT1 for polling (SyncSampler.h)
   void initAsync (int _int1Pin, ISRFunc _int1ISR);
   
   void calibrateOffset ();
   
-  // ISR function
-  void int1ISR ();
-  
-  // Range and resolution settings 
+  // Ellipsoid model (bias, scale and cross-axis) from imu_cal_tool, fitted
+  // in full resolution mode.  Replaces the offset registers while loaded.
+  // Returns false if the blob is not a valid ADXL345 calibration.
+  bool loadCalibration (const CalibrationBlob& _blob);
+  void clearCalibration ();
+  bool isCalibrated () {return m_calibrated;}
+  
+  // Event engines, thresholds and times are converted to register units and
+  // clamped to their range.  AC coupled activity and inactivity compare the
+  // change since the engine was enabled rather than the absolute value.
+  void configureActivity (double _thresholdmG, uint8_t _axes, bool _acCoupled);
+  void configureInactivity (double _thresholdmG, uint8_t _timeS, uint8_t _axes, bool _acCoupled);
+  void configureTap (double _thresholdmG, double _durationmS, double _latencymS, double _windowmS, uint8_t _axes);
+  void configureFreeFall (double _thresholdmG, double _timemS);
+  
+  // Route an event to INT1 (next to DATA_READY) or INT2 and enable it
+  void enableEvent (EVENT _event, bool _int2);
+  void disableEvent (EVENT _event);
+  
+  // Activity and inactivity alternate instead of firing independently.
+  // Kept across init () and initAsync ().
+  void setLinkMode (bool _link);
+  
+  // Attach INT2 for events routed to it
+  void initEventAsync (int _int2Pin, ISRFunc _int2ISR);
+  
+  // ISR functions.  int1ISR returns true when it read a sample.
+  bool int1ISR ();
+  void int2ISR ();
+  
+  // Range and resolution settings.  They only rescale offsets already
+  // taken by calibrateOffset (), they never sample, so they are safe with
+  // interrupts off.
   void setRange (RANGE_SETTING _range);
   RANGE_SETTING getRange () {return m_rangeSetting;}
   void setFullRes (bool _fullRes);
@@ -100,9 +177,16 @@ class ADXL345
   // Read accelerometer data
   void dataReady (bool &_drdy, bool &_ovrn);
   vector16b readRaw ();
+  // Newest sample read by the ISR, before filtering and correction
+  vector16b getLatestRaw () {return m_latestRaw;}
+  
+  // Converts the newest async sample (LP filtered if enabled) when called
+  // instead of in the ISR.  Call from loop ().
+  vector16b readLatestRaw ();
+  vectord readMilliG ();
+  void readPitchRoll (imu_real& _pitch, imu_real& _roll);
  private:
   // Device parameters
-  static const uint8_t ADDRESS             = 0x53;
   static const uint8_t REG_WIDTH           = 1;
   
   static const uint8_t DEV_ID_REG          = 0x00;
@@ -229,6 +313,17 @@ class ADXL345
   // Scale factor of offset registers (LSB/mg)
   static const double OFFSET_REGS_SCALE;
   
+  // Event engine register units
+  static const double EVENT_THRESH_MG;     // mg/LSB, all thresholds
+  static const double FREE_FALL_TIME_MS;   // ms/LSB
+  static const double TAP_DURATION_MS;     // ms/LSB
+  static const double TAP_TIME_MS;         // ms/LSB, latency and window
+  
+  // INT_ENABLE, INT_MAP and INT_SOURCE bit of each event
+  static const uint8_t EVENT_MASK[EVENT_NUM];
+  static const uint8_t EVENT_MASK_ALL = SINGLE_TAP_ENABLE | DOUBLE_TAP_ENABLE | ACTIVITY_ENABLE |
+                                        INACTIVITY_ENABLE | FREE_FALL_ENABLE;
+  
   // Initialized
   bool                 m_initialized;
   
@@ -237,30 +332,59 @@ class ADXL345
   bool                 m_fullResSetting;
   
   // Current resolution in mg
-  double               m_resolution;
+  imu_real             m_resolution;
   
   // Current output rate
   OUTPUT_RATE          m_outRate;
   
-  // LP filter variables
+  // LP filter variables, the filter runs on raw samples so mg and pitch
+  // and roll can be derived from it at any time
   bool                 m_lpFilter;
-  vectord              m_lpFilterPrev;
+  Vec3<float>          m_lpFilterPrev;
+  
+  // Newest async sample
+  vector16b            m_latestRaw;
   
   
-  // Calibration vector (x0g, y0g, z1g) in raw unit
+  // Calibration vector (x0g, y0g, z1g) in raw unit, and the resolution it
+  // was taken at
   vector16b            m_calibrationDataRaw;
+  imu_real             m_calibrationResolution;
   // Calibration vector initialized
   bool                 m_calibrationVectorInit;
+  
+  // Loaded ellipsoid model in raw unit
+  bool                 m_calibrated;
+  Vec3<float>          m_calBias;
+  Mat3<float>          m_calMatrix;
 
   // Callbacks
-  AccelerationCallback m_accCB;
-  PitchRollCallback    m_prCB;
+  Subscribers<RawCallback, SUBSCRIBERS_MAX>       m_rawSubscribers;
+  Subscribers<MilliGCallback, SUBSCRIBERS_MAX>    m_mGSubscribers;
+  Subscribers<PitchRollCallback, SUBSCRIBERS_MAX> m_prSubscribers;
+  Subscribers<EventCallback, SUBSCRIBERS_MAX>     m_eventSubscribers;
   OverrunCallback      m_ovrnCB;
+  
+  // Shadows of INT_ENABLE and INT_MAP, and the POWER_CTRL bits init () and
+  // initAsync () keep when they switch measurement on and off
+  uint8_t              m_intEnable;
+  uint8_t              m_intMap;
+  uint8_t              m_powerCtrl;
+  
+  // Bus the device is attached to
+  I2CTransport         m_i2c;
+  BusTransport*        m_bus;
  
   // Helper functions
   uint8_t readReg (const uint8_t _reg);
   void writeReg (const uint8_t _reg, const uint8_t _val);
   void updateResolution ();
+  void writeOffsets ();
+  vectord correctedmG (const Vec3<float>& _rawAcc);
+  static void pitchRoll (const vectord& _accmG, imu_real& _pitch, imu_real& _roll);
+  static uint8_t toRegUnits (double _value, double _lsb);
+  uint8_t readInterruptSource (uint8_t& _tapStatus);
+  void dispatchEvents (uint8_t _source, uint8_t _tapStatus);
 };
 
 #endif
@@ -5,11 +5,13 @@
  */
  
 #include "BMP085.h"
+#include "FastMath.h"
 
-const double BMP085::OSSR_CONVERSION_TIME[OSSR_NUM] = {4.5, 7.5, 13.5, 25.5};
-const double BMP085::PRESSURE_SEA_LEVEL_HPA = 1013.25;
+const imu_real BMP085::OSSR_CONVERSION_TIME[OSSR_NUM] = {4.5, 7.5, 13.5, 25.5};
+const imu_real BMP085::PRESSURE_SEA_LEVEL_HPA = 1013.25;
+const imu_real BMP085::FEET_PER_METRE = 3.2808;
 
-BMP085::BMP085 ()
+BMP085::BMP085 (BusTransport* _bus)
   : m_initialized (false),
     m_AC1 (0),
     m_AC2 (0),
@@ -26,41 +28,83 @@ BMP085::BMP085 ()
     m_async (false),
     m_ossrAsync (OSSR_STANDARD),
     m_rawTempAsync (0),
+    m_tempDecimation (TEMP_DECIMATION_DEFAULT),
+    m_pressureSinceTemp (0),
+    m_pressureSamples (0),
+    m_tempDeciC (0),
+    m_B3Base (0),
+    m_B4 (0),
+#ifndef IMU_CFG_NO_AVG_FILTER
     m_avgFilter (false),
+#endif
+    m_rawPressureAsync (0),
+    m_pressurePa (0),
+    m_pressureTimemS (0),
+    m_prevPressurePa (0),
+    m_prevPressureTimemS (0),
     m_verticalSpeedSamplesCount (0),
     m_lastAltitudeM (0.0),
     m_lastAltitudeTimemS (0),
-    m_tempCB (NULL),
-    m_pressureCB (NULL),
-    m_altitudeCB (NULL),
-    m_verticalSpeedCB (NULL)
+    m_i2c (ADDRESS, 0, &Wire, I2C_MAX_SPEED),
+    m_bus (_bus ? _bus : &m_i2c)
 {
+#ifndef IMU_CFG_NO_AVG_FILTER
   for (int32_t i = 0; i < COEFZ; i++)
     m_k[i] = 0;
+#endif
 }
 
 BMP085::~BMP085 ()
 {
 }
 
-void BMP085::registerTemperatureCallback (TemperatureCallback _cb)
+bool BMP085::subscribe (QUANTITY _quantity, QuantityCallback _cb)
 {
-  m_tempCB = _cb;
+  if (_quantity >= QUANTITY_SUBSCRIBED)
+    return false;
+  return m_subscribers[_quantity].add (_cb);
 }
 
-void BMP085::registerPressureCallback (PressureCallback _cb)
+void BMP085::unsubscribe (QUANTITY _quantity, QuantityCallback _cb)
 {
-  m_pressureCB = _cb;
+  if (_quantity < QUANTITY_SUBSCRIBED)
+    m_subscribers[_quantity].remove (_cb);
 }
 
-void BMP085::registerAltitudeCallback (AltitudeCallback _cb)
+imu_real BMP085::read (QUANTITY _quantity)
 {
-  m_altitudeCB = _cb;
-}
-
-void BMP085::registerVerticalSpeedCallback (VerticalSpeedCallback _cb)
-{
-  m_verticalSpeedCB = _cb;
+  if (!ImuConfig::IMPERIAL_UNITS && _quantity >= QUANTITY_SUBSCRIBED)
+    return 0;
+  
+  // Snapshot the newest sample, the conversion runs with interrupts on
+  noInterrupts ();
+  int16_t rawTemp = m_rawTempAsync;
+  int32_t tempDeciC = m_tempDeciC;
+  int32_t rawPressure = m_rawPressureAsync;
+  int32_t pressurePa = m_pressurePa;
+  int32_t prevPressurePa = m_prevPressurePa;
+  uint32_t timeDiffmS = m_pressureTimemS - m_prevPressureTimemS;
+  interrupts ();
+  
+  switch (_quantity)
+  {
+    case RAW_TEMP:     return rawTemp;
+    case TEMP_C:       return tempDeciC * (imu_real) 0.1;
+    case TEMP_F:       return (tempDeciC * (imu_real) 0.1 * 9 / 5) + 32;
+    case RAW_PRESSURE: return rawPressure;
+    case PRESSURE_HPA: return pressurePa / (imu_real) 100.0;
+    case ALTITUDE_M:   return altitudeM (pressurePa);
+    case ALTITUDE_F:   return altitudeM (pressurePa) * FEET_PER_METRE;
+    case VERTICAL_SPEED_MPS:
+    case VERTICAL_SPEED_FPS:
+    {
+      if (timeDiffmS == 0 || prevPressurePa == 0)
+        return 0;
+      imu_real speedMpS = (altitudeM (pressurePa) - altitudeM (prevPressurePa)) / (((imu_real) timeDiffmS) / 1000);
+      return (_quantity == VERTICAL_SPEED_MPS) ? speedMpS : speedMpS * FEET_PER_METRE;
+    }
+    default:           return 0;
+  }
 }
 
 void BMP085::init ()
@@ -95,7 +139,8 @@ void BMP085::initAsync (int _eocPin, ISRFunc _eocIsr)
   
   // Configure interrupt
   pinMode (_eocPin, INPUT);
-  attachInterrupt (_eocPin, _eocIsr, RISING);
+  if (_eocIsr)
+    attachInterrupt (_eocPin, _eocIsr, RISING);
   
   // Set the initial state
   m_state = WAIT_TEMP_CONVERSION;
@@ -111,7 +156,19 @@ void BMP085::eocISR ()
     case WAIT_TEMP_CONVERSION:
     {
       // Read temperature
-      m_rawTempAsync = ((readReg (VALUE_MSB_REG) << 8) | readReg (VALUE_LSB_REG));
+      int16_t rawTemp = ((readReg (VALUE_MSB_REG) << 8) | readReg (VALUE_LSB_REG));
+      
+      // If the temperature moved noticeably, check it again after the next pressure
+      // conversion instead of waiting for the full decimation period
+      int16_t tempChange = rawTemp - m_rawTempAsync;
+      if (tempChange > TEMP_CHANGE_THRESHOLD || tempChange < -TEMP_CHANGE_THRESHOLD)
+        m_pressureSinceTemp = m_tempDecimation - 1;
+      else
+        m_pressureSinceTemp = 0;
+      m_rawTempAsync = rawTemp;
+      
+      // Recalculate the temperature dependent compensation terms
+      updateTempCompensation ();
       
       // Start a pressure reading
       writeReg (CTRL_REG, PRESSURE_OSRS0 | (m_ossrAsync << 6));
@@ -125,85 +182,64 @@ void BMP085::eocISR ()
       // Read pressure
       int32_t pressure = (((readReg (VALUE_MSB_REG) << 16) | (readReg (VALUE_LSB_REG) << 8) | readReg (VALUE_XLSB_REG)) >> (8 - m_ossrAsync));
       
-      // Calculate true temperature
-      int32_t X1 = (((int32_t) m_rawTempAsync - (int32_t) m_AC6) * (int32_t) m_AC5) >> 15;
-      int32_t X2 = ((int32_t) m_MC << 11) / (X1 + m_MD);
-      int32_t B5 = X1 + X2;
-      int32_t T = (B5 + 8) >> 4;
-      double tempC = T * 0.1;
-      double tempF = (tempC * 9 / 5) + 32;
+      m_rawPressureAsync = pressure;
+      m_pressureSamples++;
       
-      // Calculate true pressure
-      int32_t B6 = B5 - 4000;
-      X1 = (m_B2 * (B6 * B6 >> 12)) >> 11;
-      X2 = (m_AC2 * B6) >> 11;
-      int32_t X3 = X1 + X2;
-      int32_t B3 = (((((int32_t) m_AC1) * 4 + X3) << m_ossrAsync) + 2) >> 2;
-      X1 = (m_AC3 * B6) >> 13;
-      X2 = (m_B1 * ((B6 * B6) >> 12)) >> 16;
-      X3 = ((X1 + X2) + 2) >> 2;
-      uint32_t B4 = (m_AC4 * (uint32_t)(X3 + 32768)) >> 15;
-      uint32_t B7 = ((uint32_t)(pressure - B3) * (50000 >> m_ossrAsync));
-      int32_t p;
-      if (B7 < 0x80000000)
-        p = (B7 << 1) / B4;
-      else
-        p = (B7 / B4) << 1;
-      X1 = (p >> 8) * (p >> 8);
-      X1 = (X1 * 3038) >> 16;
-      X2 = (-7357 * p) >> 16;
-      p = p + ((X1 + X2 + 3791) >> 4);
+      // Only the pressure dependent part of the compensation is done per
+      // sample.  It is integer math and runs unconditionally so the filter
+      // history and lazy reads stay current.
+      int32_t p = compensatePressure (pressure);
       
+#ifndef IMU_CFG_NO_AVG_FILTER
       // Apply average filter if needed
       if (m_avgFilter)
         p = moveAvgIntZ (p);
+#endif
       
-      // Convert from Pa to hPa
-      double pressurehPa = ((double) p) / 100.0;
-      
-      // Calculate altitude
-      double altitudeM = 44330.0 * (1.0 - pow (pressurehPa / PRESSURE_SEA_LEVEL_HPA, 1 / 5.255)); 
-      double altitudeF = altitudeM * 3.2808;
-      
-      
+      m_prevPressurePa = m_pressurePa;
+      m_prevPressureTimemS = m_pressureTimemS;
+      m_pressurePa = p;
+      m_pressureTimemS = millis ();
       
       // Make callbacks
-      if (m_tempCB)
-        m_tempCB (m_rawTempAsync, tempC, tempF);
-      if (m_pressureCB)
-        m_pressureCB (pressure, pressurehPa);
-      if (m_altitudeCB)
-        m_altitudeCB (altitudeM, altitudeF);
-      if (m_verticalSpeedCB && m_verticalSpeedSamplesCount == 0)
-      {
-        // Calculate vertical speed
-        double altDiffM = altitudeM - m_lastAltitudeM;
-        uint32_t currentTimemS = millis ();
-        uint32_t timeDiffmS = currentTimemS - m_lastAltitudeTimemS;
-        double verticalSpeedMpS = altDiffM / (((double) timeDiffmS) / 1000.0);
-        double verticalSpeedFpS = verticalSpeedMpS * 3.2808;
+      publishPressure ();
       
-        // Update values
-        m_verticalSpeedSamplesCount = VERTICAL_SPEED_SAMPLE_DIFFERENCE;
-        m_lastAltitudeM = altitudeM;
-        m_lastAltitudeTimemS = currentTimemS;
+      // Temperature changes slowly, so only convert it every m_tempDecimation pressure samples
+      m_pressureSinceTemp++;
+      if (m_pressureSinceTemp >= m_tempDecimation)
+      {
+        // start another temperature reading
+        writeReg (CTRL_REG, TEMPERATURE);
         
-        // Make callback
-        m_verticalSpeedCB (verticalSpeedMpS, verticalSpeedFpS);
+        // Transition back to waiting for temperature conversion
+        m_state = WAIT_TEMP_CONVERSION;
       }
-      else if (m_verticalSpeedCB)
-        m_verticalSpeedSamplesCount--;
-      
-      // start another temperature reading
-      writeReg (CTRL_REG, TEMPERATURE);
-      
-      // Transition back to waiting for temperature conversion
-      m_state = WAIT_TEMP_CONVERSION;
+      else
+        // Start another pressure reading and stay in this state
+        writeReg (CTRL_REG, PRESSURE_OSRS0 | (m_ossrAsync << 6));
       break;
     }
   }
 }
 
+// Expected async pressure samples per second, one temperature conversion is
+// amortized over m_tempDecimation pressure conversions.  Using the max conversion
+// times with the default decimation of 16 this is roughly:
+//   OSSR_LOW_POWER       209 Hz (111 Hz alternating)
+//   OSSR_STANDARD        128 Hz  (83 Hz alternating)
+//   OSSR_HIGH_RES         73 Hz  (56 Hz alternating)
+//   OSSR_ULTRA_HIGH_RES   39 Hz  (33 Hz alternating)
+imu_real BMP085::getPressureSampleRate (OSSR_SETTING _ossr)
+{
+  if (_ossr >= OSSR_NUM)
+    return 0;
+    
+  imu_real periodmS = OSSR_CONVERSION_TIME[_ossr] + (OSSR_CONVERSION_TIME[OSSR_LOW_POWER] / m_tempDecimation);
+  
+  return 1000 / periodmS;
+}
+
+#ifndef IMU_CFG_NO_SYNC_READS
 int16_t BMP085::readRawTempSync ()
 {
   if (m_async)
@@ -230,35 +266,24 @@ int32_t BMP085::readRawPressureSync (OSSR_SETTING _ossr)
   
   return (((readReg (VALUE_MSB_REG) << 16) | (readReg (VALUE_LSB_REG) << 8) | readReg (VALUE_XLSB_REG)) >> (8 - _ossr));
 }
+#endif
 
 uint8_t BMP085::readReg (const uint8_t _reg)
 {
-  uint8_t retval;
-  
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (_reg);
-  Wire.endTransmission ();
-  
-  Wire.requestFrom (ADDRESS, REG_WIDTH);
-  while (Wire.available ())
-    retval = Wire.read ();
-    
-  return retval;
+  return m_bus->readReg (_reg);
 }
 
 void BMP085::writeReg (const uint8_t _reg, const uint8_t _val)
 {
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (_reg);
-  Wire.write (_val);
-  Wire.endTransmission ();
+  m_bus->writeReg (_reg, _val);
 }
 
+#ifndef IMU_CFG_NO_AVG_FILTER
 int32_t BMP085::moveAvgIntZ (int32_t _input)
 {
   int32_t cum = 0;
   
-  for (int32_t i = 0; i < COEFZ; i++)
+  for (int32_t i = 0; i < COEFZ - 1; i++)
     m_k[i] = m_k[i + 1];
     
   m_k[COEFZ - 1] = _input;
@@ -268,3 +293,108 @@ int32_t BMP085::moveAvgIntZ (int32_t _input)
     
   return (cum / COEFZ);
 }
+#endif
+
+void BMP085::updateTempCompensation ()
+{
+  // Calculate true temperature
+  int32_t X1 = (((int32_t) m_rawTempAsync - (int32_t) m_AC6) * (int32_t) m_AC5) >> 15;
+  int32_t X2 = ((int32_t) m_MC << 11) / (X1 + m_MD);
+  int32_t B5 = X1 + X2;
+  m_tempDeciC = (B5 + 8) >> 4;
+  
+  // Calculate the temperature dependent pressure terms
+  int32_t B6 = B5 - 4000;
+  X1 = (m_B2 * (B6 * B6 >> 12)) >> 11;
+  X2 = (m_AC2 * B6) >> 11;
+  int32_t X3 = X1 + X2;
+  m_B3Base = ((int32_t) m_AC1) * 4 + X3;
+  X1 = (m_AC3 * B6) >> 13;
+  X2 = (m_B1 * ((B6 * B6) >> 12)) >> 16;
+  X3 = ((X1 + X2) + 2) >> 2;
+  m_B4 = (m_AC4 * (uint32_t)(X3 + 32768)) >> 15;
+  
+  // Make callbacks
+  publishTemperature ();
+}
+
+int32_t BMP085::compensatePressure (int32_t _rawPressure)
+{
+  // Calculate true pressure from the cached temperature terms
+  int32_t B3 = ((m_B3Base << m_ossrAsync) + 2) >> 2;
+  uint32_t B7 = ((uint32_t)(_rawPressure - B3) * (50000 >> m_ossrAsync));
+  int32_t p;
+  if (B7 < 0x80000000)
+    p = (B7 << 1) / m_B4;
+  else
+    p = (B7 / m_B4) << 1;
+  int32_t X1 = (p >> 8) * (p >> 8);
+  X1 = (X1 * 3038) >> 16;
+  int32_t X2 = (-7357 * p) >> 16;
+  
+  return p + ((X1 + X2 + 3791) >> 4);
+}
+
+void BMP085::publishTemperature ()
+{
+  m_subscribers[RAW_TEMP].publish ((imu_real) m_rawTempAsync);
+  
+  imu_real tempC = m_tempDeciC * (imu_real) 0.1;
+  m_subscribers[TEMP_C].publish (tempC);
+  if (ImuConfig::IMPERIAL_UNITS && !m_subscribers[TEMP_F].empty ())
+    m_subscribers[TEMP_F].publish ((tempC * 9 / 5) + 32);
+}
+
+void BMP085::publishPressure ()
+{
+  m_subscribers[RAW_PRESSURE].publish ((imu_real) m_rawPressureAsync);
+  
+  // Convert from Pa to hPa
+  if (!m_subscribers[PRESSURE_HPA].empty ())
+    m_subscribers[PRESSURE_HPA].publish (((imu_real) m_pressurePa) / 100);
+  
+  // The altitude's fastPow () (FastMath.h, within 3 mm of libm's at
+  // FAST_MATH_HIGH and 15 mm at LOW) is still the bulk of the ISR's float
+  // work, skip it unless altitude or vertical speed has a subscriber
+  bool imperialSpeed = ImuConfig::IMPERIAL_UNITS && !m_subscribers[VERTICAL_SPEED_FPS].empty ();
+  bool imperialAltitude = ImuConfig::IMPERIAL_UNITS && !m_subscribers[ALTITUDE_F].empty ();
+  bool verticalSpeed = !m_subscribers[VERTICAL_SPEED_MPS].empty () || imperialSpeed;
+  if (!verticalSpeed && m_subscribers[ALTITUDE_M].empty () && !imperialAltitude)
+    return;
+  
+  imu_real altM = altitudeM (m_pressurePa);
+  m_subscribers[ALTITUDE_M].publish (altM);
+  if (imperialAltitude)
+    m_subscribers[ALTITUDE_F].publish (altM * FEET_PER_METRE);
+  
+  if (!verticalSpeed)
+    return;
+  
+  if (m_verticalSpeedSamplesCount > 0)
+  {
+    m_verticalSpeedSamplesCount--;
+    return;
+  }
+  
+  // Calculate vertical speed
+  imu_real altDiffM = altM - m_lastAltitudeM;
+  uint32_t timeDiffmS = m_pressureTimemS - m_lastAltitudeTimemS;
+  imu_real verticalSpeedMpS = altDiffM / (((imu_real) timeDiffmS) / 1000);
+  
+  // Update values
+  m_verticalSpeedSamplesCount = VERTICAL_SPEED_SAMPLE_DIFFERENCE;
+  m_lastAltitudeM = altM;
+  m_lastAltitudeTimemS = m_pressureTimemS;
+  
+  // Make callbacks
+  m_subscribers[VERTICAL_SPEED_MPS].publish (verticalSpeedMpS);
+  if (imperialSpeed)
+    m_subscribers[VERTICAL_SPEED_FPS].publish (verticalSpeedMpS * FEET_PER_METRE);
+}
+
+imu_real BMP085::altitudeM (int32_t _pressurePa)
+{
+  // fastPow keeps this within a few mm of the double pow ()
+  float ratio = (((imu_real) _pressurePa) / 100) / PRESSURE_SEA_LEVEL_HPA;
+  return (imu_real) 44330.0 * (1 - fastPow (ratio, (float) (1 / 5.255)));
+}
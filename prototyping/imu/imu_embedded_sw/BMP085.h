@@ -8,6 +8,9 @@
 
 #include "Arduino.h"
 #include "Wire.h"
+#include "BusTransport.h"
+#include "Subscribers.h"
+#include "ImuConfig.h"
 
 class BMP085
 {
@@ -22,44 +25,96 @@ class BMP085
     OSSR_NUM
   } OSSR_SETTING;
   
+  // Outputs in async mode.  The ISR only converts to the quantities that
+  // have subscribers, anything else can be read lazily with read ().  The
+  // imperial ones are last so a build without them (ImuConfig.h) has no
+  // subscriber slots for them.
+  typedef enum QUANTITY_ENUM
+  {
+    RAW_TEMP = 0,          // Uncompensated, as read
+    TEMP_C,
+    RAW_PRESSURE,          // Uncompensated, as read
+    PRESSURE_HPA,          // Compensated, averaged if the filter is on
+    ALTITUDE_M,
+    VERTICAL_SPEED_MPS,
+    TEMP_F,
+    ALTITUDE_F,
+    VERTICAL_SPEED_FPS,
+    QUANTITY_NUM
+  } QUANTITY;
+  
   // Callback typdefs
-  typedef void (*TemperatureCallback)(int16_t _rawTemp, double _tempC, double _tempF);
-  typedef void (*PressureCallback) (int32_t _rawPressure, double _pressurehPa);
-  typedef void (*AltitudeCallback) (double _altitudeM, double _altitudeF);
-  typedef void (*VerticalSpeedCallback) (double _verticalSpeedMpS, double _verticalSpeedFpS);
+  typedef void (*QuantityCallback) (imu_real _value);
+  
+  // Subscribers per quantity
+  static const uint8_t SUBSCRIBERS_MAX = ImuConfig::SUBSCRIBERS;
   
   // ISRs
   typedef void (*ISRFunc) (); // should just call BMP085::eocISR
   
-  BMP085 ();
+  // Fixed, a second part needs its own bus
+  static const uint8_t ADDRESS        = 0x77;
+  
+  // Uses I2C unless a transport is given
+  BMP085 (BusTransport* _bus = NULL);
   ~BMP085 ();
   
-  // Register callbacks
-  void registerTemperatureCallback (TemperatureCallback _cb);
-  void registerPressureCallback (PressureCallback _cb);
-  void registerAltitudeCallback (AltitudeCallback _cb);
-  void registerVerticalSpeedCallback (VerticalSpeedCallback _cb);
+  // Bus the device is attached to
+  BusTransport* getBus () {return m_bus;}
+  
+  // Fastest I2C speed mode the part takes
+  static const I2C_SPEED I2C_MAX_SPEED = I2C_HIGH_SPEED;
+  
+  // Speed mode of the device's transactions, clamped to what the part and
+  // its transport take.  Returns the mode in use, I2C_SPEED_NUM on SPI.
+  I2C_SPEED setI2CSpeed (I2C_SPEED _speed) {return m_bus->setSpeed (_speed);}
+  
+  // Subscribe to a quantity, from setup () or with interrupts off.  Returns
+  // false if the quantity already has SUBSCRIBERS_MAX subscribers or is
+  // built out.
+  bool subscribe (QUANTITY _quantity, QuantityCallback _cb);
+  void unsubscribe (QUANTITY _quantity, QuantityCallback _cb);
+  
+  // Converts the newest async sample when called instead of in the ISR.
+  // Vertical speed is over the last two pressure samples.  Call from loop ().
+  // Quantities built out read 0.
+  imu_real read (QUANTITY _quantity);
   
   // Initialize
   void init ();
   
-  // Initialize for asynchronous reading style
+  // Initialize for asynchronous reading style.  A NULL _eocIsr leaves EOC
+  // for polling (SyncSampler.h).
   void initAsync (int _eocPin, ISRFunc _eocIsr);
   // ISR functions
   void eocISR ();
   // Set and get functions for OSSR setting for async mode
   OSSR_SETTING getAsyncOSSR () {return m_ossrAsync;}
   void setAsyncOSSR (OSSR_SETTING _ossr) {m_ossrAsync = _ossr;}
-  // Use moving average filter in async mode
+  // Use moving average filter in async mode, stays off when built out
+#ifdef IMU_CFG_NO_AVG_FILTER
+  bool getAvgFilter () {return false;}
+  void setAvgFilter (bool) {}
+#else
   bool getAvgFilter () {return m_avgFilter;}
   void setAvgFilter (bool _filter) {m_avgFilter = _filter;}
+#endif
+  // Number of pressure conversions between temperature conversions in async mode
+  uint8_t getTempDecimation () {return m_tempDecimation;}
+  void setTempDecimation (uint8_t _decimation) {m_tempDecimation = (_decimation > 0) ? _decimation : 1;}
+  // Pressure samples produced in async mode and expected rate for an OSSR setting
+  uint32_t getPressureSampleCount () {return m_pressureSamples;}
+  // Newest compensated (and filtered, if enabled) async pressure
+  int32_t getPressurePa () {return m_pressurePa;}
+  imu_real getPressureSampleRate (OSSR_SETTING _ossr);
   
+#ifndef IMU_CFG_NO_SYNC_READS
   // Synchronous poll reads
   int16_t readRawTempSync ();
   int32_t readRawPressureSync (OSSR_SETTING _ossr);
+#endif
  private:
   // Device parameters
-  static const uint8_t ADDRESS        = 0x77;
   static const uint8_t REG_WIDTH      = 1;
    
   // Device registers
@@ -98,10 +153,13 @@ class BMP085
   static const uint8_t VALUE_XLSB_REG = 0xF8;
  
   // Pressure at sea level
-  static const double PRESSURE_SEA_LEVEL_HPA;
+  static const imu_real PRESSURE_SEA_LEVEL_HPA;
+  
+  // Unit conversion
+  static const imu_real FEET_PER_METRE;
  
   // Array to convert oversampling setting to conversion time
-  static const double  OSSR_CONVERSION_TIME[OSSR_NUM];
+  static const imu_real OSSR_CONVERSION_TIME[OSSR_NUM];
   
   // Moving average filter
   static const int32_t COEFZ = 21;
@@ -109,6 +167,15 @@ class BMP085
   // Vertical speed sample difference
   static const uint32_t VERTICAL_SPEED_SAMPLE_DIFFERENCE = 1;
   
+  // Quantities with subscriber slots
+  static const uint8_t QUANTITY_SUBSCRIBED = ImuConfig::IMPERIAL_UNITS ? QUANTITY_NUM : TEMP_F;
+  
+  // Default pressure conversions per temperature conversion
+  static const uint8_t TEMP_DECIMATION_DEFAULT = 16;
+  
+  // Raw temperature change that forces an early temperature conversion
+  static const int16_t TEMP_CHANGE_THRESHOLD = 16;
+  
   typedef enum ASYNC_STATE_ENUM
   {
     WAIT_TEMP_CONVERSION = 0,
@@ -144,25 +211,52 @@ class BMP085
   // Saved temp value across interrupts for async
   int16_t              m_rawTempAsync;
   
+  // Temperature scheduling for async
+  uint8_t              m_tempDecimation;
+  uint8_t              m_pressureSinceTemp;
+  uint32_t             m_pressureSamples;
+  
+  // Temperature dependent compensation terms cached between temp conversions
+  int32_t              m_tempDeciC;
+  int32_t              m_B3Base;
+  uint32_t             m_B4;
+  
+#ifndef IMU_CFG_NO_AVG_FILTER
   // Moving average filter
   bool                 m_avgFilter;
   int32_t              m_k[COEFZ];
+#endif
+  
+  // Newest and previous async pressure samples in Pa, kept for lazy reads
+  int32_t              m_rawPressureAsync;
+  int32_t              m_pressurePa;
+  uint32_t             m_pressureTimemS;
+  int32_t              m_prevPressurePa;
+  uint32_t             m_prevPressureTimemS;
   
   // Vertical speed measurement variables
   uint32_t             m_verticalSpeedSamplesCount;
-  double               m_lastAltitudeM;
+  imu_real             m_lastAltitudeM;
   uint32_t             m_lastAltitudeTimemS;
  
-  // Calbacks for asynchronous operation
-  TemperatureCallback    m_tempCB;
-  PressureCallback       m_pressureCB;
-  AltitudeCallback       m_altitudeCB;
-  VerticalSpeedCallback  m_verticalSpeedCB;
+  // Subscribers for asynchronous operation
+  Subscribers<QuantityCallback, SUBSCRIBERS_MAX> m_subscribers[QUANTITY_SUBSCRIBED];
+  
+  // Bus the device is attached to
+  I2CTransport         m_i2c;
+  BusTransport*        m_bus;
   
   // Private helper functions
   uint8_t readReg (const uint8_t _reg);
   void writeReg (const uint8_t _reg, const uint8_t _val);
+#ifndef IMU_CFG_NO_AVG_FILTER
   int32_t moveAvgIntZ (int32_t _input);
+#endif
+  void updateTempCompensation ();
+  int32_t compensatePressure (int32_t _rawPressure);
+  void publishTemperature ();
+  void publishPressure ();
+  static imu_real altitudeM (int32_t _pressurePa);
 };
 
 #endif
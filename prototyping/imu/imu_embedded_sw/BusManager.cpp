@@ -0,0 +1,240 @@
+/*
+ * BusManager.cpp - Sensor placement over several bus controllers
+ * Currently just for personal use.
+ */
+
+#include "BusManager.h"
+
+// The queue is fed from ISRs of different priorities and drained from the
+// engine's completion.  The interrupt state is put back as it was, setup ()
+// and the uplink handler already have them off.  Nothing to guard on the host.
+#if defined (__arm__)
+static inline uint32_t lockQueue ()
+{
+  uint32_t primask;
+  __asm__ volatile ("mrs %0, primask" : "=r" (primask));
+  __asm__ volatile ("cpsid i" ::: "memory");
+  return primask;
+}
+static inline void unlockQueue (uint32_t _primask)
+{
+  if (!_primask)
+    __asm__ volatile ("cpsie i" ::: "memory");
+}
+#elif defined (ARDUINO)
+static inline uint32_t lockQueue () {uint8_t sreg = SREG; noInterrupts (); return sreg;}
+static inline void unlockQueue (uint32_t _sreg) {SREG = (uint8_t) _sreg;}
+#else
+static inline uint32_t lockQueue () {return 0;}
+static inline void unlockQueue (uint32_t) {}
+#endif
+
+BusQueue::BusQueue (const char* _name, BUS_TYPE _type, uint32_t _clockHz, DMAEngine* _engine)
+  : m_name (_name),
+    m_type (_type),
+    m_clockHz (_clockHz),
+    m_engine (_engine),
+    m_transportCount (0),
+    m_groupBySpeed (false),
+    m_inFlight (false),
+    m_head (0),
+    m_waiting (0),
+    m_lastClockHz (0),
+    m_headSkips (0),
+    m_transfers (0),
+    m_waits (0),
+    m_regrouped (0),
+    m_rejects (0),
+    m_maxDepth (0)
+{
+}
+
+bool BusQueue::bind (BusTransport* _transport)
+{
+  if (isBound (_transport))
+    return true;
+  if (m_transportCount >= MAX_TRANSPORTS)
+    return false;
+  m_transports[m_transportCount++] = _transport;
+  return true;
+}
+
+bool BusQueue::isBound (BusTransport* _transport)
+{
+  for (uint8_t i = 0; i < m_transportCount; i++)
+  {
+    if (m_transports[i] == _transport)
+      return true;
+  }
+  return false;
+}
+
+bool BusQueue::start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                      CompleteFunc _complete, void* _ctx)
+{
+  Transfer transfer = {_bus, _reg, _dst, _len, _complete, _ctx};
+
+  uint32_t irqState = lockQueue ();
+  if (m_inFlight)
+  {
+    if (m_waiting >= QUEUE_LENGTH)
+    {
+      m_rejects++;
+      unlockQueue (irqState);
+      return false;
+    }
+    m_queue[(m_head + m_waiting) & (QUEUE_LENGTH - 1)] = transfer;
+    m_waiting++;
+    m_waits++;
+    if (m_waiting > m_maxDepth)
+      m_maxDepth = m_waiting;
+    unlockQueue (irqState);
+    return true;
+  }
+  m_inFlight = true;
+  unlockQueue (irqState);
+
+  launch (transfer);
+  return true;
+}
+
+void BusQueue::launch (const Transfer& _transfer)
+{
+  // A CPU engine completes inside start (), which then launches the next
+  // from here, at most a queue's depth down
+  m_current = _transfer;
+  m_lastClockHz = clockOf (_transfer.bus);
+  if (!m_engine->start (_transfer.bus, _transfer.reg, _transfer.dst, _transfer.len, transferComplete, this))
+  {
+    // Only this queue drives the engine, so it should never be busy
+    m_rejects++;
+    next ();
+  }
+}
+
+void BusQueue::transferComplete (void* _ctx)
+{
+  BusQueue* queue = (BusQueue*) _ctx;
+  queue->m_transfers++;
+
+  // New transfers started from the completion queue up behind the rest
+  Transfer done = queue->m_current;
+  done.complete (done.ctx);
+  queue->next ();
+}
+
+void BusQueue::next ()
+{
+  uint32_t irqState = lockQueue ();
+  if (m_waiting == 0)
+  {
+    m_inFlight = false;
+    unlockQueue (irqState);
+    return;
+  }
+  uint8_t pick = 0;
+  if (m_groupBySpeed && m_headSkips < GROUP_SKIP_MAX)
+  {
+    for (uint8_t i = 0; i < m_waiting; i++)
+    {
+      if (clockOf (m_queue[(m_head + i) & (QUEUE_LENGTH - 1)].bus) == m_lastClockHz)
+      {
+        pick = i;
+        break;
+      }
+    }
+  }
+  Transfer transfer = m_queue[(m_head + pick) & (QUEUE_LENGTH - 1)];
+  if (pick)
+  {
+    // The ones ahead of it move up one, keeping their order
+    for (uint8_t i = pick; i > 0; i--)
+      m_queue[(m_head + i) & (QUEUE_LENGTH - 1)] = m_queue[(m_head + i - 1) & (QUEUE_LENGTH - 1)];
+    m_headSkips++;
+    m_regrouped++;
+  }
+  else
+  {
+    m_headSkips = 0;
+  }
+  m_head = (m_head + 1) & (QUEUE_LENGTH - 1);
+  m_waiting--;
+  unlockQueue (irqState);
+
+  launch (transfer);
+}
+
+uint32_t BusQueue::getBytes ()
+{
+  uint32_t bytes = 0;
+  for (uint8_t i = 0; i < m_transportCount; i++)
+    bytes += m_transports[i]->getBytes ();
+  return bytes;
+}
+
+uint32_t BusQueue::getTransactions ()
+{
+  uint32_t transactions = 0;
+  for (uint8_t i = 0; i < m_transportCount; i++)
+    transactions += m_transports[i]->getTransactions ();
+  return transactions;
+}
+
+uint32_t BusQueue::getBusyuS ()
+{
+  // I2C: 9 clocks per byte plus start, repeated start and stop.  In high
+  // speed the master code byte and its start go at fast mode speed.
+  // SPI: 8 clocks per byte plus about one of chip select.
+  uint64_t busyuS = 0;
+  for (uint8_t i = 0; i < m_transportCount; i++)
+  {
+    uint64_t bytes = m_transports[i]->getBytes ();
+    uint64_t transactions = m_transports[i]->getTransactions ();
+    uint32_t clockHz = clockOf (m_transports[i]);
+    uint64_t clocks;
+    if (m_type == BUS_I2C)
+    {
+      if (clockHz == I2C_SPEED_HZ[I2C_HIGH_SPEED])
+      {
+        busyuS += (transactions * (9 + 1) * 1000000UL) / I2C_SPEED_HZ[I2C_FAST];
+        bytes -= transactions;
+      }
+      clocks = (bytes * 9) + (transactions * 3);
+    }
+    else
+    {
+      clocks = (bytes * 8) + transactions;
+    }
+    busyuS += (clocks * 1000000UL) / clockHz;
+  }
+  return (uint32_t) busyuS;
+}
+
+uint32_t BusQueue::clockOf (BusTransport* _transport)
+{
+  uint32_t clockHz = _transport->getClockHz ();
+  return clockHz ? clockHz : m_clockHz;
+}
+
+BusManager::BusManager ()
+  : m_busCount (0)
+{
+}
+
+bool BusManager::addBus (BusQueue* _bus)
+{
+  if (m_busCount >= MAX_BUSES)
+    return false;
+  m_buses[m_busCount++] = _bus;
+  return true;
+}
+
+BusQueue* BusManager::findBus (BusTransport* _transport)
+{
+  for (uint8_t i = 0; i < m_busCount; i++)
+  {
+    if (m_buses[i]->isBound (_transport))
+      return m_buses[i];
+  }
+  return NULL;
+}
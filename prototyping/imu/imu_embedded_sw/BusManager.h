@@ -0,0 +1,138 @@
+/*
+ * BusManager.h - Sensor placement over several bus controllers
+ * Currently just for personal use.
+ */
+#ifndef BUSMANAGER_H
+#define BUSMANAGER_H
+
+#include "BusTransport.h"
+#include "DMABlockReader.h"
+
+// One bus controller: the transports bound to it and a queue of burst
+// transfers in front of its DMA engine.  It is a DMAEngine itself, so a
+// DMABlockReader given one queues behind the other users of its bus instead
+// of finding the engine busy.  Transfers only ever wait for their own bus;
+// with an engine that returns before the transfer is done, buses run at the
+// same time.
+//
+// Register accesses the drivers make directly through a bound transport
+// don't go through the queue, but they are on the wire all the same, so the
+// load is worked out from the bytes of every bound transport, each at its
+// own clock.
+//
+// With devices at different I2C speeds on the bus, grouping by speed takes
+// the first waiting transfer at the clock of the last one ahead of the
+// oldest, so the clock is switched less often.  The oldest is passed over
+// at most GROUP_SKIP_MAX times in a row.
+class BusQueue : public DMAEngine
+{
+ public:
+  typedef enum BUS_TYPE_ENUM
+  {
+    BUS_I2C = 0,
+    BUS_SPI,
+    BUS_TYPE_NUM
+  } BUS_TYPE;
+
+  static const uint8_t QUEUE_LENGTH = 8;    // must be a power of two
+  static const uint8_t MAX_TRANSPORTS = 6;
+  static const uint8_t GROUP_SKIP_MAX = 4;
+
+  BusQueue (const char* _name, BUS_TYPE _type, uint32_t _clockHz, DMAEngine* _engine);
+
+  // Adds a transport on this bus, false when they are all taken
+  bool bind (BusTransport* _transport);
+  bool isBound (BusTransport* _transport);
+
+  // Queued, false only when the queue is full
+  virtual bool start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                      CompleteFunc _complete, void* _ctx);
+  virtual bool busy () {return m_waiting >= QUEUE_LENGTH;}
+
+  void setGroupBySpeed (bool _group) {m_groupBySpeed = _group;}
+
+  const char* getName () {return m_name;}
+  BUS_TYPE getType () {return m_type;}
+  uint32_t getClockHz () {return m_clockHz;}
+
+  // Bytes on the wire from all bound transports, and the bus time they took
+  // at each one's clock (the same bit counts as SimTransport).  All only
+  // count up, callers work on deltas.
+  uint32_t getBytes ();
+  uint32_t getTransactions ();
+  uint32_t getBusyuS ();
+
+  // Queue statistics: transfers done, those that had to wait for another,
+  // those taken ahead of older ones to stay at one clock, those refused on
+  // a full queue, and the deepest the queue has been
+  uint32_t getTransfers () {return m_transfers;}
+  uint32_t getWaits () {return m_waits;}
+  uint32_t getRegrouped () {return m_regrouped;}
+  uint32_t getRejects () {return m_rejects;}
+  uint8_t getMaxDepth () {return m_maxDepth;}
+ private:
+  typedef struct transfer_struct
+  {
+    BusTransport*  bus;
+    uint8_t        reg;
+    uint8_t*       dst;
+    uint16_t       len;
+    CompleteFunc   complete;
+    void*          ctx;
+  } Transfer;
+
+  static void transferComplete (void* _ctx);
+  void launch (const Transfer& _transfer);
+  void next ();
+  uint32_t clockOf (BusTransport* _transport);
+
+  const char*          m_name;
+  BUS_TYPE             m_type;
+  uint32_t             m_clockHz;
+  DMAEngine*           m_engine;
+  BusTransport*        m_transports[MAX_TRANSPORTS];
+  uint8_t              m_transportCount;
+  bool                 m_groupBySpeed;
+
+  // m_current is on the bus, the ring holds the ones behind it
+  Transfer             m_current;
+  volatile bool        m_inFlight;
+  Transfer             m_queue[QUEUE_LENGTH];
+  volatile uint8_t     m_head;
+  volatile uint8_t     m_waiting;
+  uint32_t             m_lastClockHz;
+  uint8_t              m_headSkips;
+
+  volatile uint32_t    m_transfers;
+  volatile uint32_t    m_waits;
+  volatile uint32_t    m_regrouped;
+  volatile uint32_t    m_rejects;
+  volatile uint8_t     m_maxDepth;
+};
+
+// The bus controllers of the board and which sensor transports sit on each.
+// The sketch adds its buses and binds the drivers' transports in setup ();
+// the host tool imu_bus_placement does the same with SimTransports to find
+// the placement with the most sample throughput.  The queues are owned by
+// the caller so block readers can be built on them before setup ().
+class BusManager
+{
+ public:
+  static const uint8_t MAX_BUSES = 4;
+
+  BusManager ();
+
+  // False when all are taken
+  bool addBus (BusQueue* _bus);
+
+  uint8_t getBusCount () {return m_busCount;}
+  BusQueue* getBus (uint8_t _index) {return (_index < m_busCount) ? m_buses[_index] : NULL;}
+
+  // The bus _transport was bound to, NULL if none
+  BusQueue* findBus (BusTransport* _transport);
+ private:
+  BusQueue*            m_buses[MAX_BUSES];
+  uint8_t              m_busCount;
+};
+
+#endif
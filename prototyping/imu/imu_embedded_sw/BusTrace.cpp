@@ -0,0 +1,87 @@
+/*
+ * BusTrace.cpp - Ring buffer trace of sensor bus transactions
+ * Currently just for personal use.
+ */
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "BusTrace.h"
+
+BusTrace::BusTrace (ClockFunc _clock)
+  : m_clock (_clock),
+    m_frozen (false),
+    m_total (0)
+{
+}
+
+void BusTrace::resume ()
+{
+  m_total = 0;
+  m_frozen = false;
+}
+
+uint32_t BusTrace::now ()
+{
+  if (m_clock)
+    return m_clock ();
+#ifdef ARDUINO
+  return micros ();
+#else
+  return 0;
+#endif
+}
+
+void BusTrace::record (uint8_t _device, uint8_t _reg, uint8_t _length, uint8_t _flags, uint32_t _startuS)
+{
+  uint32_t enduS = now ();
+  if (inISR ())
+    _flags |= BUS_TRACE_ISR;
+
+  // An ISR's transaction can land in the middle of main's, so the slot is
+  // claimed and filled with interrupts held off.  PRIMASK is put back as it
+  // was, the caller may already have them off.
+#if defined (__arm__)
+  uint32_t primask;
+  __asm__ volatile ("mrs %0, primask" : "=r" (primask));
+  __asm__ volatile ("cpsid i" ::: "memory");
+#endif
+  if (!m_frozen)
+  {
+    BusTraceRecord& r = m_records[m_total & (RECORDS - 1)];
+    r.startuS = _startuS;
+    r.enduS = enduS;
+    r.device = _device;
+    r.reg = _reg;
+    r.length = _length;
+    r.flags = _flags;
+    m_total++;
+  }
+#if defined (__arm__)
+  if (!primask)
+    __asm__ volatile ("cpsie i" ::: "memory");
+#endif
+}
+
+uint16_t BusTrace::getCount ()
+{
+  return (m_total < RECORDS) ? m_total : RECORDS;
+}
+
+const BusTraceRecord& BusTrace::getRecord (uint16_t _index)
+{
+  uint32_t oldest = m_total - getCount ();
+  return m_records[(oldest + _index) & (RECORDS - 1)];
+}
+
+bool BusTrace::inISR ()
+{
+  // IPSR holds the active exception number, 0 in thread mode
+#if defined (__arm__)
+  uint32_t ipsr;
+  __asm__ volatile ("mrs %0, ipsr" : "=r" (ipsr));
+  return (ipsr & 0x1FF) != 0;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,74 @@
+/*
+ * BusTrace.h - Ring buffer trace of sensor bus transactions
+ * Currently just for personal use.
+ */
+#ifndef BUSTRACE_H
+#define BUSTRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// One transaction, little endian, also the layout of a dump file
+// (imu_host_tools/imu_bus_trace) after its BusTraceHeader
+typedef struct bus_trace_record_struct
+{
+  uint32_t startuS;
+  uint32_t enduS;
+  uint8_t  device;      // I2C address, or CS pin with BUS_TRACE_SPI
+  uint8_t  reg;         // First register, without auto increment / command bits
+  uint8_t  length;      // Data bytes, not counting addressing
+  uint8_t  flags;
+} BusTraceRecord;
+
+static const uint8_t  BUS_TRACE_WRITE = 0x01;  // Otherwise a read
+static const uint8_t  BUS_TRACE_ISR   = 0x02;  // Issued from an interrupt
+static const uint8_t  BUS_TRACE_SPI   = 0x04;  // Otherwise I2C
+
+static const uint32_t BUS_TRACE_MAGIC = 0x45435254;  // "TRCE"
+
+typedef struct bus_trace_header_struct
+{
+  uint32_t magic;
+  uint32_t records;     // Records that follow, oldest first
+  uint32_t total;       // Recorded since the last resume, more were overwritten
+  uint32_t i2cClockHz;
+} BusTraceHeader;
+
+// Fixed RAM ring of the last RECORDS transactions.  The transports record
+// into it once attached with BusTransport::setTrace.  Freeze it to read it
+// back consistently, from an overrun callback to keep the transactions that
+// led up to it; resume clears it and starts over.
+class BusTrace
+{
+ public:
+  static const uint16_t RECORDS = 256;  // must be a power of two
+
+  // Timestamp source, micros () on the board
+  typedef uint32_t (*ClockFunc) ();
+
+  BusTrace (ClockFunc _clock = NULL);
+
+  void freeze () {m_frozen = true;}
+  void resume ();
+  bool isFrozen () {return m_frozen;}
+
+  uint32_t now ();
+
+  // Called by the transports around each transaction
+  void record (uint8_t _device, uint8_t _reg, uint8_t _length, uint8_t _flags, uint32_t _startuS);
+
+  // Frozen contents, _index 0 is the oldest record kept
+  uint16_t getCount ();
+  uint32_t getTotal () {return m_total;}
+  const BusTraceRecord& getRecord (uint16_t _index);
+
+  // True in an exception handler.  Always false on the host.
+  static bool inISR ();
+ private:
+  ClockFunc               m_clock;
+  volatile bool           m_frozen;
+  volatile uint32_t       m_total;
+  BusTraceRecord          m_records[RECORDS];
+};
+
+#endif
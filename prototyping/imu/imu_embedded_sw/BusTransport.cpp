@@ -0,0 +1,215 @@
+/*
+ * BusTransport.cpp - Register level bus access for the sensor libraries
+ * Currently just for personal use.
+ */
+
+#include "BusTransport.h"
+
+BusTransport::BusTransport ()
+  : m_transactions (0),
+    m_bytes (0),
+    m_trace (NULL),
+    m_traceDevice (0),
+    m_traceFlags (0)
+{
+}
+
+BusTransport::~BusTransport ()
+{
+}
+
+#ifdef ARDUINO
+// Clock each controller was last set to, shared by the transports on it.
+// Wire.begin () leaves it at standard mode.
+static const uint8_t MAX_WIRES = 4;
+static TwoWire*      s_wires[MAX_WIRES];
+static uint32_t      s_wireClockHz[MAX_WIRES];
+static uint32_t      s_wireClockSwitches[MAX_WIRES];
+static uint8_t       s_wireCount = 0;
+
+static uint8_t wireIndex (TwoWire* _wire)
+{
+  for (uint8_t i = 0; i < s_wireCount; i++)
+  {
+    if (s_wires[i] == _wire)
+      return i;
+  }
+  if (s_wireCount >= MAX_WIRES)
+    return 0;
+  s_wires[s_wireCount] = _wire;
+  s_wireClockHz[s_wireCount] = I2C_SPEED_HZ[I2C_STANDARD];
+  s_wireClockSwitches[s_wireCount] = 0;
+  return s_wireCount++;
+}
+
+static void setWireClock (TwoWire* _wire, uint32_t _clockHz)
+{
+  uint8_t index = wireIndex (_wire);
+  if (s_wireClockHz[index] == _clockHz)
+    return;
+  _wire->setClock (_clockHz);
+  s_wireClockHz[index] = _clockHz;
+  s_wireClockSwitches[index]++;
+}
+
+I2CTransport::I2CTransport (uint8_t _address, uint8_t _autoIncrement, TwoWire* _wire,
+                            I2C_SPEED _maxSpeed)
+  : m_wire (_wire),
+    m_address (_address),
+    m_autoIncrement (_autoIncrement),
+    m_speed (I2C_STANDARD),
+    m_maxSpeed (_maxSpeed)
+{
+  setTraceDevice (m_address, 0);
+}
+
+I2C_SPEED I2CTransport::setSpeed (I2C_SPEED _speed)
+{
+  m_speed = (_speed < m_maxSpeed) ? _speed : m_maxSpeed;
+  return m_speed;
+}
+
+uint32_t I2CTransport::getClockSwitches (TwoWire* _wire)
+{
+  return s_wireClockSwitches[wireIndex (_wire)];
+}
+
+uint8_t I2CTransport::beginTransfer ()
+{
+  if (m_speed != I2C_HIGH_SPEED)
+  {
+    setWireClock (m_wire, I2C_SPEED_HZ[m_speed]);
+    return 0;
+  }
+
+  // Master code at fast mode speed without a stop.  Nobody may acknowledge
+  // it, so the NACK endTransmission reports is the expected outcome.
+  setWireClock (m_wire, I2C_SPEED_HZ[I2C_FAST]);
+  m_wire->beginTransmission (I2C_HS_MASTER_CODE >> 1);
+  m_wire->endTransmission (false);
+  setWireClock (m_wire, I2C_SPEED_HZ[I2C_HIGH_SPEED]);
+  return 1;
+}
+
+uint8_t I2CTransport::readReg (const uint8_t _reg)
+{
+  uint32_t startuS = traceStart ();
+  uint8_t masterCode = beginTransfer ();
+  
+  // Send request to read reg
+  m_wire->beginTransmission (m_address);
+  m_wire->write (_reg);
+  m_wire->endTransmission (stopAfterAddress ());
+
+  // Receive reg value back
+  uint8_t val = 0;
+  m_wire->requestFrom (m_address, (uint8_t) 1);
+  while (m_wire->available ())
+    val = m_wire->read ();
+
+  // Address + reg, address + value
+  countTransaction (masterCode + 4);
+  traceEnd (startuS, _reg, 1, 0);
+
+  return val;
+}
+
+void I2CTransport::writeReg (const uint8_t _reg, const uint8_t _val)
+{
+  uint32_t startuS = traceStart ();
+  uint8_t masterCode = beginTransfer ();
+  
+  // Send request to write
+  m_wire->beginTransmission (m_address);
+  m_wire->write (_reg);
+  m_wire->write (_val);
+  m_wire->endTransmission ();
+
+  countTransaction (masterCode + 3);
+  traceEnd (startuS, _reg, 1, BUS_TRACE_WRITE);
+}
+
+void I2CTransport::readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len)
+{
+  uint32_t startuS = traceStart ();
+  uint8_t masterCode = beginTransfer ();
+  
+  // Send request with auto-increment enabled
+  m_wire->beginTransmission (m_address);
+  m_wire->write (_reg | m_autoIncrement);
+  m_wire->endTransmission (stopAfterAddress ());
+
+  // Receive successive transmission
+  m_wire->requestFrom (m_address, _len);
+  while (m_wire->available () < _len);
+  for (uint8_t i = 0; i < _len; i++)
+    _buf[i] = m_wire->read ();
+
+  countTransaction (masterCode + 3 + _len);
+  traceEnd (startuS, _reg, _len, 0);
+}
+
+// Both the ADXL345 and L3G4200D use SPI mode 3
+SPITransport::SPITransport (uint8_t _csPin, uint32_t _clockHz, uint8_t _multiByte)
+  : m_csPin (_csPin),
+    m_multiByte (_multiByte),
+    m_settings (_clockHz, MSBFIRST, SPI_MODE3)
+{
+  setTraceDevice (m_csPin, BUS_TRACE_SPI);
+}
+
+void SPITransport::begin ()
+{
+  // Chip select idles high, low selects SPI mode on the device
+  pinMode (m_csPin, OUTPUT);
+  digitalWrite (m_csPin, HIGH);
+  SPI.begin ();
+}
+
+uint8_t SPITransport::readReg (const uint8_t _reg)
+{
+  uint32_t startuS = traceStart ();
+  SPI.beginTransaction (m_settings);
+  digitalWrite (m_csPin, LOW);
+  SPI.transfer (_reg | READ_BIT);
+  uint8_t val = SPI.transfer (0);
+  digitalWrite (m_csPin, HIGH);
+  SPI.endTransaction ();
+
+  countTransaction (2);
+  traceEnd (startuS, _reg, 1, 0);
+
+  return val;
+}
+
+void SPITransport::writeReg (const uint8_t _reg, const uint8_t _val)
+{
+  uint32_t startuS = traceStart ();
+  SPI.beginTransaction (m_settings);
+  digitalWrite (m_csPin, LOW);
+  SPI.transfer (_reg);
+  SPI.transfer (_val);
+  digitalWrite (m_csPin, HIGH);
+  SPI.endTransaction ();
+
+  countTransaction (2);
+  traceEnd (startuS, _reg, 1, BUS_TRACE_WRITE);
+}
+
+void SPITransport::readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len)
+{
+  // Single command byte with the read and multi byte bits set, the device
+  // then shifts out successive registers for as long as CS stays low
+  uint32_t startuS = traceStart ();
+  SPI.beginTransaction (m_settings);
+  digitalWrite (m_csPin, LOW);
+  SPI.transfer (_reg | READ_BIT | m_multiByte);
+  for (uint8_t i = 0; i < _len; i++)
+    _buf[i] = SPI.transfer (0);
+  digitalWrite (m_csPin, HIGH);
+  SPI.endTransaction ();
+
+  countTransaction (1 + _len);
+  traceEnd (startuS, _reg, _len, 0);
+}
+#endif
@@ -0,0 +1,149 @@
+/*
+ * BusTransport.h - Register level bus access for the sensor libraries
+ * Currently just for personal use.
+ */
+#ifndef BUSTRANSPORT_H
+#define BUSTRANSPORT_H
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#include "Wire.h"
+#include "SPI.h"
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+#include "BusTrace.h"
+
+// I2C speed modes.  Every device on a bus takes standard mode; one that
+// takes a faster mode is addressed at it, the others ignore the traffic.
+// High speed starts each transfer with a master code at fast mode speed,
+// which nobody acknowledges, and carries on at 3.4 MHz from a repeated start
+// until the stop.
+typedef enum I2C_SPEED_ENUM
+{
+  I2C_STANDARD = 0,     // 100 kHz
+  I2C_FAST,             // 400 kHz
+  I2C_HIGH_SPEED,       // 3.4 MHz
+  I2C_SPEED_NUM
+} I2C_SPEED;
+
+static const uint32_t I2C_SPEED_HZ[I2C_SPEED_NUM] = {100000, 400000, 3400000};
+
+// 00001xxx, the low bits tell masters apart, this one is the only master
+static const uint8_t  I2C_HS_MASTER_CODE = 0x08;
+
+// Base class for the bus a sensor is attached to.  Drivers only use
+// readReg, writeReg and readBlock, so the bus can be picked at construction.
+class BusTransport
+{
+ public:
+  BusTransport ();
+  virtual ~BusTransport ();
+
+  // Bring up the bus pins, Wire.begin () is still done by the sketch
+  virtual void begin () {}
+
+  virtual uint8_t readReg (const uint8_t _reg) = 0;
+  virtual void writeReg (const uint8_t _reg, const uint8_t _val) = 0;
+  // Read _len successive registers starting at _reg in one transaction
+  virtual void readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len) = 0;
+
+  // I2C speed mode of this device's transactions, clamped to the fastest
+  // the device takes.  Returns the mode in use, I2C_SPEED_NUM on buses
+  // without speed modes, which keep their one clock.
+  virtual I2C_SPEED setSpeed (I2C_SPEED) {return I2C_SPEED_NUM;}
+  // Clock of this device's transactions, 0 if it isn't switched per device
+  virtual uint32_t getClockHz () {return 0;}
+
+  // Bus statistics (bytes on the wire including addressing)
+  uint32_t getTransactions () {return m_transactions;}
+  uint32_t getBytes () {return m_bytes;}
+  void resetStats () {m_transactions = 0; m_bytes = 0;}
+
+  // Record every transaction into _trace, NULL to stop
+  void setTrace (BusTrace* _trace) {m_trace = _trace;}
+  BusTrace* getTrace () {return m_trace;}
+  // Device id and bus flag of the records, the board transports set their own
+  void setTraceDevice (uint8_t _device, uint8_t _flags) {m_traceDevice = _device; m_traceFlags = _flags;}
+ protected:
+  void countTransaction (uint32_t _bytes) {m_transactions++; m_bytes += _bytes;}
+
+  // Around each transaction, only a pointer check without a trace
+  uint32_t traceStart () {return m_trace ? m_trace->now () : 0;}
+  void traceEnd (uint32_t _startuS, uint8_t _reg, uint8_t _length, uint8_t _flags)
+  {
+    if (m_trace)
+      m_trace->record (m_traceDevice, _reg, _length, m_traceFlags | _flags, _startuS);
+  }
+
+  volatile uint32_t    m_transactions;
+  volatile uint32_t    m_bytes;
+  BusTrace*            m_trace;
+  uint8_t              m_traceDevice;
+  uint8_t              m_traceFlags;
+};
+
+#ifdef ARDUINO
+class I2CTransport : public BusTransport
+{
+ public:
+  // _autoIncrement is OR'd into the register address of block reads for
+  // devices that need it (L3G4200D), 0 for devices that always auto increment.
+  // _wire picks the bus on boards with more than one (Wire1 on a Teensy 3).
+  // _maxSpeed is the fastest mode the device takes, it starts in standard.
+  I2CTransport (uint8_t _address, uint8_t _autoIncrement, TwoWire* _wire = &Wire,
+                I2C_SPEED _maxSpeed = I2C_STANDARD);
+
+  uint8_t getAddress () {return m_address;}
+  TwoWire* getWire () {return m_wire;}
+
+  virtual I2C_SPEED setSpeed (I2C_SPEED _speed);
+  virtual uint32_t getClockHz () {return I2C_SPEED_HZ[m_speed];}
+  I2C_SPEED getSpeed () {return m_speed;}
+  I2C_SPEED getMaxSpeed () {return m_maxSpeed;}
+
+  // Times the controller's clock was reprogrammed for a device on it.  Wire
+  // is only told when the clock changes, so devices of one speed in a row
+  // cost nothing; BusQueue groups its transfers by clock for that.
+  static uint32_t getClockSwitches (TwoWire* _wire);
+
+  virtual uint8_t readReg (const uint8_t _reg);
+  virtual void writeReg (const uint8_t _reg, const uint8_t _val);
+  virtual void readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len);
+ private:
+  // Clock and master code ahead of a transfer, returns the bytes that took
+  uint8_t beginTransfer ();
+  // Whether the register write stops before the read, not in high speed
+  // where a stop falls back to fast mode
+  bool stopAfterAddress () {return m_speed != I2C_HIGH_SPEED;}
+
+  TwoWire*             m_wire;
+  uint8_t              m_address;
+  uint8_t              m_autoIncrement;
+  I2C_SPEED            m_speed;
+  I2C_SPEED            m_maxSpeed;
+};
+
+class SPITransport : public BusTransport
+{
+ public:
+  // Read bit in the command byte, same for the ADXL345 and L3G4200D
+  static const uint8_t READ_BIT = 0x80;
+
+  // _multiByte is the multi byte / address increment bit of the command byte
+  SPITransport (uint8_t _csPin, uint32_t _clockHz, uint8_t _multiByte);
+
+  virtual void begin ();
+
+  virtual uint8_t readReg (const uint8_t _reg);
+  virtual void writeReg (const uint8_t _reg, const uint8_t _val);
+  virtual void readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len);
+ private:
+  uint8_t              m_csPin;
+  uint8_t              m_multiByte;
+  SPISettings          m_settings;
+};
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * CalibrationBlob.h - Per board sensor calibration parameters
+ * Currently just for personal use.
+ */
+#ifndef CALIBRATIONBLOB_H
+#define CALIBRATIONBLOB_H
+
+#include <stdint.h>
+#include "VectorMath.h"
+#include "CaptureRecord.h"
+#include "Crc16.h"
+
+// Marks a programmed blob, erased EEPROM reads back 0xFFFF
+static const uint16_t CALIBRATION_MAGIC   = 0xCA1B;
+static const uint8_t  CALIBRATION_VERSION = 1;
+
+// Fixed point formats of the stored terms
+static const int32_t  CALIBRATION_BIAS_ONE   = 16;    // Q4 raw LSB
+static const int32_t  CALIBRATION_MATRIX_ONE = 16384; // Q14
+
+// Ellipsoid model fitted by imu_host_tools/imu_cal_tool:
+//   corrected = matrix * (raw - bias)
+// corrected stays in raw LSB, so the drivers' scale factors still apply.  For
+// the ADXL345 |corrected| is 1 g at rest, for the HMC5883L the matrix removes
+// soft iron without changing the mean gain.  Little endian, 36 bytes.
+typedef struct calibration_blob_struct
+{
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  sensor;        // CAPTURE_ACC or CAPTURE_MAG
+  uint32_t boardId;
+  int16_t  bias[3];       // CALIBRATION_BIAS_ONE per raw LSB
+  int16_t  matrix[9];     // Row major, CALIBRATION_MATRIX_ONE is 1.0
+  uint16_t residual;      // RMS fit residual, 65536 is the whole radius
+  uint16_t crc;           // CRC-16/CCITT of everything before it
+} CalibrationBlob;
+
+inline uint16_t calibrationCRC (const CalibrationBlob& _blob)
+{
+  return crc16CCITT ((const uint8_t*) &_blob, sizeof (CalibrationBlob) - sizeof (_blob.crc));
+}
+
+inline bool calibrationValid (const CalibrationBlob& _blob, CAPTURE_SENSOR _sensor)
+{
+  return _blob.magic == CALIBRATION_MAGIC &&
+         _blob.version == CALIBRATION_VERSION &&
+         _blob.sensor == _sensor &&
+         _blob.crc == calibrationCRC (_blob);
+}
+
+// Expand to floats once so the per sample correction is one subtract and multiply
+inline void unpackCalibration (const CalibrationBlob& _blob, Vec3<float>& _bias, Mat3<float>& _matrix)
+{
+  _bias = makeVec3<float> ((float) _blob.bias[0] / CALIBRATION_BIAS_ONE,
+                           (float) _blob.bias[1] / CALIBRATION_BIAS_ONE,
+                           (float) _blob.bias[2] / CALIBRATION_BIAS_ONE);
+  for (uint8_t r = 0; r < 3; r++)
+    for (uint8_t c = 0; c < 3; c++)
+      _matrix.m[r][c] = (float) _blob.matrix[r * 3 + c] / CALIBRATION_MATRIX_ONE;
+}
+
+#endif
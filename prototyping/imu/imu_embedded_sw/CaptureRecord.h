@@ -0,0 +1,34 @@
+/*
+ * CaptureRecord.h - Binary record format for raw sensor captures
+ * Currently just for personal use.
+ */
+#ifndef CAPTURERECORD_H
+#define CAPTURERECORD_H
+
+#include <stdint.h>
+
+// Sensor a record came from
+typedef enum CAPTURE_SENSOR_ENUM
+{
+  CAPTURE_GYRO = 0,      // L3G4200D raw rotational velocity, 3 axes
+  CAPTURE_ACC,           // ADXL345 raw acceleration, 3 axes
+  CAPTURE_MAG,           // HMC5883L raw field, 3 axes
+  CAPTURE_PRESSURE,      // BMP085 raw (uncompensated) pressure, 1 axis
+  CAPTURE_TEMP,          // BMP085 raw temperature, 1 axis
+  CAPTURE_SENSOR_NUM
+} CAPTURE_SENSOR;
+
+// Marks the start of every record so a reader can resync on a serial stream
+static const uint16_t CAPTURE_SYNC = 0xA55A;
+
+// Little endian, written back to back
+typedef struct capture_record_struct
+{
+  uint16_t sync;
+  uint8_t  sensor;
+  uint8_t  axes;
+  uint32_t timeuS;
+  int32_t  value[3];
+} CaptureRecord;
+
+#endif
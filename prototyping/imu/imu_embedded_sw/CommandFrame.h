@@ -0,0 +1,105 @@
+/*
+ * CommandFrame.h - Framed uplink commands for live configuration
+ * Currently just for personal use.
+ */
+#ifndef COMMANDFRAME_H
+#define COMMANDFRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include "Crc16.h"
+
+// Sent by the host
+typedef enum COMMAND_ENUM
+{
+  COMMAND_PING = 0,          // No payload, acked with an empty payload
+  COMMAND_SET,               // (setting, value) pairs, applied together between samples
+  COMMAND_GET,               // Setting ids, none for all of them
+  COMMAND_WRITE_CALIBRATION, // CalibrationBlob, stored to EEPROM and loaded
+  COMMAND_ACK,               // Sent by the board, see below
+  COMMAND_TRACE,             // TRACE_OP and its arguments, reads back the bus trace
+  COMMAND_NUM
+} COMMAND;
+
+// Live settings, values are the driver enums or 0/1
+typedef enum COMMAND_SETTING_ENUM
+{
+  SETTING_ACC_OUTPUT_RATE = 0, // ADXL345::OUTPUT_RATE
+  SETTING_ACC_RANGE,           // ADXL345::RANGE_SETTING
+  SETTING_ACC_FULL_RES,
+  SETTING_ACC_LP_FILTER,
+  SETTING_BAR_OSSR,            // BMP085::OSSR_SETTING
+  SETTING_BAR_AVG_FILTER,
+  SETTING_BAR_TEMP_DECIMATION, // 1-255 pressure samples per temperature sample
+  SETTING_NUM
+} COMMAND_SETTING;
+
+typedef enum COMMAND_STATUS_ENUM
+{
+  STATUS_OK = 0,
+  STATUS_UNKNOWN_COMMAND,
+  STATUS_BAD_LENGTH,
+  STATUS_BAD_SETTING,
+  STATUS_BAD_VALUE,          // Nothing in the frame was applied
+  STATUS_NUM
+} COMMAND_STATUS;
+
+// COMMAND_TRACE operations.  The ack carries, after the status:
+//   TRACE_FREEZE  records kept (2) | records since resume (4) | I2C clock in Hz (4)
+//   TRACE_READ    first index (2) | up to TRACE_RECORDS_PER_FRAME BusTraceRecords
+//   TRACE_RESUME  nothing, the trace is cleared and recording again
+// TRACE_READ takes the index (2) to read from, valid while frozen.  Firmware
+// built without IMU_BUS_TRACE answers STATUS_UNKNOWN_COMMAND.
+typedef enum TRACE_OP_ENUM
+{
+  TRACE_FREEZE = 0,
+  TRACE_READ,
+  TRACE_RESUME,
+  TRACE_OP_NUM
+} TRACE_OP;
+
+static const uint8_t  TRACE_RECORDS_PER_FRAME = 3;   // 12 byte records
+
+// Distinct from CAPTURE_SYNC so acks can share the capture stream
+static const uint16_t COMMAND_SYNC        = 0x5AC3;
+static const uint8_t  COMMAND_PAYLOAD_MAX = 48;
+
+// On the wire, little endian:
+//   sync (2) | command | sequence | length | payload (length) | crc (2)
+// crc is CRC-16/CCITT from command to the end of the payload.  An ack echoes
+// the sequence of the frame it answers, its payload is the acked command, a
+// COMMAND_STATUS and, for COMMAND_SET and COMMAND_GET, the current value of
+// every setting the frame named as (setting, value) pairs, or the
+// COMMAND_TRACE data above.
+static const uint8_t  COMMAND_HEADER_BYTES = 5;
+static const uint8_t  COMMAND_FRAME_MAX    = COMMAND_HEADER_BYTES + COMMAND_PAYLOAD_MAX + 2;
+
+typedef struct command_frame_struct
+{
+  uint8_t command;
+  uint8_t sequence;
+  uint8_t length;
+  uint8_t payload[COMMAND_PAYLOAD_MAX];
+} CommandFrame;
+
+inline uint16_t commandCRC (const CommandFrame& _frame)
+{
+  return crc16CCITT (&_frame.command, 3 + _frame.length);
+}
+
+// Writes the frame to _out (COMMAND_FRAME_MAX bytes), returns its size
+inline uint8_t encodeCommandFrame (const CommandFrame& _frame, uint8_t* _out)
+{
+  uint16_t crc = commandCRC (_frame);
+  _out[0] = COMMAND_SYNC & 0xFF;
+  _out[1] = COMMAND_SYNC >> 8;
+  _out[2] = _frame.command;
+  _out[3] = _frame.sequence;
+  _out[4] = _frame.length;
+  memcpy (&_out[COMMAND_HEADER_BYTES], _frame.payload, _frame.length);
+  _out[COMMAND_HEADER_BYTES + _frame.length] = crc & 0xFF;
+  _out[COMMAND_HEADER_BYTES + _frame.length + 1] = crc >> 8;
+  return COMMAND_HEADER_BYTES + _frame.length + 2;
+}
+
+#endif
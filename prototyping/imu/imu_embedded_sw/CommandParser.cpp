@@ -0,0 +1,88 @@
+/*
+ * CommandParser.cpp - Incremental parser for CommandFrames
+ * Currently just for personal use.
+ */
+#include "CommandParser.h"
+
+CommandParser::CommandParser ()
+  : m_frames (0),
+    m_errors (0)
+{
+  reset ();
+}
+
+void CommandParser::reset ()
+{
+  m_state = PARSE_SYNC_LO;
+  m_received = 0;
+  m_crc = 0;
+  m_frame.length = 0;
+}
+
+bool CommandParser::feed (uint8_t _byte)
+{
+  switch (m_state)
+  {
+    case PARSE_SYNC_LO:
+      if (_byte == (COMMAND_SYNC & 0xFF))
+        m_state = PARSE_SYNC_HI;
+      break;
+      
+    case PARSE_SYNC_HI:
+      if (_byte == (COMMAND_SYNC >> 8))
+        m_state = PARSE_COMMAND;
+      else if (_byte != (COMMAND_SYNC & 0xFF))
+        m_state = PARSE_SYNC_LO;
+      break;
+      
+    case PARSE_COMMAND:
+      m_frame.command = _byte;
+      m_state = PARSE_SEQUENCE;
+      break;
+      
+    case PARSE_SEQUENCE:
+      m_frame.sequence = _byte;
+      m_state = PARSE_LENGTH;
+      break;
+      
+    case PARSE_LENGTH:
+      if (_byte > COMMAND_PAYLOAD_MAX)
+      {
+        m_errors++;
+        reset ();
+        break;
+      }
+      m_frame.length = _byte;
+      m_received = 0;
+      m_state = (_byte > 0) ? PARSE_PAYLOAD : PARSE_CRC_LO;
+      break;
+      
+    case PARSE_PAYLOAD:
+      m_frame.payload[m_received++] = _byte;
+      if (m_received == m_frame.length)
+        m_state = PARSE_CRC_LO;
+      break;
+      
+    case PARSE_CRC_LO:
+      m_crc = _byte;
+      m_state = PARSE_CRC_HI;
+      break;
+      
+    case PARSE_CRC_HI:
+      m_crc |= (uint16_t) _byte << 8;
+      m_state = PARSE_SYNC_LO;
+      if (m_crc != commandCRC (m_frame))
+      {
+        m_errors++;
+        break;
+      }
+      m_frames++;
+      return true;
+      
+    default:
+      reset ();
+      break;
+  }
+  
+  return false;
+}
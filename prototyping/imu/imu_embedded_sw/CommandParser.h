@@ -0,0 +1,52 @@
+/*
+ * CommandParser.h - Incremental parser for CommandFrames
+ * Currently just for personal use.
+ */
+#ifndef COMMANDPARSER_H
+#define COMMANDPARSER_H
+
+#include <stdint.h>
+#include "CommandFrame.h"
+
+// Fed one byte at a time as it arrives, so the caller never waits on a
+// partial frame.  Anything between frames (text, CaptureRecords) is skipped,
+// a frame with a bad length or CRC is counted and dropped and the parser
+// resyncs on the next sync word.
+class CommandParser
+{
+ public:
+  CommandParser ();
+  
+  // Returns true when _byte completes a valid frame
+  bool feed (uint8_t _byte);
+  
+  // The last complete frame, valid until the next call to feed
+  const CommandFrame& getFrame () {return m_frame;}
+  
+  uint32_t getFrameCount () {return m_frames;}
+  uint32_t getErrorCount () {return m_errors;}
+  
+  void reset ();
+ private:
+  typedef enum PARSE_STATE_ENUM
+  {
+    PARSE_SYNC_LO = 0,
+    PARSE_SYNC_HI,
+    PARSE_COMMAND,
+    PARSE_SEQUENCE,
+    PARSE_LENGTH,
+    PARSE_PAYLOAD,
+    PARSE_CRC_LO,
+    PARSE_CRC_HI,
+    PARSE_STATE_NUM
+  } PARSE_STATE;
+  
+  PARSE_STATE  m_state;
+  CommandFrame m_frame;
+  uint8_t      m_received;
+  uint16_t     m_crc;
+  uint32_t     m_frames;
+  uint32_t     m_errors;
+};
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Crc16.h - CRC-16/CCITT shared by the stored and framed binary formats
+ * Currently just for personal use.
+ */
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+// Bitwise, no table, the frames and blobs it covers are tens of bytes.  Pass
+// the previous result as _crc to continue over a second range.
+inline uint16_t crc16CCITT (const uint8_t* _bytes, uint16_t _length, uint16_t _crc = 0xFFFF)
+{
+  for (uint16_t i = 0; i < _length; i++)
+  {
+    _crc ^= (uint16_t) _bytes[i] << 8;
+    for (uint8_t b = 0; b < 8; b++)
+      _crc = (_crc & 0x8000) ? (uint16_t) ((_crc << 1) ^ 0x1021) : (uint16_t) (_crc << 1);
+  }
+  return _crc;
+}
+
+#endif
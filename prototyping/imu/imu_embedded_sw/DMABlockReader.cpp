@@ -0,0 +1,160 @@
+/*
+ * DMABlockReader.cpp - Double buffered burst reads of sensor samples
+ * Currently just for personal use.
+ */
+
+#include "DMABlockReader.h"
+
+bool CPUDMAEngine::start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                          CompleteFunc _complete, void* _ctx)
+{
+  _bus->readBlock (_reg, _dst, _len);
+  _complete (_ctx);
+  return true;
+}
+
+SimDMAEngine::SimDMAEngine ()
+  : m_busy (false),
+    m_bus (NULL),
+    m_reg (0),
+    m_dst (NULL),
+    m_len (0),
+    m_complete (NULL),
+    m_ctx (NULL),
+    m_transfers (0),
+    m_bytes (0)
+{
+}
+
+bool SimDMAEngine::start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                          CompleteFunc _complete, void* _ctx)
+{
+  if (m_busy)
+    return false;
+
+  m_bus = _bus;
+  m_reg = _reg;
+  m_dst = _dst;
+  m_len = _len;
+  m_complete = _complete;
+  m_ctx = _ctx;
+  m_busy = true;
+  return true;
+}
+
+bool SimDMAEngine::service ()
+{
+  if (!m_busy)
+    return false;
+
+  m_bus->readBlock (m_reg, m_dst, m_len);
+  m_transfers++;
+  m_bytes += m_len;
+
+  // Clear busy before completing so the completion can chain another burst
+  m_busy = false;
+  m_complete (m_ctx);
+  return true;
+}
+
+DMABlockReader::DMABlockReader (DMAEngine* _engine)
+  : m_engine (_engine),
+    m_bus (NULL),
+    m_reg (0),
+    m_sampleBytes (1),
+    m_samplesPerBurst (1),
+    m_blockSamples (0),
+    m_fill (0),
+    m_fillSamples (0),
+    m_fullReady (false),
+    m_inFlight (false),
+    m_blockCount (0),
+    m_overruns (0),
+    m_blockCB (NULL)
+{
+}
+
+DMABlockReader::~DMABlockReader ()
+{
+}
+
+void DMABlockReader::registerBlockCallback (BlockCallback _cb)
+{
+  m_blockCB = _cb;
+}
+
+void DMABlockReader::attach (BusTransport* _bus, uint8_t _reg, uint8_t _sampleBytes, uint8_t _samplesPerBurst)
+{
+  m_bus = _bus;
+  m_reg = _reg;
+  m_sampleBytes = (_sampleBytes > 0) ? _sampleBytes : 1;
+  m_samplesPerBurst = (_samplesPerBurst > 0) ? _samplesPerBurst : 1;
+
+  // Whole bursts per block so a burst never straddles the two buffers
+  uint16_t bursts = BLOCK_BYTES / (m_sampleBytes * m_samplesPerBurst);
+  if (bursts == 0)
+  {
+    bursts = 1;
+    m_samplesPerBurst = BLOCK_BYTES / m_sampleBytes;
+  }
+  m_blockSamples = bursts * m_samplesPerBurst;
+
+  m_fill = 0;
+  m_fillSamples = 0;
+  m_fullReady = false;
+  m_inFlight = false;
+}
+
+void DMABlockReader::trigger ()
+{
+  if (!m_bus)
+    return;
+
+  // Previous burst still in flight, the sample is lost.  That burst still
+  // has the bus, so it stays marked in flight.
+  if (m_inFlight)
+  {
+    m_overruns++;
+    return;
+  }
+
+  // Marked before start (), the CPU engine completes inside it.  A refusal
+  // (engine or queue full) started nothing.
+  uint8_t* dst = &m_blocks[m_fill][m_fillSamples * m_sampleBytes];
+  m_inFlight = true;
+  if (!m_engine->start (m_bus, m_reg, dst, m_samplesPerBurst * m_sampleBytes, dmaComplete, this))
+  {
+    m_inFlight = false;
+    m_overruns++;
+  }
+}
+
+void DMABlockReader::dmaComplete (void* _ctx)
+{
+  ((DMABlockReader*) _ctx)->burstComplete ();
+}
+
+void DMABlockReader::burstComplete ()
+{
+  m_inFlight = false;
+  m_fillSamples += m_samplesPerBurst;
+  if (m_fillSamples < m_blockSamples)
+    return;
+
+  // Block boundary: the consumer still holds the other block, so refill this
+  // one and drop its contents rather than write under the consumer
+  m_fillSamples = 0;
+  if (m_fullReady)
+  {
+    m_overruns++;
+    return;
+  }
+
+  // Swap buffers and hand the full block over
+  m_fill = 1 - m_fill;
+  m_fullReady = true;
+  m_blockCount++;
+
+  if (m_blockCB)
+    m_blockCB (m_blocks[1 - m_fill], m_blockSamples);
+}
@@ -0,0 +1,123 @@
+/*
+ * DMABlockReader.h - Double buffered burst reads of sensor samples
+ * Currently just for personal use.
+ */
+#ifndef DMABLOCKREADER_H
+#define DMABLOCKREADER_H
+
+#include "BusTransport.h"
+
+// Moves a burst of register bytes from a bus into memory and signals
+// completion.  Target backends drive a DMA channel, the others stand in for it.
+class DMAEngine
+{
+ public:
+  typedef void (*CompleteFunc) (void* _ctx);
+
+  virtual ~DMAEngine () {}
+
+  // Returns false if a transfer is already in flight
+  virtual bool start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                      CompleteFunc _complete, void* _ctx) = 0;
+  virtual bool busy () = 0;
+};
+
+// Fallback engine that does the burst with the CPU inside start (), for buses
+// without a DMA capable driver.  The block handling above it is unchanged.
+class CPUDMAEngine : public DMAEngine
+{
+ public:
+  virtual bool start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                      CompleteFunc _complete, void* _ctx);
+  virtual bool busy () {return false;}
+};
+
+// Host emulation of a DMA channel.  start () only queues the transfer, it is
+// carried out and completed when the host calls service (), so completions
+// can be interleaved with triggers the way the hardware would.
+class SimDMAEngine : public DMAEngine
+{
+ public:
+  SimDMAEngine ();
+
+  virtual bool start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                      CompleteFunc _complete, void* _ctx);
+  virtual bool busy () {return m_busy;}
+
+  // Complete the queued transfer, returns false if none was queued
+  bool service ();
+
+  uint32_t getTransfers () {return m_transfers;}
+  uint32_t getBytes () {return m_bytes;}
+ private:
+  bool                 m_busy;
+  BusTransport*        m_bus;
+  uint8_t              m_reg;
+  uint8_t*             m_dst;
+  uint16_t             m_len;
+  CompleteFunc         m_complete;
+  void*                m_ctx;
+  uint32_t             m_transfers;
+  uint32_t             m_bytes;
+};
+
+// Fills one of two sample blocks with DMA bursts.  The data ready interrupt
+// only calls trigger (), and a full block is handed to the consumer while the
+// next one fills.  The consumer calls releaseBlock () once it is done with it.
+class DMABlockReader
+{
+ public:
+  // Bytes per sample block (32 samples of a 3 axis 16 bit sensor)
+  static const uint16_t BLOCK_BYTES = 192;
+
+  // Callback definitions
+  typedef void (*BlockCallback) (const uint8_t* _block, uint16_t _samples);
+
+  DMABlockReader (DMAEngine* _engine);
+  ~DMABlockReader ();
+
+  // Register callbacks
+  void registerBlockCallback (BlockCallback _cb);
+
+  // Source of the samples.  _samplesPerBurst > 1 relies on the device rolling
+  // its auto increment back to the first data register (L3G4200D FIFO).
+  void attach (BusTransport* _bus, uint8_t _reg, uint8_t _sampleBytes, uint8_t _samplesPerBurst);
+
+  // Called from the data ready (or FIFO watermark) interrupt
+  void trigger ();
+  // Started and not yet complete, the bus isn't free for the driver
+  bool burstInFlight () {return m_inFlight;}
+
+  // Full block for polling consumers, NULL if none is ready
+  const uint8_t* getFullBlock () {return m_fullReady ? m_blocks[1 - m_fill] : NULL;}
+  uint16_t getBlockSamples () {return m_blockSamples;}
+  void releaseBlock () {m_fullReady = false;}
+
+  // Statistics
+  uint32_t getBlocks () {return m_blockCount;}
+  uint32_t getOverruns () {return m_overruns;}
+ private:
+  static void dmaComplete (void* _ctx);
+  void burstComplete ();
+
+  DMAEngine*           m_engine;
+  BusTransport*        m_bus;
+  uint8_t              m_reg;
+  uint8_t              m_sampleBytes;
+  uint8_t              m_samplesPerBurst;
+  uint16_t             m_blockSamples;
+
+  // Double buffer, m_fill is the block being written by DMA
+  uint8_t              m_blocks[2][BLOCK_BYTES];
+  volatile uint8_t     m_fill;
+  volatile uint16_t    m_fillSamples;
+  volatile bool        m_fullReady;
+  volatile bool        m_inFlight;
+
+  volatile uint32_t    m_blockCount;
+  volatile uint32_t    m_overruns;
+
+  BlockCallback        m_blockCB;
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*
+ * FastMath.h - Bounded error replacements for the libm calls on the sensor paths
+ * Currently just for personal use.
+ */
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Precision of the float functions, chosen at compile time for the whole
+// build with -DFAST_MATH_PRECISION=...  Worst case errors, as measured by
+// imu_host_tools/imu_fastmath_bench:
+//                      LOW             HIGH
+//   fastSqrt           2e-3 relative   5e-6 relative
+//   fastAtan2          4e-3 rad        1.2e-5 rad
+//   fastSin, fastCos   4e-5            1e-6
+//   fastPow            7e-6 relative   1.3e-6 relative, for |_y| up to 3
+// The barometer's altitude through fastPow is within 15 mm (LOW) and 3 mm
+// (HIGH) of libm's.
+// LIBM forwards to the C library, for comparison or for parts where it is
+// faster anyway (a Cortex-M4F has a single instruction sqrt).
+#define FAST_MATH_LOW   0
+#define FAST_MATH_HIGH  1
+#define FAST_MATH_LIBM  2
+#ifndef FAST_MATH_PRECISION
+#define FAST_MATH_PRECISION FAST_MATH_HIGH
+#endif
+
+inline uint32_t floatBits (float _f)
+{
+  uint32_t i;
+  memcpy (&i, &_f, sizeof (i));
+  return i;
+}
+
+inline float bitsFloat (uint32_t _i)
+{
+  float f;
+  memcpy (&f, &_i, sizeof (f));
+  return f;
+}
+
+// Square root through the inverse square root bit trick and Newton steps,
+// 0 for anything not positive
+template <uint8_t P = FAST_MATH_PRECISION>
+inline float fastSqrt (float _x)
+{
+  if (P == FAST_MATH_LIBM)
+    return sqrtf (_x);
+  if (!(_x > 0.0f))
+    return 0.0f;
+  float h = 0.5f * _x;
+  float y = bitsFloat (0x5F375A86 - (floatBits (_x) >> 1));
+  y = y * (1.5f - h * y * y);
+  if (P == FAST_MATH_HIGH)
+    y = y * (1.5f - h * y * y);
+  return _x * y;
+}
+
+// Four quadrant arctangent in radians.  A polynomial on [0, 1] covers the
+// first octant, the others are reflections of it.
+template <uint8_t P = FAST_MATH_PRECISION>
+inline float fastAtan2 (float _y, float _x)
+{
+  if (P == FAST_MATH_LIBM)
+    return atan2f (_y, _x);
+  float ax = fabsf (_x);
+  float ay = fabsf (_y);
+  float mx = (ax > ay) ? ax : ay;
+  if (mx == 0.0f)
+    return 0.0f;
+  float a = ((ax > ay) ? ay : ax) / mx;
+  float r;
+  if (P == FAST_MATH_HIGH)
+  {
+    // Abramowitz and Stegun 4.4.49
+    float s = a * a;
+    r = a * (0.9998660f + s * (-0.3302995f + s * (0.1801410f + s * (-0.0851330f + s * 0.0208351f))));
+  }
+  else
+  {
+    r = a * (0.7853982f + 0.273f * (1.0f - a));
+  }
+  if (ay > ax)
+    r = 1.5707963f - r;
+  if (_x < 0.0f)
+    r = 3.1415927f - r;
+  return (_y < 0.0f) ? -r : r;
+}
+
+// Sine and cosine together, radians.  The angle is reduced to a quarter turn
+// around 0 by a two part pi / 2, so it stays accurate to a few thousand
+// radians.
+template <uint8_t P = FAST_MATH_PRECISION>
+inline void fastSinCos (float _a, float& _sin, float& _cos)
+{
+  if (P == FAST_MATH_LIBM)
+  {
+    _sin = sinf (_a);
+    _cos = cosf (_a);
+    return;
+  }
+  float t = _a * 0.63661977f;
+  int32_t q = (int32_t) (t + ((t >= 0.0f) ? 0.5f : -0.5f));
+  float r = (_a - q * 1.5707963705f) + q * 4.3711388e-8f;
+  float r2 = r * r;
+  float s, c;
+  if (P == FAST_MATH_HIGH)
+  {
+    s = r * (1.0f - r2 * (1.0f / 6.0f - r2 * (1.0f / 120.0f - r2 * (1.0f / 5040.0f))));
+    c = 1.0f - r2 * (0.5f - r2 * (1.0f / 24.0f - r2 * (1.0f / 720.0f - r2 * (1.0f / 40320.0f))));
+  }
+  else
+  {
+    s = r * (1.0f - r2 * (1.0f / 6.0f - r2 * (1.0f / 120.0f)));
+    c = 1.0f - r2 * (0.5f - r2 * (1.0f / 24.0f - r2 * (1.0f / 720.0f)));
+  }
+  switch (q & 3)
+  {
+    case 0:  _sin = s;  _cos = c;  break;
+    case 1:  _sin = c;  _cos = -s; break;
+    case 2:  _sin = -s; _cos = -c; break;
+    default: _sin = -c; _cos = s;  break;
+  }
+}
+
+template <uint8_t P = FAST_MATH_PRECISION>
+inline float fastSin (float _a)
+{
+  float s, c;
+  fastSinCos<P> (_a, s, c);
+  return s;
+}
+
+template <uint8_t P = FAST_MATH_PRECISION>
+inline float fastCos (float _a)
+{
+  float s, c;
+  fastSinCos<P> (_a, s, c);
+  return c;
+}
+
+// _x to the power _y for _x > 0 (0 otherwise), as exp (_y ln _x).  The log
+// works on the mantissa scaled into [sqrt (1/2), sqrt (2)) with the atanh
+// series, the exponential on a remainder within ln (2) / 2 with 2^k put
+// straight into the exponent bits.
+template <uint8_t P = FAST_MATH_PRECISION>
+inline float fastPow (float _x, float _y)
+{
+  if (P == FAST_MATH_LIBM)
+    return powf (_x, _y);
+  if (!(_x > 0.0f))
+    return 0.0f;
+
+  uint32_t bits = floatBits (_x);
+  int32_t e = (int32_t) ((bits >> 23) & 0xFF) - 127;
+  float m = bitsFloat ((bits & 0x007FFFFF) | 0x3F800000);
+  if (m > 1.4142135f)
+  {
+    m *= 0.5f;
+    e++;
+  }
+  float s = (m - 1.0f) / (m + 1.0f);
+  float s2 = s * s;
+  float lnm;
+  if (P == FAST_MATH_HIGH)
+    lnm = 2.0f * s * (1.0f + s2 * (1.0f / 3.0f + s2 * (1.0f / 5.0f + s2 * (1.0f / 7.0f))));
+  else
+    lnm = 2.0f * s * (1.0f + s2 * (1.0f / 3.0f + s2 * (1.0f / 5.0f)));
+  float t = _y * (e * 0.69314718f + lnm);
+
+  float kf = t * 1.4426950f;
+  int32_t k = (int32_t) (kf + ((kf >= 0.0f) ? 0.5f : -0.5f));
+  if (k < -126)
+    return 0.0f;
+  if (k > 127)
+    return INFINITY;
+  float r = (t - k * 0.69314575f) - k * 1.4286068e-6f;
+  float er;
+  if (P == FAST_MATH_HIGH)
+    er = 1.0f + r * (1.0f + r * (0.5f + r * (1.0f / 6.0f + r * (1.0f / 24.0f + r * (1.0f / 120.0f + r * (1.0f / 720.0f))))));
+  else
+    er = 1.0f + r * (1.0f + r * (0.5f + r * (1.0f / 6.0f + r * (1.0f / 24.0f + r * (1.0f / 120.0f)))));
+  return er * bitsFloat ((uint32_t) (k + 127) << 23);
+}
+
+//
+// Fixed point.  Angles are binary, 65536 to a turn, so they wrap for free in
+// 16 bits; sines are Q15.
+//
+
+// Floor of the square root, one result bit per step
+inline uint16_t fastSqrtU32 (uint32_t _x)
+{
+  uint32_t r = 0;
+  uint32_t bit = (uint32_t) 1 << 30;
+  while (bit > _x)
+    bit >>= 2;
+  while (bit != 0)
+  {
+    if (_x >= r + bit)
+    {
+      _x -= r + bit;
+      r = (r >> 1) + bit;
+    }
+    else
+    {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint16_t) r;
+}
+
+// Binary angle of (_x, _y), within 20 (0.1 degrees).  The first octant uses
+// atan (a) = pi/4 a + a (1 - a) (0.2447 + 0.0663 a) on a Q15 ratio.
+inline int16_t fastAtan2Q (int16_t _y, int16_t _x)
+{
+  uint32_t ax = (_x < 0) ? (uint32_t) -(int32_t) _x : (uint32_t) _x;
+  uint32_t ay = (_y < 0) ? (uint32_t) -(int32_t) _y : (uint32_t) _y;
+  uint32_t mx = (ax > ay) ? ax : ay;
+  if (mx == 0)
+    return 0;
+  uint32_t a = (((ax > ay) ? ay : ax) << 15) / mx;
+  uint32_t t = (a * (32768 - a)) >> 15;
+  uint32_t r = (a >> 2) + ((t * (2552 + ((691 * a) >> 15))) >> 15);
+  if (ay > ax)
+    r = 16384 - r;
+  if (_x < 0)
+    r = 32768 - r;
+  return (int16_t) ((_y < 0) ? -(int32_t) r : (int32_t) r);
+}
+
+// Q15 sine of a binary angle, linear between the 65 points of a quarter
+// wave, within 4 LSB
+inline int16_t fastSinQ15 (uint16_t _angle)
+{
+  static const int16_t QUARTER_WAVE[65] =
+  {
+        0,   804,  1608,  2411,  3212,  4011,  4808,  5602,  6393,
+     7180,  7962,  8740,  9512, 10279, 11039, 11793, 12540, 13279,
+    14010, 14733, 15447, 16151, 16846, 17531, 18205, 18868, 19520,
+    20160, 20788, 21403, 22006, 22595, 23170, 23732, 24279, 24812,
+    25330, 25833, 26320, 26791, 27246, 27684, 28106, 28511, 28899,
+    29269, 29622, 29957, 30274, 30572, 30853, 31114, 31357, 31581,
+    31786, 31972, 32138, 32286, 32413, 32522, 32610, 32679, 32729,
+    32758, 32767
+  };
+  uint16_t a = _angle & 0x3FFF;
+  if (_angle & 0x4000)
+    a = 0x4000 - a;
+  uint8_t i = a >> 8;
+  int16_t s = QUARTER_WAVE[i];
+  if (i < 64)
+    s += (int16_t) (((int32_t) (QUARTER_WAVE[i + 1] - s) * (a & 0xFF)) >> 8);
+  return (_angle & 0x8000) ? -s : s;
+}
+
+inline int16_t fastCosQ15 (uint16_t _angle)
+{
+  return fastSinQ15 ((uint16_t) (_angle + 0x4000));
+}
+
+#endif
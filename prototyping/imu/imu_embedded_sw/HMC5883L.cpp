@@ -6,8 +6,13 @@
  
 #include "HMC5883L.h"
 
-HMC5883L::HMC5883L ()
+HMC5883L::HMC5883L (BusTransport* _bus)
+  : m_calibrated (false),
+    m_i2c (ADDRESS, 0, &Wire, I2C_MAX_SPEED),
+    m_bus (_bus ? _bus : &m_i2c)
 {
+  m_calBias = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_calMatrix = Mat3<float>::identity ();
 }
 
 HMC5883L::~HMC5883L ()
@@ -16,51 +21,66 @@ HMC5883L::~HMC5883L ()
 
 uint8_t HMC5883L::readReg (const uint8_t _reg)
 {
-    // Send request to read reg
-    Wire.beginTransmission (ADDRESS);
-    Wire.write (_reg);
-    Wire.endTransmission ();
-  
-    // Receive reg value back
-    uint8_t val;
-    Wire.requestFrom (ADDRESS, REG_WIDTH);
-    while (Wire.available () < 0);
-        val = Wire.read();
-    
-    return val;
+  return m_bus->readReg (_reg);
 }
 
 void HMC5883L::writeReg (const uint8_t _reg, const uint8_t _val)
 { 
-    // Send request to write
-    Wire.beginTransmission (ADDRESS);
-    Wire.write (_reg);
-    Wire.write (_val);
-    Wire.endTransmission ();
+  m_bus->writeReg (_reg, _val);
 }
 
-HMC5883L::vector16b HMC5883L::readRaw ()
+I2C_SPEED HMC5883L::setI2CSpeed (I2C_SPEED _speed)
 {
-  // Send request with auto-increment enabled
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (DATA_OUT_X_MSB_REG);
-  Wire.endTransmission ();
+  // The bit is written at the speed in use, so set before going up to high
+  // speed and cleared before coming down from it
+  uint8_t mode = readReg (MODE_REG) & ~HS_I2C_3400_KHZ;
+  if (_speed == I2C_HIGH_SPEED)
+    writeReg (MODE_REG, mode | HS_I2C_3400_KHZ);
+  else
+    writeReg (MODE_REG, mode);
+  I2C_SPEED speed = m_bus->setSpeed (_speed);
   
-  // Receive 6 byte successive transmission
-  Wire.requestFrom (ADDRESS, 6);
-  while (Wire.available () < 6);
-  uint8_t xh = Wire.read();
-  uint8_t xl = Wire.read ();
-  uint8_t zh = Wire.read ();
-  uint8_t zl = Wire.read ();
-  uint8_t yh = Wire.read ();
-  uint8_t yl = Wire.read ();
+  // The transport couldn't follow, back to a mode it can address
+  if (_speed == I2C_HIGH_SPEED && speed != I2C_HIGH_SPEED)
+    writeReg (MODE_REG, mode);
+  return speed;
+}
+
+HMC5883L::vector16b HMC5883L::readRaw ()
+{
+  // Receive 6 byte successive transmission, the device always auto increments
+  uint8_t buf[6];
+  m_bus->readBlock (DATA_OUT_X_MSB_REG, buf, 6);
   
-  // Aggregate high and low bytes
+  // Aggregate high and low bytes, registers are in X, Z, Y order
   vector16b retval;
-  retval.x = (int16_t)(xh << 8 | xl);
-  retval.y = (int16_t)(yh << 8 | yl);
-  retval.z = (int16_t)(zh << 8 | zl);
+  unpackVec3BEXZY (buf, &retval, 1);
   
   return retval;
 }
+
+bool HMC5883L::loadCalibration (const CalibrationBlob& _blob)
+{
+  if (!calibrationValid (_blob, CAPTURE_MAG))
+    return false;
+  
+  unpackCalibration (_blob, m_calBias, m_calMatrix);
+  m_calibrated = true;
+  return true;
+}
+
+void HMC5883L::clearCalibration ()
+{
+  m_calibrated = false;
+  m_calBias = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_calMatrix = Mat3<float>::identity ();
+}
+
+HMC5883L::vectorf HMC5883L::readCalibrated ()
+{
+  vectorf raw = scaleVec3<float> (readRaw (), 1.0f);
+  if (!m_calibrated)
+    return raw;
+  
+  return m_calMatrix * (raw - m_calBias);
+}
@@ -8,6 +8,9 @@
 
 #include "Arduino.h"
 #include "Wire.h"
+#include "VectorMath.h"
+#include "BusTransport.h"
+#include "CalibrationBlob.h"
 
 class HMC5883L
 {
@@ -63,22 +66,25 @@ class HMC5883L
   static const uint8_t ID_REG_B           = 0x0B;
   static const uint8_t ID_REG_C           = 0x0C;
   
-  // Vector structs
-  typedef struct vectorf_struct
-  {
-      float   x; 
-      float   y;
-      float   z;
-  } vectorf;
-  typedef struct vector16b_struct
-  {
-      int16_t x;
-      int16_t y;
-      int16_t z;
-  } vector16b;
+  // Vector types
+  typedef Vec3<float>   vectorf;
+  typedef Vec3<int16_t> vector16b;
  
-  HMC5883L ();
+  // Uses I2C unless a transport is given
+  HMC5883L (BusTransport* _bus = NULL);
   ~HMC5883L();
+  
+  // Bus the device is attached to
+  BusTransport* getBus () {return m_bus;}
+  
+  // Fastest I2C speed mode the part takes, once HS_I2C_3400_KHZ is set
+  static const I2C_SPEED I2C_MAX_SPEED = I2C_HIGH_SPEED;
+  
+  // Speed mode of the device's transactions, clamped to what the part and
+  // its transport take, setting or clearing HS_I2C_3400_KHZ in MODE_REG to
+  // match.  Call it after
+  // any other write to MODE_REG, which would clear the bit.
+  I2C_SPEED setI2CSpeed (I2C_SPEED _speed);
 
   // Read and write regs
   uint8_t readReg (const uint8_t _reg);
@@ -86,7 +92,24 @@ class HMC5883L
   
   // Read magnometer data
   vector16b readRaw ();
+  
+  // Hard and soft iron model from imu_cal_tool, fitted at the gain it is
+  // used with.  Returns false if the blob is not a valid HMC5883L calibration.
+  bool loadCalibration (const CalibrationBlob& _blob);
+  void clearCalibration ();
+  bool isCalibrated () {return m_calibrated;}
+  
+  // Raw data with the calibration applied, still in raw unit
+  vectorf readCalibrated ();
  private:
+  // Loaded hard/soft iron model in raw unit
+  bool        m_calibrated;
+  vectorf     m_calBias;
+  Mat3<float> m_calMatrix;
+  
+  // Bus the device is attached to
+  I2CTransport  m_i2c;
+  BusTransport* m_bus;
 };
 
 #endif
@@ -0,0 +1,40 @@
+/*
+ * ISRDispatch.cpp - Context carrying interrupt handlers for attachInterrupt and IntervalTimer
+ * Currently just for personal use.
+ */
+
+#include "ISRDispatch.h"
+
+volatile ISRDispatch::Slot ISRDispatch::s_slots[ISRDispatch::SLOTS];
+
+const ISRDispatch::ISRFunc ISRDispatch::TRAMPOLINES[ISRDispatch::SLOTS] =
+{
+  trampoline<0>, trampoline<1>, trampoline<2>, trampoline<3>,
+  trampoline<4>, trampoline<5>, trampoline<6>, trampoline<7>
+};
+
+ISRDispatch::ISRFunc ISRDispatch::attach (Handler _handler, void* _context)
+{
+  for (uint8_t i = 0; i < SLOTS; i++)
+  {
+    if (s_slots[i].handler)
+      continue;
+    
+    // Context first, the handler makes the slot live.  No interrupt can run
+    // the slot before the caller arms it with the function returned, so the
+    // interrupt state is left alone: setup () attaches with them off.
+    s_slots[i].context = _context;
+    s_slots[i].handler = _handler;
+    return TRAMPOLINES[i];
+  }
+  return NULL;
+}
+
+void ISRDispatch::detach (ISRFunc _isr)
+{
+  for (uint8_t i = 0; i < SLOTS; i++)
+  {
+    if (TRAMPOLINES[i] == _isr)
+      s_slots[i].handler = NULL;
+  }
+}
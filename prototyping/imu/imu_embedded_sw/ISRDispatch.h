@@ -0,0 +1,52 @@
+/*
+ * ISRDispatch.h - Context carrying interrupt handlers for attachInterrupt and IntervalTimer
+ * Currently just for personal use.
+ */
+#ifndef ISRDISPATCH_H
+#define ISRDISPATCH_H
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+// attachInterrupt and IntervalTimer only take a plain void () function, so a
+// sketch used to need one trampoline per device calling its global.  This
+// hands out plain functions from a fixed table, each calling a handler with
+// the context pointer it was attached with:
+//   g_gyro2.initAsync (0, ISRDispatch::attach (gyroISR, &g_gyro2));
+// where gyroISR (void* _gyro) serves every gyro.
+class ISRDispatch
+{
+ public:
+  typedef void (*ISRFunc) ();
+  typedef void (*Handler) (void* _context);
+
+  static const uint8_t SLOTS = 8;
+
+  // The function to give to attachInterrupt, NULL when all slots are taken
+  static ISRFunc attach (Handler _handler, void* _context);
+  // Frees the slot of a function from attach (), after the interrupt is detached
+  static void detach (ISRFunc _isr);
+ private:
+  typedef struct slot_struct
+  {
+    Handler  handler;
+    void*    context;
+  } Slot;
+
+  template <uint8_t N>
+  static void trampoline ()
+  {
+    Handler handler = s_slots[N].handler;
+    if (handler)
+      handler (s_slots[N].context);
+  }
+
+  static volatile Slot   s_slots[SLOTS];
+  static const ISRFunc   TRAMPOLINES[SLOTS];
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * ImuConfig.h - Compile time selection of driver features
+ * Currently just for personal use.
+ */
+#ifndef IMUCONFIG_H
+#define IMUCONFIG_H
+
+#include <stdint.h>
+
+// Driver features that can be left out to make room for bigger FIFOs and
+// buffers on small parts.  Everything is in by default.  The IDE builds each
+// .cpp on its own, so the sketch's defines never reach the drivers: set these
+// here, or with -D for all files (imu_size_report compares builds this way).
+
+// Converted outputs and their callbacks in float instead of double
+//#define IMU_CFG_FLOAT
+
+// No F, ft and ft/s outputs (BMP085)
+//#define IMU_CFG_NO_IMPERIAL
+
+// No polled conversions with delay (), async only (BMP085)
+//#define IMU_CFG_NO_SYNC_READS
+
+// No moving average on pressure, 84 bytes of history (BMP085)
+//#define IMU_CFG_NO_AVG_FILTER
+
+// Callback slots per driver output, 0 leaves only the lazy reads
+//#define IMU_CFG_SUBSCRIBERS 1
+
+#ifndef IMU_CFG_SUBSCRIBERS
+#define IMU_CFG_SUBSCRIBERS 4
+#endif
+
+#ifdef IMU_CFG_FLOAT
+typedef float  imu_real;
+#else
+typedef double imu_real;
+#endif
+
+// The selections that only pick code paths, as constants so the branches on
+// them fold away.  Sync reads and the average filter take out members and
+// functions, so the drivers test those defines directly.
+struct ImuConfig
+{
+#ifdef IMU_CFG_NO_IMPERIAL
+  static const bool    IMPERIAL_UNITS = false;
+#else
+  static const bool    IMPERIAL_UNITS = true;
+#endif
+  static const uint8_t SUBSCRIBERS = IMU_CFG_SUBSCRIBERS;
+};
+
+#endif
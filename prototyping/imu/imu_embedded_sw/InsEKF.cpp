@@ -0,0 +1,299 @@
+/*
+ * InsEKF.cpp - 15 state error-state Kalman filter for attitude, velocity and height
+ * Currently just for personal use.
+ */
+
+#include <string.h>
+#include "InsEKF.h"
+
+const float InsEKF::GRAVITY_MPS2 = 9.80665f;
+
+// Gravity updates need |acc| within this of 1 g
+const float InsEKF::GRAVITY_GATE_MPS2 = 1.0f;
+
+// Stationary while the corrected rate and |acc| - 1 g stay under these
+const float InsEKF::STILL_GYRO_RADS = 0.05f;
+const float InsEKF::STILL_ACC_MPS2 = 0.3f;
+const float InsEKF::STILL_TIME_S = 0.5f;
+
+InsEKF::InsEKF ()
+  : m_gate2 (16.0f),
+    m_stillTimeS (0.0f),
+    m_rejected (0)
+{
+  // L3G4200D and ADXL345 datasheet noise, loose enough for the zero rate
+  // and offset calibrations to wander
+  m_noise.gyro = 0.0005f;
+  m_noise.acc = 0.006f;
+  m_noise.gyroBiasWalk = 0.00002f;
+  m_noise.accBiasWalk = 0.0002f;
+  m_noise.gravity = 0.3f;
+  m_noise.heading = 0.05f;
+  m_noise.altitude = 0.5f;
+  m_noise.zeroVelocity = 0.02f;
+
+  vectorf up = makeVec3<float> (0.0f, 0.0f, GRAVITY_MPS2);
+  vectorf north = makeVec3<float> (1.0f, 0.0f, 0.0f);
+  reset (up, north, 0.0f);
+}
+
+void InsEKF::reset (const vectorf& _acc, const vectorf& _mag, float _altitudeM)
+{
+  float roll = atan2 (_acc.y, _acc.z);
+  float pitch = atan2 (-_acc.x, sqrt (_acc.y * _acc.y + _acc.z * _acc.z));
+  quaternionf tilt = Quaternion<float>::fromRotationVector (makeVec3<float> (0.0f, pitch, 0.0f)) *
+                     Quaternion<float>::fromRotationVector (makeVec3<float> (roll, 0.0f, 0.0f));
+  vectorf level = rotate (tilt, _mag);
+  float yaw = -atan2 (level.y, level.x);
+  m_q = normalize (Quaternion<float>::fromRotationVector (makeVec3<float> (0.0f, 0.0f, yaw)) * tilt);
+
+  m_v = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_p = makeVec3<float> (0.0f, 0.0f, _altitudeM);
+  m_bg = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_ba = makeVec3<float> (0.0f, 0.0f, 0.0f);
+
+  memset (m_dx, 0, sizeof (m_dx));
+  memset (m_P, 0, sizeof (m_P));
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    m_P[STATE_ATT + i][STATE_ATT + i] = 0.05f * 0.05f;
+    m_P[STATE_VEL + i][STATE_VEL + i] = 0.1f * 0.1f;
+    m_P[STATE_POS + i][STATE_POS + i] = 1.0f;
+    m_P[STATE_GYRO_BIAS + i][STATE_GYRO_BIAS + i] = 0.01f * 0.01f;
+    m_P[STATE_ACC_BIAS + i][STATE_ACC_BIAS + i] = 0.2f * 0.2f;
+  }
+  m_P[STATE_POS + 2][STATE_POS + 2] = m_noise.altitude * m_noise.altitude;
+  m_stillTimeS = 0.0f;
+}
+
+void InsEKF::predict (float _dt, const vectorf& _gyro, const vectorf& _acc)
+{
+  predictDelta (_dt, _gyro * _dt, _acc * _dt);
+}
+
+void InsEKF::predictDelta (float _dt, const vectorf& _dAngle, const vectorf& _dVelocity)
+{
+  if (!(_dt > 0.0f))
+    return;
+
+  // Mean rate and specific force for the stationary test and the Jacobian
+  float invDt = 1.0f / _dt;
+  vectorf w = _dAngle * invDt - m_bg;
+  vectorf f = _dVelocity * invDt - m_ba;
+  matrixf R = toMat3 (m_q);
+
+  if (norm (w) < STILL_GYRO_RADS && fabs (norm (_dVelocity) * invDt - GRAVITY_MPS2) < STILL_ACC_MPS2)
+    m_stillTimeS += _dt;
+  else
+    m_stillTimeS = 0.0f;
+
+  // Nominal state
+  vectorf a = R * f;
+  a.z -= GRAVITY_MPS2;
+  m_p += m_v * _dt + a * (0.5f * _dt * _dt);
+  m_v += a * _dt;
+  m_q = normalize (m_q * Quaternion<float>::fromRotationVector (w * _dt));
+
+  // The transition matrix is identity plus dt times
+  //   -[w x]     0    0   -I    0
+  //   -R [f x]   0    0    0   -R
+  //    0         I    0    0    0
+  //    0         0    0    0    0
+  //    0         0    0    0    0
+  // so only the attitude, velocity and position rows and columns change.
+  // B = -R [f x] dt and C = -R dt, the [w x] blocks are written out.
+  float tx = w.x * _dt, ty = w.y * _dt, tz = w.z * _dt;
+  float B[3][3], C[3][3];
+  for (uint8_t r = 0; r < 3; r++)
+  {
+    B[r][0] = (R.m[r][2] * f.y - R.m[r][1] * f.z) * _dt;
+    B[r][1] = (R.m[r][0] * f.z - R.m[r][2] * f.x) * _dt;
+    B[r][2] = (R.m[r][1] * f.x - R.m[r][0] * f.y) * _dt;
+    C[r][0] = -R.m[r][0] * _dt;
+    C[r][1] = -R.m[r][1] * _dt;
+    C[r][2] = -R.m[r][2] * _dt;
+  }
+
+  // M = F P, rows 0-8.  The bias rows of M are those of P.
+  float M[9][STATES];
+  for (uint8_t j = 0; j < STATES; j++)
+  {
+    float p0 = m_P[0][j], p1 = m_P[1][j], p2 = m_P[2][j];
+    float a0 = m_P[12][j], a1 = m_P[13][j], a2 = m_P[14][j];
+    M[0][j] = p0 + tz * p1 - ty * p2 - _dt * m_P[9][j];
+    M[1][j] = p1 - tz * p0 + tx * p2 - _dt * m_P[10][j];
+    M[2][j] = p2 + ty * p0 - tx * p1 - _dt * m_P[11][j];
+    for (uint8_t r = 0; r < 3; r++)
+    {
+      M[3 + r][j] = m_P[3 + r][j] + B[r][0] * p0 + B[r][1] * p1 + B[r][2] * p2 +
+                    C[r][0] * a0 + C[r][1] * a1 + C[r][2] * a2;
+      M[6 + r][j] = m_P[6 + r][j] + _dt * m_P[3 + r][j];
+    }
+  }
+
+  // P = M F', rows 0-8 and mirrored into the bias rows.  The bias-bias
+  // block is unchanged apart from the process noise.
+  for (uint8_t i = 0; i < 9; i++)
+  {
+    const float* m = M[i];
+    float row[STATES];
+    row[0] = m[0] + tz * m[1] - ty * m[2] - _dt * m[9];
+    row[1] = m[1] - tz * m[0] + tx * m[2] - _dt * m[10];
+    row[2] = m[2] + ty * m[0] - tx * m[1] - _dt * m[11];
+    for (uint8_t c = 0; c < 3; c++)
+    {
+      row[3 + c] = m[3 + c] + B[c][0] * m[0] + B[c][1] * m[1] + B[c][2] * m[2] +
+                   C[c][0] * m[12] + C[c][1] * m[13] + C[c][2] * m[14];
+      row[6 + c] = m[6 + c] + _dt * m[3 + c];
+    }
+    for (uint8_t j = 9; j < STATES; j++)
+      row[j] = m[j];
+    for (uint8_t j = i; j < STATES; j++)
+    {
+      m_P[i][j] = row[j];
+      m_P[j][i] = row[j];
+    }
+  }
+
+  float qGyro = m_noise.gyro * m_noise.gyro * _dt;
+  float qAcc = m_noise.acc * m_noise.acc * _dt;
+  float qGyroBias = m_noise.gyroBiasWalk * m_noise.gyroBiasWalk * _dt;
+  float qAccBias = m_noise.accBiasWalk * m_noise.accBiasWalk * _dt;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    m_P[STATE_ATT + i][STATE_ATT + i] += qGyro;
+    m_P[STATE_VEL + i][STATE_VEL + i] += qAcc;
+    m_P[STATE_GYRO_BIAS + i][STATE_GYRO_BIAS + i] += qGyroBias;
+    m_P[STATE_ACC_BIAS + i][STATE_ACC_BIAS + i] += qAccBias;
+  }
+}
+
+uint8_t InsEKF::updateGravity (const vectorf& _acc)
+{
+  if (fabs (norm (_acc) - GRAVITY_MPS2) > GRAVITY_GATE_MPS2)
+    return 0;
+
+  // At rest the accelerometer reads R' (0, 0, g) + ba.  With the attitude
+  // error on the body side that is g_b + [g_b x] dtheta + dba.
+  matrixf R = toMat3 (m_q);
+  vectorf g = makeVec3<float> (R.m[2][0], R.m[2][1], R.m[2][2]) * GRAVITY_MPS2;
+  float r = m_noise.gravity * m_noise.gravity;
+  uint8_t applied = 0;
+
+  const uint8_t idxX[3] = {STATE_ATT + 1, STATE_ATT + 2, STATE_ACC_BIAS};
+  const float hX[3] = {-g.z, g.y, 1.0f};
+  applied += scalarUpdate (_acc.x - g.x - m_ba.x, idxX, hX, 3, r);
+  const uint8_t idxY[3] = {STATE_ATT, STATE_ATT + 2, STATE_ACC_BIAS + 1};
+  const float hY[3] = {g.z, -g.x, 1.0f};
+  applied += scalarUpdate (_acc.y - g.y - m_ba.y, idxY, hY, 3, r);
+  const uint8_t idxZ[3] = {STATE_ATT, STATE_ATT + 1, STATE_ACC_BIAS + 2};
+  const float hZ[3] = {-g.y, g.x, 1.0f};
+  applied += scalarUpdate (_acc.z - g.z - m_ba.z, idxZ, hZ, 3, r);
+
+  inject ();
+  return applied;
+}
+
+uint8_t InsEKF::updateHeading (const vectorf& _mag)
+{
+  // Field in the reference frame, its horizontal part points along x
+  matrixf R = toMat3 (m_q);
+  vectorf m = R * _mag;
+  float h2 = m.x * m.x + m.y * m.y;
+  if (h2 <= 1e-6f * dot (m, m))
+    return 0;
+
+  // Only the rotation about vertical, phi_z of the reference frame error
+  // phi = R dtheta, is corrected.  A dipping field ties heading to the tilt
+  // about north as well, but with that in the Jacobian the magnetometer
+  // noise walks tilt and accelerometer bias off together where gravity
+  // can't tell them apart, so tilt is left to gravity.
+  const uint8_t idx[3] = {STATE_ATT, STATE_ATT + 1, STATE_ATT + 2};
+  const float h[3] = {R.m[2][0], R.m[2][1], R.m[2][2]};
+
+  uint8_t applied = scalarUpdate (-atan2 (m.y, m.x), idx, h, 3, m_noise.heading * m_noise.heading);
+  inject ();
+  return applied;
+}
+
+uint8_t InsEKF::updateAltitude (float _altitudeM)
+{
+  const uint8_t idx = STATE_POS + 2;
+  const float h = 1.0f;
+  uint8_t applied = scalarUpdate (_altitudeM - m_p.z, &idx, &h, 1, m_noise.altitude * m_noise.altitude);
+  inject ();
+  return applied;
+}
+
+uint8_t InsEKF::updateZeroVelocity ()
+{
+  float r = m_noise.zeroVelocity * m_noise.zeroVelocity;
+  const float h = 1.0f;
+  uint8_t applied = 0;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    const uint8_t idx = STATE_VEL + i;
+    float v = (i == 0) ? m_v.x : (i == 1) ? m_v.y : m_v.z;
+    applied += scalarUpdate (-v, &idx, &h, 1, r);
+  }
+  inject ();
+  return applied;
+}
+
+void InsEKF::getEuler (float& _roll, float& _pitch, float& _yaw)
+{
+  matrixf R = toMat3 (m_q);
+  _roll = atan2 (R.m[2][1], R.m[2][2]);
+  _pitch = -asin (R.m[2][0] < -1.0f ? -1.0f : (R.m[2][0] > 1.0f ? 1.0f : R.m[2][0]));
+  _yaw = atan2 (R.m[1][0], R.m[0][0]);
+}
+
+bool InsEKF::scalarUpdate (float _y, const uint8_t* _idx, const float* _h, uint8_t _nnz, float _r)
+{
+  // Earlier scalars of the same measurement already moved the error state
+  for (uint8_t k = 0; k < _nnz; k++)
+    _y -= _h[k] * m_dx[_idx[k]];
+
+  float pht[STATES];
+  for (uint8_t i = 0; i < STATES; i++)
+  {
+    float s = 0.0f;
+    for (uint8_t k = 0; k < _nnz; k++)
+      s += m_P[i][_idx[k]] * _h[k];
+    pht[i] = s;
+  }
+  float s = _r;
+  for (uint8_t k = 0; k < _nnz; k++)
+    s += _h[k] * pht[_idx[k]];
+
+  if (_y * _y > m_gate2 * s)
+  {
+    m_rejected++;
+    return false;
+  }
+
+  float inv = 1.0f / s;
+  for (uint8_t i = 0; i < STATES; i++)
+  {
+    float ki = pht[i] * inv;
+    m_dx[i] += ki * _y;
+    for (uint8_t j = i; j < STATES; j++)
+    {
+      m_P[i][j] -= ki * pht[j];
+      m_P[j][i] = m_P[i][j];
+    }
+  }
+  return true;
+}
+
+void InsEKF::inject ()
+{
+  // The covariance reset for the attitude error is left out, it is
+  // second order in an error this small
+  m_q = normalize (m_q * Quaternion<float>::fromRotationVector (makeVec3<float> (m_dx[0], m_dx[1], m_dx[2])));
+  m_v += makeVec3<float> (m_dx[3], m_dx[4], m_dx[5]);
+  m_p += makeVec3<float> (m_dx[6], m_dx[7], m_dx[8]);
+  m_bg += makeVec3<float> (m_dx[9], m_dx[10], m_dx[11]);
+  m_ba += makeVec3<float> (m_dx[12], m_dx[13], m_dx[14]);
+  memset (m_dx, 0, sizeof (m_dx));
+}
@@ -0,0 +1,129 @@
+/*
+ * InsEKF.h - 15 state error-state Kalman filter for attitude, velocity and height
+ * Currently just for personal use.
+ */
+#ifndef INSEKF_H
+#define INSEKF_H
+
+#include <stdint.h>
+#include "VectorMath.h"
+
+// Strapdown INS around a nominal state (attitude quaternion, velocity,
+// position, gyro and accelerometer bias) with a 15 state error-state filter
+// on top:
+//   0-2   attitude error, body frame, rad
+//   3-5   velocity error, m/s
+//   6-8   position error, m
+//   9-11  gyro bias error, rad/s
+//   12-14 accelerometer bias error, m/s^2
+// The reference frame has x toward magnetic north and z up.  Nothing
+// observes horizontal position, it is only dead reckoned; height comes from
+// the barometer and velocity from zero velocity updates while stationary.
+//
+// Float throughout so it fits a microcontroller without a double FPU.  The
+// covariance propagation works on the 3x3 blocks of the transition matrix,
+// skipping the identity and zero blocks, and every measurement is applied
+// as a sequence of scalar updates with at most three non-zero Jacobian
+// entries, so there is no matrix inverse anywhere.  imu_host_tools/
+// imu_ins_bench checks it against a dense implementation.
+class InsEKF
+{
+ public:
+  typedef Vec3<float>       vectorf;
+  typedef Mat3<float>       matrixf;
+  typedef Quaternion<float> quaternionf;
+
+  static const uint8_t STATES = 15;
+  static const uint8_t STATE_ATT = 0;
+  static const uint8_t STATE_VEL = 3;
+  static const uint8_t STATE_POS = 6;
+  static const uint8_t STATE_GYRO_BIAS = 9;
+  static const uint8_t STATE_ACC_BIAS = 12;
+
+  static const float   GRAVITY_MPS2;
+
+  // Process noise densities and measurement standard deviations
+  typedef struct noise_struct
+  {
+    float gyro;           // rad/s/sqrt(Hz)
+    float acc;            // m/s^2/sqrt(Hz)
+    float gyroBiasWalk;   // rad/s/sqrt(s)
+    float accBiasWalk;    // m/s^2/sqrt(s)
+    float gravity;        // m/s^2, per axis, covers small accelerations
+    float heading;        // rad
+    float altitude;       // m
+    float zeroVelocity;   // m/s, per axis
+  } Noise;
+
+  InsEKF ();
+
+  void setNoise (const Noise& _noise) {m_noise = _noise;}
+  const Noise& getNoise () {return m_noise;}
+
+  // Innovations beyond _sigmas standard deviations are rejected
+  void setGate (float _sigmas) {m_gate2 = _sigmas * _sigmas;}
+
+  // Levels the attitude from a resting accelerometer sample, points it at
+  // magnetic north from a magnetometer sample and starts at _altitudeM with
+  // zero velocity and bias
+  void reset (const vectorf& _acc, const vectorf& _mag, float _altitudeM);
+
+  // Integrates _dt seconds at the given mean rate (rad/s) and specific force
+  // (m/s^2), both as measured in the body frame
+  void predict (float _dt, const vectorf& _gyro, const vectorf& _acc);
+
+  // The same from body frame increments over _dt: the rotation vector (rad)
+  // and velocity change (m/s) in the frame at the start, as PreIntegrator
+  // gives them with the coning and sculling terms in
+  void predictDelta (float _dt, const vectorf& _dAngle, const vectorf& _dVelocity);
+
+  // Measurement updates, each returns the number of scalar updates applied.
+  // Gravity is only used while |_acc| is close to 1 g; heading takes any
+  // magnetometer unit, only its direction is used.
+  uint8_t updateGravity (const vectorf& _acc);
+  uint8_t updateHeading (const vectorf& _mag);
+  uint8_t updateAltitude (float _altitudeM);
+  uint8_t updateZeroVelocity ();
+
+  // True once the last predict inputs have looked stationary for a while
+  bool isStationary () {return m_stillTimeS >= STILL_TIME_S;}
+
+  quaternionf getAttitude () {return m_q;}
+  void getEuler (float& _roll, float& _pitch, float& _yaw);
+  vectorf getVelocity () {return m_v;}
+  vectorf getPosition () {return m_p;}
+  vectorf getGyroBias () {return m_bg;}
+  vectorf getAccBias () {return m_ba;}
+  float getCovariance (uint8_t _i, uint8_t _j) {return m_P[_i][_j];}
+
+  uint32_t getRejected () {return m_rejected;}
+ private:
+  static const float   GRAVITY_GATE_MPS2;
+  static const float   STILL_GYRO_RADS;
+  static const float   STILL_ACC_MPS2;
+  static const float   STILL_TIME_S;
+
+  // y = z - h (x) with a Jacobian row of _nnz entries at _idx
+  bool scalarUpdate (float _y, const uint8_t* _idx, const float* _h, uint8_t _nnz, float _r);
+
+  // Moves the accumulated error state into the nominal state
+  void inject ();
+
+  // Nominal state
+  quaternionf  m_q;
+  vectorf      m_v;
+  vectorf      m_p;
+  vectorf      m_bg;
+  vectorf      m_ba;
+
+  // Error state and its covariance, kept symmetric
+  float        m_dx[STATES];
+  float        m_P[STATES][STATES];
+
+  Noise        m_noise;
+  float        m_gate2;
+  float        m_stillTimeS;
+  uint32_t     m_rejected;
+};
+
+#endif
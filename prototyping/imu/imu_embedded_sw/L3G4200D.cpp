@@ -5,17 +5,24 @@
  */
  
 #include "L3G4200D.h"
+
+const uint8_t L3G4200D::DR_BITS[RATE_NUM] = {DR0, DR1, DR2, DR3};
  
-L3G4200D::L3G4200D ()
+L3G4200D::L3G4200D (BusTransport* _bus, uint8_t _address)
   : m_initialized (false),
     m_timer (),
+    m_timerISR (NULL),
+    m_pollIntervaluS (POLL_INTERVAL_US_DEFAULT),
+    m_outRate (RATE_100HZ),
     m_zeroRateInit (false),
     m_rotVelCB (NULL),
-    m_ovrnCB (NULL)
+    m_ovrnCB (NULL),
+    m_i2c (_address, I2C_AUTO_INC, &Wire, I2C_MAX_SPEED),
+    m_bus (_bus ? _bus : &m_i2c),
+    m_blockReader (NULL),
+    m_samplesPerBurst (1)
 {
-  m_zeroRate.x = 0;
-  m_zeroRate.y = 0;
-  m_zeroRate.z = 0;
+  m_zeroRate = makeVec3<int16_t> (0, 0, 0);
 }
 
 L3G4200D::~L3G4200D ()
@@ -37,9 +44,9 @@ void L3G4200D::init ()
   if (m_initialized)
     return;
     
-  // Initialize to default data rate and bandwidth,
+  // Initialize to the set data rate and lowest bandwidth,
   // exit power down mode, and enabled all axes  
-  writeReg (CTRL_REG1, L3G4200D::DR0 | 
+  writeReg (CTRL_REG1, DR_BITS[m_outRate] | 
                        L3G4200D::BW0 |
                        L3G4200D::PD_DISABLE |
                        L3G4200D::Z_ENABLE |
@@ -67,7 +74,8 @@ void L3G4200D::initAsync (int _int2Pin, ISRFunc _int2ISR)
   //writeReg (CTRL_REG3, I2_DRDY);
   
   // Setup timer
-  m_timer.begin (_int2ISR, 100000); // Fire timer at 10 Hz (should be higher)
+  m_timerISR = _int2ISR;
+  m_timer.begin (m_timerISR, m_pollIntervaluS);
   
   // Do normal initialization
   init ();
@@ -80,10 +88,7 @@ void L3G4200D::calibrateZeroRate ()
  
   if (!m_zeroRateInit)
   {
-    vectord cum;
-    cum.x = 0;
-    cum.y = 0;
-    cum.z = 0;
+    vectord cum = makeVec3<imu_real> (0, 0, 0);
     for (int32_t i = 0; i < ZERO_RATE_SAMPLES; i++)
     {
       // Wait for data to be ready
@@ -93,10 +98,7 @@ void L3G4200D::calibrateZeroRate ()
         dataReady (drdy, ovrn);
         
       // Read data
-      vector16b rawData = readRaw ();
-      cum.x += rawData.x;
-      cum.y += rawData.y;
-      cum.z += rawData.z;
+      cum += scaleVec3<imu_real> (readRaw (), 1);
     }
     
     m_zeroRate.x = ((int32_t) -cum.x) / ZERO_RATE_SAMPLES;
@@ -107,8 +109,92 @@ void L3G4200D::calibrateZeroRate ()
   }
 }
 
+void L3G4200D::setOutputRate (OUTPUT_RATE _rate)
+{
+  if (_rate >= RATE_NUM)
+    return;
+  m_outRate = _rate;
+  
+  if (!m_initialized)
+    return;
+  
+  uint8_t val = readReg (CTRL_REG1);
+  val = (val & ~(DR3 | BW3)) | DR_BITS[m_outRate] | BW0;
+  writeReg (CTRL_REG1, val);
+}
+
+double L3G4200D::getOutputRateHz (OUTPUT_RATE _rate)
+{
+  return 100.0 * (1 << _rate);
+}
+
+void L3G4200D::setPollInterval (uint32_t _intervaluS)
+{
+  m_pollIntervaluS = _intervaluS;
+  
+  // Restart a running timer at the new period
+  if (m_timerISR)
+    m_timer.begin (m_timerISR, m_pollIntervaluS);
+}
+
+void L3G4200D::setBlockReader (DMABlockReader* _reader, uint8_t _samplesPerBurst)
+{
+  m_blockReader = _reader;
+  
+  // Room for a burst more in the FIFO while a tick waits for a whole one
+  if (_samplesPerBurst > FIFO_DEPTH / 2)
+    _samplesPerBurst = FIFO_DEPTH / 2;
+  
+  if (m_blockReader && _samplesPerBurst > 1)
+  {
+    // Stream mode, the output registers roll back to OUT_X_L after OUT_Z_H
+    // so the whole watermark can be read in a single burst
+    writeReg (FIFO_CTRL_REG, STREAM_MODE | _samplesPerBurst);
+    writeReg (CTRL_REG5, readReg (CTRL_REG5) | FIFO_ENABLE);
+  }
+  else
+  {
+    writeReg (CTRL_REG5, readReg (CTRL_REG5) & ~FIFO_ENABLE);
+    writeReg (FIFO_CTRL_REG, 0);
+    _samplesPerBurst = 1;
+  }
+  
+  m_samplesPerBurst = _samplesPerBurst;
+  if (m_blockReader)
+  {
+    m_blockReader->attach (m_bus, OUT_X_L_REG, 6, _samplesPerBurst);
+    setPollInterval ((uint32_t) (_samplesPerBurst * 10000.0 * BLOCK_POLL_PERCENT / getOutputRateHz (m_outRate)));
+  }
+}
+
 void L3G4200D::int2ISR ()
 {
+  // Burst mode, the reader does the transfer and zero rate is left to the
+  // consumer.  The status is read here, but not under a burst in flight.
+  if (m_blockReader)
+  {
+    if (m_blockReader->burstInFlight ())
+      return;
+    
+    bool ready, ovrn;
+    if (m_samplesPerBurst > 1)
+    {
+      uint8_t src = readReg (FIFO_SRC_REG);
+      ovrn = src & OVRN_MASK;
+      ready = ovrn || ((src & FSS_MASK) >= m_samplesPerBurst);
+    }
+    else
+    {
+      dataReady (ready, ovrn);
+    }
+    
+    if (ready)
+      m_blockReader->trigger ();
+    if (m_ovrnCB && ovrn)
+      m_ovrnCB ();
+    return;
+  }
+  
   bool drdy, ovrn;
   dataReady (drdy, ovrn);
   
@@ -118,9 +204,7 @@ void L3G4200D::int2ISR ()
     vector16b rawRotVel = readRaw ();
     
     // Compensate for zero rate
-    rawRotVel.x += m_zeroRate.x;
-    rawRotVel.y += m_zeroRate.y;
-    rawRotVel.z += m_zeroRate.z;
+    rawRotVel += m_zeroRate;
       
     // Make callback
     m_rotVelCB (rawRotVel);
@@ -132,18 +216,7 @@ void L3G4200D::int2ISR ()
 
 uint8_t L3G4200D::readReg (const uint8_t _reg)
 {
-  // Send request to read reg
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (_reg);
-  Wire.endTransmission ();
-
-  // Receive reg value back
-  uint8_t val;
-  Wire.requestFrom (ADDRESS, REG_WIDTH);
-  while (Wire.available ())
-      val = Wire.read();
-  
-  return val;
+  return m_bus->readReg (_reg);
 }
 
 void L3G4200D::writeReg (const uint8_t _reg, const uint8_t _val)
@@ -151,11 +224,7 @@ void L3G4200D::writeReg (const uint8_t _reg, const uint8_t _val)
   // TODO: Check for correct reg and change
   //       sensitivity if necessary
 
-  // Send request to write
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (_reg);
-  Wire.write (_val);
-  Wire.endTransmission ();
+  m_bus->writeReg (_reg, _val);
 }
 
 void L3G4200D::dataReady (bool &_drdy, bool &_ovrn)
@@ -171,28 +240,30 @@ void L3G4200D::dataReady (bool &_drdy, bool &_ovrn)
     _ovrn = true;
 }
 
+bool L3G4200D::readSample (vector16b& _rawRotVel, bool& _ovrn)
+{
+  // STATUS_REG sits right below OUT_X_L, so one transaction reads both
+  uint8_t buf[7];
+  m_bus->readBlock (STATUS_REG, buf, 7);
+  _ovrn = buf[0] & ZYXOR_MASK;
+  if (!(buf[0] & ZYXDA_MASK))
+    return false;
+  
+  unpackVec3LE (&buf[1], &_rawRotVel, 1);
+  _rawRotVel += m_zeroRate;
+  return true;
+}
+
 L3G4200D::vector16b L3G4200D::readRaw ()
 {
-  // Send request with auto-increment enabled
-  Wire.beginTransmission (ADDRESS);
-  Wire.write (OUT_X_L_REG | (1 << 7));
-  Wire.endTransmission ();
-  
-  // Receive 6 byte successive transmission
-  Wire.requestFrom (ADDRESS, 6);
-  while (Wire.available () < 6);
-  uint8_t xl = Wire.read();
-  uint8_t xh = Wire.read ();
-  uint8_t yl = Wire.read ();
-  uint8_t yh = Wire.read ();
-  uint8_t zl = Wire.read ();
-  uint8_t zh = Wire.read ();
+  // Receive 6 byte successive transmission, the transport sets the
+  // auto-increment / multi byte bit for the bus in use
+  uint8_t buf[6];
+  m_bus->readBlock (OUT_X_L_REG, buf, 6);
   
   // Aggregate high and low bytes
   vector16b retval;
-  retval.x = (int16_t)(xh << 8 | xl);
-  retval.y = (int16_t)(yh << 8 | yl);
-  retval.z = (int16_t)(zh << 8 | zl);
+  unpackVec3LE (buf, &retval, 1);
   
   return retval;
 }
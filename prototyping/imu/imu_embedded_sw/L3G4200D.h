@@ -8,23 +8,17 @@
 
 #include "Arduino.h"
 #include "Wire.h"
+#include "VectorMath.h"
+#include "BusTransport.h"
+#include "DMABlockReader.h"
+#include "ImuConfig.h"
 
 class L3G4200D
 {
  public:
-  // Vector structs
-  typedef struct vectord_struct
-  {
-      double   x; 
-      double   y;
-      double   z;
-  } vectord;
-  typedef struct vector16b_struct
-  {
-      int16_t x;
-      int16_t y;
-      int16_t z;
-  } vector16b;
+  // Vector types
+  typedef Vec3<imu_real> vectord;
+  typedef Vec3<int16_t> vector16b;
   
   // Callback definitions
   typedef void (*RotationalVelocityCallback) (vector16b _rawRotVel);
@@ -34,9 +28,49 @@ class L3G4200D
   // ISRs
   typedef void (*ISRFunc) (); // should just call L3G4200D::int2ISR
   
-  L3G4200D ();
+  // Output data rates, bandwidth is left at the lowest cut-off of each
+  typedef enum OUTPUT_RATE_ENUM
+  {
+    RATE_100HZ = 0,
+    RATE_200HZ,
+    RATE_400HZ,
+    RATE_800HZ,
+    RATE_NUM
+  } OUTPUT_RATE;
+  
+  // Async timer period until setPollInterval is called
+  static const uint32_t POLL_INTERVAL_US_DEFAULT = 100000;
+  
+  // Block reads poll faster than bursts arrive, so a slow gyro clock can't
+  // let the FIFO fill up, and ticks without a whole burst wait for the next
+  static const uint8_t  BLOCK_POLL_PERCENT = 90;
+  
+  // SPI transport parameters (4-wire, mode 3, CS must be wired to a pin)
+  static const uint32_t SPI_CLOCK_HZ     = 10000000;
+  static const uint8_t  SPI_MULTI_BYTE   = 0x40;
+  
+  // I2C addresses with SDO high (the breakout's) and low, so two parts can
+  // share a bus
+  static const uint8_t  ADDRESS          = 0x69;
+  static const uint8_t  ADDRESS_ALT      = 0x68;
+  
+  // Sub-address auto increment bit, for an I2CTransport on another bus
+  static const uint8_t  I2C_AUTO_INC     = 0x80;
+  
+  // Uses I2C at _address unless a transport is given
+  L3G4200D (BusTransport* _bus = NULL, uint8_t _address = ADDRESS);
   ~L3G4200D ();
   
+  // Bus the device is attached to
+  BusTransport* getBus () {return m_bus;}
+  
+  // Fastest I2C speed mode the part takes
+  static const I2C_SPEED I2C_MAX_SPEED = I2C_FAST;
+  
+  // Speed mode of the device's transactions, clamped to what the part and
+  // its transport take.  Returns the mode in use, I2C_SPEED_NUM on SPI.
+  I2C_SPEED setI2CSpeed (I2C_SPEED _speed) {return m_bus->setSpeed (_speed);}
+  
   // Register callbacks
   void registerRotationalVelocityCallback (RotationalVelocityCallback _cb);
   void registerOverrunCallback (OverrunCallback _cb);
@@ -48,6 +82,26 @@ class L3G4200D
   void initAsync (int _int2Pin, ISRFunc _int2ISR);
   
   void calibrateZeroRate ();
+  // Offset added to samples read by the ISR, block readers add it themselves
+  vector16b getZeroRate () {return m_zeroRate;}
+  
+  // Set and get output data rate, applied at once if initialized
+  void setOutputRate (OUTPUT_RATE _rate);
+  OUTPUT_RATE getOutputRate () {return m_outRate;}
+  static double getOutputRateHz (OUTPUT_RATE _rate);
+  
+  // The breakout doesn't route INT2 so a timer polls in its place.  It
+  // should fire at the output rate to keep up without reading stale
+  // samples.  setBlockReader sets it from the burst.
+  void setPollInterval (uint32_t _intervaluS);
+  uint32_t getPollInterval () {return m_pollIntervaluS;}
+  
+  // Hand samples to a block reader from the ISR instead of reading them.
+  // More than one sample per burst puts the FIFO in stream mode with a
+  // matching watermark and reads it in one roll-over burst.  Polls at
+  // BLOCK_POLL_PERCENT of a burst's time at the current output rate, and
+  // a tick only bursts once a whole burst has arrived.
+  void setBlockReader (DMABlockReader* _reader, uint8_t _samplesPerBurst);
   
   // ISR function
   void int2ISR ();
@@ -55,9 +109,11 @@ class L3G4200D
   // Read gyro data
   void dataReady (bool &_drdy, bool &_ovrn);
   vector16b readRaw ();
+  // Status and sample in one burst from STATUS_REG, zero rate compensated
+  // like the ISR's.  False, leaving _rawRotVel alone, without new data.
+  bool readSample (vector16b& _rawRotVel, bool& _ovrn);
  private:
   // Device parameters
-  static const uint8_t ADDRESS        = 0x69;
   static const uint8_t REG_WIDTH      = 1;
   
   // Device registers
@@ -145,6 +201,7 @@ class L3G4200D
   static const uint8_t OVRN_MASK      = 0x40;
   static const uint8_t EMPTY_MASK     = 0x20;
   static const uint8_t FSS_MASK       = 0x1F;
+  static const uint8_t FIFO_DEPTH     = 32;
   
   static const uint8_t INT1_CFG       = 0x30;
   static const uint8_t OR_INTS        = 0x00;
@@ -176,6 +233,9 @@ class L3G4200D
   static const uint8_t INT1_DURATION  = 0x38;
   static const uint8_t WAIT_ENABLE    = 0x80;
   
+  // CTRL_REG1 data rate bits of each OUTPUT_RATE
+  static const uint8_t DR_BITS[RATE_NUM];
+  
   // Zero rate calibration samples
   static const int32_t ZERO_RATE_SAMPLES = 100;
   
@@ -184,6 +244,11 @@ class L3G4200D
   
   // Timer for async operation
   IntervalTimer                 m_timer;
+  ISRFunc                       m_timerISR;
+  uint32_t                      m_pollIntervaluS;
+  
+  // Output data rate
+  OUTPUT_RATE                   m_outRate;
   
   // Zero rate offset calibration
   bool                          m_zeroRateInit;
@@ -193,6 +258,14 @@ class L3G4200D
   RotationalVelocityCallback    m_rotVelCB;
   OverrunCallback               m_ovrnCB;
   
+  // Bus the device is attached to
+  I2CTransport                  m_i2c;
+  BusTransport*                 m_bus;
+  
+  // Block reader for burst mode
+  DMABlockReader*               m_blockReader;
+  uint8_t                       m_samplesPerBurst;
+  
   // Read and write regs
   uint8_t readReg (const uint8_t _reg);
   void writeReg (const uint8_t _reg, const uint8_t _val);
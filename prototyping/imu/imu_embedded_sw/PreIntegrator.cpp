@@ -0,0 +1,77 @@
+/*
+ * PreIntegrator.cpp - Delta-angle and delta-velocity accumulation between filter steps
+ * Currently just for personal use.
+ */
+
+#include "PreIntegrator.h"
+
+PreIntegrator::PreIntegrator ()
+{
+  reset ();
+}
+
+void PreIntegrator::reset ()
+{
+  vectorf zero = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_acc = zero;
+  m_hasAcc = false;
+  m_alpha = zero;
+  m_beta = zero;
+  m_v = zero;
+  m_scul = zero;
+  m_lastDAlpha = zero;
+  m_lastDV = zero;
+  m_dt = 0.0f;
+  m_gyroSamples = 0;
+  m_accSamples = 0;
+}
+
+void PreIntegrator::addAcc (const vectorf& _acc)
+{
+  m_acc = _acc;
+  m_hasAcc = true;
+  m_accSamples++;
+}
+
+void PreIntegrator::addGyro (const vectorf& _gyro, float _dt)
+{
+  vectorf dAlpha = _gyro * _dt;
+  vectorf dV = m_acc * _dt;
+
+  // The previous sample's increments carry across a take, only the sums
+  // start again
+  vectorf alphaMid = m_alpha + m_lastDAlpha * (1.0f / 6.0f);
+  vectorf vMid = m_v + m_lastDV * (1.0f / 6.0f);
+  m_beta += cross (alphaMid, dAlpha) * 0.5f;
+  m_scul += (cross (alphaMid, dV) + cross (vMid, dAlpha)) * 0.5f;
+
+  m_alpha += dAlpha;
+  m_v += dV;
+  m_lastDAlpha = dAlpha;
+  m_lastDV = dV;
+  m_dt += _dt;
+  m_gyroSamples++;
+}
+
+bool PreIntegrator::take (Increment& _increment)
+{
+  if (m_gyroSamples == 0)
+    return false;
+
+  _increment.dAngle = m_alpha + m_beta;
+  vectorf alphaV = cross (m_alpha, m_v);
+  _increment.dVelocity = m_v + alphaV * 0.5f + cross (m_alpha, alphaV) * (1.0f / 6.0f) + m_scul;
+  _increment.dt = m_dt;
+  _increment.gyroSamples = m_gyroSamples;
+  _increment.accSamples = m_accSamples;
+
+  vectorf zero = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  m_alpha = zero;
+  m_beta = zero;
+  m_v = zero;
+  m_scul = zero;
+  m_dt = 0.0f;
+  m_gyroSamples = 0;
+  m_accSamples = 0;
+  return true;
+}
@@ -0,0 +1,77 @@
+/*
+ * PreIntegrator.h - Delta-angle and delta-velocity accumulation between filter steps
+ * Currently just for personal use.
+ */
+#ifndef PREINTEGRATOR_H
+#define PREINTEGRATOR_H
+
+#include <stdint.h>
+#include "VectorMath.h"
+
+// Integrates gyro and accelerometer samples at the sensor rate into one
+// body frame increment per consumer step: the rotation vector from the body
+// frame at the start of the step to the one at its end, and the velocity
+// change, in the start frame, from the specific force.  The filter then runs
+// at its own rate, however fast the sensors sample.
+//
+// Summing the samples alone loses the coning (rotation about an axis that
+// itself rotates) and sculling (acceleration along an axis that rotates)
+// terms, which don't average out.  Both are carried sample by sample with
+// the recursive corrections of Savage (Strapdown Analytics), which
+// assume each rate varies linearly across a sample:
+//   beta += 1/2 (alpha + 1/6 dAlpha') x dAlpha
+//   S    += 1/2 ((alpha + 1/6 dAlpha') x dV + (v + 1/6 dV') x dAlpha)
+// with ' the previous sample, then alpha += dAlpha and v += dV.  The step
+// gives
+//   dAngle    = alpha + beta
+//   dVelocity = v + 1/2 alpha x v + 1/6 alpha x (alpha x v) + S
+// The second order rotation term matters for gravity, which is in v at
+// every step.
+//
+// The accelerometer usually samples slower than the gyro, so its last
+// sample is held and integrated over each gyro sample.
+class PreIntegrator
+{
+ public:
+  typedef Vec3<float> vectorf;
+
+  typedef struct increment_struct
+  {
+    vectorf  dAngle;      // rad
+    vectorf  dVelocity;   // m/s
+    float    dt;          // s
+    uint16_t gyroSamples;
+    uint16_t accSamples;
+  } Increment;
+
+  PreIntegrator ();
+
+  // Specific force in m/s^2, held until the next
+  void addAcc (const vectorf& _acc);
+  bool hasAcc () {return m_hasAcc;}
+
+  // Rate in rad/s over a gyro sample of _dt seconds
+  void addGyro (const vectorf& _gyro, float _dt);
+
+  // Hands over the increment since the last take and starts the next,
+  // false (and nothing taken) without a gyro sample since
+  bool take (Increment& _increment);
+
+  // Drops the increment in progress and the held accelerometer sample
+  void reset ();
+ private:
+  vectorf  m_acc;
+  bool     m_hasAcc;
+
+  vectorf  m_alpha;
+  vectorf  m_beta;
+  vectorf  m_v;
+  vectorf  m_scul;
+  vectorf  m_lastDAlpha;
+  vectorf  m_lastDV;
+  float    m_dt;
+  uint16_t m_gyroSamples;
+  uint16_t m_accSamples;
+};
+
+#endif
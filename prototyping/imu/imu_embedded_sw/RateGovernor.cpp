@@ -0,0 +1,153 @@
+/*
+ * RateGovernor.cpp - Motion and load driven sample rate selection
+ * Currently just for personal use.
+ */
+
+#include "RateGovernor.h"
+
+// 10 mg of vibration counts as much as 1 dps of rotation
+const double RateGovernor::ACC_ENERGY_WEIGHT = 0.01;
+
+RateGovernor::RateGovernor ()
+  : m_level (LEVEL_IDLE),
+    m_ceiling ((LEVEL) (LEVEL_NUM - 1)),
+    m_ceilingSincemS (0),
+    m_stillTiming (false),
+    m_stillSincemS (0),
+    m_holdmS (HOLD_MS_DEFAULT),
+    m_ceilingHoldmS (CEILING_HOLD_MS_DEFAULT),
+    m_busMax (0.6),
+    m_cpuMax (0.5),
+    m_transitionCB (NULL),
+    m_transitions (0)
+{
+  // RMS rates of 5 dps up / 3 dps down and 50 dps up / 30 dps down
+  m_upEnergy[LEVEL_IDLE] = 0.0;
+  m_downEnergy[LEVEL_IDLE] = 0.0;
+  setThresholds (LEVEL_CRUISE, 25.0, 9.0);
+  setThresholds (LEVEL_AGILE, 2500.0, 900.0);
+}
+
+void RateGovernor::registerTransitionCallback (TransitionCallback _cb)
+{
+  m_transitionCB = _cb;
+}
+
+void RateGovernor::setThresholds (LEVEL _level, double _upEnergy, double _downEnergy)
+{
+  if (_level <= LEVEL_IDLE || _level >= LEVEL_NUM)
+    return;
+
+  // Without a gap the level would follow every wobble around one threshold
+  if (_downEnergy > _upEnergy)
+    _downEnergy = _upEnergy;
+  m_upEnergy[_level] = _upEnergy;
+  m_downEnergy[_level] = _downEnergy;
+}
+
+void RateGovernor::setLoadLimits (double _busMax, double _cpuMax)
+{
+  m_busMax = _busMax;
+  m_cpuMax = _cpuMax;
+}
+
+bool RateGovernor::update (uint32_t _nowmS, double _energy, double _busLoad, double _cpuLoad)
+{
+  if (m_ceiling < LEVEL_NUM - 1 && _nowmS - m_ceilingSincemS >= m_ceilingHoldmS)
+    m_ceiling = (LEVEL) (LEVEL_NUM - 1);
+
+  // Overload steps down and holds the level under the one that overloaded
+  bool busOver = _busLoad > m_busMax;
+  bool cpuOver = _cpuLoad > m_cpuMax;
+  if ((busOver || cpuOver) && m_level > LEVEL_IDLE)
+  {
+    m_ceiling = (LEVEL) (m_level - 1);
+    m_ceilingSincemS = _nowmS;
+    changeLevel (_nowmS, m_ceiling, busOver ? REASON_BUS_LOAD : REASON_CPU_LOAD,
+                 _energy, _busLoad, _cpuLoad);
+    return true;
+  }
+
+  // Motion moves up straight away
+  LEVEL target = m_level;
+  for (int l = m_level + 1; l < LEVEL_NUM; l++)
+  {
+    if (_energy > m_upEnergy[l])
+      target = (LEVEL) l;
+  }
+  if (target > m_ceiling)
+    target = m_ceiling;
+  if (target > m_level)
+  {
+    changeLevel (_nowmS, target, REASON_MOTION, _energy, _busLoad, _cpuLoad);
+    return true;
+  }
+
+  // Stillness has to last the hold time before each step down
+  if (m_level == LEVEL_IDLE || _energy >= m_downEnergy[m_level])
+  {
+    m_stillTiming = false;
+    return false;
+  }
+  if (!m_stillTiming)
+  {
+    m_stillTiming = true;
+    m_stillSincemS = _nowmS;
+    return false;
+  }
+  if (_nowmS - m_stillSincemS < m_holdmS)
+    return false;
+
+  changeLevel (_nowmS, (LEVEL) (m_level - 1), REASON_STILL, _energy, _busLoad, _cpuLoad);
+  return true;
+}
+
+const RateGovernor::Transition* RateGovernor::getTransition (uint32_t _index)
+{
+  if (_index >= m_transitions || m_transitions - _index > LOG_SIZE)
+    return NULL;
+  return &m_log[_index & (LOG_SIZE - 1)];
+}
+
+const char* RateGovernor::levelName (LEVEL _level)
+{
+  switch (_level)
+  {
+    case LEVEL_IDLE:    return "idle";
+    case LEVEL_CRUISE:  return "cruise";
+    case LEVEL_AGILE:   return "agile";
+    default:            return "?";
+  }
+}
+
+const char* RateGovernor::reasonName (REASON _reason)
+{
+  switch (_reason)
+  {
+    case REASON_MOTION:   return "motion";
+    case REASON_STILL:    return "still";
+    case REASON_BUS_LOAD: return "bus";
+    case REASON_CPU_LOAD: return "cpu";
+    default:              return "?";
+  }
+}
+
+void RateGovernor::changeLevel (uint32_t _nowmS, LEVEL _level, REASON _reason,
+                                double _energy, double _busLoad, double _cpuLoad)
+{
+  Transition& t = m_log[m_transitions & (LOG_SIZE - 1)];
+  t.timemS = _nowmS;
+  t.from = m_level;
+  t.to = _level;
+  t.reason = _reason;
+  t.energy = _energy;
+  t.busLoad = _busLoad;
+  t.cpuLoad = _cpuLoad;
+  m_transitions++;
+
+  m_level = _level;
+  m_stillTiming = false;
+
+  if (m_transitionCB)
+    m_transitionCB (t);
+}
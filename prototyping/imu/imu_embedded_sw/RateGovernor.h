@@ -0,0 +1,112 @@
+/*
+ * RateGovernor.h - Motion and load driven sample rate selection
+ * Currently just for personal use.
+ */
+#ifndef RATEGOVERNOR_H
+#define RATEGOVERNOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Picks a rate level from motion energy and bus/CPU load.  The caller maps
+// each level to sensor settings (output rates, FIFO watermark, oversampling)
+// and applies them from the transition callback, so this builds on the host
+// as well.
+//
+// Motion energy is the mean squared rotation rate in dps^2 plus
+// ACC_ENERGY_WEIGHT times the mean squared deviation of |acc| from 1 g in
+// mg^2, over the update period.
+//
+// Rising motion moves up at once, straight to the highest level whose up
+// threshold is exceeded.  Falling motion has to stay below the level's down
+// threshold for the hold time, then steps down one level at a time.  Bus or
+// CPU load over its limit steps down one level and caps the level there for
+// the ceiling hold time, so an overload can't bounce between two levels.
+class RateGovernor
+{
+ public:
+  typedef enum LEVEL_ENUM
+  {
+    LEVEL_IDLE = 0,     // On the bench
+    LEVEL_CRUISE,       // Handled or gentle motion
+    LEVEL_AGILE,        // Fast manoeuvres and vibration
+    LEVEL_NUM
+  } LEVEL;
+
+  typedef enum REASON_ENUM
+  {
+    REASON_MOTION = 0,
+    REASON_STILL,
+    REASON_BUS_LOAD,
+    REASON_CPU_LOAD,
+    REASON_NUM
+  } REASON;
+
+  typedef struct transition_struct
+  {
+    uint32_t timemS;
+    uint8_t  from;
+    uint8_t  to;
+    uint8_t  reason;
+    float    energy;
+    float    busLoad;
+    float    cpuLoad;
+  } Transition;
+
+  // Callback definitions
+  typedef void (*TransitionCallback) (const Transition& _transition);
+
+  static const double   ACC_ENERGY_WEIGHT;          // dps^2 per mg^2
+  static const uint32_t HOLD_MS_DEFAULT = 2000;
+  static const uint32_t CEILING_HOLD_MS_DEFAULT = 30000;
+  static const uint8_t  LOG_SIZE = 8;               // must be a power of two
+
+  RateGovernor ();
+
+  // Register callbacks
+  void registerTransitionCallback (TransitionCallback _cb);
+
+  // Thresholds of LEVEL_CRUISE and up, _upEnergy must be above _downEnergy
+  void setThresholds (LEVEL _level, double _upEnergy, double _downEnergy);
+  void setHoldTime (uint32_t _holdmS) {m_holdmS = _holdmS;}
+  void setCeilingHoldTime (uint32_t _holdmS) {m_ceilingHoldmS = _holdmS;}
+
+  // Load limits as fractions of bus time and CPU time
+  void setLoadLimits (double _busMax, double _cpuMax);
+
+  // Call once per period with that period's measurements, returns true if
+  // the level changed
+  bool update (uint32_t _nowmS, double _energy, double _busLoad, double _cpuLoad);
+
+  LEVEL getLevel () {return m_level;}
+
+  // Transition log.  _index counts from the first transition, only the
+  // last LOG_SIZE are kept and older ones return NULL.
+  uint32_t getTransitionCount () {return m_transitions;}
+  const Transition* getTransition (uint32_t _index);
+
+  static const char* levelName (LEVEL _level);
+  static const char* reasonName (REASON _reason);
+ private:
+  void changeLevel (uint32_t _nowmS, LEVEL _level, REASON _reason,
+                    double _energy, double _busLoad, double _cpuLoad);
+
+  LEVEL                m_level;
+  LEVEL                m_ceiling;
+  uint32_t             m_ceilingSincemS;
+  bool                 m_stillTiming;
+  uint32_t             m_stillSincemS;
+
+  double               m_upEnergy[LEVEL_NUM];
+  double               m_downEnergy[LEVEL_NUM];
+  uint32_t             m_holdmS;
+  uint32_t             m_ceilingHoldmS;
+  double               m_busMax;
+  double               m_cpuMax;
+
+  TransitionCallback   m_transitionCB;
+  Transition           m_log[LOG_SIZE];
+  uint32_t             m_transitions;
+};
+
+#endif
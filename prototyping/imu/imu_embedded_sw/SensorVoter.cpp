@@ -0,0 +1,177 @@
+/*
+ * SensorVoter.cpp - Averaging and fault voting across redundant sensors of one kind
+ * Currently just for personal use.
+ */
+
+#include <math.h>
+#include "SensorVoter.h"
+
+SensorVoter::SensorVoter (uint8_t _units, float _range, float _threshold)
+  : m_units (_units > UNITS_MAX ? UNITS_MAX : _units),
+    m_range (_range),
+    m_threshold (_threshold),
+    m_rejoinSamples (REJOIN_SAMPLES_DEFAULT),
+    m_used (0),
+    m_votes (0)
+{
+  m_voted = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  for (uint8_t i = 0; i < UNITS_MAX; i++)
+  {
+    m_state[i].sample = m_voted;
+    m_state[i].fresh = false;
+    m_state[i].fault = FAULT_NONE;
+    m_state[i].goodSamples = 0;
+    m_state[i].rejected = 0;
+  }
+}
+
+bool SensorVoter::submit (uint8_t _unit, const vectorf& _sample)
+{
+  if (_unit >= m_units)
+    return false;
+
+  // A second sample before the others means they missed the period
+  bool voted = false;
+  if (m_state[_unit].fresh)
+  {
+    vote ();
+    voted = true;
+  }
+  m_state[_unit].sample = _sample;
+  m_state[_unit].fresh = true;
+
+  // Stale units aren't waited for, they join again when they next report
+  for (uint8_t i = 0; i < m_units; i++)
+  {
+    if (!m_state[i].fresh && m_state[i].fault != FAULT_STALE)
+      return voted;
+  }
+  vote ();
+  return true;
+}
+
+void SensorVoter::vote ()
+{
+  uint8_t candidates[UNITS_MAX];
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < m_units; i++)
+  {
+    if (!m_state[i].fresh)
+      reject (i, FAULT_STALE);
+    else if (outOfRange (m_state[i].sample))
+      reject (i, FAULT_RANGE);
+    else
+      candidates[count++] = i;
+  }
+
+  bool agrees[UNITS_MAX];
+  for (uint8_t k = 0; k < count; k++)
+    agrees[k] = true;
+  if (count >= 3)
+  {
+    float x[UNITS_MAX], y[UNITS_MAX], z[UNITS_MAX];
+    for (uint8_t k = 0; k < count; k++)
+    {
+      x[k] = m_state[candidates[k]].sample.x;
+      y[k] = m_state[candidates[k]].sample.y;
+      z[k] = m_state[candidates[k]].sample.z;
+    }
+    vectorf mid = makeVec3<float> (median (x, count), median (y, count), median (z, count));
+    for (uint8_t k = 0; k < count; k++)
+      agrees[k] = !disagrees (m_state[candidates[k]].sample, mid);
+  }
+  else if (count == 2 && disagrees (m_state[candidates[0]].sample, m_state[candidates[1]].sample))
+  {
+    // No majority.  Siding with the one nearer the last vote would follow a
+    // stuck unit, which stays put while the good one moves away.
+    agrees[0] = false;
+    agrees[1] = false;
+  }
+
+  // Average the trusted units.  Units rejoining count agreeing samples and
+  // are only used when no trusted unit is left.
+  vectorf sum = makeVec3<float> (0.0f, 0.0f, 0.0f);
+  vectorf rejoinSum = sum;
+  uint8_t used = 0;
+  uint8_t rejoining = 0;
+  for (uint8_t k = 0; k < count; k++)
+  {
+    uint8_t i = candidates[k];
+    UnitState& state = m_state[i];
+    if (!agrees[k])
+    {
+      reject (i, FAULT_DISAGREE);
+      continue;
+    }
+    if (state.fault != FAULT_NONE)
+    {
+      if (++state.goodSamples < m_rejoinSamples)
+      {
+        rejoinSum += state.sample;
+        rejoining++;
+        continue;
+      }
+      state.fault = FAULT_NONE;
+    }
+    sum += state.sample;
+    used++;
+  }
+  if (used == 0)
+  {
+    sum = rejoinSum;
+    used = rejoining;
+  }
+
+  if (used > 0)
+    m_voted = sum * (1.0f / used);
+  m_used = used;
+  m_votes++;
+  for (uint8_t i = 0; i < m_units; i++)
+    m_state[i].fresh = false;
+}
+
+void SensorVoter::reject (uint8_t _unit, FAULT _fault)
+{
+  m_state[_unit].fault = _fault;
+  m_state[_unit].goodSamples = 0;
+  m_state[_unit].rejected++;
+}
+
+bool SensorVoter::outOfRange (const vectorf& _v)
+{
+  return !(fabs (_v.x) < m_range && fabs (_v.y) < m_range && fabs (_v.z) < m_range);
+}
+
+bool SensorVoter::disagrees (const vectorf& _a, const vectorf& _b)
+{
+  return fabs (_a.x - _b.x) > m_threshold || fabs (_a.y - _b.y) > m_threshold || fabs (_a.z - _b.z) > m_threshold;
+}
+
+// Median of at most UNITS_MAX values, the mean of the middle two for an even
+// count.  Sorts _values.
+float SensorVoter::median (float* _values, uint8_t _count)
+{
+  for (uint8_t i = 1; i < _count; i++)
+  {
+    float v = _values[i];
+    uint8_t j = i;
+    for (; j > 0 && _values[j - 1] > v; j--)
+      _values[j] = _values[j - 1];
+    _values[j] = v;
+  }
+  if (_count & 1)
+    return _values[_count / 2];
+  return 0.5f * (_values[_count / 2 - 1] + _values[_count / 2]);
+}
+
+const char* SensorVoter::faultName (FAULT _fault)
+{
+  switch (_fault)
+  {
+    case FAULT_NONE:      return "none";
+    case FAULT_STALE:     return "stale";
+    case FAULT_RANGE:     return "range";
+    case FAULT_DISAGREE:  return "disagree";
+    default:              return "?";
+  }
+}
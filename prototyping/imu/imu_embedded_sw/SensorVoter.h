@@ -0,0 +1,91 @@
+/*
+ * SensorVoter.h - Averaging and fault voting across redundant sensors of one kind
+ * Currently just for personal use.
+ */
+#ifndef SENSORVOTER_H
+#define SENSORVOTER_H
+
+#include <stdint.h>
+#include "VectorMath.h"
+
+// Combines the samples of up to UNITS_MAX sensors of the same kind into one,
+// the mean of the units it trusts, which cuts white noise by sqrt (N).
+//
+// Votes are clocked by the samples themselves: one is taken once every live
+// unit has reported since the last, or as soon as a unit reports twice, in
+// which case the units that didn't report have missed a period and are
+// stale.  A unit is also left out of a vote when any axis is beyond the
+// range (saturated or garbage) or, with three or more in range, further than
+// the threshold from the per axis median of all of them.  Two in range that
+// disagree can't be told apart, so both are left out and the last vote
+// stands until they agree again; it takes three units to vote a failure
+// out.  A failed unit is out of the output from the first sample it fails
+// on, and only counts again after REJOIN_SAMPLES_DEFAULT agreeing samples.
+//
+// Units may submit from different ISRs as long as they can't preempt each
+// other (the same priority).
+class SensorVoter
+{
+ public:
+  typedef Vec3<float> vectorf;
+
+  typedef enum FAULT_ENUM
+  {
+    FAULT_NONE = 0,
+    FAULT_STALE,        // Missed a period
+    FAULT_RANGE,        // An axis beyond the range
+    FAULT_DISAGREE,     // Too far from the others
+    FAULT_NUM
+  } FAULT;
+
+  static const uint8_t UNITS_MAX = 4;
+  static const uint8_t REJOIN_SAMPLES_DEFAULT = 16;
+
+  // _range and _threshold per axis, in the units of the samples
+  SensorVoter (uint8_t _units, float _range, float _threshold);
+
+  void setRejoinSamples (uint8_t _samples) {m_rejoinSamples = _samples;}
+
+  // Offers the newest sample of _unit, returns true when a vote was taken
+  bool submit (uint8_t _unit, const vectorf& _sample);
+
+  // The last vote, and how many units it averaged (0 when none could be
+  // trusted, the vote before is kept then)
+  vectorf getVoted () {return m_voted;}
+  uint8_t getUsed () {return m_used;}
+  uint32_t getVotes () {return m_votes;}
+
+  // Why _unit is out of the output, FAULT_NONE once it has rejoined
+  FAULT getFault (uint8_t _unit) {return (FAULT) m_state[_unit].fault;}
+  // Samples of _unit left out of votes
+  uint32_t getRejected (uint8_t _unit) {return m_state[_unit].rejected;}
+
+  static const char* faultName (FAULT _fault);
+ private:
+  typedef struct unit_state_struct
+  {
+    vectorf  sample;
+    bool     fresh;
+    uint8_t  fault;
+    uint8_t  goodSamples;     // Agreeing samples since the last fault
+    uint32_t rejected;
+  } UnitState;
+
+  void vote ();
+  void reject (uint8_t _unit, FAULT _fault);
+  bool outOfRange (const vectorf& _v);
+  bool disagrees (const vectorf& _a, const vectorf& _b);
+  static float median (float* _values, uint8_t _count);
+
+  uint8_t      m_units;
+  float        m_range;
+  float        m_threshold;
+  uint8_t      m_rejoinSamples;
+
+  UnitState    m_state[UNITS_MAX];
+  vectorf      m_voted;
+  uint8_t      m_used;
+  uint32_t     m_votes;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * SimTransport.cpp - Simulated sensor bus for host side testing
+ * Currently just for personal use.
+ */
+
+#include "SimTransport.h"
+
+SimTransport::SimTransport (BUS_TYPE _type, uint32_t _clockHz, uint8_t _autoIncrement)
+  : m_type (_type),
+    m_clockHz (_clockHz),
+    m_highSpeed (false),
+    m_autoIncrement (_autoIncrement),
+    m_busTimeNs (0)
+{
+  setTraceDevice (0, (_type == BUS_SPI) ? BUS_TRACE_SPI : 0);
+  for (uint32_t i = 0; i < NUM_REGS; i++)
+    m_regs[i] = 0;
+}
+
+uint8_t SimTransport::readReg (const uint8_t _reg)
+{
+  uint32_t startuS = traceStart ();
+  if (m_type == BUS_I2C)
+  {
+    addI2CTransaction (4);
+  }
+  else
+  {
+    countTransaction (2);
+    addBusTime (2);
+  }
+  traceEnd (startuS, regIndex (_reg), 1, 0);
+
+  return m_regs[regIndex (_reg)];
+}
+
+void SimTransport::writeReg (const uint8_t _reg, const uint8_t _val)
+{
+  uint32_t startuS = traceStart ();
+  m_regs[regIndex (_reg)] = _val;
+
+  if (m_type == BUS_I2C)
+  {
+    addI2CTransaction (3);
+  }
+  else
+  {
+    countTransaction (2);
+    addBusTime (2);
+  }
+  traceEnd (startuS, regIndex (_reg), 1, BUS_TRACE_WRITE);
+}
+
+void SimTransport::readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len)
+{
+  // Block reads always increment, like the real transports which set the
+  // auto increment or multi byte bit themselves
+  uint32_t startuS = traceStart ();
+  uint8_t reg = regIndex (_reg);
+  for (uint8_t i = 0; i < _len; i++)
+    _buf[i] = m_regs[reg++];
+
+  if (m_type == BUS_I2C)
+  {
+    addI2CTransaction (3 + _len);
+  }
+  else
+  {
+    countTransaction (1 + _len);
+    addBusTime (1 + _len);
+  }
+  traceEnd (startuS, regIndex (_reg), _len, 0);
+}
+
+I2C_SPEED SimTransport::setSpeed (I2C_SPEED _speed)
+{
+  if (m_type != BUS_I2C)
+    return I2C_SPEED_NUM;
+  m_clockHz = I2C_SPEED_HZ[_speed];
+  m_highSpeed = (_speed == I2C_HIGH_SPEED);
+  return _speed;
+}
+
+void SimTransport::setDataReg16 (const uint8_t _reg, int16_t _val)
+{
+  // Little endian like the ADXL345 and L3G4200D output registers
+  m_regs[_reg] = (uint8_t) (_val & 0xFF);
+  m_regs[_reg + 1] = (uint8_t) ((_val >> 8) & 0xFF);
+}
+
+uint8_t SimTransport::regIndex (const uint8_t _reg)
+{
+  // SPI command bytes carry the read and multi byte bits above a 6 bit address,
+  // I2C sub-addresses only carry the auto increment bit if the device uses one
+  if (m_type == BUS_SPI)
+    return _reg & 0x3F;
+  return _reg & ~m_autoIncrement;
+}
+
+void SimTransport::addI2CTransaction (uint32_t _bytes)
+{
+  if (m_highSpeed)
+  {
+    // Start and the master code at fast mode speed, the repeated start that
+    // follows it is in the transaction's own three
+    countTransaction (1 + _bytes);
+    m_busTimeNs += (uint32_t) (((uint64_t) (9 + 1) * 1000000000UL) / I2C_SPEED_HZ[I2C_FAST]);
+  }
+  else
+  {
+    countTransaction (_bytes);
+  }
+  addBusTime (_bytes);
+}
+
+void SimTransport::addBusTime (uint32_t _bytes)
+{
+  // I2C: 9 clocks per byte (ack) plus start, repeated start and stop.
+  // SPI: 8 clocks per byte plus roughly one clock of chip select setup/hold.
+  uint32_t clocks;
+  if (m_type == BUS_I2C)
+    clocks = (_bytes * 9) + 3;
+  else
+    clocks = (_bytes * 8) + 1;
+
+  m_busTimeNs += (uint32_t) (((uint64_t) clocks * 1000000000UL) / m_clockHz);
+}
@@ -0,0 +1,61 @@
+/*
+ * SimTransport.h - Simulated sensor bus for host side testing
+ * Currently just for personal use.
+ */
+#ifndef SIMTRANSPORT_H
+#define SIMTRANSPORT_H
+
+#include "BusTransport.h"
+
+// Register file backed bus that needs no hardware.  Bus time is modeled from
+// the bit count of each transaction so I2C and SPI placements can be compared
+// on the host.
+class SimTransport : public BusTransport
+{
+ public:
+  typedef enum BUS_TYPE_ENUM
+  {
+    BUS_I2C = 0,
+    BUS_SPI,
+    BUS_TYPE_NUM
+  } BUS_TYPE;
+
+  static const uint32_t NUM_REGS = 256;
+
+  // _autoIncrement is the I2C sub-address increment bit or the SPI multi byte
+  // bit, whichever applies to _type, and is stripped from register addresses
+  SimTransport (BUS_TYPE _type, uint32_t _clockHz, uint8_t _autoIncrement);
+
+  virtual uint8_t readReg (const uint8_t _reg);
+  virtual void writeReg (const uint8_t _reg, const uint8_t _val);
+  virtual void readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len);
+
+  // I2C speed modes switch the clock, high speed adds a master code at fast
+  // mode speed to every transaction like I2CTransport.  No device limit.
+  virtual I2C_SPEED setSpeed (I2C_SPEED _speed);
+  virtual uint32_t getClockHz () {return (m_type == BUS_I2C) ? m_clockHz : 0;}
+
+  // Direct register file access for the host side
+  void setReg (const uint8_t _reg, const uint8_t _val) {m_regs[_reg] = _val;}
+  uint8_t getReg (const uint8_t _reg) {return m_regs[_reg];}
+  void setDataReg16 (const uint8_t _reg, int16_t _val);
+
+  // Modeled bus time in nanoseconds since construction or resetBusTime,
+  // resetStats leaves it alone
+  uint32_t getBusTimeNs () {return m_busTimeNs;}
+  void resetBusTime () {m_busTimeNs = 0;}
+ private:
+  uint8_t regIndex (const uint8_t _reg);
+  void addBusTime (uint32_t _bytes);
+  // I2C transaction of _bytes, after a master code in high speed
+  void addI2CTransaction (uint32_t _bytes);
+
+  BUS_TYPE             m_type;
+  uint32_t             m_clockHz;
+  bool                 m_highSpeed;
+  uint8_t              m_autoIncrement;
+  uint32_t             m_busTimeNs;
+  uint8_t              m_regs[NUM_REGS];
+};
+
+#endif
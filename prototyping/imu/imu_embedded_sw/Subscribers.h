@@ -0,0 +1,79 @@
+/*
+ * Subscribers.h - Fixed size subscriber lists for driver outputs
+ * Currently just for personal use.
+ */
+#ifndef SUBSCRIBERS_H
+#define SUBSCRIBERS_H
+
+#include <stdint.h>
+
+// Callbacks for one output of a driver.  Drivers check empty () before
+// computing an output, so nothing is derived that nobody asked for.  The
+// lists are walked from the ISRs: add and remove from setup () or with
+// interrupts off.
+template <typename Callback, uint8_t N>
+class Subscribers
+{
+ public:
+  Subscribers () : m_count (0) {}
+  
+  // Returns false if the list is full, adding a callback twice is a no-op
+  bool add (Callback _cb)
+  {
+    for (uint8_t i = 0; i < m_count; i++)
+      if (m_cbs[i] == _cb)
+        return true;
+    if (!_cb || m_count >= N)
+      return false;
+    m_cbs[m_count++] = _cb;
+    return true;
+  }
+  
+  void remove (Callback _cb)
+  {
+    for (uint8_t i = 0; i < m_count; i++)
+    {
+      if (m_cbs[i] != _cb)
+        continue;
+      m_cbs[i] = m_cbs[--m_count];
+      return;
+    }
+  }
+  
+  bool empty () const {return m_count == 0;}
+  
+  template <typename A>
+  void publish (A _a) const
+  {
+    for (uint8_t i = 0; i < m_count; i++)
+      m_cbs[i] (_a);
+  }
+  
+  template <typename A, typename B>
+  void publish (A _a, B _b) const
+  {
+    for (uint8_t i = 0; i < m_count; i++)
+      m_cbs[i] (_a, _b);
+  }
+  
+ private:
+  Callback m_cbs[N];
+  uint8_t  m_count;
+};
+
+// Built without callbacks (IMU_CFG_SUBSCRIBERS 0).  Always empty, so the
+// conversions behind the empty () checks compile out with the slots.
+template <typename Callback>
+class Subscribers<Callback, 0>
+{
+ public:
+  bool add (Callback) {return false;}
+  void remove (Callback) {}
+  bool empty () const {return true;}
+  template <typename A>
+  void publish (A) const {}
+  template <typename A, typename B>
+  void publish (A, B) const {}
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * SyncSampler.cpp - One interrupt sweep over every sensor, clocked by the gyro
+ * Currently just for personal use.
+ */
+
+#include "SyncSampler.h"
+
+SyncSampler::SyncSampler (L3G4200D* _gyro)
+  : m_gyro (_gyro),
+    m_acc (NULL),
+    m_accPin (0),
+    m_bar (NULL),
+    m_barPin (0),
+    m_frameCB (NULL),
+    m_frames (0),
+    m_accFrames (0),
+    m_pressureFrames (0),
+    m_lastSweepuS (0)
+{
+  memset (&m_frame, 0, sizeof (m_frame));
+}
+
+void SyncSampler::setAccelerometer (ADXL345* _acc, int _int1Pin)
+{
+  m_acc = _acc;
+  m_accPin = _int1Pin;
+}
+
+void SyncSampler::setBarometer (BMP085* _bar, int _eocPin)
+{
+  m_bar = _bar;
+  m_barPin = _eocPin;
+}
+
+void SyncSampler::begin (ISRFunc _tickISR)
+{
+  // The timer would otherwise run at the driver's default, far below the
+  // output rate of every sensor it sweeps
+  m_gyro->setPollInterval ((uint32_t) (1000000.0 / L3G4200D::getOutputRateHz (m_gyro->getOutputRate ())));
+  m_gyro->initAsync (0, _tickISR);
+}
+
+void SyncSampler::tick ()
+{
+  uint32_t startuS = micros ();
+  m_frame.timeuS = startuS;
+  m_frame.fresh = 0;
+
+  // Gyro first, it sets the pace
+  if (m_gyro->readSample (m_frame.gyro, m_frame.gyroOverrun))
+    m_frame.fresh |= FRESH_GYRO;
+
+  // The others only cost a bus transaction when their pin says so
+  if (m_acc && digitalRead (m_accPin) && m_acc->int1ISR ())
+  {
+    m_frame.acc = m_acc->getLatestRaw ();
+    m_frame.fresh |= FRESH_ACC;
+    m_accFrames++;
+  }
+  if (m_bar && digitalRead (m_barPin))
+  {
+    uint32_t samples = m_bar->getPressureSampleCount ();
+    m_bar->eocISR ();
+    if (m_bar->getPressureSampleCount () != samples)
+    {
+      m_frame.pressurePa = m_bar->getPressurePa ();
+      m_frame.fresh |= FRESH_PRESSURE;
+      m_pressureFrames++;
+    }
+  }
+
+  m_frame.sequence = m_frames++;
+  if (m_frameCB && m_frame.fresh)
+    m_frameCB (m_frame);
+  m_lastSweepuS = micros () - startuS;
+}
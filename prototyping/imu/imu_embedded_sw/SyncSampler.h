@@ -0,0 +1,87 @@
+/*
+ * SyncSampler.h - One interrupt sweep over every sensor, clocked by the gyro
+ * Currently just for personal use.
+ */
+#ifndef SYNCSAMPLER_H
+#define SYNCSAMPLER_H
+
+#include "Arduino.h"
+#include "L3G4200D.h"
+#include "ADXL345.h"
+#include "BMP085.h"
+
+// Synchronized sampling.  The gyro's poll timer is the only interrupt; each
+// tick reads, in order,
+//   the gyro, status and sample in one burst,
+//   the accelerometer if INT1 is high (DATA_READY holds it until read),
+//   the barometer if EOC is high (it holds until the next conversion starts),
+// through the drivers' own ISR paths so their subscribers still fire, then
+// hands one frame of whatever was fresh to the frame callback.  Nothing can
+// land in the middle of another sensor's transaction, and the accelerometer
+// and barometer wait at most a gyro period to be read.
+//
+// The accelerometer and barometer are initialized with initAsync (pin, NULL),
+// which leaves the pin as an input without attaching anything to it.  The
+// magnetometer has no data ready line wired and stays polled from loop ().
+class SyncSampler
+{
+ public:
+  // Frame contents, bits of Frame::fresh
+  static const uint8_t FRESH_GYRO     = 0x01;
+  static const uint8_t FRESH_ACC      = 0x02;
+  static const uint8_t FRESH_PRESSURE = 0x04;
+
+  typedef struct frame_struct
+  {
+    uint32_t            timeuS;       // Start of the sweep
+    uint32_t            sequence;
+    uint8_t             fresh;
+    bool                gyroOverrun;
+    L3G4200D::vector16b gyro;         // Zero rate compensated counts
+    ADXL345::vector16b  acc;          // Newest raw counts
+    int32_t             pressurePa;   // Newest compensated pressure
+  } Frame;
+
+  // Callback definitions
+  typedef void (*FrameCallback) (const Frame& _frame);
+
+  // ISRs
+  typedef void (*ISRFunc) (); // should just call SyncSampler::tick
+
+  SyncSampler (L3G4200D* _gyro);
+
+  // Sensors swept after the gyro, each with the pin that flags fresh data.
+  // Set from setup () before begin ().
+  void setAccelerometer (ADXL345* _acc, int _int1Pin);
+  void setBarometer (BMP085* _bar, int _eocPin);
+
+  void registerFrameCallback (FrameCallback _cb) {m_frameCB = _cb;}
+
+  // Starts the gyro's timer on _tickISR in place of its own ISR, one tick
+  // per gyro sample.  A rate change later has to set the poll interval too.
+  void begin (ISRFunc _tickISR);
+
+  // ISR function
+  void tick ();
+
+  // Frames swept and those each sensor was fresh in
+  uint32_t getFrames () {return m_frames;}
+  uint32_t getAccFrames () {return m_accFrames;}
+  uint32_t getPressureFrames () {return m_pressureFrames;}
+  uint32_t getLastSweepuS () {return m_lastSweepuS;}
+ private:
+  L3G4200D*            m_gyro;
+  ADXL345*             m_acc;
+  int                  m_accPin;
+  BMP085*              m_bar;
+  int                  m_barPin;
+  FrameCallback        m_frameCB;
+
+  Frame                m_frame;
+  volatile uint32_t    m_frames;
+  volatile uint32_t    m_accFrames;
+  volatile uint32_t    m_pressureFrames;
+  volatile uint32_t    m_lastSweepuS;
+};
+
+#endif
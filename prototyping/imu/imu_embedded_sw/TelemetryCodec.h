@@ -0,0 +1,89 @@
+/*
+ * TelemetryCodec.h - Delta compressed stream format for CaptureRecords
+ * Currently just for personal use.
+ */
+#ifndef TELEMETRYCODEC_H
+#define TELEMETRYCODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CaptureRecord.h"
+
+// Records are sent in CRC checked blocks, little endian:
+//   sync (2) | flags | sequence | length | payload (length) | crc (2)
+// crc is CRC-16/CCITT from flags to the end of the payload.  Each sample in
+// the payload is a tag byte followed by zigzag varints:
+//   tag          sensor (bits 0-2), TELEMETRY_TAG_3_AXES, TELEMETRY_TAG_SAME_PERIOD
+//   period delta time since the sensor's previous sample minus the previous
+//                such period, left out with TELEMETRY_TAG_SAME_PERIOD
+//   value deltas one per axis, against the sensor's previous sample
+// The predictors of every sensor start from zero at a keyframe block, so a
+// decoder that lost a block picks the stream back up at the next keyframe.
+static const uint16_t TELEMETRY_SYNC          = 0x18E7;
+static const uint8_t  TELEMETRY_HEADER_BYTES  = 5;
+static const uint8_t  TELEMETRY_PAYLOAD_MAX   = 120;
+static const uint8_t  TELEMETRY_BLOCK_MAX     = TELEMETRY_HEADER_BYTES + TELEMETRY_PAYLOAD_MAX + 2;
+
+// Block flags
+static const uint8_t  TELEMETRY_KEYFRAME      = 0x01;
+
+// Sample tag
+static const uint8_t  TELEMETRY_TAG_SENSOR    = 0x07;
+static const uint8_t  TELEMETRY_TAG_3_AXES    = 0x08;
+static const uint8_t  TELEMETRY_TAG_SAME_PERIOD = 0x10;
+
+// Longest encoding of one sample: tag, period and three axes of 5 byte varints
+static const uint8_t  TELEMETRY_SAMPLE_MAX    = 1 + 5 * 4;
+
+// Per sensor state shared by the encoder and decoder
+typedef struct telemetry_predictor_struct
+{
+  uint32_t timeuS;
+  uint32_t perioduS;
+  int32_t  value[3];
+} TelemetryPredictor;
+
+// Differences wrap modulo 2^32 on both ends, so any delta round trips
+inline int32_t wrapDelta (uint32_t _a, uint32_t _b)
+{
+  return (int32_t) (_a - _b);
+}
+
+inline uint32_t zigzagEncode (int32_t _v)
+{
+  return ((uint32_t) _v << 1) ^ (uint32_t) (_v >> 31);
+}
+
+inline int32_t zigzagDecode (uint32_t _v)
+{
+  return (int32_t) (_v >> 1) ^ -(int32_t) (_v & 1);
+}
+
+// 7 bits per byte, low group first, returns the bytes written (1 to 5)
+inline uint8_t putVarint (uint8_t* _out, uint32_t _v)
+{
+  uint8_t n = 0;
+  while (_v >= 0x80)
+  {
+    _out[n++] = (uint8_t) (_v | 0x80);
+    _v >>= 7;
+  }
+  _out[n++] = (uint8_t) _v;
+  return n;
+}
+
+// Returns the byte after the varint, or NULL if it runs past _end or is too long
+inline const uint8_t* getVarint (const uint8_t* _in, const uint8_t* _end, uint32_t& _v)
+{
+  _v = 0;
+  for (uint8_t shift = 0; shift < 35 && _in < _end; shift += 7)
+  {
+    uint8_t b = *_in++;
+    _v |= (uint32_t) (b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return _in;
+  }
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * TelemetryEncoder.cpp - Delta compresses CaptureRecords into telemetry blocks
+ * Currently just for personal use.
+ */
+#include "TelemetryEncoder.h"
+
+#include <string.h>
+#include "Crc16.h"
+
+TelemetryEncoder::TelemetryEncoder ()
+  : m_keyframeInterval (KEYFRAME_INTERVAL_DEFAULT),
+    m_blocksSinceKey (KEYFRAME_INTERVAL_DEFAULT),
+    m_sequence (0),
+    m_flags (0),
+    m_started (false),
+    m_pendingSinceuS (0),
+    m_length (0),
+    m_blockSize (0)
+{
+}
+
+void TelemetryEncoder::startBlock ()
+{
+  m_flags = 0;
+  if (m_blocksSinceKey >= m_keyframeInterval)
+  {
+    // Predictors restart from zero so this block decodes on its own
+    memset (m_state, 0, sizeof (m_state));
+    m_flags |= TELEMETRY_KEYFRAME;
+    m_blocksSinceKey = 0;
+  }
+  m_blocksSinceKey++;
+  m_length = 0;
+  m_started = true;
+}
+
+void TelemetryEncoder::finishBlock ()
+{
+  m_block[0] = TELEMETRY_SYNC & 0xFF;
+  m_block[1] = TELEMETRY_SYNC >> 8;
+  m_block[2] = m_flags;
+  m_block[3] = m_sequence++;
+  m_block[4] = m_length;
+  memcpy (&m_block[TELEMETRY_HEADER_BYTES], m_payload, m_length);
+  uint16_t crc = crc16CCITT (&m_block[2], 3 + m_length);
+  m_block[TELEMETRY_HEADER_BYTES + m_length] = crc & 0xFF;
+  m_block[TELEMETRY_HEADER_BYTES + m_length + 1] = crc >> 8;
+  m_blockSize = TELEMETRY_HEADER_BYTES + m_length + 2;
+  m_length = 0;
+  m_started = false;
+}
+
+bool TelemetryEncoder::encode (const CaptureRecord& _rec)
+{
+  if (_rec.sensor >= CAPTURE_SENSOR_NUM)
+    return false;
+  
+  // Close the block first if the worst case sample might not fit, the next
+  // block may be a keyframe and that changes how the sample is coded
+  bool completed = false;
+  if (m_started && m_length + TELEMETRY_SAMPLE_MAX > TELEMETRY_PAYLOAD_MAX)
+  {
+    finishBlock ();
+    completed = true;
+  }
+  if (!m_started)
+  {
+    startBlock ();
+    m_pendingSinceuS = _rec.timeuS;
+  }
+  
+  TelemetryPredictor& state = m_state[_rec.sensor];
+  uint8_t* out = &m_payload[m_length];
+  uint8_t axes = (_rec.axes == 3) ? 3 : 1;
+  
+  uint8_t tag = _rec.sensor;
+  if (axes == 3)
+    tag |= TELEMETRY_TAG_3_AXES;
+  uint32_t perioduS = _rec.timeuS - state.timeuS;
+  if (perioduS == state.perioduS)
+    tag |= TELEMETRY_TAG_SAME_PERIOD;
+  *out++ = tag;
+  if (!(tag & TELEMETRY_TAG_SAME_PERIOD))
+    out += putVarint (out, zigzagEncode (wrapDelta (perioduS, state.perioduS)));
+  state.timeuS = _rec.timeuS;
+  state.perioduS = perioduS;
+  
+  for (uint8_t i = 0; i < axes; i++)
+  {
+    out += putVarint (out, zigzagEncode (wrapDelta (_rec.value[i], state.value[i])));
+    state.value[i] = _rec.value[i];
+  }
+  
+  m_length = out - m_payload;
+  return completed;
+}
+
+bool TelemetryEncoder::flush ()
+{
+  if (!m_started || m_length == 0)
+    return false;
+  finishBlock ();
+  return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * TelemetryEncoder.h - Delta compresses CaptureRecords into telemetry blocks
+ * Currently just for personal use.
+ */
+#ifndef TELEMETRYENCODER_H
+#define TELEMETRYENCODER_H
+
+#include <stdint.h>
+#include "CaptureRecord.h"
+#include "TelemetryCodec.h"
+
+// Packs records into blocks as described in TelemetryCodec.h.  A sample costs
+// a few adds and shifts, about 5 bytes for a quiet 3 axis sensor against the
+// 20 of a CaptureRecord.  Runs from loop () on the records the ISRs queue.
+class TelemetryEncoder
+{
+ public:
+  static const uint8_t KEYFRAME_INTERVAL_DEFAULT = 16;
+  
+  TelemetryEncoder ();
+  
+  // Blocks from one keyframe to the next, 1 makes every block a keyframe
+  void setKeyframeInterval (uint8_t _blocks) {m_keyframeInterval = (_blocks > 0) ? _blocks : 1;}
+  uint8_t getKeyframeInterval () {return m_keyframeInterval;}
+  
+  // Adds a record.  Returns true if that completed a block, which is then in
+  // getBlock () until the next call to encode or flush.
+  bool encode (const CaptureRecord& _rec);
+  
+  // Completes the pending block early, returns false if it was empty
+  bool flush ();
+  
+  const uint8_t* getBlock () {return m_block;}
+  uint8_t getBlockSize () {return m_blockSize;}
+  
+  // Pending samples and the time of the oldest, for flushing on age
+  bool hasPending () {return m_length > 0;}
+  uint32_t getPendingSinceuS () {return m_pendingSinceuS;}
+  
+  // Start the next block with a keyframe, after a reconnect for instance
+  void forceKeyframe () {m_blocksSinceKey = m_keyframeInterval;}
+ private:
+  void startBlock ();
+  void finishBlock ();
+  
+  TelemetryPredictor m_state[CAPTURE_SENSOR_NUM];
+  uint8_t            m_keyframeInterval;
+  uint8_t            m_blocksSinceKey;
+  uint8_t            m_sequence;
+  uint8_t            m_flags;
+  bool               m_started;
+  uint32_t           m_pendingSinceuS;
+  
+  // Block being filled and the last completed block
+  uint8_t            m_payload[TELEMETRY_PAYLOAD_MAX];
+  uint8_t            m_length;
+  uint8_t            m_block[TELEMETRY_BLOCK_MAX];
+  uint8_t            m_blockSize;
+};
+
+#endif
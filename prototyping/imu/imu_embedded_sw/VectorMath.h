@@ -0,0 +1,206 @@
+/*
+ * VectorMath.h - Vector, matrix and quaternion types shared by the sensor libraries
+ * Currently just for personal use.
+ */
+#ifndef VECTORMATH_H
+#define VECTORMATH_H
+
+#include <stdint.h>
+#include <math.h>
+
+// 3 axis vector.  Kept an aggregate so driver structs stay layout compatible
+// (Vec3<int16_t> is the 6 bytes of a sensor's output registers).
+template <typename T>
+struct Vec3
+{
+  T x;
+  T y;
+  T z;
+
+  Vec3<T>& operator+= (const Vec3<T>& _v) {x += _v.x; y += _v.y; z += _v.z; return *this;}
+  Vec3<T>& operator-= (const Vec3<T>& _v) {x -= _v.x; y -= _v.y; z -= _v.z; return *this;}
+  Vec3<T>& operator*= (T _s) {x *= _s; y *= _s; z *= _s; return *this;}
+};
+
+template <typename T>
+inline Vec3<T> makeVec3 (T _x, T _y, T _z)
+{
+  Vec3<T> v = {_x, _y, _z};
+  return v;
+}
+
+template <typename T>
+inline Vec3<T> operator+ (Vec3<T> _a, const Vec3<T>& _b) {return _a += _b;}
+template <typename T>
+inline Vec3<T> operator- (Vec3<T> _a, const Vec3<T>& _b) {return _a -= _b;}
+template <typename T>
+inline Vec3<T> operator* (Vec3<T> _a, T _s) {return _a *= _s;}
+
+template <typename T>
+inline T dot (const Vec3<T>& _a, const Vec3<T>& _b)
+{
+  return _a.x * _b.x + _a.y * _b.y + _a.z * _b.z;
+}
+
+template <typename T>
+inline Vec3<T> cross (const Vec3<T>& _a, const Vec3<T>& _b)
+{
+  return makeVec3<T> (_a.y * _b.z - _a.z * _b.y,
+                      _a.z * _b.x - _a.x * _b.z,
+                      _a.x * _b.y - _a.y * _b.x);
+}
+
+template <typename T>
+inline T norm (const Vec3<T>& _v)
+{
+  return sqrt (dot (_v, _v));
+}
+
+// Raw to physical conversion of a single sample
+template <typename D, typename S>
+inline Vec3<D> scaleVec3 (const Vec3<S>& _v, D _scale)
+{
+  return makeVec3<D> (((D) _v.x) * _scale, ((D) _v.y) * _scale, ((D) _v.z) * _scale);
+}
+
+// Row major 3x3 matrix
+template <typename T>
+struct Mat3
+{
+  T m[3][3];
+
+  static Mat3<T> identity ()
+  {
+    Mat3<T> r = {{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+    return r;
+  }
+};
+
+template <typename T>
+inline Vec3<T> operator* (const Mat3<T>& _a, const Vec3<T>& _v)
+{
+  return makeVec3<T> (_a.m[0][0] * _v.x + _a.m[0][1] * _v.y + _a.m[0][2] * _v.z,
+                      _a.m[1][0] * _v.x + _a.m[1][1] * _v.y + _a.m[1][2] * _v.z,
+                      _a.m[2][0] * _v.x + _a.m[2][1] * _v.y + _a.m[2][2] * _v.z);
+}
+
+template <typename T>
+inline Mat3<T> operator* (const Mat3<T>& _a, const Mat3<T>& _b)
+{
+  Mat3<T> r;
+  for (uint8_t i = 0; i < 3; i++)
+    for (uint8_t j = 0; j < 3; j++)
+      r.m[i][j] = _a.m[i][0] * _b.m[0][j] + _a.m[i][1] * _b.m[1][j] + _a.m[i][2] * _b.m[2][j];
+  return r;
+}
+
+template <typename T>
+inline Mat3<T> transpose (const Mat3<T>& _a)
+{
+  Mat3<T> r;
+  for (uint8_t i = 0; i < 3; i++)
+    for (uint8_t j = 0; j < 3; j++)
+      r.m[i][j] = _a.m[j][i];
+  return r;
+}
+
+// Unit quaternion rotating body frame vectors into the reference frame
+template <typename T>
+struct Quaternion
+{
+  T w;
+  T x;
+  T y;
+  T z;
+
+  static Quaternion<T> identity ()
+  {
+    Quaternion<T> q = {1, 0, 0, 0};
+    return q;
+  }
+
+  // Rotation of |_rotVec| radians about _rotVec
+  static Quaternion<T> fromRotationVector (const Vec3<T>& _rotVec)
+  {
+    T angle = norm (_rotVec);
+    if (angle < (T) 1e-9)
+    {
+      Quaternion<T> q = {1, _rotVec.x / 2, _rotVec.y / 2, _rotVec.z / 2};
+      return q;
+    }
+    T s = sin (angle / 2) / angle;
+    Quaternion<T> q = {(T) cos (angle / 2), _rotVec.x * s, _rotVec.y * s, _rotVec.z * s};
+    return q;
+  }
+};
+
+template <typename T>
+inline Quaternion<T> operator* (const Quaternion<T>& _a, const Quaternion<T>& _b)
+{
+  Quaternion<T> r = {_a.w * _b.w - _a.x * _b.x - _a.y * _b.y - _a.z * _b.z,
+                     _a.w * _b.x + _a.x * _b.w + _a.y * _b.z - _a.z * _b.y,
+                     _a.w * _b.y - _a.x * _b.z + _a.y * _b.w + _a.z * _b.x,
+                     _a.w * _b.z + _a.x * _b.y - _a.y * _b.x + _a.z * _b.w};
+  return r;
+}
+
+template <typename T>
+inline Quaternion<T> conjugate (const Quaternion<T>& _q)
+{
+  Quaternion<T> r = {_q.w, -_q.x, -_q.y, -_q.z};
+  return r;
+}
+
+template <typename T>
+inline Quaternion<T> normalize (const Quaternion<T>& _q)
+{
+  T n = sqrt (_q.w * _q.w + _q.x * _q.x + _q.y * _q.y + _q.z * _q.z);
+  Quaternion<T> r = {_q.w / n, _q.x / n, _q.y / n, _q.z / n};
+  return r;
+}
+
+template <typename T>
+inline Mat3<T> toMat3 (const Quaternion<T>& _q)
+{
+  T ww = _q.w * _q.w, xx = _q.x * _q.x, yy = _q.y * _q.y, zz = _q.z * _q.z;
+  T xy = _q.x * _q.y, xz = _q.x * _q.z, yz = _q.y * _q.z;
+  T wx = _q.w * _q.x, wy = _q.w * _q.y, wz = _q.w * _q.z;
+  Mat3<T> r = {{{ww + xx - yy - zz, 2 * (xy - wz),     2 * (xz + wy)},
+                {2 * (xy + wz),     ww - xx + yy - zz, 2 * (yz - wx)},
+                {2 * (xz - wy),     2 * (yz + wx),     ww - xx - yy + zz}}};
+  return r;
+}
+
+template <typename T>
+inline Vec3<T> rotate (const Quaternion<T>& _q, const Vec3<T>& _v)
+{
+  return toMat3 (_q) * _v;
+}
+
+//
+// Whole block conversions
+//
+
+// Unpack little endian output registers (ADXL345, L3G4200D FIFO blocks)
+inline void unpackVec3LE (const uint8_t* _bytes, Vec3<int16_t>* _out, uint16_t _n)
+{
+  for (uint16_t i = 0; i < _n; i++, _bytes += 6)
+  {
+    _out[i].x = (int16_t)(_bytes[1] << 8 | _bytes[0]);
+    _out[i].y = (int16_t)(_bytes[3] << 8 | _bytes[2]);
+    _out[i].z = (int16_t)(_bytes[5] << 8 | _bytes[4]);
+  }
+}
+
+// Unpack big endian output registers in X, Z, Y order (HMC5883L)
+inline void unpackVec3BEXZY (const uint8_t* _bytes, Vec3<int16_t>* _out, uint16_t _n)
+{
+  for (uint16_t i = 0; i < _n; i++, _bytes += 6)
+  {
+    _out[i].x = (int16_t)(_bytes[0] << 8 | _bytes[1]);
+    _out[i].z = (int16_t)(_bytes[2] << 8 | _bytes[3]);
+    _out[i].y = (int16_t)(_bytes[4] << 8 | _bytes[5]);
+  }
+}
+
+#endif
@@ -1,54 +1,396 @@
 #include "Wire.h"
+#include "SPI.h"
+#include "EEPROM.h"
+#include "BusTransport.h"
+#include "BusManager.h"
+#include "DMABlockReader.h"
 #include "L3G4200D.h"
 #include "ADXL345.h"
 #include "HMC5883L.h"
 #include "BMP085.h"
+#include "CaptureRecord.h"
+#include "CalibrationBlob.h"
+#include "CommandFrame.h"
+#include "CommandParser.h"
+#include "TelemetryEncoder.h"
+#include "RateGovernor.h"
+#include "InsEKF.h"
+#include "PreIntegrator.h"
+#include "ISRDispatch.h"
+#include "SensorVoter.h"
+#include "SyncSampler.h"
 
 // LED blinking
 const int LED = 13;
 int led_val = LOW;
 
+// Uncomment to put the gyro and accelerometer on SPI.  The breakout ties both
+// CS pins to 3.3V, so they have to be rewired, and SPI takes pins 11-13 so
+// INT1 and the LED have to move too.
+//#define IMU_USE_SPI
+
+// Uncomment to read the gyro in 32 sample blocks through a block reader.  The
+// CPU engine stands in until the bus has a DMA capable driver.
+//#define IMU_BLOCK_READ
+
+// Uncomment to stream raw samples as binary CaptureRecords for the host noise
+// tool (imu_host_tools/imu_noise_tool) instead of printing text
+//#define IMU_CAPTURE_OUTPUT
+
+// Uncomment to delta compress the capture stream (TelemetryCodec.h), about
+// a quarter of the bytes, so full rate gyro, accelerometer and magnetometer
+// data fits through 115200 baud.  imu_host_tools/imu_telemetry_codec decodes
+// it back to CaptureRecords.
+//#define IMU_COMPRESSED_OUTPUT
+#ifdef IMU_COMPRESSED_OUTPUT
+#define IMU_CAPTURE_OUTPUT
+#endif
+
+// Uncomment to let the accelerometer's activity and inactivity engines drop it
+// to a low output rate while the board sits still, and bring it back to full
+// rate on the first motion
+//#define IMU_MOTION_WAKE
+
+// Uncomment to let the rate governor (RateGovernor.h) raise and lower the
+// sensor rates together with motion, backing off when the bus or CPU can't
+// keep up.  It takes over the idle rate drop of IMU_MOTION_WAKE.
+//#define IMU_RATE_GOVERNOR
+#if defined (IMU_RATE_GOVERNOR) && defined (IMU_MOTION_WAKE)
+#error "IMU_RATE_GOVERNOR and IMU_MOTION_WAKE both set the accelerometer rate"
+#endif
+
+// Uncomment to record every sensor bus transaction into a RAM ring
+// (BusTrace.h).  An overrun freezes it, and the uplink tool's trace command
+// reads it back for imu_host_tools/imu_bus_trace.
+//#define IMU_BUS_TRACE
+#ifdef IMU_BUS_TRACE
+BusTrace           g_busTrace;
+#endif
+
+// Uncomment to run the INS filter (InsEKF.h) on all four sensors and print
+// its attitude, velocity and height with the text output.
+// imu_host_tools/imu_ins_bench checks the filter against a dense one.
+//#define IMU_INS
+#if defined (IMU_INS) && defined (IMU_CAPTURE_OUTPUT)
+#error "IMU_INS reports through the text output, which IMU_CAPTURE_OUTPUT replaces"
+#endif
+
+// Uncomment to add a second gyro and accelerometer at their alternate I2C
+// addresses and vote each pair (SensorVoter.h).  The pairs have to sample in
+// step, so nothing may change the rate of one unit alone.
+//#define IMU_REDUNDANT
+#if defined (IMU_REDUNDANT) && (defined (IMU_USE_SPI) || defined (IMU_BLOCK_READ) || \
+                                defined (IMU_RATE_GOVERNOR) || defined (IMU_MOTION_WAKE))
+#error "IMU_REDUNDANT needs both pairs on I2C, read per sample at fixed rates"
+#endif
+
+// Uncomment to read the gyro, accelerometer and barometer in one ordered
+// sweep from the gyro's timer (SyncSampler.h) instead of from three ISRs.
+// imu_host_tools/imu_sync_bench compares the interrupt and bus load.
+//#define IMU_SYNC_SAMPLING
+#if defined (IMU_SYNC_SAMPLING) && (defined (IMU_BLOCK_READ) || defined (IMU_REDUNDANT))
+#error "IMU_SYNC_SAMPLING reads the gyro per sample, and only the first pair"
+#endif
+
+// Uncomment to move the gyro to the Teensy's second I2C bus (Wire1, pins
+// 29/30 on the bottom pads, the gyro on a breakout of its own) and account
+// both buses through a BusManager (BusManager.h).  Of the placements on two
+// 100 kHz buses imu_host_tools/imu_bus_placement ranks the gyro alone first,
+// about three times the sample rate one bus holds.
+//#define IMU_MULTI_BUS
+#if defined (IMU_MULTI_BUS) && defined (IMU_USE_SPI)
+#error "IMU_USE_SPI already takes the gyro off Wire"
+#endif
+
+// Uncomment to address each I2C device at the fastest speed mode it takes
+// (BusTransport.h): the gyro and accelerometer at 400 kHz, the magnetometer
+// and barometer in 3.4 MHz high speed mode.  The transports switch the
+// clock between devices.  imu_host_tools/imu_i2c_speed_bench models the gain
+// for each mix of sensors.
+//#define IMU_FAST_I2C
+
+// What the drivers are built with (float outputs, imperial units, polled
+// reads, the pressure filter, callback slots) is set in ImuConfig.h, as the
+// defines here don't reach the drivers' own files.
+// imu_host_tools/imu_size_report lists the flash and RAM each build takes.
+#if (IMU_CFG_SUBSCRIBERS == 0) && (defined (IMU_CAPTURE_OUTPUT) || defined (IMU_RATE_GOVERNOR) || \
+                                   defined (IMU_REDUNDANT) || defined (IMU_INS))
+#error "IMU_CFG_SUBSCRIBERS 0 leaves the sketch's driver callbacks unfed"
+#endif
+
+// Sensor buses
+const uint32_t    I2C_CLOCK_HZ = 100000;  // Wire's default
+#ifdef IMU_MULTI_BUS
+// Blocking Wire reads stand in for DMA until Wire has a non-blocking driver,
+// so for now the buses overlap only between transactions
+CPUDMAEngine      g_wireEngine;
+CPUDMAEngine      g_wire1Engine;
+BusQueue          g_wireBus ("Wire", BusQueue::BUS_I2C, I2C_CLOCK_HZ, &g_wireEngine);
+BusQueue          g_wire1Bus ("Wire1", BusQueue::BUS_I2C, I2C_CLOCK_HZ, &g_wire1Engine);
+BusManager        g_busManager;
+uint32_t          g_busLastBusyuS[BusManager::MAX_BUSES];
+uint32_t          g_busLastWaits[BusManager::MAX_BUSES];
+uint32_t          g_busLastTimemS = 0;
+#endif
+
 // Gyro
+#ifdef IMU_USE_SPI
+const int GYRO_CS_PIN = 9;
+SPITransport         g_gyroSpi (GYRO_CS_PIN, L3G4200D::SPI_CLOCK_HZ, L3G4200D::SPI_MULTI_BYTE);
+L3G4200D             g_gyro (&g_gyroSpi);
+#elif defined (IMU_MULTI_BUS)
+I2CTransport         g_gyroI2c (L3G4200D::ADDRESS, L3G4200D::I2C_AUTO_INC, &Wire1, L3G4200D::I2C_MAX_SPEED);
+L3G4200D             g_gyro (&g_gyroI2c);
+#else
 L3G4200D             g_gyro;
+#endif
 L3G4200D::vector16b  g_rawRotVel;
+const double         GYRO_DPS_PER_LSB = 0.00875;  // 250 dps full scale
+#ifdef IMU_BLOCK_READ
+#ifdef IMU_MULTI_BUS
+// Bursts queue behind whatever else is on Wire1
+DMABlockReader       g_gyroBlockReader (&g_wire1Bus);
+#else
+CPUDMAEngine         g_gyroDMA;
+DMABlockReader       g_gyroBlockReader (&g_gyroDMA);
+#endif
+#endif
 
 // Accelerometer
 const int INT1_PIN = 11;
+#ifdef IMU_USE_SPI
+const int ACC_CS_PIN = 10;
+SPITransport       g_accSpi (ACC_CS_PIN, ADXL345::SPI_CLOCK_HZ, ADXL345::SPI_MULTI_BYTE);
+ADXL345            g_acc (&g_accSpi);
+#else
 ADXL345            g_acc;
-ADXL345::vector16b g_rawAcc;
-ADXL345::vectord   g_accmG;
-double             g_accPitch = 0.0;
-double             g_accRoll = 0.0;
+#endif
+
+// Accelerometer events.  Free fall is flagged by the part itself, so it is
+// seen on the first sample below threshold rather than after filtering.
+const double       ACC_FREE_FALL_MG = 400.0;
+const double       ACC_FREE_FALL_MS = 150.0;
+volatile uint32_t  g_accFreeFalls = 0;
+#ifdef IMU_MOTION_WAKE
+const double       ACC_ACTIVITY_MG = 250.0;
+const double       ACC_INACTIVITY_MG = 125.0;
+const uint8_t      ACC_INACTIVITY_S = 5;
+const ADXL345::OUTPUT_RATE ACC_IDLE_RATE = ADXL345::RATE_12P5HZ;
+ADXL345::OUTPUT_RATE g_accActiveRate;
+#endif
+volatile bool      g_accIdle = false;
 
 // Magnometer
 HMC5883L magno;
 HMC5883L::vector16b rawMagno;
 
-// Barometer and thermometer
+// Calibration blobs from imu_cal_tool, programmed back to back at the start
+// of EEPROM.  Erased or stale blobs fail the CRC and are ignored.
+const int ACC_CALIBRATION_ADDR = 0;
+const int MAG_CALIBRATION_ADDR = sizeof (CalibrationBlob);
+
+// Barometer and thermometer.  The text output reads its values lazily from
+// loop (), so the ISR only converts what the capture subscribes to.
 const int EOC_PIN = 14;
 BMP085     g_barTemp;
-int16_t    g_bmp085RawTemp = 0;
-double     g_bmp085TempC = 0.0;
-double     g_bmp085TempF = 0.0;
-int32_t    g_bmp085RawPressure = 0.0;
-double     g_bmp085PressurehPa = 0.0;
-double     g_bmp085AltitudeM = 0.0;
-double     g_bmp085AltitudeF = 0.0;
-double     g_bmp085VerticalSpeedMpS = 0.0;
-double     g_bmp085VerticalSpeedFpS = 0.0;
-
-// ISRs
-void l3g4200dInt2ISR ()
+uint32_t   g_bmp085LastPressureSamples = 0;
+uint32_t   g_bmp085LastRateTimemS = 0;
+
+#ifdef IMU_SYNC_SAMPLING
+SyncSampler g_syncSampler (&g_gyro);
+uint32_t    g_syncLastFrames = 0;
+uint32_t    g_syncLastAccFrames = 0;
+uint32_t    g_syncLastPressureFrames = 0;
+uint32_t    g_syncLastTimemS = 0;
+#endif
+
+// ISR timing
+volatile uint32_t g_gyroISRTimeuS = 0;
+volatile uint32_t g_gyroISRCount = 0;
+volatile uint32_t g_accISRTimeuS = 0;
+volatile uint32_t g_accISRCount = 0;
+
+// Bus and ISR counters.  The text stats and the governor each keep their own
+// snapshot and work on deltas, so neither resets the other's window.
+typedef struct load_counters_struct
+{
+  uint32_t timemS;
+  uint32_t gyroBytes;
+  uint32_t accBytes;
+  uint32_t gyroISRTimeuS;
+  uint32_t gyroISRCount;
+  uint32_t accISRTimeuS;
+  uint32_t accISRCount;
+} LoadCounters;
+LoadCounters      g_statsCounters;
+
+#ifdef IMU_RATE_GOVERNOR
+// Sensor settings of each governor level.  The gyro timer polls at the output
+// rate, or once per FIFO watermark with the block reader.  Agile fits 100 kHz
+// I2C with the block reader; polled, the governor holds it back to cruise.
+// imu_host_tools/imu_governor_sim mirrors this table.
+typedef struct rate_profile_struct
+{
+  L3G4200D::OUTPUT_RATE gyroRate;
+  uint8_t               gyroSamplesPerBurst;
+  ADXL345::OUTPUT_RATE  accRate;
+  BMP085::OSSR_SETTING  barOSSR;
+} RateProfile;
+const RateProfile RATE_PROFILES[RateGovernor::LEVEL_NUM] =
+{
+  {L3G4200D::RATE_100HZ, 16, ADXL345::RATE_12P5HZ, BMP085::OSSR_ULTRA_HIGH_RES},
+  {L3G4200D::RATE_200HZ, 8,  ADXL345::RATE_100HZ,  BMP085::OSSR_HIGH_RES},
+  {L3G4200D::RATE_400HZ, 16, ADXL345::RATE_100HZ,  BMP085::OSSR_HIGH_RES}
+};
+const uint32_t    GOVERNOR_PERIOD_MS = 250;
+RateGovernor      g_governor;
+LoadCounters      g_governorCounters;
+uint32_t          g_governorLogged = 0;
+
+// Motion energy sums for the governor period, filled by the sensor callbacks.
+// The gyro sums squared counts so the fast ISR stays integer.
+volatile uint64_t g_motionGyroSumSq = 0;
+volatile uint32_t g_motionGyroCount = 0;
+volatile double   g_motionAccSumSq = 0.0;
+volatile uint32_t g_motionAccCount = 0;
+
+void addGyroMotion (const L3G4200D::vector16b& _rawRotVel)
+{
+  g_motionGyroSumSq += (int32_t) _rawRotVel.x * _rawRotVel.x +
+                       (int32_t) _rawRotVel.y * _rawRotVel.y +
+                       (int32_t) _rawRotVel.z * _rawRotVel.z;
+  g_motionGyroCount++;
+}
+#endif
+
+#ifdef IMU_INS
+// The sensor ISRs pre-integrate every sample (PreIntegrator.h) and the
+// filter steps from loop () every period on the increment since the last
+// step, so its cost doesn't grow with the output rates.  The gyro and
+// accelerometer ISRs share the integrator, they run at the same priority.
+const uint32_t    INS_PERIOD_MS = 10;
+InsEKF            g_ins;
+bool              g_insStarted = false;
+uint32_t          g_insLastuS = 0;
+uint32_t          g_insLastPressureSamples = 0;
+InsEKF::vectorf   g_insAcc;
+uint32_t          g_insPredictuS = 0;
+uint32_t          g_insUpdateuS = 0;
+uint16_t          g_insStepSamples = 0;
+
+PreIntegrator     g_insPreint;
+float             g_insGyroPeriodS = 0.01f;
+
+// Time each gyro sample stands for.  Polled without a FIFO the ISR reads one
+// sample a timer period, however fast the gyro samples.
+void setGyroPeriodINS ()
+{
+  double periodS = 1.0 / L3G4200D::getOutputRateHz (g_gyro.getOutputRate ());
+#ifndef IMU_BLOCK_READ
+  double pollS = g_gyro.getPollInterval () / 1000000.0;
+  if (pollS > periodS)
+    periodS = pollS;
+#endif
+  g_insGyroPeriodS = (float) periodS;
+}
+
+void addGyroINS (const L3G4200D::vector16b& _rawRotVel)
+{
+  g_insPreint.addGyro (scaleVec3<float> (_rawRotVel, (float) (GYRO_DPS_PER_LSB * DEG_TO_RAD)), g_insGyroPeriodS);
+}
+#endif
+
+#ifdef IMU_REDUNDANT
+// Second pair, at the alternate addresses on the same bus.  With only two
+// units the voters average and catch stale or saturated units; a unit that
+// disagrees can't be told from the other, so the output holds while they
+// disagree.
+const int            ACC_ALT_INT1_PIN = 15;
+L3G4200D             g_gyroAlt (NULL, L3G4200D::ADDRESS_ALT);
+ADXL345              g_accAlt (NULL, ADXL345::ADDRESS_ALT);
+const uint8_t        IMU_UNITS = 2;
+const float          GYRO_VOTE_RANGE = 32000.0f;    // counts, short of full scale
+const float          GYRO_VOTE_THRESHOLD = 800.0f;  // counts, 7 dps
+const float          ACC_VOTE_RANGE = 3900.0f;      // mg, short of RANGE_4G
+const float          ACC_VOTE_THRESHOLD = 150.0f;   // mg
+SensorVoter          g_gyroVoter (IMU_UNITS, GYRO_VOTE_RANGE, GYRO_VOTE_THRESHOLD);
+SensorVoter          g_accVoter (IMU_UNITS, ACC_VOTE_RANGE, ACC_VOTE_THRESHOLD);
+
+// From the sensor callbacks.  Only the INS takes the voted samples, capture,
+// the governor and the text output still see the first unit's own
+void voteGyro (uint8_t _unit, const L3G4200D::vector16b& _rawRotVel)
+{
+  if (!g_gyroVoter.submit (_unit, scaleVec3<float> (_rawRotVel, 1.0f)) || g_gyroVoter.getUsed () == 0)
+    return;
+#ifdef IMU_INS
+  // Scaled from the float mean as addGyroINS does, rounding it back to
+  // counts would throw away what averaging the units gained
+  g_insPreint.addGyro (scaleVec3<float> (g_gyroVoter.getVoted (), (float) (GYRO_DPS_PER_LSB * DEG_TO_RAD)), g_insGyroPeriodS);
+#endif
+}
+#endif
+
+// Uplink commands from imu_host_tools/imu_uplink_tool, read a bounded number
+// of bytes per loop so a burst of input can't hold up the sample output
+const uint8_t     COMMAND_BYTES_PER_LOOP = 64;
+CommandParser     g_commandParser;
+
+#ifdef IMU_CAPTURE_OUTPUT
+// Filled by the sensor callbacks, drained by loop ().  The producers are pin
+// ISRs at the same priority or loop () with interrupts off, so they never race
+// each other.
+const uint16_t    CAPTURE_RING_SIZE = 64; // must be a power of two
+CaptureRecord     g_captureRing[CAPTURE_RING_SIZE];
+volatile uint16_t g_captureHead = 0;
+volatile uint16_t g_captureTail = 0;
+volatile uint32_t g_captureDropped = 0;
+
+void captureSample (CAPTURE_SENSOR _sensor, uint8_t _axes, int32_t _x, int32_t _y, int32_t _z)
+{
+  uint16_t next = (g_captureHead + 1) & (CAPTURE_RING_SIZE - 1);
+  if (next == g_captureTail)
+  {
+    g_captureDropped++;
+    return;
+  }
+  
+  CaptureRecord& rec = g_captureRing[g_captureHead];
+  rec.sync = CAPTURE_SYNC;
+  rec.sensor = _sensor;
+  rec.axes = _axes;
+  rec.timeuS = micros ();
+  rec.value[0] = _x;
+  rec.value[1] = _y;
+  rec.value[2] = _z;
+  g_captureHead = next;
+}
+#endif
+
+#ifdef IMU_COMPRESSED_OUTPUT
+// A block is sent when full or when its oldest sample is this old
+const uint32_t    TELEMETRY_FLUSH_US = 20000;
+TelemetryEncoder  g_telemetryEncoder;
+#endif
+
+// ISRs.  The gyro and accelerometer ones are attached through ISRDispatch
+// with the device as context, so every unit shares them.
+void l3g4200dInt2ISR (void* _gyro)
 {
   //noInterrupts ();
-  g_gyro.int2ISR ();
+  uint32_t startuS = micros ();
+  ((L3G4200D*) _gyro)->int2ISR ();
+  g_gyroISRTimeuS += micros () - startuS;
+  g_gyroISRCount++;
   //interrupts ();
 }
 
-void adxl345Int1ISR ()
+void adxl345Int1ISR (void* _acc)
 {
   //noInterrupts ();
-  g_acc.int1ISR ();
+  uint32_t startuS = micros ();
+  ((ADXL345*) _acc)->int1ISR ();
+  g_accISRTimeuS += micros () - startuS;
+  g_accISRCount++;
   //interrupts ();
 }
 
@@ -59,57 +401,617 @@ void bmp085EOCISR ()
   //interrupts ();
 }
 
+#ifdef IMU_SYNC_SAMPLING
+// The whole sweep counts as gyro ISR time for the load figures
+void syncTickISR ()
+{
+  uint32_t startuS = micros ();
+  g_syncSampler.tick ();
+  g_gyroISRTimeuS += micros () - startuS;
+  g_gyroISRCount++;
+}
+#endif
+
 // Callbacks
 void l3g4200dRotationalVelocityCallback (L3G4200D::vector16b _rawRotVel)
 {
   g_rawRotVel = _rawRotVel;
+#ifdef IMU_RATE_GOVERNOR
+  addGyroMotion (_rawRotVel);
+#endif
+#ifdef IMU_REDUNDANT
+  voteGyro (0, _rawRotVel);
+#elif defined (IMU_INS)
+  addGyroINS (_rawRotVel);
+#endif
+#ifdef IMU_CAPTURE_OUTPUT
+  captureSample (CAPTURE_GYRO, 3, _rawRotVel.x, _rawRotVel.y, _rawRotVel.z);
+#endif
+}
+
+#ifdef IMU_REDUNDANT
+void l3g4200dAltRotationalVelocityCallback (L3G4200D::vector16b _rawRotVel)
+{
+  voteGyro (1, _rawRotVel);
+}
+#endif
+
+#ifdef IMU_BLOCK_READ
+void l3g4200dBlockCallback (const uint8_t* _block, uint16_t _samples)
+{
+  // Zero rate compensated as int2ISR does per sample
+  L3G4200D::vector16b zeroRate = g_gyro.getZeroRate ();
+#if defined (IMU_RATE_GOVERNOR) || defined (IMU_INS) || defined (IMU_CAPTURE_OUTPUT)
+  for (uint16_t i = 0; i < _samples; i++)
+  {
+    L3G4200D::vector16b rawRotVel;
+    unpackVec3LE (&_block[i * 6], &rawRotVel, 1);
+    rawRotVel += zeroRate;
+#ifdef IMU_RATE_GOVERNOR
+    addGyroMotion (rawRotVel);
+#endif
+#ifdef IMU_INS
+    addGyroINS (rawRotVel);
+#endif
+#ifdef IMU_CAPTURE_OUTPUT
+    captureSample (CAPTURE_GYRO, 3, rawRotVel.x, rawRotVel.y, rawRotVel.z);
+#endif
+  }
+#endif
+  
+  // Keep the newest sample of the block, then give the buffer back
+  unpackVec3LE (&_block[(_samples - 1) * 6], &g_rawRotVel, 1);
+  g_rawRotVel += zeroRate;
+  g_gyroBlockReader.releaseBlock ();
 }
+#endif
 
 void l3g4200dOverrunCallback ()
 {
   //Serial.println ("L3G4200D Overrun!");
+#ifdef IMU_BUS_TRACE
+  g_busTrace.freeze ();
+#endif
+}
+
+#ifdef IMU_SYNC_SAMPLING
+// The accelerometer and barometer subscribers already ran in the sweep, the
+// gyro's go through here
+void syncFrameCallback (const SyncSampler::Frame& _frame)
+{
+  if (_frame.fresh & SyncSampler::FRESH_GYRO)
+    l3g4200dRotationalVelocityCallback (_frame.gyro);
+  if (_frame.gyroOverrun)
+    l3g4200dOverrunCallback ();
+}
+#endif
+
+#ifdef IMU_CAPTURE_OUTPUT
+void adxl345RawCallback (ADXL345::vector16b _rawAcc)
+{
+  captureSample (CAPTURE_ACC, 3, _rawAcc.x, _rawAcc.y, _rawAcc.z);
+}
+#endif
+
+#ifdef IMU_RATE_GOVERNOR
+void adxl345MotionCallback (ADXL345::vectord _accmG)
+{
+  double dev = sqrt (_accmG.x * _accmG.x + _accmG.y * _accmG.y + _accmG.z * _accmG.z) - 1000.0;
+  g_motionAccSumSq += dev * dev;
+  g_motionAccCount++;
+}
+
+// Runs from updateGovernor () with interrupts held off, like an uplink SET
+void governorTransitionCallback (const RateGovernor::Transition& _transition)
+{
+  const RateProfile& profile = RATE_PROFILES[_transition.to];
+  g_gyro.setOutputRate (profile.gyroRate);
+#ifdef IMU_BLOCK_READ
+  // Also sets the poll interval from the burst
+  g_gyro.setBlockReader (&g_gyroBlockReader, profile.gyroSamplesPerBurst);
+#else
+  g_gyro.setPollInterval ((uint32_t) (1000000.0 / L3G4200D::getOutputRateHz (profile.gyroRate)));
+#endif
+  g_acc.setOutputRate (profile.accRate);
+  g_barTemp.setAsyncOSSR (profile.barOSSR);
+#ifdef IMU_INS
+  setGyroPeriodINS ();
+#endif
+}
+#endif
+
+#ifdef IMU_INS
+void adxl345INSCallback (ADXL345::vectord _accmG)
+{
+  g_insPreint.addAcc (scaleVec3<float> (_accmG, (float) (InsEKF::GRAVITY_MPS2 / 1000.0)));
+}
+#endif
+
+#ifdef IMU_REDUNDANT
+void voteAcc (uint8_t _unit, const ADXL345::vectord& _accmG)
+{
+  if (!g_accVoter.submit (_unit, scaleVec3<float> (_accmG, 1.0f)) || g_accVoter.getUsed () == 0)
+    return;
+#ifdef IMU_INS
+  adxl345INSCallback (scaleVec3<imu_real> (g_accVoter.getVoted (), 1));
+#endif
+}
+
+void adxl345VoteCallback (ADXL345::vectord _accmG)
+{
+  voteAcc (0, _accmG);
 }
 
-void adxl345AccelerationCallback (ADXL345::vector16b _rawAcc, ADXL345::vectord _accmG)
+void adxl345AltVoteCallback (ADXL345::vectord _accmG)
 {
-  g_rawAcc = _rawAcc;
-  g_accmG = _accmG;
+  voteAcc (1, _accmG);
 }
+#endif
 
-void adxl345PitchRollCallback (double _pitch, double _roll)
+void adxl345EventCallback (ADXL345::EVENT _event, uint8_t _axes)
 {
-  g_accPitch = _pitch;
-  g_accRoll = _roll;
+  switch (_event)
+  {
+    case ADXL345::EVENT_FREE_FALL:
+      g_accFreeFalls++;
+      break;
+#ifdef IMU_MOTION_WAKE
+    case ADXL345::EVENT_INACTIVITY:
+      if (!g_accIdle)
+      {
+        g_accActiveRate = g_acc.getOutputRate ();
+        g_acc.setOutputRate (ACC_IDLE_RATE);
+        g_accIdle = true;
+      }
+      break;
+    case ADXL345::EVENT_ACTIVITY:
+      if (g_accIdle)
+      {
+        g_acc.setOutputRate (g_accActiveRate);
+        g_accIdle = false;
+      }
+      break;
+#endif
+    default:
+      break;
+  }
 }
 
 void adxl345OverrunCallback ()
 {
   Serial.println ("ADXL345 Overrun!");
+#ifdef IMU_BUS_TRACE
+  g_busTrace.freeze ();
+#endif
+}
+
+#ifdef IMU_CAPTURE_OUTPUT
+void bmp085RawTempCallback (imu_real _rawTemp)
+{
+  captureSample (CAPTURE_TEMP, 1, (int32_t) _rawTemp, 0, 0);
+}
+
+void bmp085RawPressureCallback (imu_real _rawPressure)
+{
+  captureSample (CAPTURE_PRESSURE, 1, (int32_t) _rawPressure, 0, 0);
+}
+#endif
+
+// Uplink commands
+uint8_t getSetting (uint8_t _setting)
+{
+  switch (_setting)
+  {
+    case SETTING_ACC_OUTPUT_RATE:     return g_acc.getOutputRate ();
+    case SETTING_ACC_RANGE:           return g_acc.getRange ();
+    case SETTING_ACC_FULL_RES:        return g_acc.getFullRes ();
+    case SETTING_ACC_LP_FILTER:       return g_acc.getLPFilter ();
+    case SETTING_BAR_OSSR:            return g_barTemp.getAsyncOSSR ();
+    case SETTING_BAR_AVG_FILTER:      return g_barTemp.getAvgFilter ();
+    case SETTING_BAR_TEMP_DECIMATION: return g_barTemp.getTempDecimation ();
+    default:                          return 0;
+  }
+}
+
+bool settingValid (uint8_t _setting, uint8_t _value)
+{
+  switch (_setting)
+  {
+    case SETTING_ACC_OUTPUT_RATE:     return _value < ADXL345::RATE_NUM;
+    case SETTING_ACC_RANGE:           return _value < ADXL345::RANGE_NUM;
+    case SETTING_ACC_FULL_RES:
+    case SETTING_ACC_LP_FILTER:
+    case SETTING_BAR_AVG_FILTER:      return _value <= 1;
+    case SETTING_BAR_OSSR:            return _value < BMP085::OSSR_NUM;
+    case SETTING_BAR_TEMP_DECIMATION: return _value > 0;
+    default:                          return false;
+  }
+}
+
+void applyAccSetting (ADXL345& _acc, uint8_t _setting, uint8_t _value)
+{
+  switch (_setting)
+  {
+    case SETTING_ACC_OUTPUT_RATE:     _acc.setOutputRate ((ADXL345::OUTPUT_RATE) _value); break;
+    case SETTING_ACC_RANGE:           _acc.setRange ((ADXL345::RANGE_SETTING) _value); break;
+    case SETTING_ACC_FULL_RES:        _acc.setFullRes (_value != 0); break;
+    case SETTING_ACC_LP_FILTER:       _acc.setLPFilter (_value != 0); break;
+    default:                          break;
+  }
+}
+
+void applySetting (uint8_t _setting, uint8_t _value)
+{
+  switch (_setting)
+  {
+    case SETTING_ACC_OUTPUT_RATE:
+    case SETTING_ACC_RANGE:
+    case SETTING_ACC_FULL_RES:
+    case SETTING_ACC_LP_FILTER:
+      applyAccSetting (g_acc, _setting, _value);
+#ifdef IMU_REDUNDANT
+      // The voted pair has to stay at the same rate and scale
+      applyAccSetting (g_accAlt, _setting, _value);
+#endif
+      break;
+    case SETTING_BAR_OSSR:            g_barTemp.setAsyncOSSR ((BMP085::OSSR_SETTING) _value); break;
+    case SETTING_BAR_AVG_FILTER:      g_barTemp.setAvgFilter (_value != 0); break;
+    case SETTING_BAR_TEMP_DECIMATION: g_barTemp.setTempDecimation (_value); break;
+    default:                          break;
+  }
+}
+
+// Acks go out in the same stream as the text or capture output, the host
+// picks them out by their sync word and CRC
+void sendAckData (const CommandFrame& _frame, COMMAND_STATUS _status, const uint8_t* _data, uint8_t _length)
+{
+  CommandFrame ack;
+  ack.command = COMMAND_ACK;
+  ack.sequence = _frame.sequence;
+  ack.payload[0] = _frame.command;
+  ack.payload[1] = _status;
+  ack.length = 2 + _length;
+  memcpy (&ack.payload[2], _data, _length);
+  
+  uint8_t bytes[COMMAND_FRAME_MAX];
+  Serial.write (bytes, encodeCommandFrame (ack, bytes));
+}
+
+void sendAck (const CommandFrame& _frame, COMMAND_STATUS _status, const uint8_t* _settings, uint8_t _count)
+{
+  uint8_t pairs[2 * SETTING_NUM];
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    pairs[2 * i] = _settings[i];
+    pairs[2 * i + 1] = getSetting (_settings[i]);
+  }
+  sendAckData (_frame, _status, pairs, 2 * _count);
+}
+
+#ifdef IMU_BUS_TRACE
+void handleTrace (const CommandFrame& _frame)
+{
+  uint8_t data[COMMAND_PAYLOAD_MAX - 2];
+  uint8_t length = 0;
+  
+  if (_frame.length < 1)
+  {
+    sendAck (_frame, STATUS_BAD_LENGTH, NULL, 0);
+    return;
+  }
+  switch (_frame.payload[0])
+  {
+    case TRACE_FREEZE:
+    {
+      g_busTrace.freeze ();
+      uint16_t count = g_busTrace.getCount ();
+      uint32_t total = g_busTrace.getTotal ();
+      memcpy (&data[0], &count, 2);
+      memcpy (&data[2], &total, 4);
+      memcpy (&data[6], &I2C_CLOCK_HZ, 4);
+      length = 10;
+      break;
+    }
+      
+    case TRACE_READ:
+    {
+      // Reading a live ring would tear records, the host freezes it first
+      if (_frame.length != 3)
+      {
+        sendAck (_frame, STATUS_BAD_LENGTH, NULL, 0);
+        return;
+      }
+      uint16_t index = _frame.payload[1] | (_frame.payload[2] << 8);
+      if (!g_busTrace.isFrozen () || index > g_busTrace.getCount ())
+      {
+        sendAck (_frame, STATUS_BAD_VALUE, NULL, 0);
+        return;
+      }
+      memcpy (&data[0], &index, 2);
+      length = 2;
+      for (uint8_t i = 0; i < TRACE_RECORDS_PER_FRAME && index + i < g_busTrace.getCount (); i++)
+      {
+        memcpy (&data[length], &g_busTrace.getRecord (index + i), sizeof (BusTraceRecord));
+        length += sizeof (BusTraceRecord);
+      }
+      break;
+    }
+      
+    case TRACE_RESUME:
+      g_busTrace.resume ();
+      break;
+      
+    default:
+      sendAck (_frame, STATUS_BAD_VALUE, NULL, 0);
+      return;
+  }
+  sendAckData (_frame, STATUS_OK, data, length);
+}
+#endif
+
+void handleCommand (const CommandFrame& _frame)
+{
+  uint8_t settings[SETTING_NUM];
+  uint8_t count = 0;
+  
+  switch (_frame.command)
+  {
+    case COMMAND_PING:
+      sendAck (_frame, STATUS_OK, NULL, 0);
+      break;
+      
+    case COMMAND_SET:
+      if ((_frame.length & 1) || _frame.length > 2 * SETTING_NUM)
+      {
+        sendAck (_frame, STATUS_BAD_LENGTH, NULL, 0);
+        break;
+      }
+      
+      // Check the whole frame first, it is applied completely or not at all
+      for (uint8_t i = 0; i < _frame.length; i += 2)
+      {
+        if (_frame.payload[i] >= SETTING_NUM || !settingValid (_frame.payload[i], _frame.payload[i + 1]))
+        {
+          sendAck (_frame, (_frame.payload[i] >= SETTING_NUM) ? STATUS_BAD_SETTING : STATUS_BAD_VALUE, NULL, 0);
+          return;
+        }
+        settings[count++] = _frame.payload[i];
+      }
+      
+      // The ISRs run before or after the whole change, never in the middle
+      // of it, so no sample is taken with half of a configuration
+      noInterrupts ();
+      for (uint8_t i = 0; i < _frame.length; i += 2)
+        applySetting (_frame.payload[i], _frame.payload[i + 1]);
+      interrupts ();
+      sendAck (_frame, STATUS_OK, settings, count);
+      break;
+      
+    case COMMAND_GET:
+      if (_frame.length > SETTING_NUM)
+      {
+        sendAck (_frame, STATUS_BAD_LENGTH, NULL, 0);
+        break;
+      }
+      for (uint8_t i = 0; i < _frame.length; i++)
+      {
+        if (_frame.payload[i] >= SETTING_NUM)
+        {
+          sendAck (_frame, STATUS_BAD_SETTING, NULL, 0);
+          return;
+        }
+        settings[count++] = _frame.payload[i];
+      }
+      
+      // None named means all of them
+      if (count == 0)
+        for (uint8_t i = 0; i < SETTING_NUM; i++)
+          settings[count++] = i;
+      sendAck (_frame, STATUS_OK, settings, count);
+      break;
+      
+    case COMMAND_WRITE_CALIBRATION:
+    {
+      if (_frame.length != sizeof (CalibrationBlob))
+      {
+        sendAck (_frame, STATUS_BAD_LENGTH, NULL, 0);
+        break;
+      }
+      CalibrationBlob blob;
+      memcpy (&blob, _frame.payload, sizeof (blob));
+      bool acc = calibrationValid (blob, CAPTURE_ACC);
+      if (!acc && !calibrationValid (blob, CAPTURE_MAG))
+      {
+        sendAck (_frame, STATUS_BAD_VALUE, NULL, 0);
+        break;
+      }
+      
+      // Stored first so the board comes back up with it
+      EEPROM.put (acc ? ACC_CALIBRATION_ADDR : MAG_CALIBRATION_ADDR, blob);
+      noInterrupts ();
+      if (acc)
+        g_acc.loadCalibration (blob);
+      else
+        magno.loadCalibration (blob);
+      interrupts ();
+      sendAck (_frame, STATUS_OK, NULL, 0);
+      break;
+    }
+      
+#ifdef IMU_BUS_TRACE
+    case COMMAND_TRACE:
+      handleTrace (_frame);
+      break;
+#endif
+      
+    default:
+      sendAck (_frame, STATUS_UNKNOWN_COMMAND, NULL, 0);
+      break;
+  }
+}
+
+void pollCommands ()
+{
+  for (uint8_t i = 0; i < COMMAND_BYTES_PER_LOOP && Serial.available () > 0; i++)
+  {
+    if (g_commandParser.feed ((uint8_t) Serial.read ()))
+      handleCommand (g_commandParser.getFrame ());
+  }
 }
 
-void bmp085TempCallback (int16_t _rawTemp, double _tempC, double _tempF)
+//
+// Load and governor
+//
+
+void readLoadCounters (LoadCounters& _counters)
 {
-  g_bmp085RawTemp = _rawTemp;
-  g_bmp085TempC = _tempC;
-  g_bmp085TempF = _tempF;
+  noInterrupts ();
+  _counters.timemS = millis ();
+  _counters.gyroBytes = g_gyro.getBus ()->getBytes ();
+  _counters.accBytes = g_acc.getBus ()->getBytes ();
+  _counters.gyroISRTimeuS = g_gyroISRTimeuS;
+  _counters.gyroISRCount = g_gyroISRCount;
+  _counters.accISRTimeuS = g_accISRTimeuS;
+  _counters.accISRCount = g_accISRCount;
+  interrupts ();
 }
-void bmp085PressureCallback (int32_t _rawPressure, double _pressurehPa)
+
+#ifdef IMU_RATE_GOVERNOR
+void updateGovernor ()
 {
-  g_bmp085RawPressure = _rawPressure;
-  g_bmp085PressurehPa = _pressurehPa;
+  if (millis () - g_governorCounters.timemS < GOVERNOR_PERIOD_MS)
+    return;
+  
+  LoadCounters counters;
+  readLoadCounters (counters);
+  double periodS = (counters.timemS - g_governorCounters.timemS) / 1000.0;
+  uint32_t gyroBytes = counters.gyroBytes - g_governorCounters.gyroBytes;
+  uint32_t accBytes = counters.accBytes - g_governorCounters.accBytes;
+  uint32_t isruS = (counters.gyroISRTimeuS - g_governorCounters.gyroISRTimeuS) +
+                   (counters.accISRTimeuS - g_governorCounters.accISRTimeuS);
+  g_governorCounters = counters;
+  
+  // Bus time of the gyro and accelerometer traffic, 9 clocks per I2C byte
+#ifdef IMU_USE_SPI
+  double busS = gyroBytes * 8.0 / L3G4200D::SPI_CLOCK_HZ + accBytes * 8.0 / ADXL345::SPI_CLOCK_HZ;
+#elif defined (IMU_MULTI_BUS)
+  // Separate buses, the busier one limits
+  double busS = max (gyroBytes * 9.0 / g_gyro.getBus ()->getClockHz (), accBytes * 9.0 / g_acc.getBus ()->getClockHz ());
+#else
+  double busS = gyroBytes * 9.0 / g_gyro.getBus ()->getClockHz () + accBytes * 9.0 / g_acc.getBus ()->getClockHz ();
+#endif
+  double busLoad = busS / periodS;
+  double cpuLoad = isruS / (periodS * 1000000.0);
+  
+  noInterrupts ();
+  double gyroMeanSq = g_motionGyroCount ? (double) g_motionGyroSumSq / g_motionGyroCount : 0.0;
+  double accMeanSq = g_motionAccCount ? g_motionAccSumSq / g_motionAccCount : 0.0;
+  g_motionGyroSumSq = 0;
+  g_motionGyroCount = 0;
+  g_motionAccSumSq = 0.0;
+  g_motionAccCount = 0;
+  double energy = gyroMeanSq * GYRO_DPS_PER_LSB * GYRO_DPS_PER_LSB + accMeanSq * RateGovernor::ACC_ENERGY_WEIGHT;
+  g_governor.update (counters.timemS, energy, busLoad, cpuLoad);
+  interrupts ();
 }
 
-void bmp085AltitudeCallback (double _altitudeM, double _altitudeF)
+void printGovernorTransitions ()
 {
-  g_bmp085AltitudeM = _altitudeM;
-  g_bmp085AltitudeF = _altitudeF;
+  // Anything older than the log has already been overwritten
+  uint32_t count = g_governor.getTransitionCount ();
+  if (count - g_governorLogged > RateGovernor::LOG_SIZE)
+    g_governorLogged = count - RateGovernor::LOG_SIZE;
+  
+  for (; g_governorLogged < count; g_governorLogged++)
+  {
+    const RateGovernor::Transition* t = g_governor.getTransition (g_governorLogged);
+    Serial.println ("RateTransition:");
+    Serial.print ("TimemS=");
+    Serial.println (t->timemS, DEC);
+    Serial.print ("From=");
+    Serial.println (RateGovernor::levelName ((RateGovernor::LEVEL) t->from));
+    Serial.print ("To=");
+    Serial.println (RateGovernor::levelName ((RateGovernor::LEVEL) t->to));
+    Serial.print ("Reason=");
+    Serial.println (RateGovernor::reasonName ((RateGovernor::REASON) t->reason));
+    Serial.print ("Energy=");
+    Serial.println (t->energy, DEC);
+    Serial.print ("BusLoad=");
+    Serial.println (t->busLoad, DEC);
+    Serial.print ("CpuLoad=");
+    Serial.println (t->cpuLoad, DEC);
+    Serial.println ("");
+  }
 }
+#endif
 
-void bmp085VerticalSpeedCallback (double _verticalSpeedMpS, double _verticalSpeedFpS)
+#ifdef IMU_INS
+//
+// INS
+//
+
+void updateINS ()
 {
-  g_bmp085VerticalSpeedMpS = _verticalSpeedMpS;
-  g_bmp085VerticalSpeedFpS = _verticalSpeedFpS;
+  uint32_t nowuS = micros ();
+  if (nowuS - g_insLastuS < INS_PERIOD_MS * 1000)
+    return;
+  
+  // Take the increment and poll the magnetometer with the ISRs held off, as
+  // the capture output does
+  noInterrupts ();
+  PreIntegrator::Increment increment;
+  if (!g_insPreint.take (increment))
+  {
+    interrupts ();
+    return;
+  }
+  bool hasAcc = g_insPreint.hasAcc ();
+  bool magReady = magno.readReg (HMC5883L::STATUS_REG) & HMC5883L::RDY_MASK;
+  HMC5883L::vectorf mag;
+  if (magReady)
+    mag = magno.readCalibrated ();
+  interrupts ();
+  
+  g_insLastuS = nowuS;
+  g_insStepSamples = increment.gyroSamples;
+  uint32_t pressureSamples = g_barTemp.getPressureSampleCount ();
+  
+  // The mean specific force over the step, for levelling and the gravity
+  // update
+  if (increment.accSamples > 0)
+    g_insAcc = increment.dVelocity * (1.0f / increment.dt);
+  
+  // Starts on the first accelerometer, magnetometer and pressure samples,
+  // with the board held still
+  if (!g_insStarted)
+  {
+    if (!hasAcc || increment.accSamples == 0 || !magReady || pressureSamples == 0)
+      return;
+    g_ins.reset (g_insAcc, mag, g_barTemp.read (BMP085::ALTITUDE_M));
+    g_insLastPressureSamples = pressureSamples;
+    g_insStarted = true;
+    return;
+  }
+  
+  uint32_t startuS = micros ();
+  g_ins.predictDelta (increment.dt, increment.dAngle, increment.dVelocity);
+  uint32_t predictuS = micros ();
+  if (increment.accSamples > 0)
+    g_ins.updateGravity (g_insAcc);
+  if (magReady)
+    g_ins.updateHeading (mag);
+  if (pressureSamples != g_insLastPressureSamples)
+  {
+    g_ins.updateAltitude (g_barTemp.read (BMP085::ALTITUDE_M));
+    g_insLastPressureSamples = pressureSamples;
+  }
+  if (g_ins.isStationary ())
+    g_ins.updateZeroVelocity ();
+  uint32_t enduS = micros ();
+  g_insPredictuS = predictuS - startuS;
+  g_insUpdateuS = enduS - predictuS;
 }
+#endif
 
 //
 // Main Program
@@ -124,48 +1026,231 @@ void setup ()
   
   // Begin com libs
   Wire.begin();
+#ifdef IMU_MULTI_BUS
+  Wire1.begin ();
+#endif
   Serial.begin(115200);
   
   noInterrupts ();
   
+#ifdef IMU_BUS_TRACE
+  // Attached first so the trace starts with the sensors' init traffic
+  g_gyro.getBus ()->setTrace (&g_busTrace);
+  g_acc.getBus ()->setTrace (&g_busTrace);
+  magno.getBus ()->setTrace (&g_busTrace);
+  g_barTemp.getBus ()->setTrace (&g_busTrace);
+#endif
+  
+#ifdef IMU_USE_SPI
+  g_gyroSpi.begin ();
+  g_accSpi.begin ();
+#endif
+  
+#ifdef IMU_MULTI_BUS
+  g_busManager.addBus (&g_wireBus);
+  g_busManager.addBus (&g_wire1Bus);
+  g_wire1Bus.bind (g_gyro.getBus ());
+  g_wireBus.bind (g_acc.getBus ());
+  g_wireBus.bind (magno.getBus ());
+  g_wireBus.bind (g_barTemp.getBus ());
+#ifdef IMU_REDUNDANT
+  g_wireBus.bind (g_gyroAlt.getBus ());
+  g_wireBus.bind (g_accAlt.getBus ());
+#endif
+  for (uint8_t b = 0; b < g_busManager.getBusCount (); b++)
+  {
+    g_busLastBusyuS[b] = g_busManager.getBus (b)->getBusyuS ();
+    g_busLastWaits[b] = g_busManager.getBus (b)->getWaits ();
+  }
+  g_busLastTimemS = millis ();
+#endif
+  
   // Initialize gyro for async mode
   g_gyro.registerRotationalVelocityCallback (l3g4200dRotationalVelocityCallback);
   g_gyro.registerOverrunCallback (l3g4200dOverrunCallback);
   g_gyro.init ();
   g_gyro.calibrateZeroRate ();
-  g_gyro.initAsync (0, l3g4200dInt2ISR);
+#ifndef IMU_SYNC_SAMPLING
+  g_gyro.initAsync (0, ISRDispatch::attach (l3g4200dInt2ISR, &g_gyro));
+#endif
+#ifdef IMU_BLOCK_READ
+  g_gyroBlockReader.registerBlockCallback (l3g4200dBlockCallback);
+  g_gyro.setBlockReader (&g_gyroBlockReader, 8);
+#endif
+#ifdef IMU_INS
+  setGyroPeriodINS ();
+#endif
    
   // Initialize accelerometer for async mode
-  g_acc.registerAccelerationCallback (adxl345AccelerationCallback);
-  g_acc.registerPitchRollCallback (adxl345PitchRollCallback);
+#ifdef IMU_CAPTURE_OUTPUT
+  g_acc.subscribe (adxl345RawCallback);
+#endif
+  g_acc.subscribe (adxl345EventCallback);
+#ifdef IMU_RATE_GOVERNOR
+  g_acc.subscribe (adxl345MotionCallback);
+#endif
+#ifdef IMU_REDUNDANT
+  g_acc.subscribe (adxl345VoteCallback);
+#elif defined (IMU_INS)
+  g_acc.subscribe (adxl345INSCallback);
+#endif
   g_acc.registerOverrunCallback (adxl345OverrunCallback);
   g_acc.setRange (ADXL345::RANGE_4G);
   g_acc.setFullRes (true);
   g_acc.setLPFilter (true);
   g_acc.setOutputRate (ADXL345::RATE_50HZ);
   g_acc.init ();
-  g_acc.calibrateOffset ();
-  g_acc.initAsync (INT1_PIN, adxl345Int1ISR);  
+  CalibrationBlob calBlob;
+  EEPROM.get (ACC_CALIBRATION_ADDR, calBlob);
+  if (!g_acc.loadCalibration (calBlob))
+  {
+#ifndef IMU_CAPTURE_OUTPUT
+    // Fall back to the single position offsets, captures stay uncorrected
+    g_acc.calibrateOffset ();
+#endif
+  }
+  
+  // Events share INT1 with DATA_READY, the ISR reads INT_SOURCE either way
+  g_acc.configureFreeFall (ACC_FREE_FALL_MG, ACC_FREE_FALL_MS);
+  g_acc.enableEvent (ADXL345::EVENT_FREE_FALL, false);
+#ifdef IMU_MOTION_WAKE
+  // Linked, so activity is only reported after inactivity and vice versa
+  g_acc.setLinkMode (true);
+  g_acc.configureActivity (ACC_ACTIVITY_MG, ADXL345::AXIS_ALL, true);
+  g_acc.configureInactivity (ACC_INACTIVITY_MG, ACC_INACTIVITY_S, ADXL345::AXIS_ALL, true);
+  g_acc.enableEvent (ADXL345::EVENT_ACTIVITY, false);
+  g_acc.enableEvent (ADXL345::EVENT_INACTIVITY, false);
+#endif
+#ifdef IMU_SYNC_SAMPLING
+  g_acc.initAsync (INT1_PIN, NULL);
+#else
+  g_acc.initAsync (INT1_PIN, ISRDispatch::attach (adxl345Int1ISR, &g_acc));
+#endif
+  
+#ifdef IMU_REDUNDANT
+  // Second pair set up like the first.  The EEPROM blob belongs to the first
+  // accelerometer, the second gets single position offsets.
+  g_gyroAlt.registerRotationalVelocityCallback (l3g4200dAltRotationalVelocityCallback);
+  g_gyroAlt.registerOverrunCallback (l3g4200dOverrunCallback);
+  g_gyroAlt.init ();
+  g_gyroAlt.calibrateZeroRate ();
+  g_gyroAlt.initAsync (0, ISRDispatch::attach (l3g4200dInt2ISR, &g_gyroAlt));
+  g_accAlt.subscribe (adxl345AltVoteCallback);
+  g_accAlt.registerOverrunCallback (adxl345OverrunCallback);
+  g_accAlt.setRange (ADXL345::RANGE_4G);
+  g_accAlt.setFullRes (true);
+  g_accAlt.setLPFilter (true);
+  g_accAlt.setOutputRate (ADXL345::RATE_50HZ);
+  g_accAlt.init ();
+  g_accAlt.calibrateOffset ();
+  g_accAlt.initAsync (ACC_ALT_INT1_PIN, ISRDispatch::attach (adxl345Int1ISR, &g_accAlt));
+#endif
                                          
   // Configure magnometer
   //magno.writeReg (HMC5883L::CONFIG_REGA, HMC5883L::SAMPLES_AVG_1 |
   //                                       HMC5883L::DOR_75_HZ);
   //magno.writeReg (HMC5883L::MODE_REG, HMC5883L::CONTINUOUS_MODE);
+  EEPROM.get (MAG_CALIBRATION_ADDR, calBlob);
+  magno.loadCalibration (calBlob);
+#if defined (IMU_CAPTURE_OUTPUT) || defined (IMU_INS)
+  magno.writeReg (HMC5883L::CONFIG_REGA, HMC5883L::SAMPLES_AVG_1 |
+                                         HMC5883L::DOR_75_HZ);
+  magno.writeReg (HMC5883L::MODE_REG, HMC5883L::CONTINUOUS_MODE);
+#endif
+  
+#ifdef IMU_FAST_I2C
+  // After the MODE_REG writes above, which clear the magnetometer's high
+  // speed bit.  Each is clamped to what its part takes.
+  g_gyro.setI2CSpeed (I2C_HIGH_SPEED);
+  g_acc.setI2CSpeed (I2C_HIGH_SPEED);
+  magno.setI2CSpeed (I2C_HIGH_SPEED);
+  g_barTemp.setI2CSpeed (I2C_HIGH_SPEED);
+#ifdef IMU_REDUNDANT
+  g_gyroAlt.setI2CSpeed (I2C_HIGH_SPEED);
+  g_accAlt.setI2CSpeed (I2C_HIGH_SPEED);
+#endif
+#ifdef IMU_MULTI_BUS
+  g_wireBus.setGroupBySpeed (true);
+  g_wire1Bus.setGroupBySpeed (true);
+#endif
+#endif
   
   // Initalize barTemp for async mode
-  g_barTemp.registerTemperatureCallback (bmp085TempCallback);
-  g_barTemp.registerPressureCallback (bmp085PressureCallback);
-  g_barTemp.registerAltitudeCallback (bmp085AltitudeCallback);
-  g_barTemp.registerVerticalSpeedCallback (bmp085VerticalSpeedCallback);
+#ifdef IMU_CAPTURE_OUTPUT
+  g_barTemp.subscribe (BMP085::RAW_TEMP, bmp085RawTempCallback);
+  g_barTemp.subscribe (BMP085::RAW_PRESSURE, bmp085RawPressureCallback);
+#endif
   g_barTemp.setAsyncOSSR (BMP085::OSSR_ULTRA_HIGH_RES);
   g_barTemp.setAvgFilter (true);
+  g_barTemp.setTempDecimation (16);
+#ifdef IMU_SYNC_SAMPLING
+  g_barTemp.initAsync (EOC_PIN, NULL);
+  
+  // The gyro's timer starts once everything it sweeps is set up
+  g_syncSampler.setAccelerometer (&g_acc, INT1_PIN);
+  g_syncSampler.setBarometer (&g_barTemp, EOC_PIN);
+  g_syncSampler.registerFrameCallback (syncFrameCallback);
+  g_syncSampler.begin (syncTickISR);
+#else
   g_barTemp.initAsync (EOC_PIN, bmp085EOCISR);
+#endif
+  
+#ifdef IMU_RATE_GOVERNOR
+  // Start from the idle profile rather than the fixed rates above
+  g_governor.registerTransitionCallback (governorTransitionCallback);
+  RateGovernor::Transition boot = {0, RateGovernor::LEVEL_IDLE, RateGovernor::LEVEL_IDLE, RateGovernor::REASON_STILL, 0.0f, 0.0f, 0.0f};
+  governorTransitionCallback (boot);
+#endif
   
   interrupts ();
+  
+  readLoadCounters (g_statsCounters);
+#ifdef IMU_RATE_GOVERNOR
+  g_governorCounters = g_statsCounters;
+#endif
 }
 
 void loop ()
 {
+  pollCommands ();
+#ifdef IMU_RATE_GOVERNOR
+  updateGovernor ();
+#endif
+#ifdef IMU_INS
+  updateINS ();
+#endif
+  
+#ifdef IMU_CAPTURE_OUTPUT
+  // The magnetometer has no interrupt, poll it with the ISRs held off so
+  // they can't cut into the Wire transaction
+  noInterrupts ();
+  if (magno.readReg (HMC5883L::STATUS_REG) & HMC5883L::RDY_MASK)
+  {
+    HMC5883L::vector16b rawMag = magno.readRaw ();
+    captureSample (CAPTURE_MAG, 3, rawMag.x, rawMag.y, rawMag.z);
+  }
+  interrupts ();
+  
+  // Raw records only, the text output would corrupt the stream
+  while (g_captureTail != g_captureHead)
+  {
+#ifdef IMU_COMPRESSED_OUTPUT
+    if (g_telemetryEncoder.encode (g_captureRing[g_captureTail]))
+      Serial.write (g_telemetryEncoder.getBlock (), g_telemetryEncoder.getBlockSize ());
+#else
+    Serial.write ((const uint8_t*) &g_captureRing[g_captureTail], sizeof (CaptureRecord));
+#endif
+    g_captureTail = (g_captureTail + 1) & (CAPTURE_RING_SIZE - 1);
+  }
+#ifdef IMU_COMPRESSED_OUTPUT
+  if (g_telemetryEncoder.hasPending () &&
+      micros () - g_telemetryEncoder.getPendingSinceuS () >= TELEMETRY_FLUSH_US &&
+      g_telemetryEncoder.flush ())
+    Serial.write (g_telemetryEncoder.getBlock (), g_telemetryEncoder.getBlockSize ());
+#endif
+  return;
+#endif
+  
   // Flash LED
   if (led_val == LOW)
   {
@@ -179,45 +1264,69 @@ void loop ()
   };
   
   // Print accelerometer data
+  ADXL345::vector16b rawAcc = g_acc.readLatestRaw ();
+  ADXL345::vectord accmG = g_acc.readMilliG ();
+  imu_real accPitch, accRoll;
+  g_acc.readPitchRoll (accPitch, accRoll);
   Serial.println ("Accelerometer:");
   Serial.print ("RawX=");
-  Serial.println (g_rawAcc.x, DEC);
+  Serial.println (rawAcc.x, DEC);
   Serial.print ("RawY=");
-  Serial.println (g_rawAcc.y, DEC);
+  Serial.println (rawAcc.y, DEC);
   Serial.print ("RawZ=");
-  Serial.println (g_rawAcc.z, DEC);
+  Serial.println (rawAcc.z, DEC);
   Serial.print ("AccXmg=");
-  Serial.println (g_accmG.x, DEC);
+  Serial.println (accmG.x, DEC);
   Serial.print ("AccYmg=");
-  Serial.println (g_accmG.y, DEC);
+  Serial.println (accmG.y, DEC);
   Serial.print ("AccZmg=");
-  Serial.println (g_accmG.z, DEC);
+  Serial.println (accmG.z, DEC);
   Serial.print ("Pitch=");
-  Serial.println (g_accPitch, DEC);
+  Serial.println (accPitch, DEC);
   Serial.print ("Roll=");
-  Serial.println (g_accRoll, DEC);
+  Serial.println (accRoll, DEC);
+  Serial.print ("FreeFalls=");
+  Serial.println (g_accFreeFalls, DEC);
+  Serial.print ("Idle=");
+  Serial.println (g_accIdle ? 1 : 0, DEC);
   Serial.println ("");
   
   // Print barometer and thermometer data
   Serial.println ("Barometer and Thermometer:");
   Serial.print ("RawTemp=");
-  Serial.println (g_bmp085RawTemp, DEC);
+  Serial.println ((int16_t) g_barTemp.read (BMP085::RAW_TEMP), DEC);
   Serial.print ("TempC=");
-  Serial.println (g_bmp085TempC, DEC);
+  Serial.println (g_barTemp.read (BMP085::TEMP_C), DEC);
+#ifndef IMU_CFG_NO_IMPERIAL
   Serial.print ("TempF=");
-  Serial.println (g_bmp085TempF, DEC);
+  Serial.println (g_barTemp.read (BMP085::TEMP_F), DEC);
+#endif
   Serial.print ("RawPressure=");
-  Serial.println (g_bmp085RawPressure, DEC);
+  Serial.println ((int32_t) g_barTemp.read (BMP085::RAW_PRESSURE), DEC);
   Serial.print ("PressurehPa=");
-  Serial.println (g_bmp085PressurehPa, DEC);
+  Serial.println (g_barTemp.read (BMP085::PRESSURE_HPA), DEC);
   Serial.print ("AltitudeM=");
-  Serial.println (g_bmp085AltitudeM, DEC);
+  Serial.println (g_barTemp.read (BMP085::ALTITUDE_M), DEC);
+#ifndef IMU_CFG_NO_IMPERIAL
   Serial.print ("AltitudeF=");
-  Serial.println (g_bmp085AltitudeF, DEC);
+  Serial.println (g_barTemp.read (BMP085::ALTITUDE_F), DEC);
+#endif
   Serial.print ("VerticalSpeedMpS=");
-  Serial.println (g_bmp085VerticalSpeedMpS, DEC);
+  Serial.println (g_barTemp.read (BMP085::VERTICAL_SPEED_MPS), DEC);
+#ifndef IMU_CFG_NO_IMPERIAL
   Serial.print ("VerticalSpeedFpS=");
-  Serial.println (g_bmp085VerticalSpeedFpS, DEC);
+  Serial.println (g_barTemp.read (BMP085::VERTICAL_SPEED_FPS), DEC);
+#endif
+  
+  // Measured pressure sample rate against the expected rate for the OSSR setting
+  uint32_t pressureSamples = g_barTemp.getPressureSampleCount ();
+  uint32_t rateTimemS = millis ();
+  Serial.print ("PressureRateHz=");
+  Serial.println (((double) (pressureSamples - g_bmp085LastPressureSamples) * 1000.0) / (rateTimemS - g_bmp085LastRateTimemS), DEC);
+  Serial.print ("ExpectedPressureRateHz=");
+  Serial.println (g_barTemp.getPressureSampleRate (g_barTemp.getAsyncOSSR ()), DEC);
+  g_bmp085LastPressureSamples = pressureSamples;
+  g_bmp085LastRateTimemS = rateTimemS;
   Serial.println ("");
  
   // Print gyro data
@@ -230,6 +1339,177 @@ void loop ()
   Serial.println (g_rawRotVel.z, DEC);
   Serial.println ("");
   
+  // Print bus throughput and ISR time for the gyro and accelerometer
+  LoadCounters counters;
+  readLoadCounters (counters);
+  uint32_t gyroBytes = counters.gyroBytes - g_statsCounters.gyroBytes;
+  uint32_t accBytes = counters.accBytes - g_statsCounters.accBytes;
+  uint32_t gyroISRs = counters.gyroISRCount - g_statsCounters.gyroISRCount;
+  uint32_t accISRs = counters.accISRCount - g_statsCounters.accISRCount;
+  double gyroISRuS = gyroISRs ? ((double) (counters.gyroISRTimeuS - g_statsCounters.gyroISRTimeuS) / gyroISRs) : 0.0;
+  double accISRuS = accISRs ? ((double) (counters.accISRTimeuS - g_statsCounters.accISRTimeuS) / accISRs) : 0.0;
+  double busStatsS = (counters.timemS - g_statsCounters.timemS) / 1000.0;
+  g_statsCounters = counters;
+  Serial.println ("Bus:");
+  Serial.print ("GyroBytesPerS=");
+  Serial.println (gyroBytes / busStatsS, DEC);
+  Serial.print ("GyroISRuS=");
+  Serial.println (gyroISRuS, DEC);
+  Serial.print ("AccBytesPerS=");
+  Serial.println (accBytes / busStatsS, DEC);
+  Serial.print ("AccISRuS=");
+  Serial.println (accISRuS, DEC);
+  Serial.println ("");
+  
+#ifdef IMU_MULTI_BUS
+  // Load of each bus from the bytes of the transports bound to it, and the
+  // queued transfers that had to wait for another on the same bus
+  uint32_t busTimemS = millis ();
+  double busesS = (busTimemS - g_busLastTimemS) / 1000.0;
+  Serial.println ("Buses:");
+  for (uint8_t b = 0; b < g_busManager.getBusCount (); b++)
+  {
+    BusQueue* bus = g_busManager.getBus (b);
+    noInterrupts ();
+    uint32_t busBusyuS = bus->getBusyuS ();
+    uint32_t busWaits = bus->getWaits ();
+    interrupts ();
+    Serial.print (bus->getName ());
+    Serial.print ("Load=");
+    Serial.println ((busBusyuS - g_busLastBusyuS[b]) / (busesS * 1000000.0), DEC);
+    Serial.print (bus->getName ());
+    Serial.print ("WaitsPerS=");
+    Serial.println ((busWaits - g_busLastWaits[b]) / busesS, DEC);
+    Serial.print (bus->getName ());
+    Serial.print ("MaxDepth=");
+    Serial.println (bus->getMaxDepth (), DEC);
+    g_busLastBusyuS[b] = busBusyuS;
+    g_busLastWaits[b] = busWaits;
+  }
+  g_busLastTimemS = busTimemS;
+  Serial.println ("");
+#endif
+  
+#ifdef IMU_SYNC_SAMPLING
+  // Sweeps per second and how many found each sensor fresh
+  noInterrupts ();
+  uint32_t syncFrames = g_syncSampler.getFrames ();
+  uint32_t syncAccFrames = g_syncSampler.getAccFrames ();
+  uint32_t syncPressureFrames = g_syncSampler.getPressureFrames ();
+  uint32_t syncSweepuS = g_syncSampler.getLastSweepuS ();
+  interrupts ();
+  uint32_t syncTimemS = millis ();
+  double syncS = (syncTimemS - g_syncLastTimemS) / 1000.0;
+  Serial.println ("Sync:");
+  Serial.print ("SweepsPerS=");
+  Serial.println ((syncFrames - g_syncLastFrames) / syncS, DEC);
+  Serial.print ("AccFramesPerS=");
+  Serial.println ((syncAccFrames - g_syncLastAccFrames) / syncS, DEC);
+  Serial.print ("PressureFramesPerS=");
+  Serial.println ((syncPressureFrames - g_syncLastPressureFrames) / syncS, DEC);
+  Serial.print ("SweepuS=");
+  Serial.println (syncSweepuS, DEC);
+  Serial.println ("");
+  g_syncLastFrames = syncFrames;
+  g_syncLastAccFrames = syncAccFrames;
+  g_syncLastPressureFrames = syncPressureFrames;
+  g_syncLastTimemS = syncTimemS;
+#endif
+  
+#ifdef IMU_RATE_GOVERNOR
+  Serial.println ("Governor:");
+  Serial.print ("Level=");
+  Serial.println (RateGovernor::levelName (g_governor.getLevel ()));
+  Serial.println ("");
+  printGovernorTransitions ();
+#endif
+  
+#ifdef IMU_REDUNDANT
+  noInterrupts ();
+  SensorVoter::vectorf votedRotVel = g_gyroVoter.getVoted ();
+  uint8_t gyroUsed = g_gyroVoter.getUsed ();
+  SensorVoter::vectorf votedAcc = g_accVoter.getVoted ();
+  uint8_t accUsed = g_accVoter.getUsed ();
+  interrupts ();
+  Serial.println ("Redundancy:");
+  Serial.print ("GyroUsed=");
+  Serial.println (gyroUsed, DEC);
+  Serial.print ("GyroXdps=");
+  Serial.println (votedRotVel.x * GYRO_DPS_PER_LSB, DEC);
+  Serial.print ("GyroYdps=");
+  Serial.println (votedRotVel.y * GYRO_DPS_PER_LSB, DEC);
+  Serial.print ("GyroZdps=");
+  Serial.println (votedRotVel.z * GYRO_DPS_PER_LSB, DEC);
+  Serial.print ("AccUsed=");
+  Serial.println (accUsed, DEC);
+  Serial.print ("AccXmg=");
+  Serial.println (votedAcc.x, DEC);
+  Serial.print ("AccYmg=");
+  Serial.println (votedAcc.y, DEC);
+  Serial.print ("AccZmg=");
+  Serial.println (votedAcc.z, DEC);
+  for (uint8_t u = 0; u < IMU_UNITS; u++)
+  {
+    Serial.print ("Gyro");
+    Serial.print (u, DEC);
+    Serial.print ("Fault=");
+    Serial.println (SensorVoter::faultName (g_gyroVoter.getFault (u)));
+    Serial.print ("Acc");
+    Serial.print (u, DEC);
+    Serial.print ("Fault=");
+    Serial.println (SensorVoter::faultName (g_accVoter.getFault (u)));
+  }
+  Serial.println ("");
+#endif
+  
+#ifdef IMU_INS
+  float insRoll, insPitch, insYaw;
+  g_ins.getEuler (insRoll, insPitch, insYaw);
+  InsEKF::vectorf insVel = g_ins.getVelocity ();
+  InsEKF::vectorf insGyroBias = g_ins.getGyroBias ();
+  InsEKF::vectorf insAccBias = g_ins.getAccBias ();
+  Serial.println ("INS:");
+  Serial.print ("Started=");
+  Serial.println (g_insStarted ? 1 : 0, DEC);
+  Serial.print ("Roll=");
+  Serial.println (insRoll * RAD_TO_DEG, DEC);
+  Serial.print ("Pitch=");
+  Serial.println (insPitch * RAD_TO_DEG, DEC);
+  Serial.print ("Yaw=");
+  Serial.println (insYaw * RAD_TO_DEG, DEC);
+  Serial.print ("VelXMpS=");
+  Serial.println (insVel.x, DEC);
+  Serial.print ("VelYMpS=");
+  Serial.println (insVel.y, DEC);
+  Serial.print ("VelZMpS=");
+  Serial.println (insVel.z, DEC);
+  Serial.print ("HeightM=");
+  Serial.println (g_ins.getPosition ().z, DEC);
+  Serial.print ("GyroBiasXdps=");
+  Serial.println (insGyroBias.x * RAD_TO_DEG, DEC);
+  Serial.print ("GyroBiasYdps=");
+  Serial.println (insGyroBias.y * RAD_TO_DEG, DEC);
+  Serial.print ("GyroBiasZdps=");
+  Serial.println (insGyroBias.z * RAD_TO_DEG, DEC);
+  Serial.print ("AccBiasXmg=");
+  Serial.println (insAccBias.x * 1000.0 / InsEKF::GRAVITY_MPS2, DEC);
+  Serial.print ("AccBiasYmg=");
+  Serial.println (insAccBias.y * 1000.0 / InsEKF::GRAVITY_MPS2, DEC);
+  Serial.print ("AccBiasZmg=");
+  Serial.println (insAccBias.z * 1000.0 / InsEKF::GRAVITY_MPS2, DEC);
+  Serial.print ("Stationary=");
+  Serial.println (g_ins.isStationary () ? 1 : 0, DEC);
+  Serial.print ("GyroSamplesPerStep=");
+  Serial.println (g_insStepSamples, DEC);
+  Serial.print ("PredictuS=");
+  Serial.println (g_insPredictuS, DEC);
+  Serial.print ("UpdateuS=");
+  Serial.println (g_insUpdateuS, DEC);
+  Serial.print ("Rejected=");
+  Serial.println (g_ins.getRejected (), DEC);
+  Serial.println ("");
+#endif
+  
   /*
   // Update magnometer data
   //val = acc.readReg (HMC5883L::STATUS_REG);
@@ -249,5 +1529,12 @@ void loop ()
   Serial.println (rawMagno.z, DEC);
   Serial.println ("");*/
   
+#ifdef IMU_INS
+  // Keep stepping the filter through the wait
+  uint32_t waitStartmS = millis ();
+  while (millis () - waitStartmS < 100)
+    updateINS ();
+#else
   delay (100);
+#endif
 }
@@ -1,5 +1,9 @@
 #include "attitude_indicator.h"
 
+#include <algorithm>
+
+#include "FastMath.h"
+
 const qreal   AttitudeIndicator::DEFAULTS_ROLL_ROTATE[AttitudeIndicator::NUM_ROLL_LINES] = {270.0, 30.0, 15.0, 15.0, 10.0, 10.0,
                                                                                             10.0, 10.0, 10.0, 10.0, 15.0, 15.0, 30.0};
 const AttitudeIndicator::ATTITUDE_LINE_TYPE AttitudeIndicator::DEFAULTS_TYPE_ROLL[AttitudeIndicator::NUM_ROLL_LINES] = {AttitudeIndicator::NORMAL_ROLL_LINE,
@@ -25,13 +29,13 @@ const AttitudeIndicator::ATTITUDE_LINE_TYPE AttitudeIndicator::DEFAULTS_TYPE_PIT
                                                                                                                           AttitudeIndicator::NORMAL_PITCH_LINE};
 
 AttitudeIndicator::AttitudeIndicator (QWidget* _parent)
-    : QWidget (_parent),
-      m_size (INDICATOR_SIZE_MIN)
+    : RenderedWidget (_parent),
+      m_size (INDICATOR_SIZE_MIN),
+      m_prediction (true),
+      m_rollRate (0.0),
+      m_pitchRate (0.0),
+      m_sampleNs (0)
 {
-    QTimer* timer = new QTimer(this);
-    connect (timer, SIGNAL(timeout()), this, SLOT(update()));
-    timer->start (1000);
-
     setMinimumSize (INDICATOR_SIZE_MIN, INDICATOR_SIZE_MIN);
     setMaximumSize (INDICATOR_SIZE_MAX, INDICATOR_SIZE_MAX);
     resize (m_size, m_size);
@@ -59,9 +63,58 @@ AttitudeIndicator::~AttitudeIndicator ()
 {
 }
 
-void AttitudeIndicator::paintEvent (QPaintEvent * _event)
+void AttitudeIndicator::setAttitudeSample (qreal _roll, qreal _pitch, qreal _rateX, qreal _rateY, qreal _rateZ, qint64 _sampleNs)
+{
+    m_roll = _roll;
+    m_pitch = _pitch;
+    m_sampleNs = _sampleNs;
+
+    // Body rates to roll and pitch rates at the sampled attitude, the roll
+    // term is left out near vertical where it has no meaning
+    float sinRoll, cosRoll, sinPitch, cosPitch;
+    fastSinCos (qDegreesToRadians (_roll), sinRoll, cosRoll);
+    fastSinCos (qDegreesToRadians (_pitch), sinPitch, cosPitch);
+    m_rollRate = _rateX;
+    if (qAbs (cosPitch) > 0.01f)
+        m_rollRate += (_rateY * sinRoll + _rateZ * cosRoll) * sinPitch / cosPitch;
+    m_pitchRate = _rateY * cosRoll - _rateZ * sinRoll;
+
+    stateChanged ();
+    if (m_prediction)
+        animateUntil (_sampleNs + PREDICT_MAX_NS);
+}
+
+void AttitudeIndicator::setPrediction (bool _prediction)
+{
+    m_prediction = _prediction;
+    stateChanged ();
+}
+
+AttitudeIndicator::RenderFunc AttitudeIndicator::makeRenderFunc () const
+{
+    PaintState state;
+    state.width = width ();
+    state.height = height ();
+    state.size = m_size;
+    std::copy (&m_rollPoint[0][0], &m_rollPoint[0][0] + NUM_ROLL_LINES * 2, &state.rollPoint[0][0]);
+    std::copy (m_rollRotate, m_rollRotate + NUM_ROLL_LINES, state.rollRotate);
+    std::copy (&m_pitchPoint[0][0], &m_pitchPoint[0][0] + NUM_PITCH_LINES * 2, &state.pitchPoint[0][0]);
+    state.roll = m_roll;
+    state.pitch = m_pitch;
+    if (m_prediction && m_sampleNs)
+    {
+        qreal aheadS = predictS (m_sampleNs, PREDICT_MAX_NS);
+        state.roll += m_rollRate * aheadS;
+        state.pitch += m_pitchRate * aheadS;
+    }
+    state.target = m_target;
+    state.rollPointer = m_rollPointer;
+
+    return [state] (QPainter& _painter) {paint (_painter, state);};
+}
+
+void AttitudeIndicator::paint (QPainter& _painter, const PaintState& _s)
 {
-    QPainter painter (this);
     QPoint center (0, 0);
     QPen whitePen (Qt::white);
     QPen blackPen (Qt::black);
@@ -69,45 +122,45 @@ void AttitudeIndicator::paintEvent (QPaintEvent * _event)
     QBrush bgGround (QColor (247, 168, 21));
     whitePen.setWidth (2);
     blackPen.setWidth (1);
-    painter.setRenderHint (QPainter::Antialiasing);
-    painter.translate (width () / 2, height () / 2);
-    int side = qMin (width (), height ());
-    painter.scale (side / static_cast<qreal> (m_size), side / static_cast<qreal> (m_size));
-    painter.setPen (blackPen);
-    painter.rotate (m_roll);
-    painter.setBrush (bgSky);
-
-    int y = 0.25 * m_size * m_pitch / 20.;
-
-    int x = sqrt (m_size * m_size / 4 - y * y);
-    qreal gr = atan (static_cast<double> (y) / x);
+    _painter.setRenderHint (QPainter::Antialiasing);
+    _painter.translate (_s.width / 2, _s.height / 2);
+    int side = qMin (_s.width, _s.height);
+    _painter.scale (side / static_cast<qreal> (_s.size), side / static_cast<qreal> (_s.size));
+    _painter.setPen (blackPen);
+    _painter.rotate (_s.roll);
+    _painter.setBrush (bgSky);
+
+    int y = 0.25 * _s.size * _s.pitch / 20.;
+
+    int x = fastSqrt (static_cast<float> (_s.size * _s.size / 4 - y * y));
+    qreal gr = fastAtan2 (static_cast<float> (y), static_cast<float> (x));
     gr = gr * 180. / 3.1415926;
-    painter.drawChord ( -side / 2, -side / 2, side, side, gr * 16, (180 - 2 * gr) * 16);
-    painter.setBrush (bgGround);
-    painter.drawChord (-side / 2, -side / 2, side, side, gr * 16, -(180 + 2 * gr) * 16);
-    painter.setPen (whitePen);
-
-    painter.drawLine (-x, -y, x, -y);
-    painter.setPen (blackPen);
-    painter.rotate (-180.);
+    _painter.drawChord ( -side / 2, -side / 2, side, side, gr * 16, (180 - 2 * gr) * 16);
+    _painter.setBrush (bgGround);
+    _painter.drawChord (-side / 2, -side / 2, side, side, gr * 16, -(180 + 2 * gr) * 16);
+    _painter.setPen (whitePen);
+
+    _painter.drawLine (-x, -y, x, -y);
+    _painter.setPen (blackPen);
+    _painter.rotate (-180.);
     for(int i = 0;i < NUM_ROLL_LINES; i++)
     {
-        painter.rotate (m_rollRotate[i]);
-        painter.drawLine (m_rollPoint[i][0], m_rollPoint[i][1]);
+        _painter.rotate (_s.rollRotate[i]);
+        _painter.drawLine (_s.rollPoint[i][0], _s.rollPoint[i][1]);
     }
 
     whitePen.setWidth (1);
-    painter.setPen (whitePen);
-    painter.rotate (-90.);
+    _painter.setPen (whitePen);
+    _painter.rotate (-90.);
     for(int i = 0;i < NUM_PITCH_LINES; i++)
     {
-        painter.drawLine (m_pitchPoint[i][0], m_pitchPoint[i][1]);
+        _painter.drawLine (_s.pitchPoint[i][0], _s.pitchPoint[i][1]);
     }
-    painter.rotate (-m_roll);
+    _painter.rotate (-_s.roll);
     blackPen.setWidth (3);
-    painter.setPen (blackPen);
-    painter.drawLines (m_target);
-    painter.drawLines (m_rollPointer);
+    _painter.setPen (blackPen);
+    _painter.drawLines (_s.target);
+    _painter.drawLines (_s.rollPointer);
 }
 
 void AttitudeIndicator::resizeEvent (QResizeEvent* _event)
@@ -122,6 +175,8 @@ void AttitudeIndicator::resizeEvent (QResizeEvent* _event)
 
     resizeTargetChar ();
     resizeRollChar ();
+
+    RenderedWidget::resizeEvent (_event);
 }
 
 void AttitudeIndicator::keyPressEvent (QKeyEvent* _event)
@@ -148,7 +203,7 @@ void AttitudeIndicator::keyPressEvent (QKeyEvent* _event)
             break;
             //QFrame::keyPressEvent(event);
     }
-    update ();
+    stateChanged ();
 }
 
 void AttitudeIndicator::getRollLine (ATTITUDE_LINE_TYPE _type, QPoint* _from, QPoint* _to)
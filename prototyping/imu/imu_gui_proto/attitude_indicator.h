@@ -5,7 +5,9 @@
 #include <QtWidgets/QWidget>
 #include <QDebug>
 
-class AttitudeIndicator : public QWidget
+#include "rendered_widget.h"
+
+class AttitudeIndicator : public RenderedWidget
 {
     Q_OBJECT
 
@@ -26,22 +28,53 @@ public:
     static const ATTITUDE_LINE_TYPE DEFAULTS_TYPE_ROLL[];
     static const ATTITUDE_LINE_TYPE DEFAULTS_TYPE_PITCH[];
 
+    // Furthest a sample is extrapolated, past that the link is taken as
+    // stalled and the display holds
+    static const qint64             PREDICT_MAX_NS = 100000000;
+
     AttitudeIndicator (QWidget *parent = 0);
     ~AttitudeIndicator ();
 
-    void setRoll (qreal _roll) {m_roll  = _roll;}
-    void setPitch (qreal _val){m_pitch = _val;}
+    void setRoll (qreal _roll) {m_roll  = _roll; m_sampleNs = 0; stateChanged ();}
+    void setPitch (qreal _val){m_pitch = _val; m_sampleNs = 0; stateChanged ();}
     qreal getRoll () const {return m_roll;}
     qreal getPitch () const {return m_pitch;}
 
+    // Attitude in degrees sampled at _sampleNs (RenderedWidget::clockNs),
+    // with the gyro's body rates at that time in degrees/s.  Frames show it
+    // extrapolated to when they reach the screen.
+    void setAttitudeSample (qreal _roll, qreal _pitch, qreal _rateX, qreal _rateY, qreal _rateZ, qint64 _sampleNs);
+    bool getPrediction () const {return m_prediction;}
+
     QSize size () const {return QSize(m_size, m_size);}
     QSize sizeHint () const {return QSize(m_size, m_size);}
+public slots:
+    void setPrediction (bool _prediction);
+
 protected:
-    void paintEvent (QPaintEvent* _event);
+    RenderFunc makeRenderFunc () const;
+    qint64 sampleTimeNs () const {return m_sampleNs;}
     void resizeEvent (QResizeEvent* _event);
     void keyPressEvent (QKeyEvent* _event);
 
 private:
+    // Everything paint () reads, copied so it can be drawn on another thread
+    struct PaintState
+    {
+        qint32          width;
+        qint32          height;
+        qint32          size;
+        QPoint          rollPoint[NUM_ROLL_LINES][2];
+        qreal           rollRotate[NUM_ROLL_LINES];
+        QPoint          pitchPoint[NUM_PITCH_LINES][2];
+        qreal           roll;
+        qreal           pitch;
+        QVector<QLine>  target;
+        QVector<QLine>  rollPointer;
+    };
+
+    static void paint (QPainter& _painter, const PaintState& _s);
+
     void getRollLine (ATTITUDE_LINE_TYPE _type, QPoint* _from, QPoint* _to);
     void getPitchLine (ATTITUDE_LINE_TYPE _type, quint32 _index, QPoint* _from, QPoint* _to);
     void initTargetChar ();
@@ -57,6 +90,12 @@ private:
     qreal           m_pitch;
     QVector<QLine>  m_target;
     QVector<QLine>  m_rollPointer;
+
+    // Euler angle rates of the newest sample and its time
+    bool            m_prediction;
+    qreal           m_rollRate;
+    qreal           m_pitchRate;
+    qint64          m_sampleNs;
 };
 
 #endif // ATTITUDE_INDICATOR_H
@@ -1,10 +1,15 @@
 #include "compass.h"
 
+#include "FastMath.h"
+
 Compass::Compass(QWidget* parent)
-  : QWidget(parent),
+  : RenderedWidget(parent),
     m_size (COMPASS_SIZE_MIN),
-    m_direction (0),
-    m_rotateNeedle (false)
+    m_rotateNeedle (false),
+    m_direction (0.0),
+    m_prediction (true),
+    m_directionRate (0.0),
+    m_sampleNs (0)
 {
     setMinimumSize (COMPASS_SIZE_MIN, COMPASS_SIZE_MIN);
     setMaximumSize (COMPASS_SIZE_MAX, COMPASS_SIZE_MAX);
@@ -17,163 +22,190 @@ Compass::Compass(QWidget* parent)
 void Compass::setDirection (qint32 _direction)
 {
     m_direction = _direction;
-    update ();
+    m_sampleNs = 0;
+    stateChanged ();
+}
+
+void Compass::setHeadingSample (qreal _heading, qreal _headingRate, qint64 _sampleNs)
+{
+    m_direction = _heading;
+    m_directionRate = _headingRate;
+    m_sampleNs = _sampleNs;
+    stateChanged ();
+    if (m_prediction)
+        animateUntil (_sampleNs + PREDICT_MAX_NS);
+}
+
+void Compass::setPrediction (bool _prediction)
+{
+    m_prediction = _prediction;
+    stateChanged ();
 }
 
 void Compass::setRotateNeedle (bool _rotate)
 {
     m_rotateNeedle = _rotate;
-    update ();
+    stateChanged ();
 }
 
-void Compass::paintEvent (QPaintEvent* _event)
+Compass::RenderFunc Compass::makeRenderFunc () const
 {
-    QPainter painter (this);
-    painter.translate (m_size / 2, m_size / 2);
+    qint32 size = m_size;
+    bool rotateNeedle = m_rotateNeedle;
+    qreal direction = m_direction;
+    if (m_prediction && m_sampleNs)
+        direction += m_directionRate * predictS (m_sampleNs, PREDICT_MAX_NS);
+    return [size, rotateNeedle, direction] (QPainter& _painter) {paint (_painter, size, rotateNeedle, direction);};
+}
+
+void Compass::paint (QPainter& _painter, qint32 _size, bool _rotateNeedle, qreal _direction)
+{
+    _painter.translate (_size / 2, _size / 2);
 
     // Draw black circle
-    painter.setPen (Qt::black);
-    painter.setBrush (Qt::black);
-    painter.drawEllipse (QPoint (0, 0), m_size / 2, m_size / 2);
+    _painter.setPen (Qt::black);
+    _painter.setBrush (Qt::black);
+    _painter.drawEllipse (QPoint (0, 0), _size / 2, _size / 2);
 
     // Draw inner white circles
-    painter.setPen (Qt::white);
-    painter.drawEllipse (QPointF (0, 0), m_size * 0.3, m_size * 0.3);
-    painter.drawEllipse (QPointF (0, 0), m_size * 0.29, m_size * 0.29);
+    _painter.setPen (Qt::white);
+    _painter.drawEllipse (QPointF (0, 0), _size * 0.3, _size * 0.3);
+    _painter.drawEllipse (QPointF (0, 0), _size * 0.29, _size * 0.29);
 
     // Draw center star
     QPainterPath starPath;
     starPath.moveTo(0, 0);
-    qreal outerRadius = m_size * 0.29;
-    qreal innerRadius = m_size * 0.05;
+    qreal outerRadius = _size * 0.29;
+    qreal innerRadius = _size * 0.05;
+    float s, c;
     for (int angle = 0; angle <= 360; angle += 45)
     {
+        fastSinCos (angle / 180.0f * 3.14159265f, s, c);
         if (angle % 90 == 0)
-            starPath.lineTo (QPointF (outerRadius * cos(angle / 180.0 * 3.14159),
-                                      outerRadius * sin(angle / 180.0 * 3.14159)));
+            starPath.lineTo (QPointF (outerRadius * c, outerRadius * s));
         else
-            starPath.lineTo (QPointF (innerRadius * cos(angle / 180.0 * 3.14159),
-                                      innerRadius * sin(angle / 180.0 * 3.14159)));
+            starPath.lineTo (QPointF (innerRadius * c, innerRadius * s));
     }
     starPath.closeSubpath();
     starPath.moveTo (0,0);
-    outerRadius = m_size * 0.29 / 1.5;
-    innerRadius = m_size * 0.05 / 1.5;
+    outerRadius = _size * 0.29 / 1.5;
+    innerRadius = _size * 0.05 / 1.5;
     for (int angle = 0; angle <= 360; angle += 45)
     {
         //if ((angle >= 90 && angle <= 180) || (angle >= 270 && angle <= 360 ))
         //{
+            fastSinCos (angle / 180.0f * 3.14159265f, s, c);
             if (angle % 90)
-                starPath.lineTo (QPointF (outerRadius * cos(angle / 180.0 * 3.14159),
-                                          outerRadius * sin(angle / 180.0 * 3.14159)));
+                starPath.lineTo (QPointF (outerRadius * c, outerRadius * s));
             else
-                starPath.lineTo (QPointF (innerRadius * cos(angle / 180.0 * 3.14159),
-                                          innerRadius * sin(angle / 180.0 * 3.14159)));
+                starPath.lineTo (QPointF (innerRadius * c, innerRadius * s));
         //}
     }
     starPath.setFillRule(Qt::WindingFill);
 
     // Need to rotate star if we are not rotating the needle
-    if (!m_rotateNeedle)
-        painter.rotate (-m_direction);
+    if (!_rotateNeedle)
+        _painter.rotate (-_direction);
 
-    painter.fillPath (starPath, Qt::white);
+    _painter.fillPath (starPath, Qt::white);
 
     // Undo rotatopn for star
-    if (!m_rotateNeedle)
-        painter.rotate (m_direction);
+    if (!_rotateNeedle)
+        _painter.rotate (_direction);
 
     // Rotate painter to rotate the needle
-    if (m_rotateNeedle)
-        painter.rotate (m_direction);
+    if (_rotateNeedle)
+        _painter.rotate (_direction);
 
     // Draw red needle
-    painter.setPen (Qt::red);
+    _painter.setPen (Qt::red);
     QPainterPath redNeedlePath = QPainterPath ();
-    redNeedlePath.moveTo (QPointF (0, -(m_size / 2) * 0.6));
-    redNeedlePath.lineTo (QPointF (m_size * 0.02, -((m_size/2) * 0.6) + (m_size * 0.03)));
-    redNeedlePath.quadTo (QPointF (m_size * 0.02, -(((m_size/2) * 0.6) + (m_size * 0.03)) / 4), QPointF(m_size * 0.05, 0));
-    redNeedlePath.lineTo (QPointF (-m_size * 0.05, 0));
-    redNeedlePath.quadTo (QPointF (-m_size * 0.02, -(((m_size/2) * 0.6) + (m_size * 0.03)) / 4), QPointF(-m_size * 0.02, -((m_size/2) * 0.6) + (m_size * 0.03)));
+    redNeedlePath.moveTo (QPointF (0, -(_size / 2) * 0.6));
+    redNeedlePath.lineTo (QPointF (_size * 0.02, -((_size/2) * 0.6) + (_size * 0.03)));
+    redNeedlePath.quadTo (QPointF (_size * 0.02, -(((_size/2) * 0.6) + (_size * 0.03)) / 4), QPointF(_size * 0.05, 0));
+    redNeedlePath.lineTo (QPointF (-_size * 0.05, 0));
+    redNeedlePath.quadTo (QPointF (-_size * 0.02, -(((_size/2) * 0.6) + (_size * 0.03)) / 4), QPointF(-_size * 0.02, -((_size/2) * 0.6) + (_size * 0.03)));
     redNeedlePath.closeSubpath ();
-    painter.fillPath (redNeedlePath, Qt::red);
+    _painter.fillPath (redNeedlePath, Qt::red);
 
     // Draw white needle
-    painter.setPen (Qt::white);
+    _painter.setPen (Qt::white);
     QPainterPath whiteNeedlePath = QPainterPath ();
-    whiteNeedlePath.moveTo (QPointF (0, (m_size / 2) * 0.6));
-    whiteNeedlePath.lineTo (QPointF (m_size * 0.02, ((m_size/2) * 0.6) - (m_size * 0.03)));
-    whiteNeedlePath.quadTo (QPointF (m_size * 0.02, (((m_size/2) * 0.6) - (m_size * 0.03)) / 4), QPointF(m_size * 0.05, 0));
-    whiteNeedlePath.lineTo (QPointF (-m_size * 0.05, 0));
-    whiteNeedlePath.quadTo (QPointF (-m_size * 0.02, (((m_size/2) * 0.6) - (m_size * 0.03)) / 4), QPointF(-m_size * 0.02, ((m_size/2) * 0.6) - (m_size * 0.03)));
+    whiteNeedlePath.moveTo (QPointF (0, (_size / 2) * 0.6));
+    whiteNeedlePath.lineTo (QPointF (_size * 0.02, ((_size/2) * 0.6) - (_size * 0.03)));
+    whiteNeedlePath.quadTo (QPointF (_size * 0.02, (((_size/2) * 0.6) - (_size * 0.03)) / 4), QPointF(_size * 0.05, 0));
+    whiteNeedlePath.lineTo (QPointF (-_size * 0.05, 0));
+    whiteNeedlePath.quadTo (QPointF (-_size * 0.02, (((_size/2) * 0.6) - (_size * 0.03)) / 4), QPointF(-_size * 0.02, ((_size/2) * 0.6) - (_size * 0.03)));
     whiteNeedlePath.closeSubpath ();
-    painter.fillPath (whiteNeedlePath, Qt::white);
+    _painter.fillPath (whiteNeedlePath, Qt::white);
 
     // We don't want the screw to rotate in either case
-    if (m_rotateNeedle)
-        painter.rotate(-m_direction);
+    if (_rotateNeedle)
+        _painter.rotate(-_direction);
 
     // Draw "screw" on top of needle
-    painter.setPen (Qt::black);
-    painter.drawEllipse (QPointF (0, 0), m_size * 0.03, m_size * 0.03);
+    _painter.setPen (Qt::black);
+    _painter.drawEllipse (QPointF (0, 0), _size * 0.03, _size * 0.03);
 
-    if (!m_rotateNeedle)
-        painter.rotate (-m_direction);
+    if (!_rotateNeedle)
+        _painter.rotate (-_direction);
 
 
     // Draw directions text and markers
-    QPen thickWhite (Qt::white, m_size * 0.02);
-    painter.setFont (QFont ("Helvetica",m_size * 0.08, 70));
+    QPen thickWhite (Qt::white, _size * 0.02);
+    _painter.setFont (QFont ("Helvetica",_size * 0.08, 70));
     QString directions[4] = {"N", "E", "S", "W"};
     for (qint32 i = 0; i < 360; i += 90)
     {
         // Draw text
-        painter.setPen (Qt::white);
-        QFontMetrics fm = painter.fontMetrics ();
+        _painter.setPen (Qt::white);
+        QFontMetrics fm = _painter.fontMetrics ();
         qint32 dirIndex = i / 90;
-        QPoint pos = QPoint (-fm.width (directions[dirIndex]) / 2, -(m_size / 2) + fm.height () + (m_size * 0.02));
-        painter.drawText (pos, directions[dirIndex]);
+        QPoint pos = QPoint (-fm.width (directions[dirIndex]) / 2, -(_size / 2) + fm.height () + (_size * 0.02));
+        _painter.drawText (pos, directions[dirIndex]);
 
         // Draw marker
-        painter.setPen (thickWhite);
-        painter.drawLine (QPointF (0, -(m_size / 2) + (m_size * 0.02)), QPointF (0, -(m_size / 2) + (m_size * 0.05)));
+        _painter.setPen (thickWhite);
+        _painter.drawLine (QPointF (0, -(_size / 2) + (_size * 0.02)), QPointF (0, -(_size / 2) + (_size * 0.05)));
 
-        painter.rotate (90);
+        _painter.rotate (90);
     }
 
     // Draw 15 degree marks and text
-    painter.setPen (Qt::white);
-    painter.setFont (QFont ("Helvetica", m_size * 0.03));
-    QFontMetrics fm = painter.fontMetrics ();
+    _painter.setPen (Qt::white);
+    _painter.setFont (QFont ("Helvetica", _size * 0.03));
+    QFontMetrics fm = _painter.fontMetrics ();
     for (qint32 i = 0; i < 360; i += 15)
     {
         if ((i % 90) != 0)
         {
             // Draw text
             QString text = QString::number (i);
-            QPoint pos = QPoint (-fm.width (text) / 2, -(m_size / 2) + fm.height () + (m_size * 0.04));
-            painter.drawText (pos, text);
+            QPoint pos = QPoint (-fm.width (text) / 2, -(_size / 2) + fm.height () + (_size * 0.04));
+            _painter.drawText (pos, text);
 
             // Draw marker
-            painter.drawLine (QPointF (0, -(m_size / 2) + (m_size * 0.02)), QPointF (0, -(m_size / 2) + (m_size * 0.05)));
+            _painter.drawLine (QPointF (0, -(_size / 2) + (_size * 0.02)), QPointF (0, -(_size / 2) + (_size * 0.05)));
         }
 
-        painter.rotate (15);
+        _painter.rotate (15);
     }
 
     // Draw 5 degree marks
     for (qint32 i = 0; i < 360; i += 5)
     {
         if ((i % 15) != 0)
-            painter.drawLine (QPointF (0, -(m_size / 2) + (m_size * 0.02)), QPointF (0, -(m_size / 2) + (m_size * 0.03)));
+            _painter.drawLine (QPointF (0, -(_size / 2) + (_size * 0.02)), QPointF (0, -(_size / 2) + (_size * 0.03)));
 
-        painter.rotate (5);
+        _painter.rotate (5);
     }
 }
 
 void Compass::resizeEvent (QResizeEvent* _event)
 {
     m_size = qMin(width (), height ());
+
+    RenderedWidget::resizeEvent (_event);
 }
 
 void Compass::keyPressEvent (QKeyEvent* _event)
@@ -189,5 +221,5 @@ void Compass::keyPressEvent (QKeyEvent* _event)
         default:
             break;
     }
-    update ();
+    stateChanged ();
 }
@@ -5,32 +5,52 @@
 #include <QWidget>
 #include <QPainter>
 
-class Compass : public QWidget
+#include "rendered_widget.h"
+
+class Compass : public RenderedWidget
 {
     Q_OBJECT
 public:
     static const quint32 COMPASS_SIZE_MAX = 600;
     static const quint32 COMPASS_SIZE_MIN = 200;
 
+    // Furthest a sample is extrapolated, as for AttitudeIndicator
+    static const qint64  PREDICT_MAX_NS = 100000000;
+
     explicit Compass(QWidget *parent = 0);
     
     QSize size () const {return QSize (m_size, m_size);}
     bool getRotateNeedle () const {return m_rotateNeedle;}
-    qint32 getDirection () const {return m_direction;}
+    qint32 getDirection () const {return qRound (m_direction);}
+
+    // Heading in degrees sampled at _sampleNs (RenderedWidget::clockNs) and
+    // its rate in degrees/s, the yaw Euler rate rather than the gyro's z when
+    // tilted.  Frames show it extrapolated to when they reach the screen.
+    void setHeadingSample (qreal _heading, qreal _headingRate, qint64 _sampleNs);
+    bool getPrediction () const {return m_prediction;}
 public slots:
     void setDirection (qint32 _direction);
     void setRotateNeedle (bool _rotate);
+    void setPrediction (bool _prediction);
 
 protected:
-    void paintEvent (QPaintEvent* _event);
+    RenderFunc makeRenderFunc () const;
+    qint64 sampleTimeNs () const {return m_sampleNs;}
     void resizeEvent (QResizeEvent* _event);
     void keyPressEvent (QKeyEvent* _event);
 
 private:
+    static void paint (QPainter& _painter, qint32 _size, bool _rotateNeedle, qreal _direction);
+
     qint32          m_size;
 
     bool            m_rotateNeedle;
-    qint32          m_direction;
+    qreal           m_direction;
+
+    // Rate of the newest sample and its time
+    bool            m_prediction;
+    qreal           m_directionRate;
+    qint64          m_sampleNs;
 };
 
 #endif // COMPASS_H
@@ -4,19 +4,43 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = imu_gui_proto
 TEMPLATE = app
+CONFIG   += c++11
+INCLUDEPATH += ../imu_embedded_sw \
+    ../imu_host_tools/common
 
 
 SOURCES += main.cpp\
         imu_gui_proto_main_window.cpp \
     attitude_indicator.cpp \
-    compass.cpp
+    compass.cpp \
+    strip_chart.cpp \
+    rendered_widget.cpp \
+    instrument_bench.cpp \
+    log_player.cpp \
+    live_source.cpp \
+    ../imu_host_tools/common/capture_log.cpp \
+    ../imu_host_tools/common/capture_reader.cpp \
+    ../imu_host_tools/common/serial_port.cpp \
+    ../imu_host_tools/common/telemetry_decoder.cpp
 
 HEADERS  += imu_gui_proto_main_window.h \
     attitude_indicator.h \
-    compass.h
+    compass.h \
+    strip_chart.h \
+    rendered_widget.h \
+    instrument_bench.h \
+    log_player.h \
+    live_source.h \
+    ../imu_host_tools/common/capture_log.h \
+    ../imu_host_tools/common/capture_reader.h \
+    ../imu_host_tools/common/serial_port.h \
+    ../imu_host_tools/common/telemetry_decoder.h \
+    ../imu_embedded_sw/TelemetryCodec.h \
+    ../imu_embedded_sw/Crc16.h \
+    ../imu_embedded_sw/FastMath.h
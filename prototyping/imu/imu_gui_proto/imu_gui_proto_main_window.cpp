@@ -1,26 +1,205 @@
 #include "imu_gui_proto_main_window.h"
 
+const char* ImuGuiProtoMainWindow::TRACE_NAMES[ImuGuiProtoMainWindow::TRACE_NUM] = {"GyroX", "GyroY", "GyroZ",
+                                                                                    "AccX", "AccY", "AccZ",
+                                                                                    "MagX", "MagY", "MagZ",
+                                                                                    "Pressure", "Temp"};
+
+const qreal ImuGuiProtoMainWindow::PLAYBACK_SPEEDS[ImuGuiProtoMainWindow::PLAYBACK_SPEED_NUM] = {0.25, 0.5, 1.0, 2.0, 4.0, 8.0};
+
 ImuGuiProtoMainWindow::ImuGuiProtoMainWindow(QWidget *parent)
     : QWidget (parent),
+      m_vBox (new QVBoxLayout),
       m_hBox (new QHBoxLayout),
       m_compassButton (new QPushButton ("Needle")),
+      m_renderButton (new QPushButton ("Threaded")),
+      m_predictButton (new QPushButton ("Predict")),
+      m_latencyLabel (new QLabel),
       m_compass (new Compass),
-      m_attInd (new AttitudeIndicator)
+      m_attInd (new AttitudeIndicator),
+      m_chart (new StripChart),
+      m_player (new LogPlayer (this)),
+      m_openButton (new QPushButton ("Open log")),
+      m_playButton (new QPushButton ("Play")),
+      m_speedBox (new QComboBox),
+      m_timeline (new QSlider (Qt::Horizontal)),
+      m_timeLabel (new QLabel),
+      m_live (new LiveSource (this))
 {
     // Connect compass button to compass
     m_compassButton->setCheckable (true);
     connect (m_compassButton, SIGNAL (clicked (bool)), m_compass, SLOT(setRotateNeedle (bool)));
 
+    // Switch the instruments between direct and off-thread rendering
+    m_renderButton->setCheckable (true);
+    connect (m_renderButton, SIGNAL (clicked (bool)), m_compass, SLOT (setThreaded (bool)));
+    connect (m_renderButton, SIGNAL (clicked (bool)), m_attInd, SLOT (setThreaded (bool)));
+
+    // Extrapolate timestamped samples to the screen, on by default
+    m_predictButton->setCheckable (true);
+    m_predictButton->setChecked (true);
+    connect (m_predictButton, SIGNAL (clicked (bool)), m_compass, SLOT (setPrediction (bool)));
+    connect (m_predictButton, SIGNAL (clicked (bool)), m_attInd, SLOT (setPrediction (bool)));
+
+    // Sample to screen latency of both instruments
+    QTimer* latencyTimer = new QTimer (this);
+    connect (latencyTimer, SIGNAL (timeout ()), this, SLOT (showLatency ()));
+    latencyTimer->start (LATENCY_INTERVAL_MS);
+    showLatency ();
+
     // Add widgets to layout
-    m_hBox->addWidget (m_compassButton, 0, Qt::AlignTop);
+    QVBoxLayout* buttons = new QVBoxLayout;
+    buttons->addWidget (m_compassButton);
+    buttons->addWidget (m_renderButton);
+    buttons->addWidget (m_predictButton);
+    buttons->addWidget (m_latencyLabel);
+    buttons->addStretch ();
+    m_hBox->addLayout (buttons);
     m_hBox->addWidget (m_compass);
     m_hBox->addWidget (m_attInd);
 
-    setLayout (m_hBox);
+    // One strip chart trace per sensor axis, in SENSOR_TRACE order
+    for (qint32 i = 0; i < TRACE_NUM; i++)
+        m_chart->addTrace (TRACE_NAMES[i], QColor::fromHsv ((i * 360) / TRACE_NUM, 200, 255));
+
+    // Log playback drives the instruments and the chart on one timeline
+    m_player->setHistory (m_chart->getTimeWindow ());
+    connect (m_player, SIGNAL (cleared ()), m_chart, SLOT (clear ()));
+    connect (m_player, SIGNAL (traceSample (qint32, qint64, float)), m_chart, SLOT (addSample (qint32, qint64, float)));
+    connect (m_player, SIGNAL (attitudeSample (qreal, qreal, qreal, qreal, qreal, qreal, qreal, qint64)),
+             this, SLOT (showPlaybackAttitude (qreal, qreal, qreal, qreal, qreal, qreal, qreal, qint64)));
+    connect (m_player, SIGNAL (positionChanged (qint64)), this, SLOT (showPlaybackPosition (qint64)));
+    connect (m_player, SIGNAL (playingChanged (bool)), m_playButton, SLOT (setChecked (bool)));
+    connect (m_openButton, SIGNAL (clicked ()), this, SLOT (openLogDialog ()));
+    m_playButton->setCheckable (true);
+    m_playButton->setEnabled (false);
+    connect (m_playButton, SIGNAL (clicked (bool)), m_player, SLOT (setPlaying (bool)));
+    for (qint32 i = 0; i < PLAYBACK_SPEED_NUM; i++)
+        m_speedBox->addItem (QString ("%1x").arg (PLAYBACK_SPEEDS[i]));
+    m_speedBox->setCurrentIndex (PLAYBACK_SPEED_DEFAULT);
+    connect (m_speedBox, SIGNAL (currentIndexChanged (int)), this, SLOT (setPlaybackSpeed (int)));
+    m_timeline->setRange (0, TIMELINE_STEPS);
+    m_timeline->setEnabled (false);
+    connect (m_timeline, SIGNAL (valueChanged (int)), this, SLOT (seekTimeline (int)));
+
+    // The board's stream feeds the chart the same way while live
+    connect (m_live, SIGNAL (cleared ()), m_chart, SLOT (clear ()));
+    connect (m_live, SIGNAL (traceSample (qint32, qint64, float)), m_chart, SLOT (addSample (qint32, qint64, float)));
+    connect (m_live, SIGNAL (closed ()), this, SLOT (liveClosed ()));
+
+    QHBoxLayout* playback = new QHBoxLayout;
+    playback->addWidget (m_openButton);
+    playback->addWidget (m_playButton);
+    playback->addWidget (m_speedBox);
+    playback->addWidget (m_timeline, 1);
+    playback->addWidget (m_timeLabel);
+
+    m_vBox->addLayout (m_hBox);
+    m_vBox->addLayout (playback);
+    m_vBox->addWidget (m_chart);
+
+    setLayout (m_vBox);
     setWindowTitle ("IMU GUI Prototype");
-    resize (900,400);
+    resize (900,700);
 }
 
 ImuGuiProtoMainWindow::~ImuGuiProtoMainWindow()
 {  
 }
+
+void ImuGuiProtoMainWindow::showLatency ()
+{
+    // Nothing to show until timestamped samples arrive
+    QString text = "Latency ms";
+    qint64 attitudeNs = m_attInd->getMeanLatencyNs ();
+    qint64 headingNs = m_compass->getMeanLatencyNs ();
+    text += "\nAttitude " + (attitudeNs ? QString::number (attitudeNs / 1e6, 'f', 1) : QString ("-"));
+    text += "\nHeading " + (headingNs ? QString::number (headingNs / 1e6, 'f', 1) : QString ("-"));
+    m_latencyLabel->setText (text);
+}
+
+qint32 ImuGuiProtoMainWindow::firstTrace (CAPTURE_SENSOR _sensor)
+{
+    return (_sensor < CAPTURE_PRESSURE) ? TRACE_GYRO_X + _sensor * 3 : TRACE_PRESSURE + (_sensor - CAPTURE_PRESSURE);
+}
+
+bool ImuGuiProtoMainWindow::openLog (const QString& _path)
+{
+    m_live->close ();
+    if (!m_player->open (_path))
+    {
+        QMessageBox::warning (this, windowTitle (), QString ("Can't open capture file %1").arg (_path));
+        return false;
+    }
+    m_playButton->setEnabled (true);
+    m_timeline->setEnabled (true);
+    setWindowTitle ("IMU GUI Prototype - " + QFileInfo (_path).fileName ());
+    return true;
+}
+
+bool ImuGuiProtoMainWindow::openLive (const QString& _path, qint32 _baud, bool _compressed)
+{
+    // Playback and the board would both write the chart
+    m_player->setPlaying (false);
+    if (!m_live->open (_path, _baud, _compressed))
+    {
+        QMessageBox::warning (this, windowTitle (), QString ("Can't open %1").arg (_path));
+        return false;
+    }
+    m_playButton->setEnabled (false);
+    m_timeline->setEnabled (false);
+    m_timeLabel->clear ();
+    setWindowTitle ("IMU GUI Prototype - live " + _path);
+    return true;
+}
+
+void ImuGuiProtoMainWindow::liveClosed ()
+{
+    setWindowTitle ("IMU GUI Prototype");
+}
+
+void ImuGuiProtoMainWindow::openLogDialog ()
+{
+    QString path = QFileDialog::getOpenFileName (this, "Open capture file");
+    if (!path.isEmpty ())
+        openLog (path);
+}
+
+void ImuGuiProtoMainWindow::seekTimeline (int _step)
+{
+    // Seeks on every move of the slider, so dragging it scrubs
+    qint64 startUs = m_player->getStartUs ();
+    qint64 lengthUs = m_player->getEndUs () - startUs;
+    m_player->seek (startUs + (lengthUs * _step) / TIMELINE_STEPS);
+}
+
+void ImuGuiProtoMainWindow::setPlaybackSpeed (int _index)
+{
+    if (_index >= 0 && _index < PLAYBACK_SPEED_NUM)
+        m_player->setSpeed (PLAYBACK_SPEEDS[_index]);
+}
+
+void ImuGuiProtoMainWindow::showPlaybackPosition (qint64 _positionUs)
+{
+    qint64 startUs = m_player->getStartUs ();
+    qint64 lengthUs = m_player->getEndUs () - startUs;
+
+    // Following playback mustn't seek back to the slider's rounded step
+    QSignalBlocker blocker (m_timeline);
+    m_timeline->setValue (lengthUs > 0 ? (qint32) (((_positionUs - startUs) * TIMELINE_STEPS) / lengthUs) : 0);
+    m_timeLabel->setText (formatTime (_positionUs - startUs) + " / " + formatTime (lengthUs));
+}
+
+void ImuGuiProtoMainWindow::showPlaybackAttitude (qreal _roll, qreal _pitch, qreal _heading, qreal _headingRate,
+                                                  qreal _rateX, qreal _rateY, qreal _rateZ, qint64 _sampleNs)
+{
+    m_attInd->setAttitudeSample (_roll, _pitch, _rateX, _rateY, _rateZ, _sampleNs);
+    m_compass->setHeadingSample (_heading, _headingRate, _sampleNs);
+}
+
+QString ImuGuiProtoMainWindow::formatTime (qint64 _us)
+{
+    // m:ss.s
+    qint64 tenths = _us / 100000;
+    return QString ("%1:%2.%3").arg (tenths / 600).arg ((tenths / 10) % 60, 2, 10, QChar ('0')).arg (tenths % 10);
+}
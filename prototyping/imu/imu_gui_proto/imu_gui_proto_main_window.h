@@ -5,20 +5,86 @@
 
 #include "compass.h"
 #include "attitude_indicator.h"
+#include "strip_chart.h"
+#include "log_player.h"
+#include "live_source.h"
 
 class ImuGuiProtoMainWindow : public QWidget
 {
     Q_OBJECT
     
 public:
+    // Strip chart traces for all sensor axes
+    typedef enum SENSOR_TRACE_ENUM
+    {
+        TRACE_GYRO_X = 0,
+        TRACE_GYRO_Y,
+        TRACE_GYRO_Z,
+        TRACE_ACC_X,
+        TRACE_ACC_Y,
+        TRACE_ACC_Z,
+        TRACE_MAG_X,
+        TRACE_MAG_Y,
+        TRACE_MAG_Z,
+        TRACE_PRESSURE,
+        TRACE_TEMPERATURE,
+        TRACE_NUM
+    } SENSOR_TRACE;
+
+    static const char*  TRACE_NAMES[TRACE_NUM];
+
+    // Trace of a capture sensor's first axis, the others follow it
+    static qint32 firstTrace (CAPTURE_SENSOR _sensor);
+
+    static const qint32 LATENCY_INTERVAL_MS = 500;
+
+    // Timeline slider resolution, and the playback speeds offered
+    static const qint32 TIMELINE_STEPS = 10000;
+    static const qint32 PLAYBACK_SPEED_NUM = 6;
+    static const qint32 PLAYBACK_SPEED_DEFAULT = 2;
+    static const qreal  PLAYBACK_SPEEDS[PLAYBACK_SPEED_NUM];
+
     ImuGuiProtoMainWindow (QWidget* parent = 0);
     ~ImuGuiProtoMainWindow ();
 
+    // Loads a capture file for playback, paused at its start
+    bool openLog (const QString& _path);
+
+    // Charts the board's stream live, see LiveSource::open
+    bool openLive (const QString& _path, qint32 _baud, bool _compressed);
+
+private slots:
+    void showLatency ();
+    void openLogDialog ();
+    void seekTimeline (int _step);
+    void setPlaybackSpeed (int _index);
+    void showPlaybackPosition (qint64 _positionUs);
+    void liveClosed ();
+    void showPlaybackAttitude (qreal _roll, qreal _pitch, qreal _heading, qreal _headingRate,
+                               qreal _rateX, qreal _rateY, qreal _rateZ, qint64 _sampleNs);
+
 private:
+    static QString formatTime (qint64 _us);
+
+    QVBoxLayout*        m_vBox;
     QHBoxLayout*        m_hBox;
     QPushButton*        m_compassButton;
+    QPushButton*        m_renderButton;
+    QPushButton*        m_predictButton;
+    QLabel*             m_latencyLabel;
     Compass*            m_compass;
     AttitudeIndicator*  m_attInd;
+    StripChart*         m_chart;
+
+    // Log playback
+    LogPlayer*          m_player;
+    QPushButton*        m_openButton;
+    QPushButton*        m_playButton;
+    QComboBox*          m_speedBox;
+    QSlider*            m_timeline;
+    QLabel*             m_timeLabel;
+
+    LiveSource*         m_live;
 };
 
 #endif // IMU_GUI_PROTO_MAIN_WINDOW_H
@@ -0,0 +1,152 @@
+#include "instrument_bench.h"
+
+#include <cstdio>
+
+InstrumentBench::InstrumentBench (qint32 _instruments, QWidget* _parent)
+    : QWidget (_parent),
+      m_timer (new QTimer (this)),
+      m_mode (RenderedWidget::RENDER_DIRECT),
+      m_tickNs (0),
+      m_maxIntervalNs (0),
+      m_frames (0),
+      m_step (0),
+      m_renderedBase (0),
+      m_droppedBase (0)
+{
+    // Alternate compasses and attitude indicators in a square grid
+    QGridLayout* grid = new QGridLayout;
+    qint32 columns = qCeil (qSqrt (_instruments));
+    for (qint32 i = 0; i < _instruments; i++)
+    {
+        QWidget* instrument;
+        if (i % 2)
+        {
+            Compass* compass = new Compass;
+            compass->setRotateNeedle (i % 4 == 1);
+            compass->setPrediction (false);
+            m_compasses.append (compass);
+            instrument = compass;
+        }
+        else
+        {
+            AttitudeIndicator* attInd = new AttitudeIndicator;
+            attInd->setPrediction (false);
+            m_attInds.append (attInd);
+            instrument = attInd;
+        }
+        grid->addWidget (instrument, i / columns, i % columns);
+    }
+    setLayout (grid);
+    setWindowTitle (QString ("Instrument benchmark (%1 instruments)").arg (_instruments));
+
+    connect (m_timer, SIGNAL (timeout ()), this, SLOT (tick ()));
+    m_timer->start (FRAME_INTERVAL_MS);
+    startPhase (RenderedWidget::RENDER_DIRECT);
+}
+
+void InstrumentBench::startPhase (RenderedWidget::RENDER_MODE _mode)
+{
+    m_mode = _mode;
+    foreach (Compass* compass, m_compasses)
+        compass->setRenderMode (_mode);
+    foreach (AttitudeIndicator* attInd, m_attInds)
+        attInd->setRenderMode (_mode);
+
+    // Instrument counters are cumulative
+    frameCounts (m_renderedBase, m_droppedBase);
+    RenderedWidget::resetPaintNs ();
+    m_tickNs = 0;
+    m_maxIntervalNs = 0;
+    m_frames = 0;
+    m_phaseTime.start ();
+    m_frameTime.start ();
+}
+
+void InstrumentBench::tick ()
+{
+    // Late ticks mean the GUI thread was stalled
+    qint64 intervalNs = m_frameTime.nsecsElapsed ();
+    m_frameTime.start ();
+    if (m_frames > 0)
+        m_maxIntervalNs = qMax (m_maxIntervalNs, intervalNs);
+
+    QElapsedTimer timer;
+    timer.start ();
+
+    // Timestamped samples with their rates, as the telemetry would send.
+    // The body rates are the ones that give these roll and pitch rates with
+    // no yaw.  A sample comes every frame here, so prediction is off: it
+    // would only add renders, and the latency is the pipeline's either way.
+    qint64 sampleNs = RenderedWidget::clockNs ();
+    qreal ticksPerS = 1000.0 / FRAME_INTERVAL_MS;
+    qint32 index = 0;
+    foreach (Compass* compass, m_compasses)
+        compass->setHeadingSample ((m_step + 20 * index++) % 360, ticksPerS, sampleNs);
+    foreach (AttitudeIndicator* attInd, m_attInds)
+    {
+        qreal phase = (m_step + 20 * index++) * 0.05;
+        qreal roll = 30.0 * qSin (phase);
+        qreal rollRate = 30.0 * qCos (phase) * 0.05 * ticksPerS;
+        qreal pitchRate = -15.0 * 0.7 * qSin (phase * 0.7) * 0.05 * ticksPerS;
+        qreal rollRad = qDegreesToRadians (roll);
+        attInd->setAttitudeSample (roll, 15.0 * qCos (phase * 0.7),
+                                   rollRate, pitchRate * qCos (rollRad), -pitchRate * qSin (rollRad), sampleNs);
+    }
+    m_tickNs += timer.nsecsElapsed ();
+    m_frames++;
+    m_step++;
+
+    if (m_phaseTime.elapsed () < PHASE_MS)
+        return;
+
+    report ();
+    if (m_mode == RenderedWidget::RENDER_DIRECT)
+        startPhase (RenderedWidget::RENDER_THREADED);
+    else
+        qApp->quit ();
+}
+
+void InstrumentBench::frameCounts (quint64& _rendered, quint64& _dropped) const
+{
+    _rendered = 0;
+    _dropped = 0;
+    foreach (Compass* compass, m_compasses)
+    {
+        _rendered += compass->getFramesRendered ();
+        _dropped += compass->getFramesDropped ();
+    }
+    foreach (AttitudeIndicator* attInd, m_attInds)
+    {
+        _rendered += attInd->getFramesRendered ();
+        _dropped += attInd->getFramesDropped ();
+    }
+}
+
+void InstrumentBench::report ()
+{
+    quint64 rendered;
+    quint64 dropped;
+    frameCounts (rendered, dropped);
+
+    qint64 latencyNs = 0;
+    foreach (Compass* compass, m_compasses)
+        latencyNs += compass->getMeanLatencyNs ();
+    foreach (AttitudeIndicator* attInd, m_attInds)
+        latencyNs += attInd->getMeanLatencyNs ();
+
+    qint64 paintNs = RenderedWidget::getPaintNs ();
+    qint32 instruments = m_compasses.size () + m_attInds.size ();
+    printf ("mode=%s instruments=%d frames=%lld ui_ms_per_frame=%.3f update_ms=%.3f paint_ms=%.3f "
+            "max_frame_interval_ms=%.1f instrument_frames=%llu dropped=%llu latency_ms=%.1f\n",
+            m_mode == RenderedWidget::RENDER_DIRECT ? "direct" : "threaded",
+            instruments,
+            m_frames,
+            (m_tickNs + paintNs) / 1e6 / qMax<qint64> (1, m_frames),
+            m_tickNs / 1e6 / qMax<qint64> (1, m_frames),
+            paintNs / 1e6 / qMax<qint64> (1, m_frames),
+            m_maxIntervalNs / 1e6,
+            rendered - m_renderedBase,
+            dropped - m_droppedBase,
+            latencyNs / 1e6 / qMax<qint32> (1, instruments));
+    fflush (stdout);
+}
@@ -0,0 +1,43 @@
+#ifndef INSTRUMENT_BENCH_H
+#define INSTRUMENT_BENCH_H
+
+#include <QtWidgets>
+
+#include "compass.h"
+#include "attitude_indicator.h"
+
+// Grid of animated instruments that measures GUI thread time per frame, first
+// with direct painting and then with threaded rendering, prints both and quits
+class InstrumentBench : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static const qint32 FRAME_INTERVAL_MS = 16;
+    static const qint32 PHASE_MS = 5000;
+
+    InstrumentBench (qint32 _instruments, QWidget* _parent = 0);
+
+private slots:
+    void tick ();
+
+private:
+    void startPhase (RenderedWidget::RENDER_MODE _mode);
+    void report ();
+    void frameCounts (quint64& _rendered, quint64& _dropped) const;
+
+    QList<Compass*>             m_compasses;
+    QList<AttitudeIndicator*>   m_attInds;
+    QTimer*                     m_timer;
+    RenderedWidget::RENDER_MODE m_mode;
+    QElapsedTimer               m_phaseTime;
+    QElapsedTimer               m_frameTime;
+    qint64                      m_tickNs;
+    qint64                      m_maxIntervalNs;
+    qint64                      m_frames;
+    qint64                      m_step;
+    quint64                     m_renderedBase;
+    quint64                     m_droppedBase;
+};
+
+#endif // INSTRUMENT_BENCH_H
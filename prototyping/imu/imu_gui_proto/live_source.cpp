@@ -0,0 +1,125 @@
+#include "live_source.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "capture_reader.h"
+#include "imu_gui_proto_main_window.h"
+#include "serial_port.h"
+
+LiveSource::LiveSource (QObject* _parent)
+    : QObject (_parent),
+      m_fd (-1),
+      m_notifier (NULL),
+      m_compressed (false),
+      m_hasTime (false),
+      m_latestUs (0)
+{
+}
+
+LiveSource::~LiveSource ()
+{
+    close ();
+}
+
+bool LiveSource::open (const QString& _path, qint32 _baud, bool _compressed)
+{
+    close ();
+
+    QByteArray path = _path.toLocal8Bit ();
+    int fd = ::open (path.constData (), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    if (isatty (fd) && !configureSerialPort (fd, _baud, path.constData ()))
+    {
+        ::close (fd);
+        return false;
+    }
+
+    m_fd = fd;
+    m_compressed = _compressed;
+    m_decoder = TelemetryDecoder ();
+    m_raw.clear ();
+    m_hasTime = false;
+    m_notifier = new QSocketNotifier (m_fd, QSocketNotifier::Read, this);
+    connect (m_notifier, SIGNAL (activated (int)), this, SLOT (readInput ()));
+    emit cleared ();
+    return true;
+}
+
+void LiveSource::close ()
+{
+    if (m_fd < 0)
+        return;
+    delete m_notifier;
+    m_notifier = NULL;
+    ::close (m_fd);
+    m_fd = -1;
+}
+
+void LiveSource::readInput ()
+{
+    uint8_t bytes[READ_BYTES];
+    ssize_t n = read (m_fd, bytes, sizeof (bytes));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0)
+    {
+        close ();
+        emit closed ();
+        return;
+    }
+
+    m_records.clear ();
+    if (m_compressed)
+    {
+        m_decoder.decode (bytes, n, m_records);
+    }
+    else
+    {
+        m_raw.insert (m_raw.end (), bytes, bytes + n);
+        parseRecords ();
+    }
+    for (size_t i = 0; i < m_records.size (); i++)
+        publish (m_records[i]);
+}
+
+void LiveSource::parseRecords ()
+{
+    // Skips a byte at a time to the next record, as CaptureReader does
+    size_t pos = 0;
+    while (m_raw.size () - pos >= sizeof (CaptureRecord))
+    {
+        CaptureRecord rec;
+        memcpy (&rec, &m_raw[pos], sizeof (rec));
+        if (!CaptureReader::isRecord (rec))
+        {
+            pos++;
+            continue;
+        }
+        m_records.push_back (rec);
+        pos += sizeof (rec);
+    }
+    m_raw.erase (m_raw.begin (), m_raw.begin () + pos);
+}
+
+void LiveSource::publish (const CaptureRecord& _rec)
+{
+    // The board's records are in time order to within a few samples, so a
+    // signed step from the newest carries the time over micros ()'s wrap
+    if (!m_hasTime)
+    {
+        m_latestUs = _rec.timeuS;
+        m_hasTime = true;
+    }
+    qint64 timeUs = m_latestUs + (qint32) (_rec.timeuS - (quint32) m_latestUs);
+    m_latestUs = qMax (m_latestUs, timeUs);
+
+    CAPTURE_SENSOR sensor = (CAPTURE_SENSOR) _rec.sensor;
+    double scale = CaptureReader::sensorScale (sensor);
+    qint32 firstTrace = ImuGuiProtoMainWindow::firstTrace (sensor);
+    for (qint32 axis = 0; axis < _rec.axes; axis++)
+        emit traceSample (firstTrace + axis, timeUs, _rec.value[axis] * scale);
+}
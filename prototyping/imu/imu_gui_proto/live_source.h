@@ -0,0 +1,60 @@
+#ifndef LIVE_SOURCE_H
+#define LIVE_SOURCE_H
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <vector>
+
+#include "CaptureRecord.h"
+#include "telemetry_decoder.h"
+
+// Reads the board's capture stream as it arrives, from a serial port or a
+// FIFO, and feeds the strip chart the same samples LogPlayer does.  The
+// stream is either raw CaptureRecords (the sketch's IMU_CAPTURE) or delta
+// compressed telemetry (IMU_TELEMETRY).  Both resync after the sketch's text
+// output or a dropped byte.
+class LiveSource : public QObject
+{
+    Q_OBJECT
+public:
+    static const qint32 BAUD_DEFAULT = 115200;
+    static const size_t READ_BYTES = 4096;
+
+    explicit LiveSource (QObject* _parent = 0);
+    ~LiveSource ();
+
+    // A serial port is set to raw mode at _baud, anything else is read as it is
+    bool open (const QString& _path, qint32 _baud, bool _compressed);
+    void close ();
+    bool isOpen () const {return m_fd >= 0;}
+
+signals:
+    // As LogPlayer's.  Cleared on open, times are the board's micros ()
+    // carried past its 32 bit wrap.
+    void cleared ();
+    void traceSample (qint32 _trace, qint64 _timeUs, float _value);
+
+    // The port went away or the FIFO's writer closed it
+    void closed ();
+
+private slots:
+    void readInput ();
+
+private:
+    void parseRecords ();
+    void publish (const CaptureRecord& _rec);
+
+    int                         m_fd;
+    QSocketNotifier*            m_notifier;
+    bool                        m_compressed;
+    TelemetryDecoder            m_decoder;
+
+    // Raw stream bytes not yet a whole record
+    std::vector<uint8_t>        m_raw;
+    std::vector<CaptureRecord>  m_records;
+
+    bool                        m_hasTime;
+    qint64                      m_latestUs;
+};
+
+#endif // LIVE_SOURCE_H
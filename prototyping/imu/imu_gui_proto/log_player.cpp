@@ -0,0 +1,166 @@
+#include "log_player.h"
+
+#include <QtMath>
+
+#include "capture_reader.h"
+#include "imu_gui_proto_main_window.h"
+#include "rendered_widget.h"
+#include "strip_chart.h"
+
+LogPlayer::LogPlayer (QObject* _parent)
+    : QObject (_parent),
+      m_pendingUs (0),
+      m_hasPending (false),
+      m_positionUs (0),
+      m_speed (1.0),
+      m_historyUs (StripChart::TIME_WINDOW_DEFAULT_US)
+{
+    m_cursor.offset = 0;
+    m_cursor.timeuS = 0;
+    for (qint32 i = 0; i < CAPTURE_SENSOR_NUM; i++)
+        m_latestUs[i] = -1;
+
+    connect (&m_timer, SIGNAL (timeout ()), this, SLOT (tick ()));
+    m_timer.setInterval (TICK_INTERVAL_MS);
+}
+
+bool LogPlayer::open (const QString& _path)
+{
+    setPlaying (false);
+    if (!m_log.open (_path.toLocal8Bit ().constData ()))
+        return false;
+    emit opened (getStartUs (), getEndUs ());
+    seek (getStartUs ());
+    return true;
+}
+
+void LogPlayer::seek (qint64 _positionUs)
+{
+    if (!m_log.isOpen ())
+        return;
+    m_positionUs = qBound (getStartUs (), _positionUs, getEndUs ());
+
+    // Read from the index entry before the history, the records before it
+    // only set the newest samples
+    qint64 traceFromUs = m_positionUs - m_historyUs;
+    m_cursor = m_log.seek (traceFromUs);
+    m_hasPending = false;
+    for (qint32 i = 0; i < CAPTURE_SENSOR_NUM; i++)
+        m_latestUs[i] = -1;
+
+    emit cleared ();
+    readTo (m_positionUs, traceFromUs);
+    publishAttitude ();
+    emit positionChanged (m_positionUs);
+}
+
+void LogPlayer::setSpeed (qreal _speed)
+{
+    if (_speed <= 0.0)
+        return;
+    m_speed = _speed;
+    publishAttitude ();
+}
+
+void LogPlayer::setPlaying (bool _playing)
+{
+    if (_playing == isPlaying ())
+        return;
+    if (_playing)
+    {
+        if (!m_log.isOpen ())
+            return;
+        // Play again from the start once at the end
+        if (m_positionUs >= getEndUs ())
+            seek (getStartUs ());
+        m_wallTime.start ();
+        m_timer.start ();
+    }
+    else
+    {
+        m_timer.stop ();
+    }
+    publishAttitude ();
+    emit playingChanged (_playing);
+}
+
+void LogPlayer::tick ()
+{
+    // Wall time since the last tick, so late ticks don't slow playback
+    qint64 elapsedNs = m_wallTime.nsecsElapsed ();
+    m_wallTime.start ();
+    m_positionUs = qMin (getEndUs (), m_positionUs + qRound64 (elapsedNs * m_speed / 1000.0));
+
+    readTo (m_positionUs, m_positionUs - m_historyUs);
+    publishAttitude ();
+    emit positionChanged (m_positionUs);
+
+    if (m_positionUs >= getEndUs ())
+        setPlaying (false);
+}
+
+void LogPlayer::readTo (qint64 _positionUs, qint64 _traceFromUs)
+{
+    for (;;)
+    {
+        if (!m_hasPending)
+        {
+            if (!m_log.next (m_cursor, m_pending))
+                return;
+            m_pendingUs = m_cursor.timeuS;
+            m_hasPending = true;
+        }
+        if (m_pendingUs > _positionUs)
+            return;
+        m_hasPending = false;
+
+        CAPTURE_SENSOR sensor = (CAPTURE_SENSOR) m_pending.sensor;
+        double scale = CaptureReader::sensorScale (sensor);
+        qint32 firstTrace = ImuGuiProtoMainWindow::firstTrace (sensor);
+        for (qint32 axis = 0; axis < m_pending.axes; axis++)
+        {
+            m_latest[sensor][axis] = m_pending.value[axis] * scale;
+            if (m_pendingUs >= _traceFromUs)
+                emit traceSample (firstTrace + axis, m_pendingUs, m_latest[sensor][axis]);
+        }
+        m_latestUs[sensor] = m_pendingUs;
+    }
+}
+
+void LogPlayer::publishAttitude ()
+{
+    if (m_latestUs[CAPTURE_ACC] < 0 || m_latestUs[CAPTURE_MAG] < 0)
+        return;
+
+    // Roll and pitch from gravity, then the heading from the field levelled
+    // with them, as InsEKF::reset starts its attitude
+    const double* acc = m_latest[CAPTURE_ACC];
+    const double* mag = m_latest[CAPTURE_MAG];
+    double roll = qAtan2 (acc[1], acc[2]);
+    double pitch = qAtan2 (-acc[0], qSqrt (acc[1] * acc[1] + acc[2] * acc[2]));
+    double y = qCos (roll) * mag[1] - qSin (roll) * mag[2];
+    double z = qSin (roll) * mag[1] + qCos (roll) * mag[2];
+    double x = qCos (pitch) * mag[0] + qSin (pitch) * z;
+    double heading = qRadiansToDegrees (-qAtan2 (y, x));
+    if (heading < 0.0)
+        heading += 360.0;
+
+    // Rates in log time run speed times faster on screen, and not at all
+    // while paused
+    double rate[3] = {0.0, 0.0, 0.0};
+    if (isPlaying () && m_latestUs[CAPTURE_GYRO] >= 0)
+    {
+        for (qint32 i = 0; i < 3; i++)
+            rate[i] = m_latest[CAPTURE_GYRO][i] * m_speed;
+    }
+    double cosPitch = qCos (pitch);
+    double headingRate = (qAbs (cosPitch) > 1e-3) ? (rate[1] * qSin (roll) + rate[2] * qCos (roll)) / cosPitch : 0.0;
+
+    // When the sample would have reached the screen had the log been live
+    qint64 sampleNs = RenderedWidget::clockNs ();
+    if (isPlaying ())
+        sampleNs -= qRound64 ((m_positionUs - m_latestUs[CAPTURE_ACC]) * 1000.0 / m_speed);
+
+    emit attitudeSample (qRadiansToDegrees (roll), qRadiansToDegrees (pitch), heading, headingRate,
+                         rate[0], rate[1], rate[2], sampleNs);
+}
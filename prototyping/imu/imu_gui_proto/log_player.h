@@ -0,0 +1,87 @@
+#ifndef LOG_PLAYER_H
+#define LOG_PLAYER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "capture_log.h"
+
+// Plays a capture file back into the instruments and the strip chart on one
+// timeline.  While playing the position follows the wall clock times the
+// speed.  A seek jumps straight there through CaptureLog's index: the chart
+// is refilled with the history before the new position and the instruments
+// show the attitude at it, so dragging the timeline scrubs all of them.
+class LogPlayer : public QObject
+{
+    Q_OBJECT
+public:
+    static const qint32 TICK_INTERVAL_MS = 16;
+
+    explicit LogPlayer (QObject* _parent = 0);
+
+    bool open (const QString& _path);
+    bool isOpen () const {return m_log.isOpen ();}
+
+    qint64 getStartUs () const {return m_log.getStartuS ();}
+    qint64 getEndUs () const {return m_log.getEnduS ();}
+    qint64 getPositionUs () const {return m_positionUs;}
+    qreal getSpeed () const {return m_speed;}
+    bool isPlaying () const {return m_timer.isActive ();}
+
+    // How far back the chart is refilled on a seek, its time window
+    void setHistory (qint64 _historyUs) {m_historyUs = _historyUs;}
+
+public slots:
+    void seek (qint64 _positionUs);
+    void setSpeed (qreal _speed);
+    void setPlaying (bool _playing);
+
+signals:
+    void opened (qint64 _startUs, qint64 _endUs);
+    void positionChanged (qint64 _positionUs);
+    void playingChanged (bool _playing);
+
+    // Chart samples, cleared before a seek refills it.  Traces are in
+    // ImuGuiProtoMainWindow's SENSOR_TRACE order: three per vector sensor in
+    // CaptureReader::sensorScale's units, then pressure and temperature as
+    // the raw counts the capture holds (compensating them needs the BMP085's
+    // calibration, which the capture doesn't carry).
+    void cleared ();
+    void traceSample (qint32 _trace, qint64 _timeUs, float _value);
+
+    // Attitude in degrees from the newest accelerometer and magnetometer
+    // samples, with the body rates in degrees/s and the heading rate
+    // scaled to playback speed.  _sampleNs is the sample's time on
+    // RenderedWidget::clockNs, so the instruments predict it the same way
+    // as live data.
+    void attitudeSample (qreal _roll, qreal _pitch, qreal _heading, qreal _headingRate,
+                         qreal _rateX, qreal _rateY, qreal _rateZ, qint64 _sampleNs);
+
+private slots:
+    void tick ();
+
+private:
+    void readTo (qint64 _positionUs, qint64 _traceFromUs);
+    void publishAttitude ();
+
+    CaptureLog          m_log;
+    CaptureLog::Cursor  m_cursor;
+
+    // The first record past the position, read but not yet played
+    CaptureRecord       m_pending;
+    qint64              m_pendingUs;
+    bool                m_hasPending;
+
+    QTimer              m_timer;
+    QElapsedTimer       m_wallTime;
+    qint64              m_positionUs;
+    qreal               m_speed;
+    qint64              m_historyUs;
+
+    // Newest sample of each sensor at or before the position, -1 for none
+    double              m_latest[CAPTURE_SENSOR_NUM][3];
+    qint64              m_latestUs[CAPTURE_SENSOR_NUM];
+};
+
+#endif // LOG_PLAYER_H
@@ -1,11 +1,39 @@
 #include "imu_gui_proto_main_window.h"
+#include "instrument_bench.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // --bench [instruments] times direct against threaded instrument rendering
+    QStringList args = a.arguments ();
+    qint32 benchIndex = args.indexOf ("--bench");
+    if (benchIndex >= 0)
+    {
+        qint32 instruments = (benchIndex + 1 < args.size ()) ? args[benchIndex + 1].toInt () : 0;
+        InstrumentBench bench (instruments > 0 ? instruments : 16);
+        bench.show ();
+        return a.exec ();
+    }
+
     ImuGuiProtoMainWindow w;
     w.show();
+
+    // --play <file> opens a capture file for playback
+    qint32 playIndex = args.indexOf ("--play");
+    if (playIndex >= 0 && playIndex + 1 < args.size ())
+        w.openLog (args[playIndex + 1]);
+
+    // --live <port> [--baud <rate>] [--compressed] charts the board's capture
+    // stream as it arrives, --compressed for its delta compressed telemetry
+    qint32 liveIndex = args.indexOf ("--live");
+    qint32 baudIndex = args.indexOf ("--baud");
+    if (liveIndex >= 0 && liveIndex + 1 < args.size ())
+    {
+        qint32 baud = (baudIndex >= 0 && baudIndex + 1 < args.size ()) ? args[baudIndex + 1].toInt () : LiveSource::BAUD_DEFAULT;
+        w.openLive (args[liveIndex + 1], baud, args.contains ("--compressed"));
+    }
     
     return a.exec();
 }
@@ -0,0 +1,197 @@
+#include "rendered_widget.h"
+
+#include <QtConcurrent/QtConcurrent>
+
+qint64 RenderedWidget::s_paintNs = 0;
+
+RenderedWidget::RenderedWidget (QWidget* _parent)
+    : QWidget (_parent),
+      m_mode (RENDER_DIRECT),
+      m_inFlight (false),
+      m_pending (false),
+      m_framesRendered (0),
+      m_framesDropped (0),
+      m_renderStartNs (0),
+      m_renderNs (0),
+      m_renderSampleNs (0),
+      m_frameSampleNs (0),
+      m_latencyNs (0),
+      m_meanLatencyNs (0),
+      m_animateUntilNs (0)
+{
+    connect (&m_watcher, SIGNAL (finished ()), this, SLOT (renderFinished ()));
+
+    m_animateTimer.setTimerType (Qt::PreciseTimer);
+    connect (&m_animateTimer, SIGNAL (timeout ()), this, SLOT (animate ()));
+}
+
+RenderedWidget::~RenderedWidget ()
+{
+    m_watcher.waitForFinished ();
+}
+
+QThreadPool* RenderedWidget::renderPool ()
+{
+    static QThreadPool* pool = 0;
+    if (!pool)
+    {
+        pool = new QThreadPool;
+        pool->setMaxThreadCount (qMax (1, QThread::idealThreadCount () - 1));
+    }
+    return pool;
+}
+
+qint64 RenderedWidget::clockNs ()
+{
+    static QElapsedTimer clock;
+    if (!clock.isValid ())
+        clock.start ();
+
+    // Never 0, that stands for no sample
+    return clock.nsecsElapsed () + 1;
+}
+
+void RenderedWidget::setRenderMode (RENDER_MODE _mode)
+{
+    m_mode = _mode;
+    m_pending = false;
+    m_frame = QImage ();
+    m_frameSampleNs = 0;
+    stateChanged ();
+}
+
+qint64 RenderedWidget::displayTimeNs () const
+{
+    qint64 ns = clockNs () + refreshNs ();
+    if (m_mode == RENDER_THREADED)
+        ns += m_renderNs;
+    return ns;
+}
+
+qreal RenderedWidget::predictS (qint64 _sampleNs, qint64 _maxNs) const
+{
+    qint64 aheadNs = displayTimeNs () - _sampleNs;
+    return qBound<qint64> (0, aheadNs, _maxNs) / 1e9;
+}
+
+void RenderedWidget::animateUntil (qint64 _untilNs)
+{
+    m_animateUntilNs = qMax (m_animateUntilNs, _untilNs);
+    if (m_animateTimer.isActive ())
+        return;
+    m_animateTimer.start (qMax<qint64> (1, refreshNs () / 1000000));
+}
+
+void RenderedWidget::animate ()
+{
+    if (clockNs () >= m_animateUntilNs)
+    {
+        m_animateTimer.stop ();
+        return;
+    }
+    stateChanged ();
+}
+
+qint64 RenderedWidget::refreshNs () const
+{
+    QWindow* handle = window ()->windowHandle ();
+    QScreen* screen = handle ? handle->screen () : QGuiApplication::primaryScreen ();
+    qreal hz = screen ? screen->refreshRate () : 0.0;
+    return 1e9 / (hz > 1.0 ? hz : 60.0);
+}
+
+void RenderedWidget::stateChanged ()
+{
+    if (m_mode == RENDER_DIRECT)
+    {
+        update ();
+        return;
+    }
+
+    // Fold into the follow-up render, the state it replaces is never drawn
+    if (m_inFlight)
+    {
+        if (m_pending)
+            m_framesDropped++;
+        m_pending = true;
+        return;
+    }
+
+    startRender ();
+}
+
+void RenderedWidget::startRender ()
+{
+    m_renderStartNs = clockNs ();
+    m_renderSampleNs = sampleTimeNs ();
+    RenderFunc render = makeRenderFunc ();
+    qreal ratio = devicePixelRatioF ();
+    QSize pixels = size () * ratio;
+
+    m_inFlight = true;
+    m_watcher.setFuture (QtConcurrent::run (renderPool (), [render, pixels, ratio] () {
+        QImage frame (pixels, QImage::Format_ARGB32_Premultiplied);
+        frame.setDevicePixelRatio (ratio);
+        frame.fill (Qt::transparent);
+        QPainter painter (&frame);
+        render (painter);
+        return frame;
+    }));
+}
+
+void RenderedWidget::renderFinished ()
+{
+    m_inFlight = false;
+    if (m_mode == RENDER_THREADED)
+    {
+        m_frame = m_watcher.result ();
+        m_frameSampleNs = m_renderSampleNs;
+        m_renderNs = clockNs () - m_renderStartNs;
+        m_framesRendered++;
+        update ();
+    }
+
+    if (m_pending)
+    {
+        m_pending = false;
+        stateChanged ();
+    }
+}
+
+void RenderedWidget::paintEvent (QPaintEvent* _event)
+{
+    QElapsedTimer timer;
+    timer.start ();
+
+    QPainter painter (this);
+    if (m_mode == RENDER_DIRECT)
+    {
+        makeRenderFunc () (painter);
+        m_framesRendered++;
+        frameShown (sampleTimeNs ());
+    }
+    else if (!m_frame.isNull ())
+    {
+        painter.drawImage (0, 0, m_frame);
+        frameShown (m_frameSampleNs);
+    }
+
+    s_paintNs += timer.nsecsElapsed ();
+}
+
+void RenderedWidget::frameShown (qint64 _sampleNs)
+{
+    if (_sampleNs == 0)
+        return;
+    m_latencyNs = clockNs () + refreshNs () - _sampleNs;
+    if (m_meanLatencyNs == 0)
+        m_meanLatencyNs = m_latencyNs;
+    else
+        m_meanLatencyNs += (m_latencyNs - m_meanLatencyNs) / LATENCY_SMOOTHING;
+}
+
+void RenderedWidget::resizeEvent (QResizeEvent* _event)
+{
+    // Frames at the old size are blitted until the new one is ready
+    stateChanged ();
+}
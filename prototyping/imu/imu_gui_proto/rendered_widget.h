@@ -0,0 +1,122 @@
+#ifndef RENDERED_WIDGET_H
+#define RENDERED_WIDGET_H
+
+#include <QtGui>
+#include <QtWidgets/QWidget>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <functional>
+
+// Base for instruments that can draw off the GUI thread.  In RENDER_DIRECT
+// mode paintEvent draws straight onto the widget.  In RENDER_THREADED mode a
+// state change renders a snapshot of the state into a QImage on the render
+// pool, and paintEvent only blits the newest finished frame.  Only one render
+// per widget is in flight; changes arriving meanwhile are coalesced into a
+// single render of the latest state, so stale frames are dropped, not queued.
+//
+// Instruments fed timestamped samples report the age of the sample on screen:
+// from its timestamp to the frame's paint, plus a refresh for the compositor
+// to show it.  Widgets get no vsync, so that refresh is also what they
+// extrapolate over, on top of the last render time when threaded.
+class RenderedWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    typedef enum RENDER_MODE_ENUM
+    {
+        RENDER_DIRECT = 0,
+        RENDER_THREADED,
+        RENDER_MODE_NUM
+    } RENDER_MODE;
+
+    // Draws one snapshot of the state, may only use what it captured
+    typedef std::function<void (QPainter&)> RenderFunc;
+
+    // Weight of a new frame in the mean latency is 1 / LATENCY_SMOOTHING
+    static const qint64     LATENCY_SMOOTHING = 16;
+
+    explicit RenderedWidget (QWidget* _parent = 0);
+    ~RenderedWidget ();
+
+    RENDER_MODE getRenderMode () const {return m_mode;}
+
+    quint64 getFramesRendered () const {return m_framesRendered;}
+    quint64 getFramesDropped () const {return m_framesDropped;}
+
+    // GUI thread time spent in paintEvent by all instruments
+    static qint64 getPaintNs () {return s_paintNs;}
+    static void resetPaintNs () {s_paintNs = 0;}
+
+    // Shared by all instruments, leaves a core for the GUI thread
+    static QThreadPool* renderPool ();
+
+    // Monotonic clock for sample timestamps, shared by all instruments.
+    // Whoever feeds them maps telemetry times onto it.
+    static qint64 clockNs ();
+
+    // Age of the sample on screen for the newest frame and on average, 0
+    // until a timestamped sample is shown
+    qint64 getLatencyNs () const {return m_latencyNs;}
+    qint64 getMeanLatencyNs () const {return m_meanLatencyNs;}
+
+public slots:
+    void setRenderMode (RENDER_MODE _mode);
+    void setThreaded (bool _threaded) {setRenderMode (_threaded ? RENDER_THREADED : RENDER_DIRECT);}
+
+protected:
+    // Copy whatever the paint needs, called on the GUI thread
+    virtual RenderFunc makeRenderFunc () const = 0;
+
+    // Subclasses call this instead of update () when their state changes
+    void stateChanged ();
+
+    // Timestamp (clockNs) of the sample the state came from, 0 for none
+    virtual qint64 sampleTimeNs () const {return 0;}
+
+    // When a frame whose state is taken now will be on screen, and how far
+    // that is past _sampleNs in seconds, up to _maxNs
+    qint64 displayTimeNs () const;
+    qreal predictS (qint64 _sampleNs, qint64 _maxNs) const;
+
+    // Render every refresh until _untilNs, for state extrapolated between
+    // samples
+    void animateUntil (qint64 _untilNs);
+
+    void paintEvent (QPaintEvent* _event);
+    void resizeEvent (QResizeEvent* _event);
+
+private slots:
+    void renderFinished ();
+    void animate ();
+
+private:
+    void startRender ();
+    qint64 refreshNs () const;
+    void frameShown (qint64 _sampleNs);
+
+    RENDER_MODE             m_mode;
+    QFutureWatcher<QImage>  m_watcher;
+    bool                    m_inFlight;
+    bool                    m_pending;
+    QImage                  m_frame;
+    quint64                 m_framesRendered;
+    quint64                 m_framesDropped;
+
+    // Render time of the last threaded frame, and the samples behind the
+    // frame in flight and the one held
+    qint64                  m_renderStartNs;
+    qint64                  m_renderNs;
+    qint64                  m_renderSampleNs;
+    qint64                  m_frameSampleNs;
+
+    qint64                  m_latencyNs;
+    qint64                  m_meanLatencyNs;
+
+    QTimer                  m_animateTimer;
+    qint64                  m_animateUntilNs;
+
+    static qint64           s_paintNs;
+};
+
+#endif // RENDERED_WIDGET_H
@@ -0,0 +1,326 @@
+#include "strip_chart.h"
+
+#include <cfloat>
+
+StripChartTrace::StripChartTrace (const QString& _name, const QColor& _color, qint64 _capacity)
+    : m_name (_name),
+      m_color (_color),
+      m_capacityMax (SUPER_BLOCK_SIZE),
+      m_capacity (SUPER_BLOCK_SIZE),
+      m_mask (SUPER_BLOCK_SIZE - 1),
+      m_count (0)
+{
+    // Capacity is a power of two and a whole number of super blocks so block
+    // boundaries line up with the ring index
+    while (m_capacityMax < _capacity)
+        m_capacityMax <<= 1;
+
+    m_time.resize (m_capacity);
+    m_value.resize (m_capacity);
+    m_blockMin.resize (m_capacity / BLOCK_SIZE);
+    m_blockMax.resize (m_capacity / BLOCK_SIZE);
+    m_superMin.resize (m_capacity / SUPER_BLOCK_SIZE);
+    m_superMax.resize (m_capacity / SUPER_BLOCK_SIZE);
+}
+
+void StripChartTrace::addSample (qint64 _timeUs, float _value)
+{
+    if (m_count == m_capacity && m_capacity < m_capacityMax)
+        grow ();
+
+    qint64 pos = m_count & m_mask;
+    qint64 block = pos / BLOCK_SIZE;
+    qint64 super = pos / SUPER_BLOCK_SIZE;
+
+    m_time[pos] = _timeUs;
+    m_value[pos] = _value;
+
+    // The first sample written into a block replaces its old summary
+    if ((pos % BLOCK_SIZE) == 0)
+    {
+        m_blockMin[block] = _value;
+        m_blockMax[block] = _value;
+    }
+    else
+    {
+        m_blockMin[block] = qMin (m_blockMin[block], _value);
+        m_blockMax[block] = qMax (m_blockMax[block], _value);
+    }
+
+    if ((pos % SUPER_BLOCK_SIZE) == 0)
+    {
+        m_superMin[super] = _value;
+        m_superMax[super] = _value;
+    }
+    else
+    {
+        m_superMin[super] = qMin (m_superMin[super], _value);
+        m_superMax[super] = qMax (m_superMax[super], _value);
+    }
+
+    m_count++;
+}
+
+void StripChartTrace::grow ()
+{
+    // Only called before the ring first wraps, so every sample and summary
+    // is already at its index under the doubled mask
+    m_capacity <<= 1;
+    m_mask = m_capacity - 1;
+
+    m_time.resize (m_capacity);
+    m_value.resize (m_capacity);
+    m_blockMin.resize (m_capacity / BLOCK_SIZE);
+    m_blockMax.resize (m_capacity / BLOCK_SIZE);
+    m_superMin.resize (m_capacity / SUPER_BLOCK_SIZE);
+    m_superMax.resize (m_capacity / SUPER_BLOCK_SIZE);
+}
+
+void StripChartTrace::clear ()
+{
+    m_count = 0;
+}
+
+qint64 StripChartTrace::lowerBound (qint64 _timeUs) const
+{
+    qint64 lo = firstIndex ();
+    qint64 hi = endIndex ();
+    while (lo < hi)
+    {
+        qint64 mid = lo + (hi - lo) / 2;
+        if (timeAt (mid) < _timeUs)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool StripChartTrace::minMax (qint64 _from, qint64 _to, float* _min, float* _max) const
+{
+    _from = qMax (_from, firstIndex ());
+    _to = qMin (_to, endIndex ());
+    if (_from >= _to)
+        return false;
+
+    float lo = FLT_MAX;
+    float hi = -FLT_MAX;
+    while (_from < _to)
+    {
+        qint64 pos = _from & m_mask;
+        if ((pos % SUPER_BLOCK_SIZE) == 0 && (_from + SUPER_BLOCK_SIZE) <= _to)
+        {
+            lo = qMin (lo, m_superMin[pos / SUPER_BLOCK_SIZE]);
+            hi = qMax (hi, m_superMax[pos / SUPER_BLOCK_SIZE]);
+            _from += SUPER_BLOCK_SIZE;
+        }
+        else if ((pos % BLOCK_SIZE) == 0 && (_from + BLOCK_SIZE) <= _to)
+        {
+            lo = qMin (lo, m_blockMin[pos / BLOCK_SIZE]);
+            hi = qMax (hi, m_blockMax[pos / BLOCK_SIZE]);
+            _from += BLOCK_SIZE;
+        }
+        else
+        {
+            lo = qMin (lo, m_value[pos]);
+            hi = qMax (hi, m_value[pos]);
+            _from++;
+        }
+    }
+
+    *_min = lo;
+    *_max = hi;
+    return true;
+}
+
+StripChart::StripChart (QWidget* parent)
+    : QWidget (parent),
+      m_timeWindowUs (TIME_WINDOW_DEFAULT_US),
+      m_latestTimeUs (0),
+      m_autoScale (true),
+      m_valueMin (-1.0f),
+      m_valueMax (1.0f),
+      m_dirty (true)
+{
+    // Repaint at most once per display frame and only when new data arrived
+    QTimer* timer = new QTimer (this);
+    connect (timer, SIGNAL (timeout ()), this, SLOT (refresh ()));
+    timer->start (REFRESH_INTERVAL_MS);
+
+    setMinimumHeight (CHART_HEIGHT_MIN);
+    setSizePolicy (QSizePolicy::Expanding, QSizePolicy::Expanding);
+    setFocusPolicy (Qt::StrongFocus);
+}
+
+StripChart::~StripChart ()
+{
+    qDeleteAll (m_traces);
+}
+
+qint32 StripChart::addTrace (const QString& _name, const QColor& _color, qint64 _capacity)
+{
+    m_traces.append (new StripChartTrace (_name, _color, _capacity));
+    m_dirty = true;
+    return m_traces.size () - 1;
+}
+
+void StripChart::addSample (qint32 _trace, qint64 _timeUs, float _value)
+{
+    if (_trace < 0 || _trace >= m_traces.size ())
+        return;
+
+    m_traces[_trace]->addSample (_timeUs, _value);
+    m_latestTimeUs = qMax (m_latestTimeUs, _timeUs);
+    m_dirty = true;
+}
+
+void StripChart::setTimeWindow (qint64 _windowUs)
+{
+    m_timeWindowUs = qMax (static_cast<qint64> (1000), _windowUs);
+    m_dirty = true;
+}
+
+void StripChart::setValueRange (float _min, float _max)
+{
+    m_valueMin = _min;
+    m_valueMax = _max;
+    m_autoScale = false;
+    m_dirty = true;
+}
+
+void StripChart::setAutoScale (bool _autoScale)
+{
+    m_autoScale = _autoScale;
+    m_dirty = true;
+}
+
+void StripChart::clear ()
+{
+    for (qint32 i = 0; i < m_traces.size (); i++)
+        m_traces[i]->clear ();
+    m_latestTimeUs = 0;
+    m_dirty = true;
+}
+
+void StripChart::refresh ()
+{
+    if (m_dirty)
+        update ();
+}
+
+void StripChart::paintEvent (QPaintEvent* _event)
+{
+    QPainter painter (this);
+    qint32 w = qMax (1, width ());
+    qint32 h = height ();
+    qint32 numTraces = m_traces.size ();
+
+    painter.fillRect (rect (), Qt::black);
+
+    // Reduce every trace to one min/max pair per pixel column so the cost of a
+    // frame depends on the width of the widget, not on the samples in the window
+    m_columnMin.resize (w * numTraces);
+    m_columnMax.resize (w * numTraces);
+    m_columnValid.resize (w * numTraces);
+
+    qint64 startUs = m_latestTimeUs - m_timeWindowUs;
+    float lo = FLT_MAX;
+    float hi = -FLT_MAX;
+    for (qint32 t = 0; t < numTraces; t++)
+    {
+        const StripChartTrace* trace = m_traces[t];
+        qint64 from = trace->lowerBound (startUs);
+        for (qint32 c = 0; c < w; c++)
+        {
+            qint64 endUs = startUs + (m_timeWindowUs * (c + 1)) / w;
+            qint64 to = trace->lowerBound (endUs);
+            qint32 i = t * w + c;
+            m_columnValid[i] = trace->minMax (from, to, &m_columnMin[i], &m_columnMax[i]);
+            if (m_columnValid[i])
+            {
+                lo = qMin (lo, m_columnMin[i]);
+                hi = qMax (hi, m_columnMax[i]);
+            }
+            from = to;
+        }
+    }
+
+    if (m_autoScale && lo <= hi)
+    {
+        // Keep a little margin and avoid a zero height range for flat traces
+        float margin = qMax ((hi - lo) * 0.05f, 0.5f);
+        m_valueMin = lo - margin;
+        m_valueMax = hi + margin;
+    }
+    qreal yScale = h / static_cast<qreal> (m_valueMax - m_valueMin);
+
+    // Draw horizontal grid and zero line
+    painter.setPen (QColor (60, 60, 60));
+    for (qint32 i = 1; i < 4; i++)
+        painter.drawLine (0, (h * i) / 4, w, (h * i) / 4);
+    if (m_valueMin < 0.0f && m_valueMax > 0.0f)
+    {
+        painter.setPen (QColor (120, 120, 120));
+        qreal zeroY = h - (-m_valueMin * yScale);
+        painter.drawLine (QPointF (0, zeroY), QPointF (w, zeroY));
+    }
+
+    // Draw traces as a vertical min to max run per column
+    for (qint32 t = 0; t < numTraces; t++)
+    {
+        painter.setPen (m_traces[t]->getColor ());
+        m_polyline.clear ();
+        for (qint32 c = 0; c < w; c++)
+        {
+            qint32 i = t * w + c;
+            if (!m_columnValid[i])
+            {
+                if (m_polyline.size () > 0)
+                    painter.drawPolyline (m_polyline);
+                m_polyline.clear ();
+                continue;
+            }
+            m_polyline.append (QPointF (c, h - (m_columnMax[i] - m_valueMin) * yScale));
+            m_polyline.append (QPointF (c, h - (m_columnMin[i] - m_valueMin) * yScale));
+        }
+        if (m_polyline.size () > 0)
+            painter.drawPolyline (m_polyline);
+    }
+
+    // Draw legend and scale text
+    painter.setFont (QFont ("Helvetica", 8));
+    QFontMetrics fm = painter.fontMetrics ();
+    qint32 x = 4;
+    for (qint32 t = 0; t < numTraces; t++)
+    {
+        painter.setPen (m_traces[t]->getColor ());
+        painter.drawText (x, fm.height (), m_traces[t]->getName ());
+        x += fm.width (m_traces[t]->getName ()) + 8;
+    }
+    painter.setPen (Qt::white);
+    painter.drawText (4, 2 * fm.height (), QString::number (m_valueMax, 'g', 4));
+    painter.drawText (4, h - 4, QString::number (m_valueMin, 'g', 4));
+    QString window = QString ("%1 s").arg (m_timeWindowUs / 1000000.0);
+    painter.drawText (w - fm.width (window) - 4, h - 4, window);
+
+    m_dirty = false;
+}
+
+void StripChart::keyPressEvent (QKeyEvent* _event)
+{
+    switch (_event->key())
+    {
+        case Qt::Key_Plus:
+            setTimeWindow (m_timeWindowUs / 2);
+            break;
+        case Qt::Key_Minus:
+            setTimeWindow (m_timeWindowUs * 2);
+            break;
+        case Qt::Key_A:
+            setAutoScale (!m_autoScale);
+            break;
+        default:
+            break;
+    }
+    update ();
+}
@@ -0,0 +1,103 @@
+#ifndef STRIP_CHART_H
+#define STRIP_CHART_H
+
+#include <QtGui>
+#include <QWidget>
+#include <QPainter>
+#include <QVector>
+
+// Ring buffer of timestamped samples for one trace.  Min/max summaries are kept
+// for fixed size blocks and super blocks of the ring so the min/max of any
+// sample range can be found without touching every sample in it.  The ring
+// starts at one super block and doubles as samples arrive, up to _capacity.
+class StripChartTrace
+{
+public:
+    static const qint64 BLOCK_SIZE = 64;
+    static const qint64 SUPER_BLOCK_SIZE = BLOCK_SIZE * 64;
+
+    StripChartTrace (const QString& _name, const QColor& _color, qint64 _capacity);
+
+    const QString& getName () const {return m_name;}
+    const QColor& getColor () const {return m_color;}
+
+    void addSample (qint64 _timeUs, float _value);
+    void clear ();
+
+    // Absolute indices of the oldest valid and one past the newest sample
+    qint64 firstIndex () const {return qMax (static_cast<qint64> (0), m_count - m_capacity);}
+    qint64 endIndex () const {return m_count;}
+    qint64 timeAt (qint64 _index) const {return m_time[_index & m_mask];}
+
+    // First sample index with time >= _timeUs
+    qint64 lowerBound (qint64 _timeUs) const;
+
+    // Min and max of the samples in [_from, _to), returns false if empty
+    bool minMax (qint64 _from, qint64 _to, float* _min, float* _max) const;
+
+private:
+    void grow ();
+
+    QString         m_name;
+    QColor          m_color;
+    qint64          m_capacityMax;
+    qint64          m_capacity;
+    qint64          m_mask;
+    qint64          m_count;
+    QVector<qint64> m_time;
+    QVector<float>  m_value;
+    QVector<float>  m_blockMin;
+    QVector<float>  m_blockMax;
+    QVector<float>  m_superMin;
+    QVector<float>  m_superMax;
+};
+
+class StripChart : public QWidget
+{
+    Q_OBJECT
+public:
+    static const quint32 CHART_HEIGHT_MIN = 150;
+    static const qint64  TRACE_CAPACITY_DEFAULT = 1 << 21;
+    static const qint64  TIME_WINDOW_DEFAULT_US = 10000000;
+    static const qint32  REFRESH_INTERVAL_MS = 16;
+
+    explicit StripChart (QWidget* parent = 0);
+    ~StripChart ();
+
+    // Returns the trace handle used by addSample
+    qint32 addTrace (const QString& _name, const QColor& _color, qint64 _capacity = TRACE_CAPACITY_DEFAULT);
+    qint32 getNumTraces () const {return m_traces.size ();}
+
+    qint64 getTimeWindow () const {return m_timeWindowUs;}
+    bool getAutoScale () const {return m_autoScale;}
+public slots:
+    void addSample (qint32 _trace, qint64 _timeUs, float _value);
+    void setTimeWindow (qint64 _windowUs);
+    void setValueRange (float _min, float _max);
+    void setAutoScale (bool _autoScale);
+    void clear ();
+
+protected:
+    void paintEvent (QPaintEvent* _event);
+    void keyPressEvent (QKeyEvent* _event);
+
+private slots:
+    void refresh ();
+
+private:
+    QVector<StripChartTrace*>   m_traces;
+    qint64                      m_timeWindowUs;
+    qint64                      m_latestTimeUs;
+    bool                        m_autoScale;
+    float                       m_valueMin;
+    float                       m_valueMax;
+    bool                        m_dirty;
+
+    // Per column min/max scratch buffers reused across frames
+    QVector<float>              m_columnMin;
+    QVector<float>              m_columnMax;
+    QVector<bool>               m_columnValid;
+    QPolygonF                   m_polyline;
+};
+
+#endif // STRIP_CHART_H
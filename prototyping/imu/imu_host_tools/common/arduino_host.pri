@@ -0,0 +1,29 @@
+# Host stand-in for the Arduino core and the sketch's sensors, for tools that
+# run the imu_embedded_sw drivers themselves over SimTransport.  Included
+# after common.pri.
+
+DEFINES += ARDUINO=10600
+
+INCLUDEPATH += $$PWD/arduino_host
+
+SOURCES += $$PWD/arduino_host/arduino_host.cpp \
+    $$PWD/sim_sensors.cpp \
+    $$PWD/../../imu_embedded_sw/L3G4200D.cpp \
+    $$PWD/../../imu_embedded_sw/ADXL345.cpp \
+    $$PWD/../../imu_embedded_sw/BMP085.cpp \
+    $$PWD/../../imu_embedded_sw/DMABlockReader.cpp \
+    $$PWD/../../imu_embedded_sw/SimTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTrace.cpp
+
+HEADERS += $$PWD/arduino_host/Arduino.h \
+    $$PWD/arduino_host/Wire.h \
+    $$PWD/arduino_host/SPI.h \
+    $$PWD/sim_sensors.h \
+    $$PWD/../../imu_embedded_sw/L3G4200D.h \
+    $$PWD/../../imu_embedded_sw/ADXL345.h \
+    $$PWD/../../imu_embedded_sw/BMP085.h \
+    $$PWD/../../imu_embedded_sw/DMABlockReader.h \
+    $$PWD/../../imu_embedded_sw/SimTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTrace.h
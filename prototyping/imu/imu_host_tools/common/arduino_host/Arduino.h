@@ -0,0 +1,78 @@
+#ifndef ARDUINO_HOST_ARDUINO_H
+#define ARDUINO_HOST_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// glibc's byte order macros, the Teensy core has none and the drivers use
+// the names for register bits
+#undef BIG_ENDIAN
+#undef LITTLE_ENDIAN
+
+// Enough of the Teensy core for the imu_embedded_sw drivers to run on the
+// host, over SimTransport in place of their I2C.  Nothing happens on its own:
+// time only moves when the tool sets it, pins read what the tool drives them
+// to, and attachInterrupt and IntervalTimer only record their handlers for
+// the tool to call when it decides the edge or tick is due.
+
+#define HIGH            1
+#define LOW             0
+
+#define INPUT           0
+#define OUTPUT          1
+
+#define FALLING         2
+#define RISING          3
+
+#define MSBFIRST        1
+
+#define PI              3.1415926535897932384626433832795
+#define DEG_TO_RAD      0.017453292519943295769236907684886
+#define RAD_TO_DEG      57.295779513082320876798154814105
+
+uint32_t micros ();
+uint32_t millis ();
+// Moves the clock on by _ms, the drivers' synchronous reads wait with it
+void delay (uint32_t _ms);
+
+void pinMode (uint8_t _pin, uint8_t _mode);
+int digitalRead (uint8_t _pin);
+void digitalWrite (uint8_t _pin, uint8_t _level);
+
+void attachInterrupt (uint8_t _pin, void (*_isr) (), int _mode);
+void detachInterrupt (uint8_t _pin);
+
+// One thread, nothing preempts the drivers
+inline void noInterrupts () {}
+inline void interrupts () {}
+
+class IntervalTimer
+{
+public:
+    IntervalTimer () : m_isr (NULL) {}
+    ~IntervalTimer () {end ();}
+
+    // A second begin () restarts the timer at the new period
+    bool begin (void (*_isr) (), uint32_t _perioduS);
+    void end ();
+private:
+    void (*m_isr) ();
+};
+
+// Host side, for the tool driving the drivers
+typedef void (*HostISR) ();
+
+static const uint8_t HOST_PINS = 64;
+
+void hostSetMicros (uint32_t _uS);
+// Level digitalRead returns, a device model drives its interrupt pin with it
+void hostSetPin (uint8_t _pin, uint8_t _level);
+// Handler attachInterrupt put on _pin, NULL if none
+HostISR hostPinISR (uint8_t _pin);
+// Period of the running IntervalTimer that calls _isr, 0 if none does
+uint32_t hostTimerPeriod (HostISR _isr);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef ARDUINO_HOST_SPI_H
+#define ARDUINO_HOST_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE3       0x0C
+
+// SPI controller with nothing on the bus, for the drivers' SPITransport,
+// which the tools replace with SimTransport.  MISO floats high.
+class SPISettings
+{
+public:
+    SPISettings () {}
+    SPISettings (uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass
+{
+public:
+    void begin () {}
+    void beginTransaction (const SPISettings&) {}
+    void endTransaction () {}
+    uint8_t transfer (uint8_t) {return 0xFF;}
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef ARDUINO_HOST_WIRE_H
+#define ARDUINO_HOST_WIRE_H
+
+#include "Arduino.h"
+
+// I2C controller with nothing on the bus, only there for the drivers' own
+// I2CTransport members.  Every address acknowledges and reads float high, so
+// a transport used by mistake returns 0xFF instead of hanging.
+class TwoWire
+{
+public:
+    TwoWire () : m_available (0) {}
+
+    void begin () {}
+    void setClock (uint32_t) {}
+
+    void beginTransmission (uint8_t) {}
+    size_t write (uint8_t) {return 1;}
+    uint8_t endTransmission (bool = true) {return 0;}
+
+    uint8_t requestFrom (uint8_t, uint8_t _len) {m_available = _len; return _len;}
+    int available () {return m_available;}
+    int read ()
+    {
+        if (m_available == 0)
+            return -1;
+        m_available--;
+        return 0xFF;
+    }
+private:
+    int     m_available;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif
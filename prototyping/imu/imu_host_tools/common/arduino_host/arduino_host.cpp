@@ -0,0 +1,92 @@
+#include <map>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+
+TwoWire Wire;
+TwoWire Wire1;
+SPIClass SPI;
+
+static uint32_t                     s_uS = 0;
+static uint8_t                      s_pinLevel[HOST_PINS];
+static HostISR                      s_pinISR[HOST_PINS];
+static std::map<HostISR, uint32_t>  s_timers;
+
+uint32_t micros ()
+{
+    return s_uS;
+}
+
+uint32_t millis ()
+{
+    return s_uS / 1000;
+}
+
+void delay (uint32_t _ms)
+{
+    s_uS += _ms * 1000;
+}
+
+void pinMode (uint8_t, uint8_t)
+{
+}
+
+int digitalRead (uint8_t _pin)
+{
+    return (_pin < HOST_PINS) ? s_pinLevel[_pin] : LOW;
+}
+
+void digitalWrite (uint8_t _pin, uint8_t _level)
+{
+    if (_pin < HOST_PINS)
+        s_pinLevel[_pin] = _level;
+}
+
+void attachInterrupt (uint8_t _pin, void (*_isr) (), int)
+{
+    if (_pin < HOST_PINS)
+        s_pinISR[_pin] = _isr;
+}
+
+void detachInterrupt (uint8_t _pin)
+{
+    if (_pin < HOST_PINS)
+        s_pinISR[_pin] = NULL;
+}
+
+bool IntervalTimer::begin (void (*_isr) (), uint32_t _perioduS)
+{
+    end ();
+    m_isr = _isr;
+    s_timers[m_isr] = _perioduS;
+    return true;
+}
+
+void IntervalTimer::end ()
+{
+    if (m_isr)
+        s_timers.erase (m_isr);
+    m_isr = NULL;
+}
+
+void hostSetMicros (uint32_t _uS)
+{
+    s_uS = _uS;
+}
+
+void hostSetPin (uint8_t _pin, uint8_t _level)
+{
+    digitalWrite (_pin, _level);
+}
+
+HostISR hostPinISR (uint8_t _pin)
+{
+    return (_pin < HOST_PINS) ? s_pinISR[_pin] : NULL;
+}
+
+uint32_t hostTimerPeriod (HostISR _isr)
+{
+    std::map<HostISR, uint32_t>::const_iterator timer = s_timers.find (_isr);
+    return (timer != s_timers.end ()) ? timer->second : 0;
+}
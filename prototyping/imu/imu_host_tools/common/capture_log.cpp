@@ -0,0 +1,160 @@
+#include "capture_log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CaptureLog::CaptureLog ()
+    : m_fd (-1),
+      m_data (NULL),
+      m_bytes (0),
+      m_startuS (0),
+      m_enduS (0)
+{
+}
+
+CaptureLog::~CaptureLog ()
+{
+    close ();
+}
+
+bool CaptureLog::open (const std::string& _path)
+{
+    close ();
+
+    m_fd = ::open (_path.c_str (), O_RDONLY);
+    if (m_fd < 0)
+        return false;
+    struct stat st;
+    if (fstat (m_fd, &st) != 0 || st.st_size < (off_t) sizeof (CaptureRecord))
+    {
+        close ();
+        return false;
+    }
+    void* data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close ();
+        return false;
+    }
+    m_data = (const unsigned char*) data;
+    m_bytes = st.st_size;
+
+    // One probe per stride, each unwrapped against the one before.  Without
+    // read ahead each probe faults in a page, not a window around it.
+    madvise (data, m_bytes, MADV_RANDOM);
+    for (uint64_t probe = 0; probe < m_bytes; probe += INDEX_STRIDE_BYTES)
+    {
+        uint64_t offset;
+        CaptureRecord record;
+        if (!resync (probe, offset, record))
+            continue;
+        Cursor entry;
+        entry.offset = offset;
+        entry.timeuS = m_index.empty () ? record.timeuS : unwrap (m_index.back ().timeuS, record.timeuS);
+        if (m_index.empty () || entry.offset > m_index.back ().offset)
+            m_index.push_back (entry);
+    }
+    if (m_index.empty ())
+    {
+        close ();
+        return false;
+    }
+    m_startuS = m_index.front ().timeuS;
+
+    // The end is within the last stride
+    Cursor cursor = m_index.back ();
+    CaptureRecord record;
+    while (next (cursor, record))
+        ;
+    m_enduS = cursor.timeuS;
+
+    // Back to read ahead for playing on from a seek
+    madvise (data, m_bytes, MADV_NORMAL);
+    return true;
+}
+
+void CaptureLog::close ()
+{
+    if (m_data)
+        munmap ((void*) m_data, m_bytes);
+    if (m_fd >= 0)
+        ::close (m_fd);
+    m_fd = -1;
+    m_data = NULL;
+    m_bytes = 0;
+    m_index.clear ();
+    m_startuS = 0;
+    m_enduS = 0;
+}
+
+CaptureLog::Cursor CaptureLog::seek (long long _timeuS) const
+{
+    Cursor start = {0, m_startuS};
+    if (m_index.empty ())
+        return start;
+
+    // Last entry strictly before, so no record at _timeuS is skipped
+    std::vector<Cursor>::const_iterator it = std::lower_bound (m_index.begin (), m_index.end (), _timeuS,
+        [] (const Cursor& _entry, long long _t) {return _entry.timeuS < _t;});
+    if (it == m_index.begin ())
+        return *it;
+    return *(it - 1);
+}
+
+bool CaptureLog::next (Cursor& _cursor, CaptureRecord& _record) const
+{
+    uint64_t offset = _cursor.offset;
+    if (!recordAt (offset, _record))
+    {
+        if (offset + sizeof (CaptureRecord) > m_bytes)
+            return false;
+        // Corrupted, skip to the next record that checks out
+        uint64_t from = offset + 1;
+        while (!resync (from, offset, _record))
+        {
+            from += RESYNC_MAX_BYTES;
+            if (from + sizeof (CaptureRecord) > m_bytes)
+                return false;
+        }
+    }
+    _cursor.offset = offset + sizeof (CaptureRecord);
+    _cursor.timeuS = unwrap (_cursor.timeuS, _record.timeuS);
+    return true;
+}
+
+bool CaptureLog::recordAt (uint64_t _offset, CaptureRecord& _record) const
+{
+    if (_offset + sizeof (CaptureRecord) > m_bytes)
+        return false;
+    memcpy (&_record, m_data + _offset, sizeof (_record));
+    return _record.sync == CAPTURE_SYNC && _record.sensor < CAPTURE_SENSOR_NUM &&
+           _record.axes != 0 && _record.axes <= 3;
+}
+
+bool CaptureLog::resync (uint64_t _from, uint64_t& _offset, CaptureRecord& _record) const
+{
+    uint64_t last = std::min (_from + RESYNC_MAX_BYTES, m_bytes);
+    for (uint64_t offset = _from; offset < last && offset + sizeof (CaptureRecord) <= m_bytes; offset++)
+    {
+        if (!recordAt (offset, _record))
+            continue;
+        CaptureRecord following;
+        uint64_t after = offset + sizeof (CaptureRecord);
+        if (after + sizeof (CaptureRecord) > m_bytes || recordAt (after, following))
+        {
+            _offset = offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+long long CaptureLog::unwrap (long long _previousuS, uint32_t _timeuS)
+{
+    // Times only move forward, by less than a wrap
+    return _previousuS + (uint32_t) (_timeuS - (uint32_t) _previousuS);
+}
@@ -0,0 +1,69 @@
+#ifndef CAPTURE_LOG_H
+#define CAPTURE_LOG_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "CaptureRecord.h"
+
+// Random access to a capture file through mmap, for playback and scrubbing.
+// Opening probes the file every INDEX_STRIDE_BYTES for the next valid record
+// instead of reading it, so only a page per probe is touched and multi-GB
+// logs open at once.  The probes make a sparse time index: a seek is a binary
+// search of it plus a scan of at most one stride.
+//
+// The records' 32 bit microsecond times wrap every 71 minutes.  Times here
+// are unwrapped, which assumes no gap between records and no stride spans a
+// wrap (a stride of 1 MiB has to hold more than 71 minutes of data for that,
+// under 250 bytes/s).
+class CaptureLog
+{
+public:
+    static const uint64_t INDEX_STRIDE_BYTES = 1024 * 1024;
+
+    // A record that only looks valid must be followed by another valid one
+    // (or the end of the file) to be taken as a resync point
+    static const uint64_t RESYNC_MAX_BYTES = 4096;
+
+    // Where reading continues, and the unwrapped time of the last record read
+    typedef struct cursor_struct
+    {
+        uint64_t        offset;
+        long long       timeuS;
+    } Cursor;
+
+    CaptureLog ();
+    ~CaptureLog ();
+
+    bool open (const std::string& _path);
+    void close ();
+    bool isOpen () const {return m_data != NULL;}
+
+    uint64_t getBytes () const {return m_bytes;}
+    size_t getIndexEntries () const {return m_index.size ();}
+    long long getStartuS () const {return m_startuS;}
+    long long getEnduS () const {return m_enduS;}
+
+    // Cursor at the last index entry before _timeuS, reading from it reaches
+    // the first record at or after _timeuS within a stride
+    Cursor seek (long long _timeuS) const;
+
+    // Next valid record from the cursor and its unwrapped time, false at the
+    // end of the file
+    bool next (Cursor& _cursor, CaptureRecord& _record) const;
+
+private:
+    bool recordAt (uint64_t _offset, CaptureRecord& _record) const;
+    bool resync (uint64_t _from, uint64_t& _offset, CaptureRecord& _record) const;
+    static long long unwrap (long long _previousuS, uint32_t _timeuS);
+
+    int                     m_fd;
+    const unsigned char*    m_data;
+    uint64_t                m_bytes;
+    std::vector<Cursor>     m_index;
+    long long               m_startuS;
+    long long               m_enduS;
+};
+
+#endif // CAPTURE_LOG_H
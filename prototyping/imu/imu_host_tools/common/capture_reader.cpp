@@ -0,0 +1,154 @@
+#include "capture_reader.h"
+
+#include <cstring>
+
+CaptureReader::CaptureReader ()
+    : m_file (NULL),
+      m_ownFile (false),
+      m_pos (0),
+      m_end (0),
+      m_eof (false),
+      m_records (0),
+      m_skippedBytes (0)
+{
+}
+
+CaptureReader::~CaptureReader ()
+{
+    close ();
+}
+
+bool CaptureReader::open (const std::string& _path)
+{
+    close ();
+
+    if (_path == "-")
+    {
+        m_file = stdin;
+        m_ownFile = false;
+    }
+    else
+    {
+        m_file = fopen (_path.c_str (), "rb");
+        m_ownFile = true;
+    }
+    if (!m_file)
+        return false;
+
+    m_buf.resize (CHUNK_BYTES);
+    m_pos = 0;
+    m_end = 0;
+    m_eof = false;
+    m_records = 0;
+    m_skippedBytes = 0;
+    return true;
+}
+
+void CaptureReader::close ()
+{
+    if (m_file && m_ownFile)
+        fclose (m_file);
+    m_file = NULL;
+}
+
+bool CaptureReader::fill ()
+{
+    // Move the partial record to the front and top the buffer up
+    size_t left = m_end - m_pos;
+    memmove (&m_buf[0], &m_buf[m_pos], left);
+    m_pos = 0;
+    m_end = left;
+
+    size_t got = fread (&m_buf[m_end], 1, m_buf.size () - m_end, m_file);
+    m_end += got;
+    if (got == 0)
+        m_eof = true;
+    return got > 0;
+}
+
+bool CaptureReader::read (std::vector<CaptureRecord>& _out, size_t _max)
+{
+    if (!m_file)
+        return false;
+
+    size_t n = 0;
+    while (n < _max)
+    {
+        if (m_end - m_pos < sizeof (CaptureRecord))
+        {
+            if (m_eof || !fill ())
+                return n > 0;
+            continue;
+        }
+
+        CaptureRecord rec;
+        memcpy (&rec, &m_buf[m_pos], sizeof (rec));
+        if (!isRecord (rec))
+        {
+            m_pos++;
+            m_skippedBytes++;
+            continue;
+        }
+
+        _out.push_back (rec);
+        m_pos += sizeof (rec);
+        m_records++;
+        n++;
+    }
+    return true;
+}
+
+bool CaptureReader::isRecord (const CaptureRecord& _rec)
+{
+    return _rec.sync == CAPTURE_SYNC && _rec.sensor < CAPTURE_SENSOR_NUM && _rec.axes > 0 && _rec.axes <= 3;
+}
+
+// Driver defaults: L3G4200D 250 dps, ADXL345 full res, HMC5883L gain 1090
+double CaptureReader::sensorScale (CAPTURE_SENSOR _sensor)
+{
+    switch (_sensor)
+    {
+        case CAPTURE_GYRO:
+            return 0.00875;
+        case CAPTURE_ACC:
+            return 3.90625;
+        case CAPTURE_MAG:
+            return 1.0 / 1090.0;
+        default:
+            return 1.0;
+    }
+}
+
+const char* CaptureReader::sensorUnit (CAPTURE_SENSOR _sensor)
+{
+    switch (_sensor)
+    {
+        case CAPTURE_GYRO:
+            return "dps";
+        case CAPTURE_ACC:
+            return "mg";
+        case CAPTURE_MAG:
+            return "G";
+        default:
+            return "raw";
+    }
+}
+
+const char* CaptureReader::sensorName (CAPTURE_SENSOR _sensor)
+{
+    switch (_sensor)
+    {
+        case CAPTURE_GYRO:
+            return "gyro";
+        case CAPTURE_ACC:
+            return "acc";
+        case CAPTURE_MAG:
+            return "mag";
+        case CAPTURE_PRESSURE:
+            return "pressure";
+        case CAPTURE_TEMP:
+            return "temp";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef CAPTURE_READER_H
+#define CAPTURE_READER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "CaptureRecord.h"
+
+// Streams CaptureRecords out of a capture file (or stdin for "-") in large
+// chunks, resyncing on the sync word if the stream is corrupted.
+class CaptureReader
+{
+public:
+    static const size_t CHUNK_BYTES = 8 * 1024 * 1024;
+
+    CaptureReader ();
+    ~CaptureReader ();
+
+    bool open (const std::string& _path);
+    void close ();
+
+    // Appends up to _max records to _out, returns false at end of file
+    bool read (std::vector<CaptureRecord>& _out, size_t _max);
+
+    unsigned long long getRecords () const {return m_records;}
+    unsigned long long getSkippedBytes () const {return m_skippedBytes;}
+
+    // Whether bytes at a sync word hold a record, or the sync was data
+    static bool isRecord (const CaptureRecord& _rec);
+
+    // Default raw to physical scale and unit of each sensor
+    static double sensorScale (CAPTURE_SENSOR _sensor);
+    static const char* sensorUnit (CAPTURE_SENSOR _sensor);
+    static const char* sensorName (CAPTURE_SENSOR _sensor);
+
+private:
+    bool fill ();
+
+    FILE*                       m_file;
+    bool                        m_ownFile;
+    std::vector<unsigned char>  m_buf;
+    size_t                      m_pos;
+    size_t                      m_end;
+    bool                        m_eof;
+    unsigned long long          m_records;
+    unsigned long long          m_skippedBytes;
+};
+
+#endif // CAPTURE_READER_H
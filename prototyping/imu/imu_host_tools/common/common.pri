@@ -0,0 +1,22 @@
+# Shared host tool sources, included by each tool's .pro
+
+CONFIG   += console c++11 thread
+CONFIG   -= app_bundle qt
+
+INCLUDEPATH += $$PWD \
+    $$PWD/../../imu_embedded_sw
+
+SOURCES += $$PWD/capture_reader.cpp \
+    $$PWD/capture_log.cpp \
+    $$PWD/worker_pool.cpp \
+    $$PWD/serial_port.cpp \
+    $$PWD/telemetry_decoder.cpp
+
+HEADERS += $$PWD/capture_reader.h \
+    $$PWD/capture_log.h \
+    $$PWD/worker_pool.h \
+    $$PWD/serial_port.h \
+    $$PWD/telemetry_decoder.h \
+    $$PWD/../../imu_embedded_sw/CaptureRecord.h \
+    $$PWD/../../imu_embedded_sw/TelemetryCodec.h \
+    $$PWD/../../imu_embedded_sw/Crc16.h
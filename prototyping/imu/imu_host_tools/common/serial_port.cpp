@@ -0,0 +1,40 @@
+#include "serial_port.h"
+
+#include <cstdio>
+#include <termios.h>
+
+static speed_t baudConstant (int _baud)
+{
+    switch (_baud)
+    {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 921600:    return B921600;
+        default:        return B0;
+    }
+}
+
+bool configureSerialPort (int _fd, int _baud, const char* _name)
+{
+    speed_t speed = baudConstant (_baud);
+    struct termios tio;
+    if (speed == B0 || tcgetattr (_fd, &tio) != 0)
+    {
+        fprintf (stderr, "%s: unsupported baud rate or not a serial port\n", _name);
+        return false;
+    }
+    cfmakeraw (&tio);
+    cfsetispeed (&tio, speed);
+    cfsetospeed (&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr (_fd, TCSANOW, &tio);
+    tcflush (_fd, TCIFLUSH);
+    return true;
+}
@@ -0,0 +1,9 @@
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+// Puts an open tty in raw 8N1 mode at _baud with non-blocking style reads
+// (VMIN = VTIME = 0) and drops anything already received.  Returns false,
+// with a message on stderr, for an unsupported rate or a non-tty.
+bool configureSerialPort (int _fd, int _baud, const char* _name);
+
+#endif // SERIAL_PORT_H
@@ -0,0 +1,298 @@
+#include "sim_sensors.h"
+
+#include "Arduino.h"
+
+// Both parts' register addresses fit in 6 bits, above them are the I2C
+// auto increment bit or the SPI read and multi byte bits
+static const uint8_t ADDRESS_MASK = 0x3F;
+
+// Little endian 3 axis sample, byte _index of OUT_X_L..OUT_Z_H or DATAX0..DATAZ1
+static uint8_t sampleByte (const Vec3<int16_t>& _sample, uint8_t _index)
+{
+    int16_t axis = (_index < 2) ? _sample.x : ((_index < 4) ? _sample.y : _sample.z);
+    return (uint8_t) (((uint16_t) axis >> ((_index & 1) * 8)) & 0xFF);
+}
+
+// L3G4200D registers
+static const uint8_t GYRO_CTRL_REG1 = 0x20;
+static const uint8_t GYRO_PD_DISABLE = 0x08;
+static const uint8_t GYRO_CTRL_REG5 = 0x24;
+static const uint8_t GYRO_FIFO_ENABLE = 0x40;
+static const uint8_t GYRO_STATUS_REG = 0x27;
+static const uint8_t GYRO_ZYXOR = 0x80;
+static const uint8_t GYRO_ZYXDA = 0x08;
+static const uint8_t GYRO_OUT_Z_H_REG = 0x2D;
+static const uint8_t GYRO_FIFO_SRC_REG = 0x2F;
+static const uint8_t GYRO_OVRN = 0x40;
+static const uint8_t GYRO_EMPTY = 0x20;
+static const uint8_t GYRO_FSS = 0x1F;
+static const size_t  GYRO_FIFO_DEPTH = 32;
+static const uint8_t GYRO_I2C_AUTO_INC = 0x80;
+static const uint8_t GYRO_SPI_MULTI_BYTE = 0x40;
+
+SimL3G4200D::SimL3G4200D (BUS_TYPE _type, uint32_t _clockHz)
+    : SimTransport (_type, _clockHz, (_type == BUS_SPI) ? GYRO_SPI_MULTI_BYTE : GYRO_I2C_AUTO_INC),
+      m_out (makeVec3<int16_t> (0, 0, 0)),
+      m_overrun (false),
+      m_produced (0),
+      m_dropped (0),
+      m_stale (0)
+{
+}
+
+void SimL3G4200D::produce (const Vec3<int16_t>& _sample)
+{
+    // Power down until the driver's init ()
+    if (!(getReg (GYRO_CTRL_REG1) & GYRO_PD_DISABLE))
+        return;
+
+    size_t depth = (getReg (GYRO_CTRL_REG5) & GYRO_FIFO_ENABLE) ? GYRO_FIFO_DEPTH : 1;
+    if (m_fifo.size () >= depth)
+    {
+        m_fifo.pop_front ();
+        m_overrun = true;
+        m_dropped++;
+    }
+    m_fifo.push_back (_sample);
+    m_produced++;
+}
+
+uint8_t SimL3G4200D::readReg (const uint8_t _reg)
+{
+    uint8_t val = SimTransport::readReg (_reg);
+    uint8_t reg = _reg & ADDRESS_MASK;
+    if (reg == GYRO_STATUS_REG)
+        return status ();
+    if (reg == GYRO_FIFO_SRC_REG)
+        return fifoSource ();
+    if (reg >= OUT_X_L_REG && reg <= GYRO_OUT_Z_H_REG)
+        return sampleByte (m_out, reg - OUT_X_L_REG);
+    return val;
+}
+
+void SimL3G4200D::readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len)
+{
+    SimTransport::readBlock (_reg, _buf, _len);
+    bool rollOver = getReg (GYRO_CTRL_REG5) & GYRO_FIFO_ENABLE;
+    uint8_t reg = _reg & ADDRESS_MASK;
+    for (uint8_t i = 0; i < _len; i++)
+    {
+        if (reg == GYRO_STATUS_REG)
+        {
+            _buf[i] = status ();
+        }
+        else if (reg == GYRO_FIFO_SRC_REG)
+        {
+            _buf[i] = fifoSource ();
+        }
+        else if (reg >= OUT_X_L_REG && reg <= GYRO_OUT_Z_H_REG)
+        {
+            if (reg == OUT_X_L_REG)
+                pop ();
+            _buf[i] = sampleByte (m_out, reg - OUT_X_L_REG);
+        }
+        reg++;
+        if (rollOver && reg == GYRO_OUT_Z_H_REG + 1)
+            reg = OUT_X_L_REG;
+    }
+}
+
+uint8_t SimL3G4200D::status ()
+{
+    return (m_fifo.empty () ? 0 : GYRO_ZYXDA) | (m_overrun ? GYRO_ZYXOR : 0);
+}
+
+uint8_t SimL3G4200D::fifoSource ()
+{
+    // FSS doesn't hold 32, OVRN says the FIFO is full
+    return (m_overrun ? GYRO_OVRN : 0) | (m_fifo.empty () ? GYRO_EMPTY : 0) |
+           (uint8_t) (m_fifo.size () & GYRO_FSS);
+}
+
+void SimL3G4200D::pop ()
+{
+    if (m_fifo.empty ())
+    {
+        m_stale++;
+        return;
+    }
+    m_out = m_fifo.front ();
+    m_fifo.pop_front ();
+    m_overrun = false;
+}
+
+// ADXL345 registers
+static const uint8_t ACC_POWER_CTRL_REG = 0x2D;
+static const uint8_t ACC_MEASURE = 0x08;
+static const uint8_t ACC_INT_ENABLE_REG = 0x2E;
+static const uint8_t ACC_INT_SOURCE_REG = 0x30;
+static const uint8_t ACC_DATA_READY = 0x80;
+static const uint8_t ACC_OVERRUN = 0x01;
+static const uint8_t ACC_DATAX0_REG = 0x32;
+static const uint8_t ACC_DATAZ1_REG = 0x37;
+static const uint8_t ACC_SPI_MULTI_BYTE = 0x40;
+
+SimADXL345::SimADXL345 (BUS_TYPE _type, uint32_t _clockHz, uint8_t _int1Pin)
+    : SimTransport (_type, _clockHz, (_type == BUS_SPI) ? ACC_SPI_MULTI_BYTE : 0),
+      m_int1Pin (_int1Pin),
+      m_sample (makeVec3<int16_t> (0, 0, 0)),
+      m_ready (false),
+      m_overrun (false),
+      m_readyuS (0),
+      m_produced (0),
+      m_read (0),
+      m_dropped (0),
+      m_latencySumuS (0),
+      m_latencyMaxuS (0)
+{
+    hostSetPin (m_int1Pin, LOW);
+}
+
+bool SimADXL345::produce (const Vec3<int16_t>& _sample)
+{
+    // Standby until the driver's init ()
+    if (!(getReg (ACC_POWER_CTRL_REG) & ACC_MEASURE))
+        return false;
+
+    bool rising = !m_ready;
+    if (m_ready)
+    {
+        m_overrun = true;
+        m_dropped++;
+    }
+    m_sample = _sample;
+    m_ready = true;
+    m_readyuS = micros ();
+    m_produced++;
+
+    if (!(getReg (ACC_INT_ENABLE_REG) & ACC_DATA_READY))
+        return false;
+    hostSetPin (m_int1Pin, HIGH);
+    return rising;
+}
+
+uint8_t SimADXL345::readReg (const uint8_t _reg)
+{
+    uint8_t val = SimTransport::readReg (_reg);
+    uint8_t reg = _reg & ADDRESS_MASK;
+    if (reg == ACC_INT_SOURCE_REG)
+        return intSource ();
+    if (reg >= ACC_DATAX0_REG && reg <= ACC_DATAZ1_REG)
+        return sampleByte (m_sample, reg - ACC_DATAX0_REG);
+    return val;
+}
+
+void SimADXL345::readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len)
+{
+    SimTransport::readBlock (_reg, _buf, _len);
+    uint8_t start = _reg & ADDRESS_MASK;
+    for (uint8_t i = 0; i < _len; i++)
+    {
+        int reg = start + i;
+        if (reg == ACC_INT_SOURCE_REG)
+            _buf[i] = intSource ();
+        else if (reg >= ACC_DATAX0_REG && reg <= ACC_DATAZ1_REG)
+            _buf[i] = sampleByte (m_sample, reg - ACC_DATAX0_REG);
+    }
+
+    // Reading the outputs clears DATA_READY and OVERRUN, and with them INT1
+    if (start <= ACC_DATAZ1_REG && start + _len > ACC_DATAX0_REG)
+    {
+        if (m_ready)
+        {
+            uint32_t latencyuS = micros () - m_readyuS;
+            m_latencySumuS += latencyuS;
+            if (latencyuS > m_latencyMaxuS)
+                m_latencyMaxuS = latencyuS;
+            m_read++;
+        }
+        m_ready = false;
+        m_overrun = false;
+        hostSetPin (m_int1Pin, LOW);
+    }
+}
+
+uint8_t SimADXL345::intSource ()
+{
+    return (m_ready ? ACC_DATA_READY : 0) | (m_overrun ? ACC_OVERRUN : 0);
+}
+
+// BMP085 registers, conversion times and the datasheet's example
+static const uint8_t  BAR_CTRL_REG = 0xF4;
+static const uint8_t  BAR_TEMPERATURE = 0x2E;
+static const uint8_t  BAR_PRESSURE = 0x34;
+static const uint8_t  BAR_VALUE_MSB_REG = 0xF6;
+static const uint32_t BAR_TEMP_CONVERSION_US = 4500;
+static const uint32_t BAR_PRESSURE_CONVERSION_US[4] = {4500, 7500, 13500, 25500};
+static const int32_t  BAR_UT = 27898;
+// UP of the example at OSS 0.  Oversampling adds bits below it, so MSB
+// aligned in the value registers it reads the same at every OSS.
+static const int32_t  BAR_UP = 23843;
+
+SimBMP085::SimBMP085 (uint32_t _clockHz, uint8_t _eocPin)
+    : SimTransport (BUS_I2C, _clockHz, 0),
+      m_eocPin (_eocPin),
+      m_converting (false),
+      m_eocuS (0),
+      m_conversions (0)
+{
+    setCalibration (0xAA, 408);       // AC1
+    setCalibration (0xAC, -72);       // AC2
+    setCalibration (0xAE, -14383);    // AC3
+    setCalibration (0xB0, 32741);     // AC4
+    setCalibration (0xB2, 32757);     // AC5
+    setCalibration (0xB4, 23153);     // AC6
+    setCalibration (0xB6, 6190);      // B1
+    setCalibration (0xB8, 4);         // B2
+    setCalibration (0xBA, -32768);    // MB
+    setCalibration (0xBC, -8711);     // MC
+    setCalibration (0xBE, 2868);      // MD
+
+    // EOC idles high
+    hostSetPin (m_eocPin, HIGH);
+}
+
+bool SimBMP085::update ()
+{
+    if (!m_converting || (int32_t) (micros () - m_eocuS) < 0)
+        return false;
+    m_converting = false;
+    hostSetPin (m_eocPin, HIGH);
+    return true;
+}
+
+void SimBMP085::writeReg (const uint8_t _reg, const uint8_t _val)
+{
+    SimTransport::writeReg (_reg, _val);
+    if (_reg != BAR_CTRL_REG)
+        return;
+
+    uint32_t conversionuS;
+    if (_val == BAR_TEMPERATURE)
+    {
+        conversionuS = BAR_TEMP_CONVERSION_US;
+        setReg (BAR_VALUE_MSB_REG, (uint8_t) (BAR_UT >> 8));
+        setReg (BAR_VALUE_MSB_REG + 1, (uint8_t) BAR_UT);
+    }
+    else if ((_val & 0x3F) == BAR_PRESSURE)
+    {
+        conversionuS = BAR_PRESSURE_CONVERSION_US[_val >> 6];
+        setReg (BAR_VALUE_MSB_REG, (uint8_t) (BAR_UP >> 8));
+        setReg (BAR_VALUE_MSB_REG + 1, (uint8_t) BAR_UP);
+        setReg (BAR_VALUE_MSB_REG + 2, 0);
+    }
+    else
+    {
+        return;
+    }
+    m_converting = true;
+    m_eocuS = micros () + conversionuS;
+    m_conversions++;
+    hostSetPin (m_eocPin, LOW);
+}
+
+void SimBMP085::setCalibration (uint8_t _reg, int16_t _val)
+{
+    setReg (_reg, (uint8_t) ((uint16_t) _val >> 8));
+    setReg (_reg + 1, (uint8_t) _val);
+}
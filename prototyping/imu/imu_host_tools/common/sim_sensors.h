@@ -0,0 +1,110 @@
+#ifndef SIM_SENSORS_H
+#define SIM_SENSORS_H
+
+#include <deque>
+#include <stdint.h>
+
+#include "SimTransport.h"
+#include "VectorMath.h"
+
+// The sketch's sensors as seen from their registers, for running the real
+// drivers (imu_embedded_sw) over SimTransport.  Each model keeps the
+// transport's bus time and register file and adds what the device does on
+// its own: samples arriving, status bits set and cleared by reads, and the
+// interrupt pins, driven through the Arduino host stand-in (arduino_host).
+// The tool moves the clock and calls produce () or update () when a sample
+// or conversion is due.  Register addresses and timings are the datasheets'.
+
+// L3G4200D.  Bypass mode holds one sample, a FIFO enabled in CTRL_REG5 holds
+// 32 and a read past OUT_Z_H rolls back to OUT_X_L for the next.  A sample
+// arriving at a full output overwrites the oldest and sets the overrun bits,
+// a read of an empty output repeats the last sample.
+class SimL3G4200D : public SimTransport
+{
+public:
+    static const uint8_t    OUT_X_L_REG = 0x28;
+
+    SimL3G4200D (BUS_TYPE _type, uint32_t _clockHz);
+
+    void produce (const Vec3<int16_t>& _sample);
+
+    virtual uint8_t readReg (const uint8_t _reg);
+    virtual void readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len);
+
+    size_t getLevel () {return m_fifo.size ();}
+    uint64_t getProduced () {return m_produced;}
+    uint64_t getDropped () {return m_dropped;}
+    uint64_t getStale () {return m_stale;}
+private:
+    uint8_t status ();
+    uint8_t fifoSource ();
+    // Next sample out of the output registers
+    void pop ();
+
+    std::deque<Vec3<int16_t> >  m_fifo;
+    Vec3<int16_t>               m_out;
+    bool                        m_overrun;
+    uint64_t                    m_produced;
+    uint64_t                    m_dropped;
+    uint64_t                    m_stale;
+};
+
+// ADXL345 in bypass mode with DATA_READY on INT1.  The pin stays high until
+// the sample is read, a sample arriving before that overwrites it and sets
+// OVERRUN.  Latency is from a sample's arrival to the read that took it.
+class SimADXL345 : public SimTransport
+{
+public:
+    SimADXL345 (BUS_TYPE _type, uint32_t _clockHz, uint8_t _int1Pin);
+
+    // True on a rising INT1, which is an interrupt if one is attached
+    bool produce (const Vec3<int16_t>& _sample);
+
+    virtual uint8_t readReg (const uint8_t _reg);
+    virtual void readBlock (const uint8_t _reg, uint8_t* _buf, const uint8_t _len);
+
+    uint64_t getProduced () {return m_produced;}
+    uint64_t getRead () {return m_read;}
+    uint64_t getDropped () {return m_dropped;}
+    double getLatencyMeanuS () {return m_read ? (double) m_latencySumuS / m_read : 0.0;}
+    uint32_t getLatencyMaxuS () {return m_latencyMaxuS;}
+private:
+    uint8_t intSource ();
+
+    uint8_t         m_int1Pin;
+    Vec3<int16_t>   m_sample;
+    bool            m_ready;
+    bool            m_overrun;
+    uint32_t        m_readyuS;
+    uint64_t        m_produced;
+    uint64_t        m_read;
+    uint64_t        m_dropped;
+    uint64_t        m_latencySumuS;
+    uint32_t        m_latencyMaxuS;
+};
+
+// BMP085 with the datasheet's example calibration and readings.  A write to
+// CTRL starts a conversion and takes EOC low until it is done.
+class SimBMP085 : public SimTransport
+{
+public:
+    SimBMP085 (uint32_t _clockHz, uint8_t _eocPin);
+
+    // True when the running conversion has just finished, EOC rises
+    bool update ();
+    bool converting () {return m_converting;}
+    uint32_t getEOCuS () {return m_eocuS;}
+
+    virtual void writeReg (const uint8_t _reg, const uint8_t _val);
+
+    uint64_t getConversions () {return m_conversions;}
+private:
+    void setCalibration (uint8_t _reg, int16_t _val);
+
+    uint8_t     m_eocPin;
+    bool        m_converting;
+    uint32_t    m_eocuS;
+    uint64_t    m_conversions;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "telemetry_decoder.h"
+
+#include <cstring>
+
+#include "Crc16.h"
+
+TelemetryDecoder::TelemetryDecoder ()
+    : m_synced (false),
+      m_nextSequence (0),
+      m_blocks (0),
+      m_badBlocks (0),
+      m_droppedBlocks (0),
+      m_skippedBytes (0)
+{
+    memset (m_state, 0, sizeof (m_state));
+}
+
+void TelemetryDecoder::decode (const uint8_t* _bytes, size_t _length, std::vector<CaptureRecord>& _out)
+{
+    // Blocks are parsed straight out of the caller's buffer, only a block
+    // split across calls goes through m_pending
+    const uint8_t* data = _bytes;
+    size_t size = _length;
+    if (!m_pending.empty ())
+    {
+        m_pending.insert (m_pending.end (), _bytes, _bytes + _length);
+        data = &m_pending[0];
+        size = m_pending.size ();
+    }
+
+    size_t pos = 0;
+    while (pos + TELEMETRY_HEADER_BYTES <= size)
+    {
+        if (data[pos] != (TELEMETRY_SYNC & 0xFF) || data[pos + 1] != (TELEMETRY_SYNC >> 8) ||
+            data[pos + 4] > TELEMETRY_PAYLOAD_MAX)
+        {
+            pos++;
+            m_skippedBytes++;
+            continue;
+        }
+
+        uint8_t length = data[pos + 4];
+        size_t blockSize = TELEMETRY_HEADER_BYTES + length + 2;
+        if (pos + blockSize > size)
+            break;
+
+        const uint8_t* block = &data[pos];
+        uint16_t crc = block[TELEMETRY_HEADER_BYTES + length] | (block[TELEMETRY_HEADER_BYTES + length + 1] << 8);
+        if (crc != crc16CCITT (&block[2], 3 + length))
+        {
+            // Probably a sync word inside other data, resync one byte on
+            m_badBlocks++;
+            m_synced = false;
+            pos++;
+            m_skippedBytes++;
+            continue;
+        }
+        pos += blockSize;
+        m_blocks++;
+
+        uint8_t flags = block[2];
+        uint8_t sequence = block[3];
+        if (flags & TELEMETRY_KEYFRAME)
+        {
+            memset (m_state, 0, sizeof (m_state));
+            m_synced = true;
+        }
+        else if (!m_synced || sequence != m_nextSequence)
+        {
+            // The predictors depend on a block we don't have
+            m_synced = false;
+            m_droppedBlocks++;
+            continue;
+        }
+        m_nextSequence = sequence + 1;
+
+        size_t before = _out.size ();
+        if (!decodePayload (&block[TELEMETRY_HEADER_BYTES], length, _out))
+        {
+            _out.resize (before);
+            m_badBlocks++;
+            m_synced = false;
+        }
+    }
+
+    // Keep the unparsed tail for the next call
+    if (m_pending.empty ())
+    {
+        m_pending.assign (_bytes + pos, _bytes + _length);
+    }
+    else
+    {
+        m_pending.erase (m_pending.begin (), m_pending.begin () + pos);
+    }
+}
+
+bool TelemetryDecoder::decodePayload (const uint8_t* _payload, uint8_t _length, std::vector<CaptureRecord>& _out)
+{
+    const uint8_t* in = _payload;
+    const uint8_t* end = _payload + _length;
+    while (in < end)
+    {
+        uint8_t tag = *in++;
+        uint8_t sensor = tag & TELEMETRY_TAG_SENSOR;
+        if (sensor >= CAPTURE_SENSOR_NUM)
+            return false;
+        TelemetryPredictor& state = m_state[sensor];
+
+        uint32_t v;
+        if (!(tag & TELEMETRY_TAG_SAME_PERIOD))
+        {
+            if (!(in = getVarint (in, end, v)))
+                return false;
+            state.perioduS += (uint32_t) zigzagDecode (v);
+        }
+        state.timeuS += state.perioduS;
+
+        CaptureRecord rec;
+        rec.sync = CAPTURE_SYNC;
+        rec.sensor = sensor;
+        rec.axes = (tag & TELEMETRY_TAG_3_AXES) ? 3 : 1;
+        rec.timeuS = state.timeuS;
+        rec.value[1] = rec.value[2] = 0;
+        for (uint8_t i = 0; i < rec.axes; i++)
+        {
+            if (!(in = getVarint (in, end, v)))
+                return false;
+            state.value[i] = (int32_t) ((uint32_t) state.value[i] + (uint32_t) zigzagDecode (v));
+            rec.value[i] = state.value[i];
+        }
+        _out.push_back (rec);
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef TELEMETRY_DECODER_H
+#define TELEMETRY_DECODER_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include "CaptureRecord.h"
+#include "TelemetryCodec.h"
+
+// Turns a delta compressed telemetry stream (imu_embedded_sw/TelemetryCodec.h)
+// back into CaptureRecords.  Takes the stream in arbitrary pieces.  Bytes
+// outside blocks are skipped, and after a corrupt or missing block the
+// following blocks are dropped until the next keyframe.
+class TelemetryDecoder
+{
+public:
+    TelemetryDecoder ();
+
+    // Appends the records of every block completed by _bytes to _out
+    void decode (const uint8_t* _bytes, size_t _length, std::vector<CaptureRecord>& _out);
+
+    unsigned long long getBlocks () const {return m_blocks;}
+    unsigned long long getBadBlocks () const {return m_badBlocks;}
+    unsigned long long getDroppedBlocks () const {return m_droppedBlocks;}
+    unsigned long long getSkippedBytes () const {return m_skippedBytes;}
+
+private:
+    bool decodePayload (const uint8_t* _payload, uint8_t _length, std::vector<CaptureRecord>& _out);
+
+    std::vector<uint8_t>    m_pending;      // Tail of the last call, up to one block
+    TelemetryPredictor      m_state[CAPTURE_SENSOR_NUM];
+    bool                    m_synced;       // Predictors are valid
+    uint8_t                 m_nextSequence;
+    unsigned long long      m_blocks;
+    unsigned long long      m_badBlocks;
+    unsigned long long      m_droppedBlocks;
+    unsigned long long      m_skippedBytes;
+};
+
+#endif // TELEMETRY_DECODER_H
@@ -0,0 +1,87 @@
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool (unsigned _threads, size_t _queueDepth)
+    : m_queueDepth (_queueDepth > 0 ? _queueDepth : 1),
+      m_stop (false)
+{
+    if (_threads == 0)
+        _threads = 1;
+
+    for (unsigned i = 0; i < _threads; i++)
+    {
+        Worker* worker = new Worker;
+        worker->running = false;
+        m_workers.push_back (worker);
+    }
+    for (unsigned i = 0; i < _threads; i++)
+        m_workers[i]->thread = std::thread (&WorkerPool::run, this, i);
+}
+
+WorkerPool::~WorkerPool ()
+{
+    {
+        std::lock_guard<std::mutex> lock (m_mutex);
+        m_stop = true;
+    }
+    m_taskCv.notify_all ();
+
+    for (size_t i = 0; i < m_workers.size (); i++)
+    {
+        m_workers[i]->thread.join ();
+        delete m_workers[i];
+    }
+}
+
+void WorkerPool::post (unsigned _worker, const Task& _task)
+{
+    Worker* worker = m_workers[_worker % m_workers.size ()];
+
+    std::unique_lock<std::mutex> lock (m_mutex);
+    while (worker->queue.size () >= m_queueDepth)
+        m_spaceCv.wait (lock);
+    worker->queue.push_back (_task);
+    lock.unlock ();
+
+    m_taskCv.notify_all ();
+}
+
+void WorkerPool::wait ()
+{
+    std::unique_lock<std::mutex> lock (m_mutex);
+    for (;;)
+    {
+        bool idle = true;
+        for (size_t i = 0; i < m_workers.size (); i++)
+            if (!m_workers[i]->queue.empty () || m_workers[i]->running)
+                idle = false;
+        if (idle)
+            return;
+        m_spaceCv.wait (lock);
+    }
+}
+
+void WorkerPool::run (unsigned _index)
+{
+    Worker* worker = m_workers[_index];
+
+    std::unique_lock<std::mutex> lock (m_mutex);
+    for (;;)
+    {
+        while (worker->queue.empty () && !m_stop)
+            m_taskCv.wait (lock);
+        if (worker->queue.empty () && m_stop)
+            return;
+
+        Task task = worker->queue.front ();
+        worker->queue.pop_front ();
+        worker->running = true;
+        lock.unlock ();
+        m_spaceCv.notify_all ();
+
+        task ();
+
+        lock.lock ();
+        worker->running = false;
+        m_spaceCv.notify_all ();
+    }
+}
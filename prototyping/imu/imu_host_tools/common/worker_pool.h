@@ -0,0 +1,48 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own bounded task queue.  Tasks
+// posted to the same worker run in order, so per stream state can be pinned
+// to one worker without locking.  post () blocks while the queue is full,
+// which bounds the memory held by queued work.
+class WorkerPool
+{
+public:
+    typedef std::function<void ()> Task;
+
+    WorkerPool (unsigned _threads, size_t _queueDepth);
+    ~WorkerPool ();
+
+    unsigned getThreads () const {return static_cast<unsigned> (m_workers.size ());}
+
+    void post (unsigned _worker, const Task& _task);
+
+    // Block until every queued task has run
+    void wait ();
+
+private:
+    struct Worker
+    {
+        std::thread             thread;
+        std::deque<Task>        queue;
+        bool                    running;
+    };
+
+    void run (unsigned _index);
+
+    std::vector<Worker*>        m_workers;
+    size_t                      m_queueDepth;
+    bool                        m_stop;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_taskCv;
+    std::condition_variable     m_spaceCv;
+};
+
+#endif // WORKER_POOL_H
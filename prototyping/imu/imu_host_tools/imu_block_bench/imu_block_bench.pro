@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Double buffered block reads through the host DMA engine
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+include(../common/arduino_host.pri)
+
+TARGET = imu_block_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp
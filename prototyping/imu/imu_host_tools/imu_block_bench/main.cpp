@@ -0,0 +1,371 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <unistd.h>
+
+#include "DMABlockReader.h"
+#include "L3G4200D.h"
+#include "sim_sensors.h"
+
+// L3G4200D defaults of the sketch in block mode
+static const double   ODR_HZ_DEFAULT = 100.0;
+static const int      BURST_DEFAULT = 8;
+static const double   SECONDS_DEFAULT = 600.0;
+static const int      SWAP_BLOCKS = 10000;
+
+// The gyro runs off its own oscillator, slow against the MCU here so a poll
+// at exactly a burst's time falls behind
+static const double   GYRO_CLOCK_ERROR = -0.004;
+
+// setBlockReader caps a burst at half the FIFO
+static const int      BURST_MAX = 16;
+static const int      SAMPLE_BYTES = 6;
+
+// Samples carry their sequence number, so a consumer sees any sample lost,
+// repeated or stale
+static Vec3<int16_t> encode (uint32_t _seq)
+{
+    return makeVec3<int16_t> ((int16_t) (_seq & 0xFFFF), (int16_t) (_seq >> 16), (int16_t) 0xA55A);
+}
+
+static uint32_t decode (const uint8_t* _sample)
+{
+    return _sample[0] | (_sample[1] << 8) | (_sample[2] << 16) | ((uint32_t) _sample[3] << 24);
+}
+
+// The driver in block mode over the simulated part, as the sketch sets it up
+// under IMU_BLOCK_READ
+class BlockGyro
+{
+public:
+    BlockGyro (L3G4200D::OUTPUT_RATE _rate, int _burst, L3G4200D::ISRFunc _pollISR)
+        : m_bus (SimTransport::BUS_I2C, 400000), m_reader (&m_engine), m_gyro (&m_bus), m_next (0)
+    {
+        m_gyro.setOutputRate (_rate);
+        m_gyro.initAsync (0, _pollISR);
+        m_gyro.setBlockReader (&m_reader, (uint8_t) _burst);
+    }
+
+    void produce () {m_bus.produce (encode (m_next++));}
+
+    SimL3G4200D& bus () {return m_bus;}
+    SimDMAEngine& engine () {return m_engine;}
+    DMABlockReader& reader () {return m_reader;}
+    L3G4200D& gyro () {return m_gyro;}
+private:
+    SimL3G4200D     m_bus;
+    SimDMAEngine    m_engine;
+    DMABlockReader  m_reader;
+    L3G4200D        m_gyro;
+    uint32_t        m_next;
+};
+
+static L3G4200D*  g_gyro = NULL;
+static uint64_t   g_overrunCallbacks = 0;
+
+static void pollISR ()
+{
+    g_gyro->int2ISR ();
+}
+
+static void overrunCallback ()
+{
+    g_overrunCallbacks++;
+}
+
+// What the block callback saw: samples in order, and blocks it holds
+typedef struct consumer_struct
+{
+    DMABlockReader*         reader;
+    bool                    release;
+    uint64_t                blocks;
+    uint64_t                samples;
+    uint64_t                gaps;
+    uint64_t                repeats;
+    uint32_t                nextSeq;
+    std::vector<uint8_t>    held;
+} Consumer;
+
+static Consumer* g_consumer = NULL;
+
+static void blockCallback (const uint8_t* _block, uint16_t _samples)
+{
+    Consumer& c = *g_consumer;
+    c.blocks++;
+    for (uint16_t i = 0; i < _samples; i++)
+    {
+        uint32_t seq = decode (&_block[i * SAMPLE_BYTES]);
+        if (c.samples > 0 && seq < c.nextSeq)
+            c.repeats++;
+        else if (c.samples > 0 && seq > c.nextSeq)
+            c.gaps++;
+        c.nextSeq = seq + 1;
+        c.samples++;
+    }
+    if (c.release)
+        c.reader->releaseBlock ();
+    else
+        c.held.assign (_block, _block + _samples * SAMPLE_BYTES);
+}
+
+static void resetConsumer (Consumer& _c, DMABlockReader* _reader, bool _release)
+{
+    _c.reader = _reader;
+    _c.release = _release;
+    _c.blocks = 0;
+    _c.samples = 0;
+    _c.gaps = 0;
+    _c.repeats = 0;
+    _c.nextSeq = 0;
+    _c.held.clear ();
+    g_consumer = &_c;
+}
+
+// The ISR's bursts into a consumer releasing at once: every block is
+// swapped and handed over whole, in order
+static bool runSwap (L3G4200D::OUTPUT_RATE _rate, int _burst)
+{
+    BlockGyro g (_rate, _burst, pollISR);
+    DMABlockReader& reader = g.reader ();
+    Consumer consumer;
+    resetConsumer (consumer, &reader, true);
+    reader.registerBlockCallback (blockCallback);
+    uint16_t blockSamples = reader.getBlockSamples ();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    uint64_t bursts = (uint64_t) SWAP_BLOCKS * blockSamples / _burst;
+    for (uint64_t b = 0; b < bursts; b++)
+    {
+        for (int s = 0; s < _burst; s++)
+            g.produce ();
+        g.gyro ().int2ISR ();
+        g.engine ().service ();
+    }
+    double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+    bool ok = consumer.blocks == (uint64_t) SWAP_BLOCKS && reader.getBlocks () == (uint32_t) SWAP_BLOCKS &&
+              consumer.samples == (uint64_t) SWAP_BLOCKS * blockSamples && consumer.gaps == 0 &&
+              consumer.repeats == 0 && reader.getOverruns () == 0 && g.bus ().getStale () == 0;
+    printf ("[Swap]\n");
+    printf ("BlockSamples=%u\n", blockSamples);
+    printf ("Blocks=%llu\n", (unsigned long long) consumer.blocks);
+    printf ("Samples=%llu\n", (unsigned long long) consumer.samples);
+    printf ("Transfers=%u\n", g.engine ().getTransfers ());
+    printf ("Overruns=%u\n", reader.getOverruns ());
+    printf ("HostNsPerBurst=%.1f\n", seconds * 1e9 / bursts);
+    printf ("Check=%s\n", ok ? "ok" : "mismatch");
+    printf ("\n");
+    return ok;
+}
+
+// The consumer keeps the first block: the next one to fill is dropped and
+// counted instead of written, the held block is untouched, and after
+// releaseBlock the block after that is handed over
+static bool runHeld (L3G4200D::OUTPUT_RATE _rate, int _burst)
+{
+    BlockGyro g (_rate, _burst, pollISR);
+    DMABlockReader& reader = g.reader ();
+    Consumer consumer;
+    resetConsumer (consumer, &reader, false);
+    reader.registerBlockCallback (blockCallback);
+    uint16_t blockSamples = reader.getBlockSamples ();
+    int burstsPerBlock = blockSamples / _burst;
+
+    for (int block = 0; block < 3; block++)
+    {
+        for (int b = 0; b < burstsPerBlock; b++)
+        {
+            for (int s = 0; s < _burst; s++)
+                g.produce ();
+            g.gyro ().int2ISR ();
+            g.engine ().service ();
+        }
+    }
+    std::vector<uint8_t> first = consumer.held;
+    const uint8_t* full = reader.getFullBlock ();
+    bool untouched = full && first.size () == (size_t) blockSamples * SAMPLE_BYTES &&
+                     memcmp (full, &first[0], first.size ()) == 0 && decode (full) == 0;
+    uint32_t overrunsHeld = reader.getOverruns ();
+    uint64_t blocksHeld = consumer.blocks;
+
+    reader.releaseBlock ();
+    consumer.release = true;
+    for (int b = 0; b < burstsPerBlock; b++)
+    {
+        for (int s = 0; s < _burst; s++)
+            g.produce ();
+        g.gyro ().int2ISR ();
+        g.engine ().service ();
+    }
+
+    // Blocks two and three were dropped while the first was held
+    bool ok = untouched && blocksHeld == 1 && overrunsHeld == 2 && consumer.blocks == 2 &&
+              consumer.gaps == 1 && consumer.repeats == 0;
+    printf ("[Held]\n");
+    printf ("BlocksWhileHeld=%llu\n", (unsigned long long) blocksHeld);
+    printf ("OverrunsWhileHeld=%u\n", overrunsHeld);
+    printf ("HeldBlockUntouched=%s\n", untouched ? "yes" : "no");
+    printf ("BlocksAfterRelease=%llu\n", (unsigned long long) consumer.blocks);
+    printf ("Check=%s\n", ok ? "ok" : "mismatch");
+    printf ("\n");
+    return ok;
+}
+
+// A trigger while the engine still has the last burst queued is refused and
+// counted, the ISR leaves the bus alone meanwhile, and the queued burst still
+// lands
+static bool runBusy (L3G4200D::OUTPUT_RATE _rate, int _burst)
+{
+    BlockGyro g (_rate, _burst, pollISR);
+    DMABlockReader& reader = g.reader ();
+    Consumer consumer;
+    resetConsumer (consumer, &reader, true);
+    reader.registerBlockCallback (blockCallback);
+
+    for (int s = 0; s < _burst; s++)
+        g.produce ();
+    reader.trigger ();
+    bool inFlight = reader.burstInFlight ();
+    reader.trigger ();
+    uint32_t overruns = reader.getOverruns ();
+    uint32_t transactions = g.bus ().getTransactions ();
+    g.gyro ().int2ISR ();
+    bool isrSkipped = g.bus ().getTransactions () == transactions;
+    g.engine ().service ();
+    bool landed = !reader.burstInFlight () && g.engine ().getTransfers () == 1 && g.bus ().getLevel () == 0;
+
+    bool ok = inFlight && overruns == 1 && isrSkipped && landed && !g.engine ().service ();
+    printf ("[Busy]\n");
+    printf ("InFlightAfterTrigger=%s\n", inFlight ? "yes" : "no");
+    printf ("Overruns=%u\n", overruns);
+    printf ("ISRSkippedInFlight=%s\n", isrSkipped ? "yes" : "no");
+    printf ("Transfers=%u\n", g.engine ().getTransfers ());
+    printf ("Check=%s\n", ok ? "ok" : "mismatch");
+    printf ("\n");
+    return ok;
+}
+
+// L3G4200D::int2ISR from its poll timer, at the interval setBlockReader sets
+// or at _intervaluS in its place, with the overrun callback on OVRN
+static void runPoll (const char* _name, L3G4200D::OUTPUT_RATE _rate, int _burst, double _seconds,
+                     uint32_t _intervaluS)
+{
+    BlockGyro g (_rate, _burst, pollISR);
+    Consumer consumer;
+    resetConsumer (consumer, &g.reader (), true);
+    g.reader ().registerBlockCallback (blockCallback);
+    g_gyro = &g.gyro ();
+    g_overrunCallbacks = 0;
+    g.gyro ().registerOverrunCallback (overrunCallback);
+    if (_intervaluS)
+        g.gyro ().setPollInterval (_intervaluS);
+    double intervaluS = hostTimerPeriod (pollISR);
+
+    double sampleuS = 1e6 / (L3G4200D::getOutputRateHz (_rate) * (1.0 + GYRO_CLOCK_ERROR));
+    double nextSampleuS = sampleuS;
+    double nextTickuS = intervaluS;
+    double enduS = _seconds * 1e6;
+    while (true)
+    {
+        if (nextSampleuS <= nextTickuS)
+        {
+            if (nextSampleuS >= enduS)
+                break;
+            hostSetMicros ((uint32_t) nextSampleuS);
+            g.produce ();
+            nextSampleuS += sampleuS;
+            continue;
+        }
+        if (nextTickuS >= enduS)
+            break;
+        hostSetMicros ((uint32_t) nextTickuS);
+        pollISR ();
+        g.engine ().service ();
+        nextTickuS += intervaluS;
+    }
+
+    printf ("[%s]\n", _name);
+    printf ("PollIntervaluS=%.0f\n", intervaluS);
+    printf ("Samples=%llu\n", (unsigned long long) g.bus ().getProduced ());
+    printf ("Delivered=%llu\n", (unsigned long long) consumer.samples);
+    printf ("Dropped=%llu\n", (unsigned long long) g.bus ().getDropped ());
+    printf ("StaleReads=%llu\n", (unsigned long long) g.bus ().getStale ());
+    printf ("Gaps=%llu\n", (unsigned long long) consumer.gaps);
+    printf ("Repeats=%llu\n", (unsigned long long) consumer.repeats);
+    printf ("OverrunCallbacks=%llu\n", (unsigned long long) g_overrunCallbacks);
+    printf ("\n");
+}
+
+static bool gyroRate (double _hz, L3G4200D::OUTPUT_RATE& _rate)
+{
+    for (int r = 0; r < L3G4200D::RATE_NUM; r++)
+    {
+        if (L3G4200D::getOutputRateHz ((L3G4200D::OUTPUT_RATE) r) == _hz)
+        {
+            _rate = (L3G4200D::OUTPUT_RATE) r;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-r odr Hz] [-b samples per burst] [-s seconds]\n", _prog);
+    fprintf (stderr, "  Runs the L3G4200D driver (imu_embedded_sw) in block mode over a simulated\n");
+    fprintf (stderr, "  part, its bursts going through DMABlockReader and SimDMAEngine.  Checks\n");
+    fprintf (stderr, "  buffer swapping with a releasing consumer, a held block and a busy engine,\n");
+    fprintf (stderr, "  then polls the FIFO from the driver's timer at the default interval and\n");
+    fprintf (stderr, "  at the one setBlockReader sets, reporting dropped and stale samples.\n");
+    fprintf (stderr, "  -r  gyro output rate, 100, 200, 400 or 800, default %.0f Hz\n", ODR_HZ_DEFAULT);
+    fprintf (stderr, "  -b  samples per burst, 1 to %d, default %d\n", BURST_MAX, BURST_DEFAULT);
+    fprintf (stderr, "  -s  simulated length of the poll runs, default %.0f s\n", SECONDS_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    double odrHz = ODR_HZ_DEFAULT;
+    int burst = BURST_DEFAULT;
+    double seconds = SECONDS_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "r:b:s:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                odrHz = atof (optarg);
+                break;
+            case 'b':
+                burst = atoi (optarg);
+                break;
+            case 's':
+                seconds = atof (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    L3G4200D::OUTPUT_RATE rate;
+    if (optind != _argc || !gyroRate (odrHz, rate) || burst < 1 || burst > BURST_MAX || seconds <= 0.0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    printf ("OdrHz=%.1f\n", odrHz);
+    printf ("SamplesPerBurst=%d\n", burst);
+    printf ("Seconds=%.1f\n", seconds);
+    printf ("\n");
+
+    bool ok = runSwap (rate, burst);
+    ok = runHeld (rate, burst) && ok;
+    ok = runBusy (rate, burst) && ok;
+    runPoll ("PollFixed", rate, burst, seconds, L3G4200D::POLL_INTERVAL_US_DEFAULT);
+    runPoll ("PollLevel", rate, burst, seconds, 0);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Sensor placement over several buses: throughput and per-bus load
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_bus_placement
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/BusManager.cpp \
+    $$PWD/../../imu_embedded_sw/DMABlockReader.cpp \
+    $$PWD/../../imu_embedded_sw/SimTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTrace.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/BusManager.h \
+    $$PWD/../../imu_embedded_sw/DMABlockReader.h \
+    $$PWD/../../imu_embedded_sw/SimTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTrace.h
@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "BusManager.h"
+#include "SimTransport.h"
+
+static const double   SECONDS_DEFAULT = 2.0;
+static const int      TOP_DEFAULT = 5;
+
+// A placement holds at a rate scale while no sample is overwritten before it
+// is read and no bus is busier than this
+static const double   LOAD_LIMIT = 0.9;
+static const double   SCALE_MIN = 0.05;
+static const double   SCALE_MAX = 64.0;
+static const int      SCALE_STEPS = 20;
+
+typedef struct transfer_model_struct
+{
+    uint8_t     reg;
+    uint8_t     len;
+} TransferModel;
+
+// What each driver reads per sample at the sketch's rates.  The gyro is the
+// 7 byte status and sample burst, the accelerometer INT_SOURCE then its
+// sample, the magnetometer its status then its sample.  The barometer's
+// pressure is three single register reads and the write starting the next
+// conversion, counted as a one byte read (one byte over), and it doesn't
+// scale as the conversion time sets its rate.  The temperature every 16th
+// conversion is left out.
+typedef struct sensor_model_struct
+{
+    const char*     name;
+    double          rateHz;
+    bool            scales;
+    bool            spi;
+    uint8_t         autoIncrement;
+    uint8_t         transfers;
+    TransferModel   transfer[4];
+} SensorModel;
+
+static const int SENSOR_NUM = 4;
+static const SensorModel SENSORS[SENSOR_NUM] =
+{
+    {"gyro", 400.0,          true,  true,  0x80, 1, {{0x27, 7}}},
+    {"acc",  100.0,          true,  true,  0x00, 2, {{0x30, 1}, {0x32, 6}}},
+    {"mag",  75.0,           true,  false, 0x00, 2, {{0x09, 1}, {0x03, 6}}},
+    {"bar",  1000.0 / 25.5,  false, false, 0x00, 4, {{0xF6, 1}, {0xF7, 1}, {0xF8, 1}, {0xF4, 1}}}
+};
+
+typedef struct bus_spec_struct
+{
+    std::string         name;
+    BusQueue::BUS_TYPE  type;
+    uint32_t            clockHz;
+} BusSpec;
+
+typedef struct options_struct
+{
+    std::vector<BusSpec> buses;
+    double      seconds;
+    int         top;
+} Options;
+
+typedef std::vector<int> Placement;
+
+typedef struct bus_result_struct
+{
+    double      load;
+    double      transfersPerS;
+    double      waitsPerS;
+    uint8_t     maxDepth;
+} BusResult;
+
+typedef struct run_result_struct
+{
+    uint64_t    lost;
+    double      maxLoad;
+    double      latencyMaxuS[SENSOR_NUM];
+    std::vector<BusResult> buses;
+} RunResult;
+
+// Host DMA engine with a bus time.  The transfer is done on start (), its
+// completion fires once the simulation clock reaches the modeled end.
+class TimedDMAEngine : public DMAEngine
+{
+public:
+    TimedDMAEngine (const double* _nowuS)
+        : m_nowuS (_nowuS), m_busy (false), m_doneuS (0.0), m_complete (NULL), m_ctx (NULL) {}
+
+    virtual bool start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                        CompleteFunc _complete, void* _ctx)
+    {
+        if (m_busy)
+            return false;
+        SimTransport* sim = (SimTransport*) _bus;
+        uint32_t beforeNs = sim->getBusTimeNs ();
+        sim->readBlock (_reg, _dst, (uint8_t) _len);
+        m_doneuS = *m_nowuS + (sim->getBusTimeNs () - beforeNs) / 1000.0;
+        m_complete = _complete;
+        m_ctx = _ctx;
+        m_busy = true;
+        return true;
+    }
+    virtual bool busy () {return m_busy;}
+
+    double getDoneuS () {return m_doneuS;}
+    void finish ()
+    {
+        m_busy = false;
+        m_complete (m_ctx);
+    }
+private:
+    const double*   m_nowuS;
+    bool            m_busy;
+    double          m_doneuS;
+    CompleteFunc    m_complete;
+    void*           m_ctx;
+};
+
+typedef struct sensor_state_struct
+{
+    const double*   nowuS;
+    double          sampleuS;
+    int             pending;
+    uint64_t        lost;
+    double          latencyMaxuS;
+    uint8_t         buf[8];
+} SensorState;
+
+static void sensorTransferComplete (void* _ctx)
+{
+    SensorState* state = (SensorState*) _ctx;
+    if (--state->pending == 0)
+        state->latencyMaxuS = std::max (state->latencyMaxuS, *state->nowuS - state->sampleuS);
+}
+
+// One placement at one rate scale, each bus on its own clock
+static RunResult runPlacement (const Options& _options, const Placement& _placement, double _scale)
+{
+    double nowuS = 0.0;
+    size_t busCount = _options.buses.size ();
+    std::vector<TimedDMAEngine*> engines;
+    std::vector<BusQueue*> queues;
+    BusManager manager;
+    for (size_t b = 0; b < busCount; b++)
+    {
+        const BusSpec& spec = _options.buses[b];
+        engines.push_back (new TimedDMAEngine (&nowuS));
+        queues.push_back (new BusQueue (spec.name.c_str (), spec.type, spec.clockHz, engines[b]));
+        manager.addBus (queues[b]);
+    }
+
+    std::vector<SimTransport*> transports;
+    SensorState states[SENSOR_NUM];
+    double perioduS[SENSOR_NUM];
+    double nextuS[SENSOR_NUM];
+    for (int s = 0; s < SENSOR_NUM; s++)
+    {
+        const BusSpec& spec = _options.buses[_placement[s]];
+        SimTransport::BUS_TYPE type = (spec.type == BusQueue::BUS_SPI) ? SimTransport::BUS_SPI : SimTransport::BUS_I2C;
+        transports.push_back (new SimTransport (type, spec.clockHz, SENSORS[s].autoIncrement));
+        manager.getBus (_placement[s])->bind (transports[s]);
+
+        memset (&states[s], 0, sizeof (states[s]));
+        states[s].nowuS = &nowuS;
+        perioduS[s] = 1e6 / (SENSORS[s].rateHz * (SENSORS[s].scales ? _scale : 1.0));
+        // Free running sensors, out of phase with each other
+        nextuS[s] = perioduS[s] * (0.13 + 0.29 * s);
+    }
+
+    double enduS = _options.seconds * 1e6;
+    while (true)
+    {
+        int sensor = -1;
+        double dueuS = enduS;
+        for (int s = 0; s < SENSOR_NUM; s++)
+        {
+            if (nextuS[s] < dueuS)
+            {
+                dueuS = nextuS[s];
+                sensor = s;
+            }
+        }
+        // Completions at the same time go first
+        int bus = -1;
+        for (size_t b = 0; b < busCount; b++)
+        {
+            if (engines[b]->busy () && engines[b]->getDoneuS () <= dueuS)
+            {
+                dueuS = engines[b]->getDoneuS ();
+                bus = (int) b;
+            }
+        }
+        if (dueuS >= enduS)
+            break;
+        nowuS = dueuS;
+
+        if (bus >= 0)
+        {
+            engines[bus]->finish ();
+            continue;
+        }
+
+        // A sample still waiting to be read is overwritten by this one
+        SensorState& state = states[sensor];
+        nextuS[sensor] += perioduS[sensor];
+        if (state.pending > 0)
+        {
+            state.lost++;
+            continue;
+        }
+        state.sampleuS = nowuS;
+        state.pending = SENSORS[sensor].transfers;
+        BusQueue* queue = manager.getBus (_placement[sensor]);
+        for (int t = 0; t < SENSORS[sensor].transfers; t++)
+        {
+            const TransferModel& transfer = SENSORS[sensor].transfer[t];
+            if (!queue->start (transports[sensor], transfer.reg, state.buf, transfer.len,
+                               sensorTransferComplete, &state))
+            {
+                state.lost++;
+                state.pending--;
+            }
+        }
+    }
+
+    RunResult result;
+    result.lost = 0;
+    result.maxLoad = 0.0;
+    for (int s = 0; s < SENSOR_NUM; s++)
+    {
+        result.lost += states[s].lost;
+        result.latencyMaxuS[s] = states[s].latencyMaxuS;
+    }
+    for (size_t b = 0; b < busCount; b++)
+    {
+        BusQueue* queue = queues[b];
+        BusResult busResult;
+        busResult.load = queue->getBusyuS () / enduS;
+        busResult.transfersPerS = queue->getTransfers () / _options.seconds;
+        busResult.waitsPerS = queue->getWaits () / _options.seconds;
+        busResult.maxDepth = queue->getMaxDepth ();
+        result.buses.push_back (busResult);
+        result.maxLoad = std::max (result.maxLoad, busResult.load);
+        result.lost += queue->getRejects ();
+    }
+
+    for (size_t i = 0; i < transports.size (); i++)
+        delete transports[i];
+    for (size_t b = 0; b < busCount; b++)
+    {
+        delete queues[b];
+        delete engines[b];
+    }
+    return result;
+}
+
+static bool holds (const Options& _options, const Placement& _placement, double _scale)
+{
+    RunResult result = runPlacement (_options, _placement, _scale);
+    return result.lost == 0 && result.maxLoad <= LOAD_LIMIT;
+}
+
+// Highest common rate scale of the scaling sensors the placement holds at
+static double maxScale (const Options& _options, const Placement& _placement)
+{
+    if (!holds (_options, _placement, SCALE_MIN))
+        return 0.0;
+    double lo = SCALE_MIN;
+    double hi = SCALE_MAX;
+    for (int i = 0; i < SCALE_STEPS; i++)
+    {
+        double mid = sqrt (lo * hi);
+        if (holds (_options, _placement, mid))
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static double samplesPerS (double _scale)
+{
+    double total = 0.0;
+    for (int s = 0; s < SENSOR_NUM; s++)
+        total += SENSORS[s].rateHz * (SENSORS[s].scales ? _scale : 1.0);
+    return total;
+}
+
+// SPI only for the parts with a SPI interface, and of buses that are the
+// same only the first unused one is tried, so mirror images aren't repeated
+static bool validPlacement (const Options& _options, const Placement& _placement)
+{
+    for (int s = 0; s < SENSOR_NUM; s++)
+    {
+        if (_options.buses[_placement[s]].type == BusQueue::BUS_SPI && !SENSORS[s].spi)
+            return false;
+    }
+    std::vector<bool> used (_options.buses.size (), false);
+    for (int s = 0; s < SENSOR_NUM; s++)
+    {
+        int b = _placement[s];
+        for (int e = 0; e < b && !used[b]; e++)
+        {
+            const BusSpec& spec = _options.buses[b];
+            const BusSpec& earlier = _options.buses[e];
+            if (!used[e] && earlier.type == spec.type && earlier.clockHz == spec.clockHz)
+                return false;
+        }
+        used[b] = true;
+    }
+    return true;
+}
+
+typedef struct ranked_struct
+{
+    Placement   placement;
+    double      scale;
+} Ranked;
+
+static bool rankedBefore (const Ranked& _a, const Ranked& _b)
+{
+    return samplesPerS (_a.scale) > samplesPerS (_b.scale);
+}
+
+static void printPlacement (const char* _title, const Options& _options, const Ranked& _ranked)
+{
+    printf ("[%s]\n", _title);
+    for (int s = 0; s < SENSOR_NUM; s++)
+        printf ("%s=%s\n", SENSORS[s].name, _options.buses[_ranked.placement[s]].name.c_str ());
+    printf ("MaxScale=%.2f\n", _ranked.scale);
+    printf ("MaxSamplesPerS=%.0f\n", samplesPerS (_ranked.scale));
+
+    // Bus detail at the sketch's rates
+    RunResult result = runPlacement (_options, _ranked.placement, 1.0);
+    for (size_t b = 0; b < _options.buses.size (); b++)
+    {
+        const char* name = _options.buses[b].name.c_str ();
+        printf ("%s.Load=%.4f\n", name, result.buses[b].load);
+        printf ("%s.TransfersPerS=%.1f\n", name, result.buses[b].transfersPerS);
+        printf ("%s.WaitsPerS=%.1f\n", name, result.buses[b].waitsPerS);
+        printf ("%s.MaxDepth=%u\n", name, result.buses[b].maxDepth);
+    }
+    for (int s = 0; s < SENSOR_NUM; s++)
+        printf ("%s.LatencyMaxuS=%.1f\n", SENSORS[s].name, result.latencyMaxuS[s]);
+    printf ("LostSamples=%llu\n", (unsigned long long) result.lost);
+    printf ("\n");
+}
+
+static bool parseBus (const char* _arg, BusSpec& _spec)
+{
+    const char* eq = strchr (_arg, '=');
+    const char* colon = eq ? strchr (eq, ':') : NULL;
+    if (!eq || !colon || eq == _arg)
+        return false;
+    _spec.name = std::string (_arg, eq - _arg);
+    std::string type (eq + 1, colon - eq - 1);
+    if (type == "i2c")
+        _spec.type = BusQueue::BUS_I2C;
+    else if (type == "spi")
+        _spec.type = BusQueue::BUS_SPI;
+    else
+        return false;
+    _spec.clockHz = (uint32_t) atol (colon + 1);
+    return _spec.clockHz > 0;
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-b name=i2c|spi:clock Hz]... [-s seconds] [-n top]\n", _prog);
+    fprintf (stderr, "  Tries every placement of the gyro, accelerometer, magnetometer and barometer\n");
+    fprintf (stderr, "  on the given buses with BusManager (imu_embedded_sw), each bus timed on its\n");
+    fprintf (stderr, "  own, and ranks them by the sample throughput they hold without losing a\n");
+    fprintf (stderr, "  sample or loading a bus over %.0f%%.\n", LOAD_LIMIT * 100.0);
+    fprintf (stderr, "  -b  a bus, repeat for each, default Wire=i2c:100000 Wire1=i2c:100000\n");
+    fprintf (stderr, "  -s  simulated length of each run, default %.1f s\n", SECONDS_DEFAULT);
+    fprintf (stderr, "  -n  placements to list, default %d\n", TOP_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    Options options;
+    options.seconds = SECONDS_DEFAULT;
+    options.top = TOP_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "b:s:n:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b':
+            {
+                BusSpec spec;
+                if (!parseBus (optarg, spec))
+                {
+                    usage (_argv[0]);
+                    return 1;
+                }
+                options.buses.push_back (spec);
+                break;
+            }
+            case 's':
+                options.seconds = atof (optarg);
+                break;
+            case 'n':
+                options.top = atoi (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (options.buses.empty ())
+    {
+        BusSpec wire = {"Wire", BusQueue::BUS_I2C, 100000};
+        BusSpec wire1 = {"Wire1", BusQueue::BUS_I2C, 100000};
+        options.buses.push_back (wire);
+        options.buses.push_back (wire1);
+    }
+    if (optind != _argc || options.buses.size () > BusManager::MAX_BUSES || options.seconds <= 0.0 ||
+        options.top <= 0 || options.buses[0].type != BusQueue::BUS_I2C)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    for (size_t b = 0; b < options.buses.size (); b++)
+        printf ("Bus=%s %s %u\n", options.buses[b].name.c_str (),
+                (options.buses[b].type == BusQueue::BUS_SPI) ? "spi" : "i2c", options.buses[b].clockHz);
+    printf ("Seconds=%.1f\n", options.seconds);
+    printf ("\n");
+
+    // Everything on the first bus, as the sketch has it
+    Ranked single;
+    single.placement.assign (SENSOR_NUM, 0);
+    single.scale = maxScale (options, single.placement);
+    printPlacement ("single bus", options, single);
+
+    std::vector<Ranked> ranked;
+    Placement placement (SENSOR_NUM, 0);
+    while (true)
+    {
+        if (validPlacement (options, placement))
+        {
+            Ranked entry;
+            entry.placement = placement;
+            entry.scale = maxScale (options, placement);
+            ranked.push_back (entry);
+        }
+        int s = 0;
+        while (s < SENSOR_NUM && ++placement[s] == (int) options.buses.size ())
+            placement[s++] = 0;
+        if (s == SENSOR_NUM)
+            break;
+    }
+    std::stable_sort (ranked.begin (), ranked.end (), rankedBefore);
+
+    int listed = std::min (options.top, (int) ranked.size ());
+    for (int r = 0; r < listed; r++)
+    {
+        char title[32];
+        snprintf (title, sizeof (title), "rank %d", r + 1);
+        printPlacement (title, options, ranked[r]);
+    }
+    if (listed > 0 && single.scale > 0.0)
+        printf ("BestOverSingle=%.2f\n", samplesPerS (ranked[0].scale) / samplesPerS (single.scale));
+    return 0;
+}
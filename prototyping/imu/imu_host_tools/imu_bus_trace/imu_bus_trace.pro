@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# Bus trace dumps to Chrome trace JSON and a utilization summary
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_bus_trace
+TEMPLATE = app
+
+
+SOURCES += main.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/BusTrace.h
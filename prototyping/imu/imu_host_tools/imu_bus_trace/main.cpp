@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "BusTrace.h"
+
+static const uint32_t I2C_CLOCK_HZ_DEFAULT = 100000;
+static const int      BUS_NUM = 2;          // I2C, SPI
+
+// A record on a common 64 bit time line, 0 at the earliest start
+struct Transaction
+{
+    long long   startuS;
+    long long   enduS;
+    uint8_t     device;
+    uint8_t     reg;
+    uint8_t     length;
+    uint8_t     flags;
+};
+
+struct DeviceStats
+{
+    unsigned long long  transactions;
+    unsigned long long  bytes;
+    unsigned long long  busyuS;
+    unsigned long long  wireuS;
+    unsigned long long  isrTransactions;
+    long long           maxuS;
+};
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-c i2c_hz] [-o trace.json] dump.bin\n", _prog);
+    fprintf (stderr, "  Summarizes a bus trace saved by 'imu_uplink_tool trace', per device and per\n");
+    fprintf (stderr, "  bus, and with -o writes it as Chrome trace JSON (chrome://tracing, Perfetto).\n");
+    fprintf (stderr, "  -c  I2C clock for the wire time estimate, the board's own by default\n");
+}
+
+static int busOf (uint8_t _flags)
+{
+    return (_flags & BUS_TRACE_SPI) ? 1 : 0;
+}
+
+static const char* busName (int _bus)
+{
+    return _bus ? "SPI" : "I2C";
+}
+
+static std::string deviceName (int _bus, uint8_t _device)
+{
+    char buf[32];
+    if (_bus)
+    {
+        snprintf (buf, sizeof (buf), "cs %u", _device);
+        return buf;
+    }
+    switch (_device)
+    {
+        case 0x53: return "ADXL345";
+        case 0x69: return "L3G4200D";
+        case 0x1D: return "ADXL345 alt";
+        case 0x68: return "L3G4200D alt";
+        case 0x1E: return "HMC5883L";
+        case 0x77: return "BMP085";
+        default:
+            snprintf (buf, sizeof (buf), "0x%02X", _device);
+            return buf;
+    }
+}
+
+// Time the bytes take on the wire at _clockHz, 9 clocks a byte with its ack.
+// A read repeats the address after the register, SPI has no addressing
+// beyond the register byte.
+static double wireTimeuS (const Transaction& _t, uint32_t _clockHz)
+{
+    if (busOf (_t.flags) || _clockHz == 0)
+        return 0.0;
+    unsigned bytes = 2 + _t.length + ((_t.flags & BUS_TRACE_WRITE) ? 0 : 1);
+    return bytes * 9 * 1e6 / _clockHz;
+}
+
+static bool readDump (const char* _path, BusTraceHeader& _header, std::vector<BusTraceRecord>& _records)
+{
+    FILE* f = fopen (_path, "rb");
+    if (!f)
+    {
+        perror (_path);
+        return false;
+    }
+    bool ok = fread (&_header, sizeof (_header), 1, f) == 1 && _header.magic == BUS_TRACE_MAGIC;
+    if (ok)
+    {
+        _records.resize (_header.records);
+        ok = _records.empty () || fread (&_records[0], sizeof (BusTraceRecord), _records.size (), f) == _records.size ();
+    }
+    fclose (f);
+    if (!ok)
+        fprintf (stderr, "%s is not a complete bus trace dump\n", _path);
+    return ok;
+}
+
+// Records are stored as they complete, so the end times are in order apart
+// from an ISR slipping in between a transaction and its record.  The 32 bit
+// microsecond clock is unwrapped on the end times, then everything is sorted
+// by start.
+static void unwrap (const std::vector<BusTraceRecord>& _records, std::vector<Transaction>& _out)
+{
+    _out.clear ();
+    long long end = 0;
+    for (size_t i = 0; i < _records.size (); i++)
+    {
+        const BusTraceRecord& r = _records[i];
+        if (i > 0)
+            end += (int32_t) (r.enduS - _records[i - 1].enduS);
+        Transaction t;
+        t.enduS = end;
+        t.startuS = end - (uint32_t) (r.enduS - r.startuS);
+        t.device = r.device;
+        t.reg = r.reg;
+        t.length = r.length;
+        t.flags = r.flags;
+        _out.push_back (t);
+    }
+    std::sort (_out.begin (), _out.end (),
+               [] (const Transaction& _a, const Transaction& _b) {return _a.startuS < _b.startuS;});
+    if (!_out.empty ())
+    {
+        long long first = _out[0].startuS;
+        for (size_t i = 0; i < _out.size (); i++)
+        {
+            _out[i].startuS -= first;
+            _out[i].enduS -= first;
+        }
+    }
+}
+
+static bool writeChromeTrace (const char* _path, const std::vector<Transaction>& _trans)
+{
+    FILE* f = fopen (_path, "w");
+    if (!f)
+    {
+        perror (_path);
+        return false;
+    }
+
+    // One process per bus and one thread per device, so each device gets its
+    // own row and overlapping I2C rows show contention
+    fprintf (f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    std::map<int, bool> named;
+    const char* sep = "";
+    for (int b = 0; b < BUS_NUM; b++)
+    {
+        fprintf (f, "%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 sep, b + 1, busName (b));
+        sep = ",\n";
+    }
+    for (size_t i = 0; i < _trans.size (); i++)
+    {
+        const Transaction& t = _trans[i];
+        int bus = busOf (t.flags);
+        int key = (bus << 8) | t.device;
+        if (!named[key])
+        {
+            named[key] = true;
+            fprintf (f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                     sep, bus + 1, t.device, deviceName (bus, t.device).c_str ());
+        }
+        fprintf (f, "%s{\"ph\":\"X\",\"name\":\"%s 0x%02X\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":%lld,\"dur\":%lld,"
+                 "\"args\":{\"reg\":\"0x%02X\",\"len\":%u,\"context\":\"%s\"}}",
+                 sep, (t.flags & BUS_TRACE_WRITE) ? "write" : "read", t.reg, busName (bus), bus + 1, t.device,
+                 t.startuS, t.enduS - t.startuS, t.reg, t.length, (t.flags & BUS_TRACE_ISR) ? "isr" : "main");
+    }
+    fprintf (f, "\n]}\n");
+    if (fclose (f) != 0)
+    {
+        perror (_path);
+        return false;
+    }
+    return true;
+}
+
+// Busy time of one bus, overlapping transactions (an ISR preempting main
+// halfway through one) counted once
+static long long busyTimeuS (const std::vector<Transaction>& _trans, int _bus)
+{
+    long long busy = 0;
+    long long coveredTo = 0;
+    bool any = false;
+    for (size_t i = 0; i < _trans.size (); i++)
+    {
+        const Transaction& t = _trans[i];
+        if (busOf (t.flags) != _bus)
+            continue;
+        long long start = (any && t.startuS < coveredTo) ? coveredTo : t.startuS;
+        if (t.enduS > start)
+            busy += t.enduS - start;
+        if (!any || t.enduS > coveredTo)
+            coveredTo = t.enduS;
+        any = true;
+    }
+    return busy;
+}
+
+static void printSummary (const BusTraceHeader& _header, const std::vector<Transaction>& _trans, uint32_t _clockHz)
+{
+    long long spanuS = 0;
+    for (size_t i = 0; i < _trans.size (); i++)
+        spanuS = std::max (spanuS, _trans[i].enduS);
+    double span = spanuS > 0 ? (double) spanuS : 1.0;
+
+    std::map<int, DeviceStats> devices;
+    for (size_t i = 0; i < _trans.size (); i++)
+    {
+        const Transaction& t = _trans[i];
+        DeviceStats& d = devices[(busOf (t.flags) << 8) | t.device];
+        long long uS = t.enduS - t.startuS;
+        d.transactions++;
+        d.bytes += t.length;
+        d.busyuS += uS;
+        d.wireuS += (unsigned long long) wireTimeuS (t, _clockHz);
+        if (t.flags & BUS_TRACE_ISR)
+            d.isrTransactions++;
+        d.maxuS = std::max (d.maxuS, uS);
+    }
+
+    printf ("Records=%u\n", _header.records);
+    printf ("Overwritten=%u\n", _header.total - _header.records);
+    printf ("I2CClockHz=%u\n", _clockHz);
+    printf ("SpanmS=%.3f\n", spanuS / 1000.0);
+    for (int b = 0; b < BUS_NUM; b++)
+    {
+        long long busy = busyTimeuS (_trans, b);
+        if (busy > 0)
+            printf ("%sUtilization=%.4f\n", busName (b), busy / span);
+    }
+    printf ("\n");
+
+    for (std::map<int, DeviceStats>::const_iterator it = devices.begin (); it != devices.end (); ++it)
+    {
+        const DeviceStats& d = it->second;
+        int bus = it->first >> 8;
+        printf ("[%s %s]\n", busName (bus), deviceName (bus, it->first & 0xFF).c_str ());
+        printf ("Transactions=%llu\n", d.transactions);
+        printf ("Bytes=%llu\n", d.bytes);
+        printf ("BusymS=%.3f\n", d.busyuS / 1000.0);
+        printf ("Utilization=%.4f\n", d.busyuS / span);
+        printf ("AvguS=%.1f\n", (double) d.busyuS / d.transactions);
+        printf ("MaxuS=%lld\n", d.maxuS);
+        printf ("IsrFraction=%.3f\n", (double) d.isrTransactions / d.transactions);
+
+        // Measured over wire time, what the driver and Wire add on top
+        if (bus == 0 && d.busyuS > 0)
+            printf ("WireEfficiency=%.3f\n", (double) d.wireuS / d.busyuS);
+        printf ("\n");
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    uint32_t clockHz = 0;
+    const char* jsonPath = NULL;
+
+    int opt;
+    while ((opt = getopt (argc, argv, "c:o:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                clockHz = (uint32_t) atoi (optarg);
+                break;
+            case 'o':
+                jsonPath = optarg;
+                break;
+            default:
+                usage (argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage (argv[0]);
+        return 1;
+    }
+
+    BusTraceHeader header;
+    std::vector<BusTraceRecord> records;
+    if (!readDump (argv[optind], header, records))
+        return 1;
+    if (clockHz == 0)
+        clockHz = header.i2cClockHz ? header.i2cClockHz : I2C_CLOCK_HZ_DEFAULT;
+
+    std::vector<Transaction> trans;
+    unwrap (records, trans);
+    printSummary (header, trans, clockHz);
+    if (jsonPath && !writeChromeTrace (jsonPath, trans))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,382 @@
+#include "ellipsoid_fit.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const double EllipsoidFit::MIN_COVERAGE = 0.05;
+
+// Below this many samples per worker the sums run on the calling thread
+static const size_t MIN_RANGE_SAMPLES = 16384;
+
+// Scale from the median absolute deviation to sigma for normal residuals
+static const double MAD_TO_SIGMA = 1.4826;
+
+void symmetricEigen (const Mat3<double>& _a, Vec3<double>& _d, Mat3<double>& _v)
+{
+    // Cyclic Jacobi rotations, converges in a handful of sweeps for 3x3
+    Mat3<double> a = _a;
+    _v = Mat3<double>::identity ();
+    for (int sweep = 0; sweep < 50; sweep++)
+    {
+        double off = a.m[0][1] * a.m[0][1] + a.m[0][2] * a.m[0][2] + a.m[1][2] * a.m[1][2];
+        if (off < 1e-30)
+            break;
+
+        for (int p = 0; p < 2; p++)
+        {
+            for (int q = p + 1; q < 3; q++)
+            {
+                if (a.m[p][q] == 0.0)
+                    continue;
+                double theta = (a.m[q][q] - a.m[p][p]) / (2.0 * a.m[p][q]);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs (theta) + sqrt (theta * theta + 1.0));
+                double c = 1.0 / sqrt (t * t + 1.0);
+                double s = t * c;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    double akp = a.m[k][p];
+                    double akq = a.m[k][q];
+                    a.m[k][p] = c * akp - s * akq;
+                    a.m[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    double apk = a.m[p][k];
+                    double aqk = a.m[q][k];
+                    a.m[p][k] = c * apk - s * aqk;
+                    a.m[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    double vkp = _v.m[k][p];
+                    double vkq = _v.m[k][q];
+                    _v.m[k][p] = c * vkp - s * vkq;
+                    _v.m[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    _d = makeVec3<double> (a.m[0][0], a.m[1][1], a.m[2][2]);
+}
+
+static bool invert (const Mat3<double>& _a, Mat3<double>& _inv)
+{
+    const double (*m)[3] = _a.m;
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                 m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                 m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (fabs (det) < 1e-300)
+        return false;
+
+    _inv.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det;
+    _inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det;
+    _inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det;
+    _inv.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) / det;
+    _inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) / det;
+    _inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det;
+    _inv.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) / det;
+    _inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) / det;
+    _inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det;
+    return true;
+}
+
+// Solve the symmetric positive definite system _a x = _b in place (Cholesky)
+static bool choleskySolve (double _a[9][9], double _b[9])
+{
+    double trace = 0.0;
+    for (int i = 0; i < 9; i++)
+        trace += _a[i][i];
+
+    for (int j = 0; j < 9; j++)
+    {
+        double d = _a[j][j];
+        for (int k = 0; k < j; k++)
+            d -= _a[j][k] * _a[j][k];
+        if (d <= 1e-12 * trace)
+            return false;
+        _a[j][j] = sqrt (d);
+        for (int i = j + 1; i < 9; i++)
+        {
+            double s = _a[i][j];
+            for (int k = 0; k < j; k++)
+                s -= _a[i][k] * _a[j][k];
+            _a[i][j] = s / _a[j][j];
+        }
+    }
+
+    for (int i = 0; i < 9; i++)
+    {
+        for (int k = 0; k < i; k++)
+            _b[i] -= _a[i][k] * _b[k];
+        _b[i] /= _a[i][i];
+    }
+    for (int i = 8; i >= 0; i--)
+    {
+        for (int k = i + 1; k < 9; k++)
+            _b[i] -= _a[k][i] * _b[k];
+        _b[i] /= _a[i][i];
+    }
+    return true;
+}
+
+EllipsoidFit::EllipsoidFit (WorkerPool* _pool, double _radius, double _rejectSigma, int _maxIterations)
+    : m_pool (_pool),
+      m_radius (_radius),
+      m_rejectSigma (_rejectSigma),
+      m_maxIterations (_maxIterations > 0 ? _maxIterations : 1),
+      m_scale (1.0)
+{
+    m_center = makeVec3<double> (0.0, 0.0, 0.0);
+}
+
+template <typename F>
+void EllipsoidFit::forRanges (size_t _n, F _func)
+{
+    unsigned threads = m_pool ? m_pool->getThreads () : 1;
+    if (threads <= 1 || _n < MIN_RANGE_SAMPLES * 2)
+    {
+        _func (0, 0, _n);
+        return;
+    }
+
+    for (unsigned w = 0; w < threads; w++)
+    {
+        size_t begin = _n * w / threads;
+        size_t end = _n * (w + 1) / threads;
+        m_pool->post (w, [=] () {_func (w, begin, end);});
+    }
+    m_pool->wait ();
+}
+
+EllipsoidFit::Result EllipsoidFit::fit (const std::vector<Vec3<float> >& _samples)
+{
+    Result r;
+    memset (&r, 0, sizeof (r));
+    r.samples = _samples.size ();
+    r.matrix = Mat3<double>::identity ();
+    if (_samples.size () < MIN_SAMPLES)
+    {
+        r.error = "too few samples";
+        return r;
+    }
+
+    size_t n = _samples.size ();
+    unsigned threads = m_pool ? m_pool->getThreads () : 1;
+
+    // Normalize so the squared terms of the normal equations stay well scaled
+    std::vector<Vec3<double> > partialSum (threads, makeVec3<double> (0.0, 0.0, 0.0));
+    forRanges (n, [&] (unsigned _w, size_t _begin, size_t _end) {
+        for (size_t i = _begin; i < _end; i++)
+            partialSum[_w] += scaleVec3<double> (_samples[i], 1.0);
+    });
+    m_center = makeVec3<double> (0.0, 0.0, 0.0);
+    for (unsigned w = 0; w < threads; w++)
+        m_center += partialSum[w];
+    m_center *= 1.0 / n;
+
+    std::vector<double> partialSq (threads, 0.0);
+    forRanges (n, [&] (unsigned _w, size_t _begin, size_t _end) {
+        for (size_t i = _begin; i < _end; i++)
+        {
+            Vec3<double> d = scaleVec3<double> (_samples[i], 1.0) - m_center;
+            partialSq[_w] += dot (d, d);
+        }
+    });
+    double sq = 0.0;
+    for (unsigned w = 0; w < threads; w++)
+        sq += partialSq[w];
+    m_scale = sqrt (sq / n);
+    if (m_scale <= 0.0)
+    {
+        r.error = "samples do not move";
+        return r;
+    }
+
+    m_inlier.assign (n, 1);
+    m_residual.resize (n);
+    std::vector<double> deviation (n);
+
+    for (r.iterations = 1; r.iterations <= m_maxIterations; r.iterations++)
+    {
+        if (!solveEllipsoid (_samples, r))
+            return r;
+        residuals (_samples, r);
+
+        // Robust spread of the residuals over all samples, so a bad fit
+        // can take rejected samples back
+        deviation = m_residual;
+        std::nth_element (deviation.begin (), deviation.begin () + n / 2, deviation.end ());
+        double median = deviation[n / 2];
+        for (size_t i = 0; i < n; i++)
+            deviation[i] = fabs (m_residual[i] - median);
+        std::nth_element (deviation.begin (), deviation.begin () + n / 2, deviation.end ());
+        double sigma = std::max (MAD_TO_SIGMA * deviation[n / 2], 1e-9);
+
+        bool changed = false;
+        size_t inliers = 0;
+        double sumSq = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned char in = fabs (m_residual[i] - median) <= m_rejectSigma * sigma;
+            if (in != m_inlier[i])
+                changed = true;
+            m_inlier[i] = in;
+            if (in)
+            {
+                inliers++;
+                sumSq += m_residual[i] * m_residual[i];
+            }
+        }
+        r.inliers = inliers;
+        r.rmsResidual = inliers ? sqrt (sumSq / inliers) : 0.0;
+        if (inliers < MIN_SAMPLES)
+        {
+            r.error = "too few inliers";
+            return r;
+        }
+        if (!changed)
+            break;
+    }
+    if (r.iterations > m_maxIterations)
+        r.iterations = m_maxIterations;
+
+    // Spread of the corrected directions, a few clustered orientations
+    // leave the ellipsoid underdetermined
+    Vec3<double> meanDir = makeVec3<double> (0.0, 0.0, 0.0);
+    Mat3<double> scatter = {{{0, 0, 0}, {0, 0, 0}, {0, 0, 0}}};
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!m_inlier[i])
+            continue;
+        Vec3<double> d = r.matrix * (scaleVec3<double> (_samples[i], 1.0) - r.bias);
+        double len = norm (d);
+        if (len <= 0.0)
+            continue;
+        d *= 1.0 / len;
+        meanDir += d;
+        double v[3] = {d.x, d.y, d.z};
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                scatter.m[a][b] += v[a] * v[b];
+    }
+    meanDir *= 1.0 / r.inliers;
+    double mv[3] = {meanDir.x, meanDir.y, meanDir.z};
+    for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+            scatter.m[a][b] = scatter.m[a][b] / r.inliers - mv[a] * mv[b];
+    Vec3<double> eig;
+    Mat3<double> vecs;
+    symmetricEigen (scatter, eig, vecs);
+    r.coverage = std::min (eig.x, std::min (eig.y, eig.z));
+    if (r.coverage < MIN_COVERAGE)
+    {
+        r.error = "orientations do not cover enough of the sphere";
+        return r;
+    }
+
+    r.ok = true;
+    return r;
+}
+
+bool EllipsoidFit::solveEllipsoid (const std::vector<Vec3<float> >& _samples, Result& _r)
+{
+    unsigned threads = m_pool ? m_pool->getThreads () : 1;
+    std::vector<NormalSums> partial (threads);
+    memset (&partial[0], 0, threads * sizeof (NormalSums));
+
+    forRanges (_samples.size (), [&] (unsigned _w, size_t _begin, size_t _end) {
+        NormalSums& s = partial[_w];
+        double invScale = 1.0 / m_scale;
+        for (size_t i = _begin; i < _end; i++)
+        {
+            if (!m_inlier[i])
+                continue;
+            Vec3<double> u = (scaleVec3<double> (_samples[i], 1.0) - m_center) * invScale;
+            double d[9] = {u.x * u.x, u.y * u.y, u.z * u.z,
+                           2 * u.x * u.y, 2 * u.x * u.z, 2 * u.y * u.z,
+                           2 * u.x, 2 * u.y, 2 * u.z};
+            for (int j = 0; j < 9; j++)
+            {
+                for (int k = 0; k <= j; k++)
+                    s.ata[j][k] += d[j] * d[k];
+                s.atb[j] += d[j];
+            }
+            s.n++;
+        }
+    });
+
+    NormalSums sum = partial[0];
+    for (unsigned w = 1; w < threads; w++)
+    {
+        for (int j = 0; j < 9; j++)
+        {
+            for (int k = 0; k <= j; k++)
+                sum.ata[j][k] += partial[w].ata[j][k];
+            sum.atb[j] += partial[w].atb[j];
+        }
+        sum.n += partial[w].n;
+    }
+    for (int j = 0; j < 9; j++)
+        for (int k = j + 1; k < 9; k++)
+            sum.ata[j][k] = sum.ata[k][j];
+
+    double p[9];
+    std::copy (sum.atb, sum.atb + 9, p);
+    if (!choleskySolve (sum.ata, p))
+    {
+        _r.error = "degenerate sample set";
+        return false;
+    }
+
+    // Center and shape in normalized coordinates:
+    // (u - cu)^T Q (u - cu) = 1 + cu^T Q cu
+    Mat3<double> q = {{{p[0], p[3], p[4]}, {p[3], p[1], p[5]}, {p[4], p[5], p[2]}}};
+    Mat3<double> qInv;
+    if (!invert (q, qInv))
+    {
+        _r.error = "samples do not lie on an ellipsoid";
+        return false;
+    }
+    Vec3<double> cu = qInv * makeVec3<double> (-p[6], -p[7], -p[8]);
+    double level = 1.0 + dot (cu, q * cu);
+    if (level <= 0.0)
+    {
+        _r.error = "samples do not lie on an ellipsoid";
+        return false;
+    }
+
+    // Back to raw coordinates, (x - c)^T M (x - c) = 1
+    Mat3<double> m;
+    for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+            m.m[a][b] = q.m[a][b] / (level * m_scale * m_scale);
+
+    Vec3<double> eig;
+    Mat3<double> vecs;
+    symmetricEigen (m, eig, vecs);
+    if (eig.x <= 0.0 || eig.y <= 0.0 || eig.z <= 0.0)
+    {
+        _r.error = "samples do not lie on an ellipsoid";
+        return false;
+    }
+
+    // Symmetric square root keeps the correction free of rotation
+    double radius = (m_radius > 0.0) ? m_radius : pow (eig.x * eig.y * eig.z, -1.0 / 6.0);
+    Mat3<double> sqrtEig = {{{sqrt (eig.x) * radius, 0, 0}, {0, sqrt (eig.y) * radius, 0}, {0, 0, sqrt (eig.z) * radius}}};
+
+    _r.bias = m_center + cu * m_scale;
+    _r.matrix = vecs * sqrtEig * transpose (vecs);
+    _r.radius = radius;
+    return true;
+}
+
+void EllipsoidFit::residuals (const std::vector<Vec3<float> >& _samples, const Result& _r)
+{
+    forRanges (_samples.size (), [&] (unsigned, size_t _begin, size_t _end) {
+        double invRadius = 1.0 / _r.radius;
+        for (size_t i = _begin; i < _end; i++)
+            m_residual[i] = norm (_r.matrix * (scaleVec3<double> (_samples[i], 1.0) - _r.bias)) * invRadius - 1.0;
+    });
+}
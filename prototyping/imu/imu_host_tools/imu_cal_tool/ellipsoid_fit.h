@@ -0,0 +1,75 @@
+#ifndef ELLIPSOID_FIT_H
+#define ELLIPSOID_FIT_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "VectorMath.h"
+#include "worker_pool.h"
+
+// Robust ellipsoid fit of raw 3 axis samples taken in many orientations.
+// Finds bias b and a symmetric matrix W with |W (raw - b)| = radius, which
+// covers offset, per axis scale and cross-axis (or hard and soft iron) terms.
+// Outliers are rejected by iterating the fit on the samples whose geometric
+// residual is within a few robust sigmas.  The sums over the samples are split
+// across the pool's workers.
+class EllipsoidFit
+{
+public:
+    struct Result
+    {
+        bool            ok;
+        const char*     error;
+        Vec3<double>    bias;           // raw LSB
+        Mat3<double>    matrix;         // corrected = matrix * (raw - bias)
+        double          radius;         // |corrected| in raw LSB
+        double          rmsResidual;    // of the inliers, relative to radius
+        double          coverage;       // smallest direction eigenvalue, 1/3 is a full sphere
+        size_t          samples;
+        size_t          inliers;
+        int             iterations;
+    };
+
+    // _radius > 0 fixes |corrected| (accelerometer, 1 g in LSB).  0 keeps the
+    // ellipsoid's mean radius, for the magnetometer where the field is unknown.
+    EllipsoidFit (WorkerPool* _pool, double _radius, double _rejectSigma, int _maxIterations);
+
+    Result fit (const std::vector<Vec3<float> >& _samples);
+
+    // Samples need to cover at least this much of the sphere
+    static const double MIN_COVERAGE;
+    static const size_t MIN_SAMPLES = 50;
+
+private:
+    // Normal equations of the 9 parameter algebraic fit
+    // a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+    struct NormalSums
+    {
+        double  ata[9][9];
+        double  atb[9];
+        size_t  n;
+    };
+
+    template <typename F>
+    void forRanges (size_t _n, F _func);
+
+    bool solveEllipsoid (const std::vector<Vec3<float> >& _samples, Result& _r);
+    void residuals (const std::vector<Vec3<float> >& _samples, const Result& _r);
+
+    WorkerPool*                 m_pool;
+    double                      m_radius;
+    double                      m_rejectSigma;
+    int                         m_maxIterations;
+
+    // Fit in coordinates centered on the mean and scaled to unit spread
+    Vec3<double>                m_center;
+    double                      m_scale;
+
+    std::vector<unsigned char>  m_inlier;
+    std::vector<double>         m_residual;
+};
+
+// Eigen decomposition of a symmetric matrix, _a = _v diag(_d) _v^T
+void symmetricEigen (const Mat3<double>& _a, Vec3<double>& _d, Mat3<double>& _v);
+
+#endif // ELLIPSOID_FIT_H
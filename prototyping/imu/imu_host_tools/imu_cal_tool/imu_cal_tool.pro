@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Ellipsoid calibration of the accelerometer and magnetometer
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_cal_tool
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    ellipsoid_fit.cpp
+
+HEADERS += ellipsoid_fit.h \
+    $$PWD/../../imu_embedded_sw/CalibrationBlob.h
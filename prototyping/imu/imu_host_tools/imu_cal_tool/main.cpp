@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "CalibrationBlob.h"
+#include "capture_reader.h"
+#include "ellipsoid_fit.h"
+#include "worker_pool.h"
+
+static const size_t READ_RECORDS = 65536;
+static const double ACC_LSB_PER_G_DEFAULT = 256.0;   // full resolution, 3.90625 mg/LSB
+static const double REJECT_SIGMA_DEFAULT = 3.0;
+static const int    MAX_ITERATIONS_DEFAULT = 20;
+
+// Averages runs of consecutive samples, which also cuts the noise the fit sees
+struct SampleSet
+{
+    std::vector<Vec3<float> >   samples;
+    Vec3<double>                sum;
+    unsigned                    count;
+};
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-j threads] [-s acc|mag|all] [-g acc_lsb_per_g] [-k reject_sigma]\n", _prog);
+    fprintf (stderr, "          [-i max_iterations] [-a average] [-o out_dir] board_capture.bin ...\n");
+    fprintf (stderr, "  Fits ADXL345 bias/scale/cross-axis and HMC5883L hard/soft iron ellipsoid\n");
+    fprintf (stderr, "  models to multi-orientation captures, one capture per board.  Writes a\n");
+    fprintf (stderr, "  CalibrationBlob (imu_embedded_sw/CalibrationBlob.h) per board and sensor.\n");
+}
+
+static void addSample (SampleSet& _set, const CaptureRecord& _rec, unsigned _average)
+{
+    _set.sum += makeVec3<double> (_rec.value[0], _rec.value[1], _rec.value[2]);
+    if (++_set.count < _average)
+        return;
+    Vec3<double> mean = _set.sum * (1.0 / _set.count);
+    _set.samples.push_back (makeVec3<float> ((float) mean.x, (float) mean.y, (float) mean.z));
+    _set.sum = makeVec3<double> (0.0, 0.0, 0.0);
+    _set.count = 0;
+}
+
+// Board id from the first number in the file name, else its position
+static uint32_t boardId (const std::string& _path, size_t _index)
+{
+    size_t slash = _path.find_last_of ('/');
+    std::string name = (slash == std::string::npos) ? _path : _path.substr (slash + 1);
+    for (size_t i = 0; i < name.size (); i++)
+        if (isdigit ((unsigned char) name[i]))
+            return strtoul (name.c_str () + i, NULL, 10);
+    return _index + 1;
+}
+
+static std::string baseName (const std::string& _path)
+{
+    size_t slash = _path.find_last_of ('/');
+    std::string name = (slash == std::string::npos) ? _path : _path.substr (slash + 1);
+    size_t dot = name.find_last_of ('.');
+    return (dot == std::string::npos || dot == 0) ? name : name.substr (0, dot);
+}
+
+static bool packBlob (const EllipsoidFit::Result& _r, CAPTURE_SENSOR _sensor, uint32_t _boardId, CalibrationBlob& _blob)
+{
+    memset (&_blob, 0, sizeof (_blob));
+    _blob.magic = CALIBRATION_MAGIC;
+    _blob.version = CALIBRATION_VERSION;
+    _blob.sensor = _sensor;
+    _blob.boardId = _boardId;
+
+    double bias[3] = {_r.bias.x, _r.bias.y, _r.bias.z};
+    for (int i = 0; i < 3; i++)
+    {
+        long q = lround (bias[i] * CALIBRATION_BIAS_ONE);
+        if (q < INT16_MIN || q > INT16_MAX)
+            return false;
+        _blob.bias[i] = (int16_t) q;
+    }
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            long q = lround (_r.matrix.m[r][c] * CALIBRATION_MATRIX_ONE);
+            if (q < INT16_MIN || q > INT16_MAX)
+                return false;
+            _blob.matrix[r * 3 + c] = (int16_t) q;
+        }
+    }
+    _blob.residual = (uint16_t) std::min (65535L, lround (_r.rmsResidual * 65536.0));
+    _blob.crc = calibrationCRC (_blob);
+    return true;
+}
+
+static bool calibrate (const std::vector<Vec3<float> >& _samples, CAPTURE_SENSOR _sensor, double _radius,
+                       const std::string& _path, size_t _index, const std::string& _outDir,
+                       WorkerPool& _pool, double _rejectSigma, int _maxIterations)
+{
+    EllipsoidFit fitter (&_pool, _radius, _rejectSigma, _maxIterations);
+    EllipsoidFit::Result r = fitter.fit (_samples);
+    uint32_t id = boardId (_path, _index);
+    const char* name = (_sensor == CAPTURE_ACC) ? "acc" : "mag";
+
+    printf ("[%s %s]\n", _path.c_str (), name);
+    printf ("BoardId=%u\n", id);
+    printf ("Samples=%zu\n", r.samples);
+    if (!r.ok)
+    {
+        printf ("Error=%s\n\n", r.error);
+        return false;
+    }
+
+    CalibrationBlob blob;
+    if (!packBlob (r, _sensor, id, blob))
+    {
+        printf ("Error=parameters out of blob range\n\n");
+        return false;
+    }
+
+    printf ("Inliers=%zu\n", r.inliers);
+    printf ("Iterations=%d\n", r.iterations);
+    printf ("Coverage=%.3f\n", r.coverage);
+    printf ("RadiusLSB=%.3f\n", r.radius);
+    printf ("RMSResidual=%.6f\n", r.rmsResidual);
+    printf ("BiasLSB=%.3f %.3f %.3f\n", r.bias.x, r.bias.y, r.bias.z);
+    for (int i = 0; i < 3; i++)
+        printf ("MatrixRow%d=%.6f %.6f %.6f\n", i, r.matrix.m[i][0], r.matrix.m[i][1], r.matrix.m[i][2]);
+
+    std::string blobPath = _outDir + "/" + baseName (_path) + "_" + name + ".cal";
+    FILE* f = fopen (blobPath.c_str (), "wb");
+    if (!f || fwrite (&blob, sizeof (blob), 1, f) != 1)
+    {
+        printf ("Error=could not write %s\n\n", blobPath.c_str ());
+        if (f)
+            fclose (f);
+        return false;
+    }
+    fclose (f);
+
+    printf ("Blob=%s\n\n", blobPath.c_str ());
+    return true;
+}
+
+int main (int argc, char* argv[])
+{
+    unsigned threads = std::thread::hardware_concurrency ();
+    bool doAcc = true;
+    bool doMag = true;
+    double accLsbPerG = ACC_LSB_PER_G_DEFAULT;
+    double rejectSigma = REJECT_SIGMA_DEFAULT;
+    int maxIterations = MAX_ITERATIONS_DEFAULT;
+    unsigned average = 1;
+    std::string outDir = ".";
+
+    int opt;
+    while ((opt = getopt (argc, argv, "j:s:g:k:i:a:o:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j':
+                threads = atoi (optarg);
+                break;
+            case 's':
+                doAcc = !strcmp (optarg, "acc") || !strcmp (optarg, "all");
+                doMag = !strcmp (optarg, "mag") || !strcmp (optarg, "all");
+                break;
+            case 'g':
+                accLsbPerG = atof (optarg);
+                break;
+            case 'k':
+                rejectSigma = atof (optarg);
+                break;
+            case 'i':
+                maxIterations = atoi (optarg);
+                break;
+            case 'a':
+                average = atoi (optarg);
+                break;
+            case 'o':
+                outDir = optarg;
+                break;
+            default:
+                usage (argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || (!doAcc && !doMag) || accLsbPerG <= 0.0 || rejectSigma <= 0.0 || average == 0)
+    {
+        usage (argv[0]);
+        return 1;
+    }
+    if (threads == 0)
+        threads = 1;
+
+    // Boards are done one after another, each fit uses every worker
+    WorkerPool pool (threads, 1);
+    int failures = 0;
+    std::vector<CaptureRecord> records;
+    records.reserve (READ_RECORDS);
+
+    for (int a = optind; a < argc; a++)
+    {
+        std::string path = argv[a];
+        size_t index = a - optind;
+
+        CaptureReader reader;
+        if (!reader.open (path))
+        {
+            fprintf (stderr, "Could not open %s\n", path.c_str ());
+            failures++;
+            continue;
+        }
+
+        SampleSet acc;
+        SampleSet mag;
+        acc.sum = mag.sum = makeVec3<double> (0.0, 0.0, 0.0);
+        acc.count = mag.count = 0;
+        for (;;)
+        {
+            records.clear ();
+            if (!reader.read (records, READ_RECORDS))
+                break;
+            for (size_t i = 0; i < records.size (); i++)
+            {
+                if (records[i].axes != 3)
+                    continue;
+                if (doAcc && records[i].sensor == CAPTURE_ACC)
+                    addSample (acc, records[i], average);
+                else if (doMag && records[i].sensor == CAPTURE_MAG)
+                    addSample (mag, records[i], average);
+            }
+        }
+
+        if (doAcc && !calibrate (acc.samples, CAPTURE_ACC, accLsbPerG, path, index, outDir, pool, rejectSigma, maxIterations))
+            failures++;
+        if (doMag && !calibrate (mag.samples, CAPTURE_MAG, 0.0, path, index, outDir, pool, rejectSigma, maxIterations))
+            failures++;
+    }
+
+    return failures ? 2 : 0;
+}
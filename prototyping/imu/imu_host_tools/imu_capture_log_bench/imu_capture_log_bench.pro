@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# Open, seek and scan timings of CaptureLog with checks
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_capture_log_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp
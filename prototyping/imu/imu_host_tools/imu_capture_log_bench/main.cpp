@@ -0,0 +1,293 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "capture_log.h"
+
+static const double   SIZE_MIB_DEFAULT = 256.0;
+static const int      SEEKS_DEFAULT = 1000;
+
+// Synthetic log: a record every RECORD_US starting just short of a time
+// wrap, so it wraps at once and then every 71 minutes (about every 34 MB),
+// with JUNK_BYTES of garbage after every JUNK_EVERY records
+static const uint32_t RECORD_US = 2000;
+static const uint32_t FIRST_TIME_US = 0xFFFFFFFFu - 10000000u;
+static const uint64_t JUNK_EVERY = 50000;
+static const int      JUNK_BYTES = 37;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapseduS (Clock::time_point _start)
+{
+    return std::chrono::duration<double, std::micro> (Clock::now () - _start).count ();
+}
+
+// Record i carries i in its first value, junk never holds the first sync
+// byte so no record can be read out of it
+static bool writeLog (const std::string& _path, uint64_t _bytes, uint64_t& _records)
+{
+    FILE* file = fopen (_path.c_str (), "wb");
+    if (!file)
+        return false;
+
+    std::mt19937 rng (1);
+    std::vector<unsigned char> buf;
+    uint64_t written = 0;
+    _records = 0;
+    while (written + buf.size () + sizeof (CaptureRecord) <= _bytes)
+    {
+        CaptureRecord rec;
+        memset (&rec, 0, sizeof (rec));
+        rec.sync = CAPTURE_SYNC;
+        rec.sensor = (uint8_t) (_records % CAPTURE_SENSOR_NUM);
+        rec.axes = (rec.sensor < CAPTURE_PRESSURE) ? 3 : 1;
+        rec.timeuS = FIRST_TIME_US + (uint32_t) (_records * RECORD_US);
+        rec.value[0] = (int32_t) _records;
+        const unsigned char* bytes = (const unsigned char*) &rec;
+        buf.insert (buf.end (), bytes, bytes + sizeof (rec));
+        _records++;
+
+        if (_records % JUNK_EVERY == 0)
+        {
+            for (int j = 0; j < JUNK_BYTES; j++)
+            {
+                unsigned char junk = (unsigned char) rng ();
+                buf.push_back ((junk == (CAPTURE_SYNC & 0xFF)) ? 0 : junk);
+            }
+        }
+        if (buf.size () >= (1 << 20))
+        {
+            written += fwrite (&buf[0], 1, buf.size (), file);
+            buf.clear ();
+        }
+    }
+    if (!buf.empty ())
+        written += fwrite (&buf[0], 1, buf.size (), file);
+    bool ok = fflush (file) == 0 && fsync (fileno (file)) == 0;
+    return fclose (file) == 0 && ok;
+}
+
+// Out of the page cache, so the next open has to fault its probes in
+static void dropCache (const std::string& _path)
+{
+    int fd = open (_path.c_str (), O_RDONLY);
+    if (fd < 0)
+        return;
+    posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+    close (fd);
+}
+
+static long long expecteduS (uint64_t _record)
+{
+    return (long long) FIRST_TIME_US + (long long) (_record * RECORD_US);
+}
+
+// Random seeks, each checked against the records around it, and in a
+// synthetic capture against the record it has to be
+static bool runSeeks (const char* _name, const CaptureLog& _log, int _seeks, bool _synthetic)
+{
+    std::mt19937_64 rng (1);
+    std::uniform_int_distribution<long long> target (_log.getStartuS (), _log.getEnduS ());
+    double seekTotaluS = 0.0;
+    double seekMaxuS = 0.0;
+    uint64_t scanMaxBytes = 0;
+    int seekErrors = 0;
+    for (int q = 0; q < _seeks; q++)
+    {
+        long long timeuS = target (rng);
+        Clock::time_point start = Clock::now ();
+        CaptureLog::Cursor cursor = _log.seek (timeuS);
+        uint64_t from = cursor.offset;
+        long long beforeuS = cursor.timeuS;
+        CaptureRecord rec;
+        bool found = false;
+        while (_log.next (cursor, rec))
+        {
+            if (cursor.timeuS >= timeuS)
+            {
+                found = true;
+                break;
+            }
+            beforeuS = cursor.timeuS;
+        }
+        double uS = elapseduS (start);
+        seekTotaluS += uS;
+        if (uS > seekMaxuS)
+            seekMaxuS = uS;
+        if (cursor.offset - from > scanMaxBytes)
+            scanMaxBytes = cursor.offset - from;
+
+        // Only the first record can be its own index entry and the target
+        bool right = found && (beforeuS < timeuS || cursor.timeuS == _log.getStartuS ());
+        if (_synthetic && right)
+        {
+            uint64_t expected = (uint64_t) ((timeuS - expecteduS (0) + RECORD_US - 1) / RECORD_US);
+            right = (uint64_t) rec.value[0] == expected && cursor.timeuS == expecteduS (expected);
+        }
+        if (!right)
+            seekErrors++;
+    }
+    bool ok = seekErrors == 0 && scanMaxBytes <= CaptureLog::INDEX_STRIDE_BYTES + CaptureLog::RESYNC_MAX_BYTES;
+    printf ("[%s]\n", _name);
+    printf ("Seeks=%d\n", _seeks);
+    printf ("SeekMeanuS=%.1f\n", seekTotaluS / _seeks);
+    printf ("SeekMaxuS=%.1f\n", seekMaxuS);
+    printf ("ScanMaxBytes=%llu\n", (unsigned long long) scanMaxBytes);
+    printf ("Errors=%d\n", seekErrors);
+    printf ("Check=%s\n", ok ? "ok" : "mismatch");
+    printf ("\n");
+    return ok;
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-m MiB] [-q seeks] [-o synthetic file] [capture file]\n", _prog);
+    fprintf (stderr, "  Times CaptureLog (common) opening a capture cold and warm and seeking in it,\n");
+    fprintf (stderr, "  and checks a full scan and every seek land on the right record.  Without\n");
+    fprintf (stderr, "  a capture file it writes a synthetic one with time wraps and junk, where\n");
+    fprintf (stderr, "  every record is known; in a real capture a seek is checked against the\n");
+    fprintf (stderr, "  records on either side of it.\n");
+    fprintf (stderr, "  -m  size of the synthetic capture, default %.0f MiB\n", SIZE_MIB_DEFAULT);
+    fprintf (stderr, "  -q  random seeks, default %d\n", SEEKS_DEFAULT);
+    fprintf (stderr, "  -o  keep the synthetic capture at this path, default a removed temporary\n");
+}
+
+int main (int _argc, char** _argv)
+{
+    double sizeMiB = SIZE_MIB_DEFAULT;
+    int seeks = SEEKS_DEFAULT;
+    std::string outPath;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "m:q:o:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                sizeMiB = atof (optarg);
+                break;
+            case 'q':
+                seeks = atoi (optarg);
+                break;
+            case 'o':
+                outPath = optarg;
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 1 < _argc || sizeMiB < 1.0 || seeks < 1 || (optind < _argc && !outPath.empty ()))
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    bool synthetic = optind == _argc;
+    std::string path;
+    uint64_t records = 0;
+    if (synthetic)
+    {
+        path = outPath;
+        if (path.empty ())
+        {
+            const char* tmp = getenv ("TMPDIR");
+            char name[4096];
+            snprintf (name, sizeof (name), "%s/imu_capture_log_bench_XXXXXX", tmp ? tmp : "/tmp");
+            int fd = mkstemp (name);
+            if (fd < 0)
+            {
+                fprintf (stderr, "Cannot create a temporary file\n");
+                return 1;
+            }
+            close (fd);
+            path = name;
+        }
+        if (!writeLog (path, (uint64_t) (sizeMiB * 1024 * 1024), records))
+        {
+            fprintf (stderr, "Cannot write %s\n", path.c_str ());
+            if (outPath.empty ())
+                unlink (path.c_str ());
+            return 1;
+        }
+    }
+    else
+    {
+        path = _argv[optind];
+    }
+
+    bool ok = true;
+    CaptureLog log;
+    dropCache (path);
+    Clock::time_point start = Clock::now ();
+    if (!log.open (path))
+    {
+        fprintf (stderr, "Cannot open %s\n", path.c_str ());
+        if (synthetic && outPath.empty ())
+            unlink (path.c_str ());
+        return 1;
+    }
+    double openColduS = elapseduS (start);
+
+    bool opened = !synthetic ||
+                  (log.getStartuS () == expecteduS (0) && log.getEnduS () == expecteduS (records - 1));
+    ok = ok && opened;
+    printf ("[Open]\n");
+    printf ("File=%s\n", synthetic ? "synthetic" : path.c_str ());
+    printf ("Bytes=%llu\n", (unsigned long long) log.getBytes ());
+    printf ("IndexEntries=%llu\n", (unsigned long long) log.getIndexEntries ());
+    printf ("DurationS=%.1f\n", (log.getEnduS () - log.getStartuS ()) / 1e6);
+    printf ("OpenColdMs=%.3f\n", openColduS / 1000.0);
+    printf ("Check=%s\n", opened ? "ok" : "mismatch");
+    printf ("\n");
+
+    // Straight after the cold open, then again once the scan has the file
+    // cached
+    ok = runSeeks ("SeekCold", log, seeks, synthetic) && ok;
+
+    // Every record in order through the junk, with the times unwrapped
+    CaptureLog::Cursor cursor = log.seek (log.getStartuS ());
+    CaptureRecord rec;
+    uint64_t scanned = 0;
+    bool inOrder = true;
+    start = Clock::now ();
+    while (log.next (cursor, rec))
+    {
+        if (synthetic && ((uint64_t) rec.value[0] != scanned || cursor.timeuS != expecteduS (scanned)))
+            inOrder = false;
+        scanned++;
+    }
+    double scanuS = elapseduS (start);
+    bool scanOk = inOrder && (!synthetic || scanned == records) && cursor.timeuS == log.getEnduS ();
+    ok = ok && scanOk;
+    printf ("[Scan]\n");
+    printf ("Records=%llu\n", (unsigned long long) scanned);
+    printf ("ScanMs=%.1f\n", scanuS / 1000.0);
+    printf ("RecordsPerS=%.0f\n", scanned / (scanuS / 1e6));
+    printf ("Check=%s\n", scanOk ? "ok" : "mismatch");
+    printf ("\n");
+
+    ok = runSeeks ("SeekWarm", log, seeks, synthetic) && ok;
+
+    // Again with the probes' pages cached
+    log.close ();
+    start = Clock::now ();
+    bool reopened = log.open (path);
+    double openWarmuS = elapseduS (start);
+    ok = ok && reopened;
+    printf ("[Reopen]\n");
+    printf ("OpenWarmMs=%.3f\n", openWarmuS / 1000.0);
+    printf ("Check=%s\n", reopened ? "ok" : "mismatch");
+    printf ("\n");
+
+    log.close ();
+    if (synthetic && outPath.empty ())
+        unlink (path.c_str ());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# FastMath error against libm and time per call
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_fastmath_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/FastMath.h
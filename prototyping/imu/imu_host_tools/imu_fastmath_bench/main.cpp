@@ -0,0 +1,286 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+#include "FastMath.h"
+
+static const int    SAMPLES_DEFAULT = 200000;
+static const int    PASSES_DEFAULT = 50;
+static const int    TIMING_INPUTS = 4096;
+static const double PRESSURE_SEA_LEVEL_HPA = 1013.25;   // As BMP085
+
+struct Options
+{
+    int samples;
+    int passes;
+};
+
+// Mean time of one call over a table of inputs, summed into a volatile so
+// the calls can't be dropped
+volatile double g_sink;
+
+template <typename Call>
+static double timeCalls (int _passes, Call _call)
+{
+    double sum = 0.0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    for (int p = 0; p < _passes; p++)
+        for (int i = 0; i < TIMING_INPUTS; i++)
+            sum += _call (i);
+    double ns = std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now () - start).count ();
+    g_sink = sum;
+    return ns / ((double) _passes * TIMING_INPUTS);
+}
+
+static void printTimes (double _libmDouble, double _libmFloat, double _low, double _high)
+{
+    printf ("NsLibmDouble=%.2f\n", _libmDouble);
+    printf ("NsLibmFloat=%.2f\n", _libmFloat);
+    printf ("NsLow=%.2f\n", _low);
+    printf ("NsHigh=%.2f\n", _high);
+    printf ("SpeedupLow=%.2f\n", _libmDouble / _low);
+    printf ("SpeedupHigh=%.2f\n", _libmDouble / _high);
+    printf ("\n");
+}
+
+static double angleDiff (double _a, double _b)
+{
+    double d = fmod (_a - _b, 2.0 * M_PI);
+    if (d > M_PI)
+        d -= 2.0 * M_PI;
+    if (d < -M_PI)
+        d += 2.0 * M_PI;
+    return fabs (d);
+}
+
+// Log spaced over 1e-3 to 1e6, relative error
+static void benchSqrt (const Options& _options)
+{
+    double err[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < _options.samples; i++)
+    {
+        float x = (float) pow (10.0, -3.0 + 9.0 * i / _options.samples);
+        double ref = sqrt ((double) x);
+        err[0] = std::max (err[0], fabs (fastSqrt<FAST_MATH_LOW> (x) - ref) / ref);
+        err[1] = std::max (err[1], fabs (fastSqrt<FAST_MATH_HIGH> (x) - ref) / ref);
+        err[2] = std::max (err[2], fabs (fastSqrt<FAST_MATH_LIBM> (x) - ref) / ref);
+    }
+
+    std::vector<float> in (TIMING_INPUTS);
+    for (int i = 0; i < TIMING_INPUTS; i++)
+        in[i] = 1.0f + 1000.0f * i / TIMING_INPUTS;
+    printf ("[sqrt]\n");
+    printf ("MaxRelErrLow=%.3g\n", err[0]);
+    printf ("MaxRelErrHigh=%.3g\n", err[1]);
+    printf ("MaxRelErrLibmFloat=%.3g\n", err[2]);
+    printTimes (timeCalls (_options.passes, [&] (int _i) {return sqrt ((double) in[_i]);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastSqrt<FAST_MATH_LIBM> (in[_i]);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastSqrt<FAST_MATH_LOW> (in[_i]);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastSqrt<FAST_MATH_HIGH> (in[_i]);}));
+}
+
+// Full circle at radii over three decades, error in radians
+static void benchAtan2 (const Options& _options)
+{
+    double err[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < _options.samples; i++)
+    {
+        double a = 2.0 * M_PI * i / _options.samples - M_PI;
+        double r = pow (10.0, (i % 7) * 0.5);
+        float y = (float) (r * sin (a));
+        float x = (float) (r * cos (a));
+        double ref = atan2 ((double) y, (double) x);
+        err[0] = std::max (err[0], angleDiff (fastAtan2<FAST_MATH_LOW> (y, x), ref));
+        err[1] = std::max (err[1], angleDiff (fastAtan2<FAST_MATH_HIGH> (y, x), ref));
+        err[2] = std::max (err[2], angleDiff (fastAtan2<FAST_MATH_LIBM> (y, x), ref));
+    }
+
+    std::vector<float> ys (TIMING_INPUTS), xs (TIMING_INPUTS);
+    for (int i = 0; i < TIMING_INPUTS; i++)
+    {
+        double a = 2.0 * M_PI * i / TIMING_INPUTS;
+        ys[i] = (float) (1000.0 * sin (a));
+        xs[i] = (float) (1000.0 * cos (a));
+    }
+    printf ("[atan2]\n");
+    printf ("MaxErrRadLow=%.3g\n", err[0]);
+    printf ("MaxErrRadHigh=%.3g\n", err[1]);
+    printf ("MaxErrRadLibmFloat=%.3g\n", err[2]);
+    printTimes (timeCalls (_options.passes, [&] (int _i) {return atan2 ((double) ys[_i], (double) xs[_i]);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastAtan2<FAST_MATH_LIBM> (ys[_i], xs[_i]);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastAtan2<FAST_MATH_LOW> (ys[_i], xs[_i]);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastAtan2<FAST_MATH_HIGH> (ys[_i], xs[_i]);}));
+}
+
+// Four turns either side of 0, the worse of sine and cosine, timed as a pair
+static void benchSinCos (const Options& _options)
+{
+    double err[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < _options.samples; i++)
+    {
+        float a = (float) (16.0 * M_PI * i / _options.samples - 8.0 * M_PI);
+        double refSin = sin ((double) a);
+        double refCos = cos ((double) a);
+        float s, c;
+        fastSinCos<FAST_MATH_LOW> (a, s, c);
+        err[0] = std::max (err[0], std::max (fabs (s - refSin), fabs (c - refCos)));
+        fastSinCos<FAST_MATH_HIGH> (a, s, c);
+        err[1] = std::max (err[1], std::max (fabs (s - refSin), fabs (c - refCos)));
+        fastSinCos<FAST_MATH_LIBM> (a, s, c);
+        err[2] = std::max (err[2], std::max (fabs (s - refSin), fabs (c - refCos)));
+    }
+
+    std::vector<float> in (TIMING_INPUTS);
+    for (int i = 0; i < TIMING_INPUTS; i++)
+        in[i] = (float) (2.0 * M_PI * i / TIMING_INPUTS);
+    printf ("[sincos]\n");
+    printf ("MaxErrLow=%.3g\n", err[0]);
+    printf ("MaxErrHigh=%.3g\n", err[1]);
+    printf ("MaxErrLibmFloat=%.3g\n", err[2]);
+    printTimes (timeCalls (_options.passes, [&] (int _i) {return sin ((double) in[_i]) + cos ((double) in[_i]);}),
+                timeCalls (_options.passes, [&] (int _i) {float s, c; fastSinCos<FAST_MATH_LIBM> (in[_i], s, c); return s + c;}),
+                timeCalls (_options.passes, [&] (int _i) {float s, c; fastSinCos<FAST_MATH_LOW> (in[_i], s, c); return s + c;}),
+                timeCalls (_options.passes, [&] (int _i) {float s, c; fastSinCos<FAST_MATH_HIGH> (in[_i], s, c); return s + c;}));
+}
+
+// General error over bases 0.01 to 100 and exponents -3 to 3, then the
+// barometer's altitude formula over 300 to 1100 hPa in metres
+static void benchPow (const Options& _options)
+{
+    double err[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < _options.samples; i++)
+    {
+        float x = (float) pow (10.0, -2.0 + 4.0 * i / _options.samples);
+        float y = (float) (-3.0 + 6.0 * ((i * 7919) % 1000) / 999.0);
+        double ref = pow ((double) x, (double) y);
+        err[0] = std::max (err[0], fabs (fastPow<FAST_MATH_LOW> (x, y) - ref) / ref);
+        err[1] = std::max (err[1], fabs (fastPow<FAST_MATH_HIGH> (x, y) - ref) / ref);
+        err[2] = std::max (err[2], fabs (fastPow<FAST_MATH_LIBM> (x, y) - ref) / ref);
+    }
+
+    double altErr[3] = {0.0, 0.0, 0.0};
+    const float exponent = 1.0f / 5.255f;
+    for (int i = 0; i < _options.samples; i++)
+    {
+        float ratio = (float) ((300.0 + 800.0 * i / _options.samples) / PRESSURE_SEA_LEVEL_HPA);
+        double ref = 44330.0 * (1.0 - pow ((double) ratio, 1 / 5.255));
+        altErr[0] = std::max (altErr[0], fabs (44330.0 * (1.0 - fastPow<FAST_MATH_LOW> (ratio, exponent)) - ref));
+        altErr[1] = std::max (altErr[1], fabs (44330.0 * (1.0 - fastPow<FAST_MATH_HIGH> (ratio, exponent)) - ref));
+        altErr[2] = std::max (altErr[2], fabs (44330.0 * (1.0 - fastPow<FAST_MATH_LIBM> (ratio, exponent)) - ref));
+    }
+
+    std::vector<float> in (TIMING_INPUTS);
+    for (int i = 0; i < TIMING_INPUTS; i++)
+        in[i] = (float) ((800.0 + 250.0 * i / TIMING_INPUTS) / PRESSURE_SEA_LEVEL_HPA);
+    printf ("[pow]\n");
+    printf ("MaxRelErrLow=%.3g\n", err[0]);
+    printf ("MaxRelErrHigh=%.3g\n", err[1]);
+    printf ("MaxRelErrLibmFloat=%.3g\n", err[2]);
+    printf ("AltitudeMaxErrMLow=%.4f\n", altErr[0]);
+    printf ("AltitudeMaxErrMHigh=%.4f\n", altErr[1]);
+    printf ("AltitudeMaxErrMLibmFloat=%.4f\n", altErr[2]);
+    printTimes (timeCalls (_options.passes, [&] (int _i) {return pow ((double) in[_i], 1 / 5.255);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastPow<FAST_MATH_LIBM> (in[_i], exponent);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastPow<FAST_MATH_LOW> (in[_i], exponent);}),
+                timeCalls (_options.passes, [&] (int _i) {return fastPow<FAST_MATH_HIGH> (in[_i], exponent);}));
+}
+
+// Fixed point against libm double: exhaustive for the sine, a sweep for the
+// square root and arctangent
+static void benchFixed (const Options& _options)
+{
+    uint32_t sqrtWrong = 0;
+    for (int i = 0; i < _options.samples; i++)
+    {
+        uint32_t x = (uint32_t) ((4294967295.0 * i) / _options.samples);
+        if (fastSqrtU32 (x) != (uint16_t) floor (sqrt ((double) x)))
+            sqrtWrong++;
+    }
+
+    double atanErr = 0.0;
+    for (int i = 0; i < _options.samples; i++)
+    {
+        double a = 2.0 * M_PI * i / _options.samples - M_PI;
+        double r = 100.0 + 32000.0 * ((i * 7919) % 1000) / 999.0;
+        int16_t y = (int16_t) lround (r * sin (a));
+        int16_t x = (int16_t) lround (r * cos (a));
+        double ref = atan2 ((double) y, (double) x) * 32768.0 / M_PI;
+        double d = fabs ((double) fastAtan2Q (y, x) - ref);
+        atanErr = std::max (atanErr, std::min (d, 65536.0 - d));
+    }
+
+    double sinErr = 0.0;
+    for (uint32_t a = 0; a < 65536; a++)
+    {
+        double ref = 32768.0 * sin (2.0 * M_PI * a / 65536.0);
+        sinErr = std::max (sinErr, fabs (fastSinQ15 ((uint16_t) a) - std::min (ref, 32767.0)));
+        sinErr = std::max (sinErr, fabs (fastCosQ15 ((uint16_t) a) - std::min (32768.0 * cos (2.0 * M_PI * a / 65536.0), 32767.0)));
+    }
+
+    std::vector<int16_t> ys (TIMING_INPUTS), xs (TIMING_INPUTS);
+    for (int i = 0; i < TIMING_INPUTS; i++)
+    {
+        double a = 2.0 * M_PI * i / TIMING_INPUTS;
+        ys[i] = (int16_t) lround (1000.0 * sin (a));
+        xs[i] = (int16_t) lround (1000.0 * cos (a));
+    }
+    printf ("[fixed]\n");
+    printf ("SqrtU32Wrong=%u\n", sqrtWrong);
+    printf ("Atan2QMaxErrUnits=%.1f\n", atanErr);
+    printf ("Atan2QMaxErrDeg=%.3f\n", atanErr * 360.0 / 65536.0);
+    printf ("SinCosQ15MaxErrLSB=%.1f\n", sinErr);
+    printf ("NsSqrtU32=%.2f\n", timeCalls (_options.passes, [&] (int _i) {return fastSqrtU32 ((uint32_t) _i * 104729u);}));
+    printf ("NsAtan2Q=%.2f\n", timeCalls (_options.passes, [&] (int _i) {return fastAtan2Q (ys[_i], xs[_i]);}));
+    printf ("NsSinCosQ15=%.2f\n", timeCalls (_options.passes, [&] (int _i) {return fastSinQ15 ((uint16_t) (_i << 4)) +
+                                                                                    fastCosQ15 ((uint16_t) (_i << 4));}));
+    printf ("\n");
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-n samples] [-p passes]\n", _prog);
+    fprintf (stderr, "  Measures the worst case error of each FastMath.h (imu_embedded_sw) function at\n");
+    fprintf (stderr, "  each precision against libm in double, and its time per call.  Host timings\n");
+    fprintf (stderr, "  rank the variants, a soft float target widens the gap to libm.\n");
+    fprintf (stderr, "  -n  inputs per error sweep, default %d\n", SAMPLES_DEFAULT);
+    fprintf (stderr, "  -p  passes over the timing inputs, default %d\n", PASSES_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    Options options;
+    options.samples = SAMPLES_DEFAULT;
+    options.passes = PASSES_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "n:p:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                options.samples = atoi (optarg);
+                break;
+            case 'p':
+                options.passes = atoi (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind != _argc || options.samples <= 0 || options.passes <= 0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    benchSqrt (options);
+    benchAtan2 (options);
+    benchSinCos (options);
+    benchPow (options);
+    benchFixed (options);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Rate governor scenario simulation: bus load and attitude error
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_governor_sim
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/RateGovernor.cpp \
+    $$PWD/../../imu_embedded_sw/SimTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTrace.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/RateGovernor.h \
+    $$PWD/../../imu_embedded_sw/SimTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTrace.h
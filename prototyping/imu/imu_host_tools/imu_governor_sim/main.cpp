@@ -0,0 +1,471 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "RateGovernor.h"
+#include "SimTransport.h"
+
+// Simulation step, every rate in the profiles is a whole number of steps
+static const uint32_t TICK_US = 50;
+static const uint32_t GOVERNOR_PERIOD_MS = 250;
+static const uint32_t ERROR_WINDOW_MS = 1000;
+static const uint32_t I2C_CLOCK_HZ_DEFAULT = 100000;
+static const uint32_t GYRO_SPI_CLOCK_HZ = 10000000;
+static const uint32_t ACC_SPI_CLOCK_HZ = 5000000;
+static const uint8_t  GYRO_FIFO_DEPTH = 32;
+static const double   GYRO_DPS_PER_LSB = 0.00875;
+static const double   GYRO_NOISE_DPS_PER_RTHZ = 0.03;
+static const double   ACC_NOISE_MG = 4.0;
+static const double   ISR_OVERHEAD_US = 15.0;
+static const uint8_t  BAR_TEMP_DECIMATION = 16;
+static const double   BAR_TEMP_CONVERSION_MS = 4.5;
+static const double   PI = 3.14159265358979;
+
+// Registers the drivers touch per sample
+static const uint8_t  GYRO_STATUS_REG = 0x27;
+static const uint8_t  GYRO_OUT_X_L_REG = 0x28;
+static const uint8_t  ACC_INT_SOURCE_REG = 0x30;
+static const uint8_t  ACC_DATAX0_REG = 0x32;
+static const uint8_t  BAR_CTRL_REG = 0xF4;
+static const uint8_t  BAR_DATA_REG = 0xF6;
+
+// Mirrors RATE_PROFILES in imu_embedded_sw.ino, with the output rate and
+// OSSR enums as their rates and conversion times
+typedef struct profile_struct
+{
+    double      gyroHz;
+    uint8_t     gyroSamplesPerBurst;
+    double      accHz;
+    double      barConversionmS;
+} Profile;
+
+static const Profile PROFILES[RateGovernor::LEVEL_NUM] =
+{
+    {100.0, 16, 12.5,  25.5},
+    {200.0, 8,  50.0,  13.5},
+    {400.0, 16, 100.0, 13.5}
+};
+
+// Rotation of each axis is a sum of tones, vibration shows on the accelerometer
+typedef struct tone_struct
+{
+    double      amplitude;
+    double      frequencyHz;
+} Tone;
+
+static const int PHASE_TONES = 3;
+
+typedef struct phase_struct
+{
+    const char* name;
+    double      seconds;
+    Tone        rotation[PHASE_TONES];
+    Tone        vibration;
+} Phase;
+
+static const Phase SCENARIO[] =
+{
+    {"bench",   20.0, {{0.0, 0.0},    {0.0, 0.0},   {0.0, 0.0}},   {0.0, 0.0}},
+    {"handled", 20.0, {{15.0, 0.4},   {6.0, 1.7},   {0.0, 0.0}},   {20.0, 3.0}},
+    {"agile",   15.0, {{180.0, 1.5},  {40.0, 12.0}, {15.0, 45.0}}, {150.0, 8.0}},
+    {"bench",   25.0, {{0.0, 0.0},    {0.0, 0.0},   {0.0, 0.0}},   {0.0, 0.0}}
+};
+static const int SCENARIO_PHASES = sizeof (SCENARIO) / sizeof (SCENARIO[0]);
+
+typedef struct options_struct
+{
+    uint32_t    i2cHz;
+    bool        blockRead;
+    bool        spi;
+    bool        verbose;
+} Options;
+
+typedef struct result_struct
+{
+    double      busLoadSum;
+    double      busLoadMax;
+    double      cpuLoadSum;
+    uint32_t    periods;
+    double      errSumSq;
+    double      errMax;
+    uint64_t    errSamples;
+    double      latencySumS;
+    uint64_t    gyroSamples;
+    uint64_t    lostSamples;
+    uint32_t    transitions;
+    double      levelSeconds[RateGovernor::LEVEL_NUM];
+} Result;
+
+// One gyro sample in the FIFO with the truth it is scored against
+typedef struct gyro_sample_struct
+{
+    double      timeS;
+    double      rate[3];
+    double      truth[3];
+} GyroSample;
+
+class Simulation
+{
+public:
+    Simulation (const Options& _options, bool _governed, RateGovernor::LEVEL _level);
+
+    Result run ();
+private:
+    static void transitionCallback (const RateGovernor::Transition& _transition);
+    void applyProfile (RateGovernor::LEVEL _level);
+    void deliverGyro (const GyroSample& _sample);
+    void governorPeriod (uint64_t _tick);
+
+    static Simulation*      s_current;
+
+    Options                 m_options;
+    bool                    m_governed;
+    RateGovernor            m_governor;
+    RateGovernor::LEVEL     m_level;
+    Result                  m_result;
+    std::mt19937            m_rng;
+    std::normal_distribution<double> m_normal;
+
+    SimTransport            m_i2c;
+    SimTransport            m_gyroSpi;
+    SimTransport            m_accSpi;
+    SimTransport*           m_gyroBus;
+    SimTransport*           m_accBus;
+
+    uint32_t                m_gyroSampleTicks;
+    uint32_t                m_gyroPollTicks;
+    uint32_t                m_accSampleTicks;
+    uint64_t                m_nextGyroSample;
+    uint64_t                m_nextGyroPoll;
+    uint64_t                m_nextAccSample;
+    uint64_t                m_nextBarSample;
+    uint32_t                m_barConversions;
+
+    std::vector<GyroSample> m_gyroFifo;
+    double                  m_est[3];
+    double                  m_lastSampleS;
+    double                  m_windowErr[3];
+    uint64_t                m_windowIndex;
+
+    double                  m_isruS;
+    uint64_t                m_motionGyroSumSq;
+    uint32_t                m_motionGyroCount;
+    double                  m_motionAccSumSq;
+    uint32_t                m_motionAccCount;
+};
+
+Simulation* Simulation::s_current = NULL;
+
+Simulation::Simulation (const Options& _options, bool _governed, RateGovernor::LEVEL _level)
+    : m_options (_options),
+      m_governed (_governed),
+      m_level (_level),
+      m_rng (1),
+      m_normal (0.0, 1.0),
+      m_i2c (SimTransport::BUS_I2C, _options.i2cHz, 0x80),
+      m_gyroSpi (SimTransport::BUS_SPI, GYRO_SPI_CLOCK_HZ, 0x40),
+      m_accSpi (SimTransport::BUS_SPI, ACC_SPI_CLOCK_HZ, 0x40),
+      m_gyroBus (_options.spi ? &m_gyroSpi : &m_i2c),
+      m_accBus (_options.spi ? &m_accSpi : &m_i2c),
+      m_nextGyroSample (0),
+      m_nextGyroPoll (0),
+      m_nextAccSample (0),
+      m_nextBarSample (0),
+      m_barConversions (0),
+      m_lastSampleS (0.0),
+      m_windowIndex (0),
+      m_isruS (0.0),
+      m_motionGyroSumSq (0),
+      m_motionGyroCount (0),
+      m_motionAccSumSq (0.0),
+      m_motionAccCount (0)
+{
+    m_result = Result ();
+    for (int a = 0; a < 3; a++)
+    {
+        m_est[a] = 0.0;
+        m_windowErr[a] = 0.0;
+    }
+    m_governor.registerTransitionCallback (transitionCallback);
+    applyProfile (m_level);
+}
+
+void Simulation::transitionCallback (const RateGovernor::Transition& _transition)
+{
+    Simulation* sim = s_current;
+    sim->m_result.transitions++;
+    sim->applyProfile ((RateGovernor::LEVEL) _transition.to);
+
+    if (sim->m_options.verbose)
+        printf ("Transition=%.2fs %s>%s %s Energy=%.1f BusLoad=%.3f CpuLoad=%.3f\n",
+                _transition.timemS / 1000.0,
+                RateGovernor::levelName ((RateGovernor::LEVEL) _transition.from),
+                RateGovernor::levelName ((RateGovernor::LEVEL) _transition.to),
+                RateGovernor::reasonName ((RateGovernor::REASON) _transition.reason),
+                _transition.energy, _transition.busLoad, _transition.cpuLoad);
+}
+
+void Simulation::applyProfile (RateGovernor::LEVEL _level)
+{
+    // Same timer setup as governorTransitionCallback on the board
+    const Profile& p = PROFILES[_level];
+    m_level = _level;
+    m_gyroSampleTicks = (uint32_t) lround (1e6 / p.gyroHz / TICK_US);
+    m_gyroPollTicks = m_gyroSampleTicks * (m_options.blockRead ? p.gyroSamplesPerBurst : 1);
+    m_accSampleTicks = (uint32_t) lround (1e6 / p.accHz / TICK_US);
+}
+
+void Simulation::deliverGyro (const GyroSample& _sample)
+{
+    // Rectangular integration over the time since the previous sample,
+    // scored against the error at the start of the window so the drift of
+    // earlier windows doesn't pile up
+    double dtS = _sample.timeS - m_lastSampleS;
+    m_lastSampleS = _sample.timeS;
+    uint64_t window = (uint64_t) (_sample.timeS * 1000.0) / ERROR_WINDOW_MS;
+    for (int a = 0; a < 3; a++)
+    {
+        m_est[a] += _sample.rate[a] * dtS;
+        double err = m_est[a] - _sample.truth[a];
+        if (window != m_windowIndex)
+            m_windowErr[a] = err;
+        double windowErr = err - m_windowErr[a];
+        m_result.errSumSq += windowErr * windowErr;
+        if (fabs (windowErr) > m_result.errMax)
+            m_result.errMax = fabs (windowErr);
+    }
+    m_windowIndex = window;
+    m_result.errSamples += 3;
+    m_result.gyroSamples++;
+}
+
+void Simulation::governorPeriod (uint64_t _tick)
+{
+    double periodS = GOVERNOR_PERIOD_MS / 1000.0;
+    double busS = m_i2c.getBusTimeNs () / 1e9;
+    if (m_options.spi)
+        busS = std::max (busS, (m_gyroSpi.getBusTimeNs () + m_accSpi.getBusTimeNs ()) / 1e9);
+    m_i2c.resetBusTime ();
+    m_gyroSpi.resetBusTime ();
+    m_accSpi.resetBusTime ();
+    double busLoad = busS / periodS;
+    double cpuLoad = m_isruS / (periodS * 1e6);
+    m_isruS = 0.0;
+
+    double gyroMeanSq = m_motionGyroCount ? (double) m_motionGyroSumSq / m_motionGyroCount : 0.0;
+    double accMeanSq = m_motionAccCount ? m_motionAccSumSq / m_motionAccCount : 0.0;
+    double energy = gyroMeanSq * GYRO_DPS_PER_LSB * GYRO_DPS_PER_LSB + accMeanSq * RateGovernor::ACC_ENERGY_WEIGHT;
+    m_motionGyroSumSq = 0;
+    m_motionGyroCount = 0;
+    m_motionAccSumSq = 0.0;
+    m_motionAccCount = 0;
+
+    m_result.busLoadSum += busLoad;
+    m_result.busLoadMax = std::max (m_result.busLoadMax, busLoad);
+    m_result.cpuLoadSum += cpuLoad;
+    m_result.periods++;
+    m_result.levelSeconds[m_level] += periodS;
+
+    if (m_governed)
+        m_governor.update ((uint32_t) (_tick * TICK_US / 1000), energy, busLoad, cpuLoad);
+}
+
+Result Simulation::run ()
+{
+    s_current = this;
+
+    double truth[3] = {0.0, 0.0, 0.0};
+    uint64_t tick = 0;
+    uint64_t governorTicks = GOVERNOR_PERIOD_MS * 1000 / TICK_US;
+    double phaseStartS = 0.0;
+    uint8_t buf[6 * GYRO_FIFO_DEPTH];
+    for (int ph = 0; ph < SCENARIO_PHASES; ph++)
+    {
+        const Phase& phase = SCENARIO[ph];
+        uint64_t phaseEnd = (uint64_t) lround ((phaseStartS + phase.seconds) * 1e6 / TICK_US);
+        for (; tick < phaseEnd; tick++)
+        {
+            // Truth, each axis gets the tones at its own phase offset
+            double tS = tick * TICK_US / 1e6;
+            double rate[3];
+            for (int a = 0; a < 3; a++)
+            {
+                rate[a] = 0.0;
+                for (int k = 0; k < PHASE_TONES; k++)
+                    rate[a] += phase.rotation[k].amplitude *
+                               sin (2.0 * PI * phase.rotation[k].frequencyHz * tS + a * 2.1 + k);
+                truth[a] += rate[a] * TICK_US / 1e6;
+            }
+
+            // Gyro conversion into the FIFO, dropping the oldest when full
+            if (tick >= m_nextGyroSample)
+            {
+                m_nextGyroSample = tick + m_gyroSampleTicks;
+                double noise = GYRO_NOISE_DPS_PER_RTHZ * sqrt (PROFILES[m_level].gyroHz / 2.0);
+                GyroSample s;
+                s.timeS = tS;
+                for (int a = 0; a < 3; a++)
+                {
+                    double counts = lround ((rate[a] + noise * m_normal (m_rng)) / GYRO_DPS_PER_LSB);
+                    s.rate[a] = counts * GYRO_DPS_PER_LSB;
+                    s.truth[a] = truth[a];
+                }
+                if (m_gyroFifo.size () >= GYRO_FIFO_DEPTH)
+                {
+                    m_gyroFifo.erase (m_gyroFifo.begin ());
+                    m_result.lostSamples++;
+                }
+                m_gyroFifo.push_back (s);
+            }
+
+            // Gyro poll, with the same bus transactions as the driver
+            if (tick >= m_nextGyroPoll)
+            {
+                m_nextGyroPoll = tick + m_gyroPollTicks;
+                uint32_t busNs = m_gyroBus->getBusTimeNs ();
+                size_t n = 0;
+                if (m_options.blockRead)
+                {
+                    n = std::min<size_t> (PROFILES[m_level].gyroSamplesPerBurst, m_gyroFifo.size ());
+                    m_gyroBus->readBlock (GYRO_OUT_X_L_REG, buf, 6 * PROFILES[m_level].gyroSamplesPerBurst);
+                }
+                else
+                {
+                    // Only the newest sample is in the output registers
+                    m_gyroBus->readReg (GYRO_STATUS_REG);
+                    if (!m_gyroFifo.empty ())
+                    {
+                        m_gyroBus->readBlock (GYRO_OUT_X_L_REG, buf, 6);
+                        m_result.lostSamples += m_gyroFifo.size () - 1;
+                        m_gyroFifo.erase (m_gyroFifo.begin (), m_gyroFifo.end () - 1);
+                        n = 1;
+                    }
+                }
+                for (size_t i = 0; i < n; i++)
+                {
+                    const GyroSample& s = m_gyroFifo[i];
+                    m_result.latencySumS += tS - s.timeS;
+                    for (int a = 0; a < 3; a++)
+                    {
+                        int64_t counts = lround (s.rate[a] / GYRO_DPS_PER_LSB);
+                        m_motionGyroSumSq += counts * counts;
+                    }
+                    m_motionGyroCount++;
+                    deliverGyro (s);
+                }
+                m_gyroFifo.erase (m_gyroFifo.begin (), m_gyroFifo.begin () + n);
+                m_isruS += ISR_OVERHEAD_US + (m_gyroBus->getBusTimeNs () - busNs) / 1000.0;
+            }
+
+            // Accelerometer DATA_READY
+            if (tick >= m_nextAccSample)
+            {
+                m_nextAccSample = tick + m_accSampleTicks;
+                uint32_t busNs = m_accBus->getBusTimeNs ();
+                m_accBus->readReg (ACC_INT_SOURCE_REG);
+                m_accBus->readBlock (ACC_DATAX0_REG, buf, 6);
+                m_isruS += ISR_OVERHEAD_US + (m_accBus->getBusTimeNs () - busNs) / 1000.0;
+
+                double dev = phase.vibration.amplitude * sin (2.0 * PI * phase.vibration.frequencyHz * tS) +
+                             ACC_NOISE_MG * m_normal (m_rng);
+                m_motionAccSumSq += dev * dev;
+                m_motionAccCount++;
+            }
+
+            // Barometer end of conversion, register at a time like BMP085
+            if (tick >= m_nextBarSample)
+            {
+                bool temp = (m_barConversions++ % BAR_TEMP_DECIMATION) == 0;
+                double conversionmS = temp ? BAR_TEMP_CONVERSION_MS : PROFILES[m_level].barConversionmS;
+                m_nextBarSample = tick + (uint64_t) lround (conversionmS * 1000.0 / TICK_US);
+                uint32_t busNs = m_i2c.getBusTimeNs ();
+                for (int i = 0; i < (temp ? 2 : 3); i++)
+                    m_i2c.readReg (BAR_DATA_REG + i);
+                m_i2c.writeReg (BAR_CTRL_REG, 0);
+                m_isruS += ISR_OVERHEAD_US + (m_i2c.getBusTimeNs () - busNs) / 1000.0;
+            }
+
+            if ((tick + 1) % governorTicks == 0)
+                governorPeriod (tick + 1);
+        }
+        phaseStartS += phase.seconds;
+    }
+
+    s_current = NULL;
+    return m_result;
+}
+
+static void printResult (const Result& _r)
+{
+    printf ("BusLoadAvg=%.3f\n", _r.busLoadSum / std::max<uint32_t> (1, _r.periods));
+    printf ("BusLoadMax=%.3f\n", _r.busLoadMax);
+    printf ("CpuLoadAvg=%.3f\n", _r.cpuLoadSum / std::max<uint32_t> (1, _r.periods));
+    printf ("GyroSamples=%llu\n", (unsigned long long) _r.gyroSamples);
+    printf ("LostGyroSamples=%llu\n", (unsigned long long) _r.lostSamples);
+    printf ("LatencyAvgmS=%.2f\n", _r.gyroSamples ? _r.latencySumS * 1000.0 / _r.gyroSamples : 0.0);
+    printf ("AttitudeErrRmsDeg=%.4f\n", _r.errSamples ? sqrt (_r.errSumSq / _r.errSamples) : 0.0);
+    printf ("AttitudeErrMaxDeg=%.4f\n", _r.errMax);
+    printf ("Transitions=%u\n", _r.transitions);
+    for (int l = 0; l < RateGovernor::LEVEL_NUM; l++)
+        printf ("Seconds%c%s=%.2f\n", toupper (RateGovernor::levelName ((RateGovernor::LEVEL) l)[0]),
+                RateGovernor::levelName ((RateGovernor::LEVEL) l) + 1, _r.levelSeconds[l]);
+    printf ("\n");
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-c i2c_hz] [-b] [-s] [-v]\n", _prog);
+    fprintf (stderr, "  Runs a bench, handled, agile, bench motion scenario with the sensor rates\n");
+    fprintf (stderr, "  fixed at the idle and agile profiles and under the rate governor, and reports\n");
+    fprintf (stderr, "  bus and CPU load and the gyro attitude error (drift within each %u ms) of each\n", ERROR_WINDOW_MS);
+    fprintf (stderr, "  -c  I2C clock, default %u\n", I2C_CLOCK_HZ_DEFAULT);
+    fprintf (stderr, "  -b  gyro FIFO read in bursts through the block reader (IMU_BLOCK_READ)\n");
+    fprintf (stderr, "  -s  gyro and accelerometer on SPI (IMU_USE_SPI)\n");
+    fprintf (stderr, "  -v  print each governor transition\n");
+}
+
+int main (int _argc, char** _argv)
+{
+    Options options;
+    options.i2cHz = I2C_CLOCK_HZ_DEFAULT;
+    options.blockRead = false;
+    options.spi = false;
+    options.verbose = false;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "c:bsvh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': options.i2cHz = (uint32_t) atol (optarg); break;
+            case 'b': options.blockRead = true; break;
+            case 's': options.spi = true; break;
+            case 'v': options.verbose = true; break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind != _argc || options.i2cHz == 0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    printf ("[fixed idle]\n");
+    Simulation fixedIdle (options, false, RateGovernor::LEVEL_IDLE);
+    printResult (fixedIdle.run ());
+    printf ("[fixed agile]\n");
+    Simulation fixedAgile (options, false, RateGovernor::LEVEL_AGILE);
+    printResult (fixedAgile.run ());
+    printf ("[governed]\n");
+    Simulation governed (options, true, RateGovernor::LEVEL_IDLE);
+    printResult (governed.run ());
+    return 0;
+}
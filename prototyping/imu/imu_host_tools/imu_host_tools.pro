@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Host side tools for captured IMU data
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += imu_noise_tool \
+    imu_cal_tool \
+    imu_telemetry_bridge \
+    imu_uplink_tool \
+    imu_telemetry_codec \
+    imu_governor_sim \
+    imu_bus_trace \
+    imu_ins_bench \
+    imu_fastmath_bench \
+    imu_vote_sim \
+    imu_preint_bench \
+    imu_sync_bench \
+    imu_bus_placement \
+    imu_i2c_speed_bench \
+    imu_size_report \
+    imu_transport_bench \
+    imu_block_bench \
+    imu_capture_log_bench
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# I2C speed modes: bus load and throughput for each sensor mix
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_i2c_speed_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/BusManager.cpp \
+    $$PWD/../../imu_embedded_sw/DMABlockReader.cpp \
+    $$PWD/../../imu_embedded_sw/SimTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTransport.cpp \
+    $$PWD/../../imu_embedded_sw/BusTrace.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/BusManager.h \
+    $$PWD/../../imu_embedded_sw/DMABlockReader.h \
+    $$PWD/../../imu_embedded_sw/SimTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTransport.h \
+    $$PWD/../../imu_embedded_sw/BusTrace.h
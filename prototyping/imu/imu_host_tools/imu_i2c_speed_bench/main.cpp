@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "BusManager.h"
+#include "SimTransport.h"
+
+static const double   SECONDS_DEFAULT = 2.0;
+
+// Reprogramming the controller's clock, a few register writes on a Teensy 3
+// during which the bus idles
+static const double   CLOCK_SWITCH_US_DEFAULT = 2.0;
+
+// A mix holds at a rate scale while no sample is overwritten before it is
+// read and the bus is busier than this
+static const double   LOAD_LIMIT = 0.9;
+static const double   SCALE_MIN = 0.05;
+static const double   SCALE_MAX = 256.0;
+static const int      SCALE_STEPS = 24;
+
+typedef struct transfer_model_struct
+{
+    uint8_t     reg;
+    uint8_t     len;
+} TransferModel;
+
+// Per sample reads at the sketch's rates as in imu_bus_placement, with the
+// fastest mode each part takes.  The barometer's rate is set by its
+// conversion time and doesn't scale.
+typedef struct sensor_model_struct
+{
+    const char*     name;
+    double          rateHz;
+    bool            scales;
+    I2C_SPEED       maxSpeed;
+    uint8_t         autoIncrement;
+    uint8_t         transfers;
+    TransferModel   transfer[4];
+} SensorModel;
+
+static const int SENSOR_NUM = 4;
+static const SensorModel SENSORS[SENSOR_NUM] =
+{
+    {"gyro", 400.0,          true,  I2C_FAST,       0x80, 1, {{0x27, 7}}},
+    {"acc",  100.0,          true,  I2C_FAST,       0x00, 2, {{0x30, 1}, {0x32, 6}}},
+    {"mag",  75.0,           true,  I2C_HIGH_SPEED, 0x00, 2, {{0x09, 1}, {0x03, 6}}},
+    {"bar",  1000.0 / 25.5,  false, I2C_HIGH_SPEED, 0x00, 4, {{0xF6, 1}, {0xF7, 1}, {0xF8, 1}, {0xF4, 1}}}
+};
+
+// Every device at standard or fast mode, or each at its fastest, FIFO or
+// grouped by clock
+typedef enum POLICY_ENUM
+{
+    POLICY_STANDARD = 0,
+    POLICY_FAST,
+    POLICY_MIXED,
+    POLICY_GROUPED,
+    POLICY_NUM
+} POLICY;
+
+static const char* POLICY_NAMES[POLICY_NUM] = {"Standard", "Fast", "Mixed", "Grouped"};
+
+typedef struct options_struct
+{
+    double      seconds;
+    double      switchuS;
+} Options;
+
+typedef struct run_result_struct
+{
+    uint64_t    lost;
+    double      load;
+    double      switchesPerS;
+    double      regroupedPerS;
+} RunResult;
+
+// Host DMA engine timing each transfer at its device's clock, plus the clock
+// switches I2CTransport would make ahead of it
+class TimedDMAEngine : public DMAEngine
+{
+public:
+    TimedDMAEngine (const double* _nowuS, double _switchuS)
+        : m_nowuS (_nowuS), m_switchuS (_switchuS), m_clockHz (I2C_SPEED_HZ[I2C_STANDARD]),
+          m_switches (0), m_busy (false), m_doneuS (0.0), m_complete (NULL), m_ctx (NULL) {}
+
+    virtual bool start (BusTransport* _bus, uint8_t _reg, uint8_t* _dst, uint16_t _len,
+                        CompleteFunc _complete, void* _ctx)
+    {
+        if (m_busy)
+            return false;
+        SimTransport* sim = (SimTransport*) _bus;
+        double uS = 0.0;
+        uint32_t clockHz = sim->getClockHz ();
+        if (clockHz == I2C_SPEED_HZ[I2C_HIGH_SPEED])
+        {
+            // Down to fast mode for the master code, then up again
+            uS += switchTo (I2C_SPEED_HZ[I2C_FAST]);
+        }
+        uS += switchTo (clockHz);
+
+        uint32_t beforeNs = sim->getBusTimeNs ();
+        sim->readBlock (_reg, _dst, (uint8_t) _len);
+        m_doneuS = *m_nowuS + uS + (sim->getBusTimeNs () - beforeNs) / 1000.0;
+        m_complete = _complete;
+        m_ctx = _ctx;
+        m_busy = true;
+        return true;
+    }
+    virtual bool busy () {return m_busy;}
+
+    double getDoneuS () {return m_doneuS;}
+    uint64_t getSwitches () {return m_switches;}
+    void finish ()
+    {
+        m_busy = false;
+        m_complete (m_ctx);
+    }
+private:
+    double switchTo (uint32_t _clockHz)
+    {
+        if (_clockHz == m_clockHz)
+            return 0.0;
+        m_clockHz = _clockHz;
+        m_switches++;
+        return m_switchuS;
+    }
+
+    const double*   m_nowuS;
+    double          m_switchuS;
+    uint32_t        m_clockHz;
+    uint64_t        m_switches;
+    bool            m_busy;
+    double          m_doneuS;
+    CompleteFunc    m_complete;
+    void*           m_ctx;
+};
+
+typedef struct sensor_state_struct
+{
+    int             pending;
+    uint64_t        lost;
+    uint8_t         buf[8];
+} SensorState;
+
+static void sensorTransferComplete (void* _ctx)
+{
+    SensorState* state = (SensorState*) _ctx;
+    state->pending--;
+}
+
+static I2C_SPEED policySpeed (POLICY _policy, int _sensor)
+{
+    switch (_policy)
+    {
+        case POLICY_STANDARD:   return I2C_STANDARD;
+        case POLICY_FAST:       return I2C_FAST;
+        default:                return SENSORS[_sensor].maxSpeed;
+    }
+}
+
+// The sensors of _mask on one I2C bus at a rate scale
+static RunResult runMix (const Options& _options, unsigned _mask, POLICY _policy, double _scale)
+{
+    double nowuS = 0.0;
+    TimedDMAEngine engine (&nowuS, _options.switchuS);
+    BusQueue queue ("Wire", BusQueue::BUS_I2C, I2C_SPEED_HZ[I2C_STANDARD], &engine);
+    queue.setGroupBySpeed (_policy == POLICY_GROUPED);
+
+    std::vector<SimTransport*> transports (SENSOR_NUM, (SimTransport*) NULL);
+    SensorState states[SENSOR_NUM];
+    double perioduS[SENSOR_NUM];
+    double nextuS[SENSOR_NUM];
+    double enduS = _options.seconds * 1e6;
+    for (int s = 0; s < SENSOR_NUM; s++)
+    {
+        memset (&states[s], 0, sizeof (states[s]));
+        nextuS[s] = enduS;
+        if (!(_mask & (1u << s)))
+            continue;
+        transports[s] = new SimTransport (SimTransport::BUS_I2C, I2C_SPEED_HZ[I2C_STANDARD], SENSORS[s].autoIncrement);
+        transports[s]->setSpeed (policySpeed (_policy, s));
+        queue.bind (transports[s]);
+        perioduS[s] = 1e6 / (SENSORS[s].rateHz * (SENSORS[s].scales ? _scale : 1.0));
+        // Free running sensors, out of phase with each other
+        nextuS[s] = perioduS[s] * (0.13 + 0.29 * s);
+    }
+
+    while (true)
+    {
+        int sensor = -1;
+        double dueuS = enduS;
+        for (int s = 0; s < SENSOR_NUM; s++)
+        {
+            if (nextuS[s] < dueuS)
+            {
+                dueuS = nextuS[s];
+                sensor = s;
+            }
+        }
+        // Completions at the same time go first
+        bool done = engine.busy () && engine.getDoneuS () <= dueuS;
+        if (done)
+            dueuS = engine.getDoneuS ();
+        if (dueuS >= enduS)
+            break;
+        nowuS = dueuS;
+
+        if (done)
+        {
+            engine.finish ();
+            continue;
+        }
+
+        // A sample still waiting to be read is overwritten by this one
+        SensorState& state = states[sensor];
+        nextuS[sensor] += perioduS[sensor];
+        if (state.pending > 0)
+        {
+            state.lost++;
+            continue;
+        }
+        state.pending = SENSORS[sensor].transfers;
+        for (int t = 0; t < SENSORS[sensor].transfers; t++)
+        {
+            const TransferModel& transfer = SENSORS[sensor].transfer[t];
+            if (!queue.start (transports[sensor], transfer.reg, state.buf, transfer.len,
+                              sensorTransferComplete, &state))
+            {
+                state.lost++;
+                state.pending--;
+            }
+        }
+    }
+
+    RunResult result;
+    result.lost = queue.getRejects ();
+    for (int s = 0; s < SENSOR_NUM; s++)
+        result.lost += states[s].lost;
+    // Wire time plus the time the bus idled for clock switches
+    result.load = (queue.getBusyuS () + engine.getSwitches () * _options.switchuS) / enduS;
+    result.switchesPerS = engine.getSwitches () / _options.seconds;
+    result.regroupedPerS = queue.getRegrouped () / _options.seconds;
+
+    for (int s = 0; s < SENSOR_NUM; s++)
+        delete transports[s];
+    return result;
+}
+
+static bool holds (const Options& _options, unsigned _mask, POLICY _policy, double _scale)
+{
+    RunResult result = runMix (_options, _mask, _policy, _scale);
+    return result.lost == 0 && result.load <= LOAD_LIMIT;
+}
+
+// Highest common rate scale of the scaling sensors the mix holds at
+static double maxScale (const Options& _options, unsigned _mask, POLICY _policy)
+{
+    if (!holds (_options, _mask, _policy, SCALE_MIN))
+        return 0.0;
+    double lo = SCALE_MIN;
+    double hi = SCALE_MAX;
+    for (int i = 0; i < SCALE_STEPS; i++)
+    {
+        double mid = sqrt (lo * hi);
+        if (holds (_options, _mask, _policy, mid))
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static double samplesPerS (unsigned _mask, double _scale)
+{
+    double total = 0.0;
+    for (int s = 0; s < SENSOR_NUM; s++)
+    {
+        if (_mask & (1u << s))
+            total += SENSORS[s].rateHz * (SENSORS[s].scales ? _scale : 1.0);
+    }
+    return total;
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-s seconds] [-w switch us]\n", _prog);
+    fprintf (stderr, "  Runs every mix of the gyro, accelerometer, magnetometer and barometer on one\n");
+    fprintf (stderr, "  I2C bus through BusManager (imu_embedded_sw) with all devices at standard\n");
+    fprintf (stderr, "  mode, all at fast mode, and each at its fastest with and without grouping by\n");
+    fprintf (stderr, "  clock, and reports the bus load and the sample throughput each holds.\n");
+    fprintf (stderr, "  -s  simulated length of each run, default %.1f s\n", SECONDS_DEFAULT);
+    fprintf (stderr, "  -w  time the bus idles per clock switch, default %.1f us\n", CLOCK_SWITCH_US_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    Options options;
+    options.seconds = SECONDS_DEFAULT;
+    options.switchuS = CLOCK_SWITCH_US_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "s:w:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                options.seconds = atof (optarg);
+                break;
+            case 'w':
+                options.switchuS = atof (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind != _argc || options.seconds <= 0.0 || options.switchuS < 0.0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    printf ("Seconds=%.1f\n", options.seconds);
+    printf ("ClockSwitchuS=%.1f\n", options.switchuS);
+    printf ("\n");
+
+    for (unsigned mask = 1; mask < (1u << SENSOR_NUM); mask++)
+    {
+        std::string name;
+        for (int s = 0; s < SENSOR_NUM; s++)
+        {
+            if (!(mask & (1u << s)))
+                continue;
+            if (!name.empty ())
+                name += "+";
+            name += SENSORS[s].name;
+        }
+        printf ("[%s]\n", name.c_str ());
+
+        double standard = 0.0;
+        for (int p = 0; p < POLICY_NUM; p++)
+        {
+            RunResult result = runMix (options, mask, (POLICY) p, 1.0);
+            double scale = maxScale (options, mask, (POLICY) p);
+            double throughput = samplesPerS (mask, scale);
+            if (p == POLICY_STANDARD)
+                standard = throughput;
+            printf ("%sLoad=%.4f\n", POLICY_NAMES[p], result.load);
+            printf ("%sLostPerS=%.1f\n", POLICY_NAMES[p], result.lost / options.seconds);
+            printf ("%sMaxSamplesPerS=%.0f\n", POLICY_NAMES[p], throughput);
+            if (p >= POLICY_MIXED)
+                printf ("%sClockSwitchesPerS=%.1f\n", POLICY_NAMES[p], result.switchesPerS);
+            if (p == POLICY_GROUPED)
+                printf ("%sRegroupedPerS=%.1f\n", POLICY_NAMES[p], result.regroupedPerS);
+            if (p != POLICY_STANDARD && standard > 0.0)
+                printf ("%sGain=%.2f\n", POLICY_NAMES[p], throughput / standard);
+        }
+        printf ("\n");
+    }
+    return 0;
+}
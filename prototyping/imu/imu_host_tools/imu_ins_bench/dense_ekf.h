@@ -0,0 +1,276 @@
+#ifndef DENSE_EKF_H
+#define DENSE_EKF_H
+
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "InsEKF.h"
+#include "VectorMath.h"
+
+// Reference for InsEKF: the same error-state filter written the textbook
+// way, with a full transition matrix, P = F P F' + Q by plain matrix
+// products and each measurement as one vector update through the inverse
+// of its innovation covariance.  Double precision for validation, float for
+// a like for like benchmark.
+template <typename T>
+class DenseEKF
+{
+public:
+    static const int N = InsEKF::STATES;
+
+    DenseEKF () : m_gravityGate (1.0) {}
+
+    // Starts from the sparse filter's state, covariance and noise
+    void setState (InsEKF& _ekf)
+    {
+        InsEKF::quaternionf q = _ekf.getAttitude ();
+        m_q.w = q.w;
+        m_q.x = q.x;
+        m_q.y = q.y;
+        m_q.z = q.z;
+        m_v = convert (_ekf.getVelocity ());
+        m_p = convert (_ekf.getPosition ());
+        m_bg = convert (_ekf.getGyroBias ());
+        m_ba = convert (_ekf.getAccBias ());
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++)
+                m_P[i][j] = _ekf.getCovariance (i, j);
+        m_noise = _ekf.getNoise ();
+    }
+
+    void predict (T _dt, const Vec3<T>& _gyro, const Vec3<T>& _acc)
+    {
+        Vec3<T> w = _gyro - m_bg;
+        Vec3<T> f = _acc - m_ba;
+        Mat3<T> R = toMat3 (m_q);
+
+        Vec3<T> a = R * f;
+        a.z -= InsEKF::GRAVITY_MPS2;
+        m_p += m_v * _dt + a * (T) (0.5 * _dt * _dt);
+        m_v += a * _dt;
+        m_q = normalize (m_q * Quaternion<T>::fromRotationVector (w * _dt));
+
+        T F[N][N];
+        memset (F, 0, sizeof (F));
+        for (int i = 0; i < N; i++)
+            F[i][i] = 1;
+        Mat3<T> wx = skew (w);
+        Mat3<T> Rfx = R * skew (f);
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                F[r][c] -= wx.m[r][c] * _dt;
+                F[3 + r][c] = -Rfx.m[r][c] * _dt;
+                F[3 + r][12 + c] = -R.m[r][c] * _dt;
+            }
+            F[r][9 + r] = -_dt;
+            F[6 + r][3 + r] = _dt;
+        }
+
+        T FP[N][N];
+        multiply (F, m_P, FP, false);
+        multiply (FP, F, m_P, true);
+
+        T q[4] = {m_noise.gyro * m_noise.gyro, m_noise.acc * m_noise.acc,
+                  m_noise.gyroBiasWalk * m_noise.gyroBiasWalk, m_noise.accBiasWalk * m_noise.accBiasWalk};
+        const int blocks[4] = {0, 3, 9, 12};
+        for (int b = 0; b < 4; b++)
+            for (int i = 0; i < 3; i++)
+                m_P[blocks[b] + i][blocks[b] + i] += q[b] * _dt;
+    }
+
+    int updateGravity (const Vec3<T>& _acc)
+    {
+        if (std::fabs (norm (_acc) - (T) InsEKF::GRAVITY_MPS2) > m_gravityGate)
+            return 0;
+        Mat3<T> R = toMat3 (m_q);
+        Vec3<T> g = makeVec3<T> (R.m[2][0], R.m[2][1], R.m[2][2]) * (T) InsEKF::GRAVITY_MPS2;
+        Mat3<T> gx = skew (g);
+        T H[3][N];
+        memset (H, 0, sizeof (H));
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 3; c++)
+                H[r][c] = gx.m[r][c];
+            H[r][12 + r] = 1;
+        }
+        T y[3] = {_acc.x - g.x - m_ba.x, _acc.y - g.y - m_ba.y, _acc.z - g.z - m_ba.z};
+        T r = m_noise.gravity * m_noise.gravity;
+        T Rn[3] = {r, r, r};
+        update (H, y, Rn, 3);
+        return 3;
+    }
+
+    int updateHeading (const Vec3<T>& _mag)
+    {
+        Mat3<T> R = toMat3 (m_q);
+        Vec3<T> m = R * _mag;
+        T h2 = m.x * m.x + m.y * m.y;
+        if (h2 <= (T) 1e-6 * dot (m, m))
+            return 0;
+        T H[1][N];
+        memset (H, 0, sizeof (H));
+        for (int c = 0; c < 3; c++)
+            H[0][c] = R.m[2][c];
+        T y[1] = {-std::atan2 (m.y, m.x)};
+        T Rn[1] = {m_noise.heading * m_noise.heading};
+        update (H, y, Rn, 1);
+        return 1;
+    }
+
+    int updateAltitude (T _altitudeM)
+    {
+        T H[1][N];
+        memset (H, 0, sizeof (H));
+        H[0][8] = 1;
+        T y[1] = {_altitudeM - m_p.z};
+        T Rn[1] = {m_noise.altitude * m_noise.altitude};
+        update (H, y, Rn, 1);
+        return 1;
+    }
+
+    int updateZeroVelocity ()
+    {
+        T H[3][N];
+        memset (H, 0, sizeof (H));
+        for (int r = 0; r < 3; r++)
+            H[r][3 + r] = 1;
+        T y[3] = {-m_v.x, -m_v.y, -m_v.z};
+        T r = m_noise.zeroVelocity * m_noise.zeroVelocity;
+        T Rn[3] = {r, r, r};
+        update (H, y, Rn, 3);
+        return 3;
+    }
+
+    Quaternion<T> getAttitude () const {return m_q;}
+    Vec3<T> getVelocity () const {return m_v;}
+    Vec3<T> getPosition () const {return m_p;}
+    Vec3<T> getGyroBias () const {return m_bg;}
+    Vec3<T> getAccBias () const {return m_ba;}
+    T getCovariance (int _i, int _j) const {return m_P[_i][_j];}
+
+private:
+    static Vec3<T> convert (const Vec3<float>& _v)
+    {
+        return makeVec3<T> (_v.x, _v.y, _v.z);
+    }
+
+    static Mat3<T> skew (const Vec3<T>& _v)
+    {
+        Mat3<T> s = {{{0, -_v.z, _v.y}, {_v.z, 0, -_v.x}, {-_v.y, _v.x, 0}}};
+        return s;
+    }
+
+    // _out = _a _b, or _a _b' with _transposeB
+    static void multiply (const T _a[N][N], const T _b[N][N], T _out[N][N], bool _transposeB)
+    {
+        for (int i = 0; i < N; i++)
+        {
+            for (int j = 0; j < N; j++)
+            {
+                T s = 0;
+                for (int k = 0; k < N; k++)
+                    s += _a[i][k] * (_transposeB ? _b[j][k] : _b[k][j]);
+                _out[i][j] = s;
+            }
+        }
+    }
+
+    void update (const T _H[][N], const T* _y, const T* _r, int _m)
+    {
+        T PHt[N][3];
+        for (int i = 0; i < N; i++)
+        {
+            for (int r = 0; r < _m; r++)
+            {
+                T s = 0;
+                for (int k = 0; k < N; k++)
+                    s += m_P[i][k] * _H[r][k];
+                PHt[i][r] = s;
+            }
+        }
+
+        // S = H P H' + R, inverted by Gauss-Jordan
+        T S[3][6];
+        for (int r = 0; r < _m; r++)
+        {
+            for (int c = 0; c < _m; c++)
+            {
+                T s = (r == c) ? _r[r] : 0;
+                for (int k = 0; k < N; k++)
+                    s += _H[r][k] * PHt[k][c];
+                S[r][c] = s;
+                S[r][_m + c] = (r == c) ? 1 : 0;
+            }
+        }
+        for (int c = 0; c < _m; c++)
+        {
+            int pivot = c;
+            for (int r = c + 1; r < _m; r++)
+                if (std::fabs (S[r][c]) > std::fabs (S[pivot][c]))
+                    pivot = r;
+            for (int k = 0; k < 2 * _m; k++)
+                std::swap (S[c][k], S[pivot][k]);
+            T inv = 1 / S[c][c];
+            for (int k = 0; k < 2 * _m; k++)
+                S[c][k] *= inv;
+            for (int r = 0; r < _m; r++)
+            {
+                if (r == c)
+                    continue;
+                T factor = S[r][c];
+                for (int k = 0; k < 2 * _m; k++)
+                    S[r][k] -= factor * S[c][k];
+            }
+        }
+
+        T K[N][3];
+        T dx[N];
+        for (int i = 0; i < N; i++)
+        {
+            dx[i] = 0;
+            for (int c = 0; c < _m; c++)
+            {
+                T s = 0;
+                for (int k = 0; k < _m; k++)
+                    s += PHt[i][k] * S[k][_m + c];
+                K[i][c] = s;
+                dx[i] += s * _y[c];
+            }
+        }
+
+        // P -= K (P H')', then symmetrized
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++)
+                for (int c = 0; c < _m; c++)
+                    m_P[i][j] -= K[i][c] * PHt[j][c];
+        for (int i = 0; i < N; i++)
+        {
+            for (int j = i + 1; j < N; j++)
+            {
+                T s = (m_P[i][j] + m_P[j][i]) / 2;
+                m_P[i][j] = s;
+                m_P[j][i] = s;
+            }
+        }
+
+        m_q = normalize (m_q * Quaternion<T>::fromRotationVector (makeVec3<T> (dx[0], dx[1], dx[2])));
+        m_v += makeVec3<T> (dx[3], dx[4], dx[5]);
+        m_p += makeVec3<T> (dx[6], dx[7], dx[8]);
+        m_bg += makeVec3<T> (dx[9], dx[10], dx[11]);
+        m_ba += makeVec3<T> (dx[12], dx[13], dx[14]);
+    }
+
+    Quaternion<T>   m_q;
+    Vec3<T>         m_v;
+    Vec3<T>         m_p;
+    Vec3<T>         m_bg;
+    Vec3<T>         m_ba;
+    T               m_P[N][N];
+    InsEKF::Noise   m_noise;
+    T               m_gravityGate;
+};
+
+#endif // DENSE_EKF_H
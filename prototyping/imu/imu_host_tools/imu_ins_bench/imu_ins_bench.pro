@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# InsEKF validation against a dense reference, and its timing
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_ins_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/InsEKF.cpp
+
+HEADERS += dense_ekf.h \
+    $$PWD/../../imu_embedded_sw/InsEKF.h \
+    $$PWD/../../imu_embedded_sw/VectorMath.h
@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+#include "InsEKF.h"
+#include "dense_ekf.h"
+
+// Sensor rates of the sketch's IMU_INS setup
+static const int      GYRO_HZ = 400;
+static const int      FILTER_HZ = 100;
+static const int      ACC_HZ = 100;
+static const int      MAG_HZ = 80;
+static const int      BARO_HZ = 40;
+static const int      TRUTH_SUBSTEPS = 10;
+static const double   SECONDS_DEFAULT = 120.0;
+static const int      BENCH_ITERATIONS_DEFAULT = 200000;
+static const double   PI = 3.14159265358979;
+
+// Sensor errors the filter has to find or ride out
+static const double   GYRO_BIAS_RADS[3] = {0.004, -0.003, 0.002};
+static const double   ACC_BIAS_MPS2[3] = {0.05, -0.08, 0.03};
+static const double   GYRO_NOISE_RADS = 0.005;
+static const double   ACC_NOISE_MPS2 = 0.04;
+static const double   MAG_NOISE = 0.01;
+static const double   BARO_NOISE_M = 0.3;
+
+// Reference frame field, x magnetic north and z up, with a 65 degree dip
+static const double   MAG_FIELD[3] = {0.21, 0.0, -0.45};
+
+// Still and moving phases, motion phases are whole periods of the height
+// swing so they end at rest
+typedef struct phase_struct
+{
+    double      seconds;
+    double      rateAmplitudeRads[3];
+    double      heightAmplitudeM;
+} Phase;
+
+static const Phase SCENARIO[] =
+{
+    {10.0, {0.0, 0.0, 0.0}, 0.0},
+    {30.0, {0.6, 0.4, 1.0}, 1.0},
+    {15.0, {0.0, 0.0, 0.0}, 0.0},
+    {30.0, {1.5, 1.2, 2.0}, 0.5},
+    {35.0, {0.0, 0.0, 0.0}, 0.0}
+};
+static const int SCENARIO_PHASES = sizeof (SCENARIO) / sizeof (SCENARIO[0]);
+static const double HEIGHT_PERIOD_S = 15.0;
+static const double RATE_FREQUENCY_HZ[3] = {0.31, 0.53, 0.17};
+
+typedef Vec3<double> vectord;
+
+// Truth at one instant
+typedef struct truth_struct
+{
+    Quaternion<double> q;
+    vectord     rate;
+    vectord     acc;        // Reference frame acceleration
+    vectord     vel;
+    vectord     pos;
+} Truth;
+
+class Trajectory
+{
+public:
+    Trajectory () : m_timeS (0.0)
+    {
+        m_truth.q = Quaternion<double>::fromRotationVector (makeVec3<double> (0.05, -0.03, 0.4));
+        m_truth.vel = makeVec3<double> (0.0, 0.0, 0.0);
+        m_truth.pos = makeVec3<double> (0.0, 0.0, 100.0);
+        evaluate ();
+    }
+
+    void step (double _dt)
+    {
+        for (int s = 0; s < TRUTH_SUBSTEPS; s++)
+        {
+            double h = _dt / TRUTH_SUBSTEPS;
+            m_timeS += h / 2;
+            evaluate ();
+            m_truth.q = normalize (m_truth.q * Quaternion<double>::fromRotationVector (m_truth.rate * h));
+            m_timeS += h / 2;
+        }
+        evaluate ();
+    }
+
+    const Truth& get () {return m_truth;}
+    double getTime () {return m_timeS;}
+private:
+    // Rate and height profile of the phase at m_timeS
+    void evaluate ()
+    {
+        double start = 0.0;
+        const Phase* phase = &SCENARIO[SCENARIO_PHASES - 1];
+        for (int p = 0; p < SCENARIO_PHASES; p++)
+        {
+            if (m_timeS < start + SCENARIO[p].seconds)
+            {
+                phase = &SCENARIO[p];
+                break;
+            }
+            start += SCENARIO[p].seconds;
+        }
+        double t = m_timeS - start;
+        double r[3];
+        for (int a = 0; a < 3; a++)
+            r[a] = phase->rateAmplitudeRads[a] * sin (2 * PI * RATE_FREQUENCY_HZ[a] * t) *
+                   sin (PI * t / phase->seconds);
+        m_truth.rate = makeVec3<double> (r[0], r[1], r[2]);
+
+        double w = 2 * PI / HEIGHT_PERIOD_S;
+        double a = phase->heightAmplitudeM;
+        m_truth.pos.z = 100.0 + a * (1 - cos (w * t));
+        m_truth.vel.z = a * w * sin (w * t);
+        m_truth.acc = makeVec3<double> (0.0, 0.0, a * w * w * cos (w * t));
+    }
+
+    double  m_timeS;
+    Truth   m_truth;
+};
+
+typedef struct options_struct
+{
+    double      seconds;
+    int         iterations;
+    unsigned    seed;
+} Options;
+
+// Noisy sensor readings of the truth, in the units the sketch hands the filter
+class Sensors
+{
+public:
+    Sensors (unsigned _seed) : m_rng (_seed) {}
+
+    vectord gyro (const Truth& _t)
+    {
+        return makeVec3<double> (_t.rate.x + GYRO_BIAS_RADS[0] + noise (GYRO_NOISE_RADS),
+                                 _t.rate.y + GYRO_BIAS_RADS[1] + noise (GYRO_NOISE_RADS),
+                                 _t.rate.z + GYRO_BIAS_RADS[2] + noise (GYRO_NOISE_RADS));
+    }
+
+    vectord acc (const Truth& _t)
+    {
+        vectord f = _t.acc;
+        f.z += InsEKF::GRAVITY_MPS2;
+        f = transpose (toMat3 (_t.q)) * f;
+        return makeVec3<double> (f.x + ACC_BIAS_MPS2[0] + noise (ACC_NOISE_MPS2),
+                                 f.y + ACC_BIAS_MPS2[1] + noise (ACC_NOISE_MPS2),
+                                 f.z + ACC_BIAS_MPS2[2] + noise (ACC_NOISE_MPS2));
+    }
+
+    vectord mag (const Truth& _t)
+    {
+        vectord m = transpose (toMat3 (_t.q)) * makeVec3<double> (MAG_FIELD[0], MAG_FIELD[1], MAG_FIELD[2]);
+        return makeVec3<double> (m.x + noise (MAG_NOISE), m.y + noise (MAG_NOISE), m.z + noise (MAG_NOISE));
+    }
+
+    double altitude (const Truth& _t)
+    {
+        return _t.pos.z + noise (BARO_NOISE_M);
+    }
+private:
+    double noise (double _sigma) {return _sigma * m_normal (m_rng);}
+
+    std::mt19937                        m_rng;
+    std::normal_distribution<double>    m_normal;
+};
+
+static Vec3<float> toFloat (const vectord& _v)
+{
+    return makeVec3<float> ((float) _v.x, (float) _v.y, (float) _v.z);
+}
+
+static vectord toDouble (const Vec3<float>& _v)
+{
+    return makeVec3<double> (_v.x, _v.y, _v.z);
+}
+
+// Rotation angle between two attitudes
+template <typename A, typename B>
+static double angleDeg (const Quaternion<A>& _a, const Quaternion<B>& _b)
+{
+    double d = std::fabs ((double) _a.w * _b.w + (double) _a.x * _b.x + (double) _a.y * _b.y + (double) _a.z * _b.z);
+    return 2 * acos (std::min (1.0, d)) * 180.0 / PI;
+}
+
+typedef struct result_struct
+{
+    double      attSumSq;
+    double      attMax;
+    double      heightSumSq;
+    double      velSumSq;
+    uint64_t    samples;
+    double      refAttMax;
+    double      refVelMax;
+    double      refHeightMax;
+    double      refBiasMax;
+    double      refCovMax;
+    uint64_t    scalarUpdates;
+    uint64_t    zeroVelocityUpdates;
+} Result;
+
+// Feeds the sparse filter and the dense double reference the same samples,
+// scoring the first against the truth and against the second
+static Result runScenario (const Options& _options)
+{
+    Result res = Result ();
+    Trajectory traj;
+    Sensors sensors (_options.seed);
+    InsEKF ekf;
+    DenseEKF<double> ref;
+
+    // Gating would let rounding decide which updates each filter takes
+    ekf.setGate (1e6f);
+
+    double dt = 1.0 / GYRO_HZ;
+    vectord acc0 = sensors.acc (traj.get ());
+    vectord mag0 = sensors.mag (traj.get ());
+    ekf.reset (toFloat (acc0), toFloat (mag0), (float) sensors.altitude (traj.get ()));
+    ref.setState (ekf);
+
+    vectord gyroSum = makeVec3<double> (0.0, 0.0, 0.0);
+    vectord acc = acc0;
+    int gyroCount = 0;
+    bool newAcc = false, newMag = false, newBaro = false;
+    uint64_t steps = (uint64_t) (_options.seconds * GYRO_HZ);
+    for (uint64_t n = 1; n <= steps; n++)
+    {
+        traj.step (dt);
+        const Truth& truth = traj.get ();
+        gyroSum += sensors.gyro (truth);
+        gyroCount++;
+        if (n % (GYRO_HZ / ACC_HZ) == 0)
+        {
+            acc = sensors.acc (truth);
+            newAcc = true;
+        }
+        newMag |= n % (GYRO_HZ / MAG_HZ) == 0;
+        newBaro |= n % (GYRO_HZ / BARO_HZ) == 0;
+        if (n % (GYRO_HZ / FILTER_HZ) != 0)
+            continue;
+
+        vectord gyro = gyroSum * (1.0 / gyroCount);
+        double filterDt = gyroCount * dt;
+        gyroSum = makeVec3<double> (0.0, 0.0, 0.0);
+        gyroCount = 0;
+        ekf.predict ((float) filterDt, toFloat (gyro), toFloat (acc));
+        ref.predict (filterDt, gyro, acc);
+
+        if (newAcc)
+        {
+            res.scalarUpdates += ekf.updateGravity (toFloat (acc));
+            ref.updateGravity (acc);
+            newAcc = false;
+        }
+        if (newMag)
+        {
+            vectord mag = sensors.mag (truth);
+            res.scalarUpdates += ekf.updateHeading (toFloat (mag));
+            ref.updateHeading (mag);
+            newMag = false;
+        }
+        if (newBaro)
+        {
+            double altitude = sensors.altitude (truth);
+            res.scalarUpdates += ekf.updateAltitude ((float) altitude);
+            ref.updateAltitude (altitude);
+            newBaro = false;
+        }
+        if (ekf.isStationary ())
+        {
+            res.scalarUpdates += ekf.updateZeroVelocity ();
+            ref.updateZeroVelocity ();
+            res.zeroVelocityUpdates++;
+        }
+
+        // Scored after the first seconds of settling
+        if (traj.getTime () < 2.0)
+            continue;
+        double att = angleDeg (ekf.getAttitude (), truth.q);
+        vectord vel = toDouble (ekf.getVelocity ()) - truth.vel;
+        double height = ekf.getPosition ().z - truth.pos.z;
+        res.attSumSq += att * att;
+        res.attMax = std::max (res.attMax, att);
+        res.velSumSq += dot (vel, vel);
+        res.heightSumSq += height * height;
+        res.samples++;
+
+        res.refAttMax = std::max (res.refAttMax, angleDeg (ekf.getAttitude (), ref.getAttitude ()));
+        res.refVelMax = std::max (res.refVelMax, norm (toDouble (ekf.getVelocity ()) - ref.getVelocity ()));
+        res.refHeightMax = std::max (res.refHeightMax, std::fabs (ekf.getPosition ().z - ref.getPosition ().z));
+        res.refBiasMax = std::max (res.refBiasMax, norm (toDouble (ekf.getGyroBias ()) - ref.getGyroBias ()));
+        for (int i = 0; i < InsEKF::STATES; i++)
+        {
+            for (int j = 0; j < InsEKF::STATES; j++)
+            {
+                double p = ref.getCovariance (i, j);
+                double scale = sqrt (ref.getCovariance (i, i) * ref.getCovariance (j, j));
+                if (scale > 0)
+                    res.refCovMax = std::max (res.refCovMax, std::fabs (ekf.getCovariance (i, j) - p) / scale);
+            }
+        }
+    }
+
+    printf ("[scenario]\n");
+    printf ("Seconds=%.1f\n", _options.seconds);
+    printf ("ScalarUpdates=%llu\n", (unsigned long long) res.scalarUpdates);
+    printf ("ZeroVelocityUpdates=%llu\n", (unsigned long long) res.zeroVelocityUpdates);
+    printf ("AttitudeErrRmsDeg=%.4f\n", sqrt (res.attSumSq / res.samples));
+    printf ("AttitudeErrMaxDeg=%.4f\n", res.attMax);
+    printf ("VelocityErrRms=%.4f\n", sqrt (res.velSumSq / res.samples));
+    printf ("HeightErrRms=%.4f\n", sqrt (res.heightSumSq / res.samples));
+    vectord bg = toDouble (ekf.getGyroBias ()) - makeVec3<double> (GYRO_BIAS_RADS[0], GYRO_BIAS_RADS[1], GYRO_BIAS_RADS[2]);
+    vectord ba = toDouble (ekf.getAccBias ()) - makeVec3<double> (ACC_BIAS_MPS2[0], ACC_BIAS_MPS2[1], ACC_BIAS_MPS2[2]);
+    printf ("GyroBiasErrDegS=%.5f\n", norm (bg) * 180.0 / PI);
+    printf ("AccBiasErr=%.5f\n", norm (ba));
+    printf ("\n");
+
+    // Float against double, the two should only differ by rounding
+    printf ("[sparse vs dense]\n");
+    printf ("AttitudeDiffMaxDeg=%.6f\n", res.refAttMax);
+    printf ("VelocityDiffMax=%.6f\n", res.refVelMax);
+    printf ("HeightDiffMax=%.6f\n", res.refHeightMax);
+    printf ("GyroBiasDiffMax=%.8f\n", res.refBiasMax);
+    printf ("CovarianceDiffMax=%.6f\n", res.refCovMax);
+    printf ("\n");
+    return res;
+}
+
+// Mean time of one call, the filters are rebuilt per run so each starts alike
+template <typename Filter, typename Call>
+static double timeCalls (Filter& _filter, int _iterations, Call _call)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    for (int i = 0; i < _iterations; i++)
+        _call (_filter, i);
+    return std::chrono::duration<double, std::micro> (std::chrono::steady_clock::now () - start).count () / _iterations;
+}
+
+template <typename Filter, typename T>
+static void benchFilter (const char* _name, Filter& _filter, int _iterations, double* _out)
+{
+    // Slow rotation so the covariance blocks stay populated
+    const T dt = (T) (1.0 / FILTER_HZ);
+    Vec3<T> gyro = makeVec3<T> ((T) 0.02, (T) -0.01, (T) 0.03);
+    Vec3<T> acc = makeVec3<T> ((T) 0.1, (T) -0.2, (T) InsEKF::GRAVITY_MPS2);
+    Vec3<T> mag = makeVec3<T> ((T) MAG_FIELD[0], (T) 0.01, (T) MAG_FIELD[2]);
+    _out[0] = timeCalls (_filter, _iterations, [&] (Filter& _f, int) {_f.predict (dt, gyro, acc);});
+    _out[1] = timeCalls (_filter, _iterations, [&] (Filter& _f, int) {_f.updateGravity (acc);});
+    _out[2] = timeCalls (_filter, _iterations, [&] (Filter& _f, int) {_f.updateHeading (mag);});
+    _out[3] = timeCalls (_filter, _iterations, [&] (Filter& _f, int _i) {_f.updateAltitude ((T) (100.0 + 0.01 * (_i & 7)));});
+    _out[4] = timeCalls (_filter, _iterations, [&] (Filter& _f, int) {_f.updateZeroVelocity ();});
+    printf ("[%s]\n", _name);
+    printf ("PredictuS=%.3f\n", _out[0]);
+    printf ("GravityUpdateuS=%.3f\n", _out[1]);
+    printf ("HeadingUpdateuS=%.3f\n", _out[2]);
+    printf ("AltitudeUpdateuS=%.3f\n", _out[3]);
+    printf ("ZeroVelocityUpdateuS=%.3f\n", _out[4]);
+    printf ("\n");
+}
+
+static void runBench (const Options& _options)
+{
+    InsEKF::vectorf up = makeVec3<float> (0.0f, 0.0f, InsEKF::GRAVITY_MPS2);
+    InsEKF::vectorf north = makeVec3<float> ((float) MAG_FIELD[0], 0.0f, (float) MAG_FIELD[2]);
+    double sparse[5], denseFloat[5], denseDouble[5];
+
+    InsEKF ekf;
+    ekf.reset (up, north, 100.0f);
+    benchFilter<InsEKF, float> ("sparse float", ekf, _options.iterations, sparse);
+
+    ekf.reset (up, north, 100.0f);
+    DenseEKF<float> refFloat;
+    refFloat.setState (ekf);
+    benchFilter<DenseEKF<float>, float> ("dense float", refFloat, _options.iterations, denseFloat);
+
+    ekf.reset (up, north, 100.0f);
+    DenseEKF<double> refDouble;
+    refDouble.setState (ekf);
+    benchFilter<DenseEKF<double>, double> ("dense double", refDouble, _options.iterations, denseDouble);
+
+    printf ("[speedup over dense float]\n");
+    printf ("Predict=%.2f\n", denseFloat[0] / sparse[0]);
+    printf ("GravityUpdate=%.2f\n", denseFloat[1] / sparse[1]);
+    printf ("HeadingUpdate=%.2f\n", denseFloat[2] / sparse[2]);
+    printf ("AltitudeUpdate=%.2f\n", denseFloat[3] / sparse[3]);
+    printf ("ZeroVelocityUpdate=%.2f\n", denseFloat[4] / sparse[4]);
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-s seconds] [-n iterations] [-r seed]\n", _prog);
+    fprintf (stderr, "  Runs a still, moving, still scenario through InsEKF (imu_embedded_sw) and a\n");
+    fprintf (stderr, "  dense double precision reference of the same filter, reports the error against\n");
+    fprintf (stderr, "  the truth and the largest difference between the two, then times predict and\n");
+    fprintf (stderr, "  each update for both.\n");
+    fprintf (stderr, "  -s  scenario length, default %.0f s\n", SECONDS_DEFAULT);
+    fprintf (stderr, "  -n  benchmark calls of each kind, default %d\n", BENCH_ITERATIONS_DEFAULT);
+    fprintf (stderr, "  -r  noise seed\n");
+}
+
+int main (int _argc, char** _argv)
+{
+    Options options;
+    options.seconds = SECONDS_DEFAULT;
+    options.iterations = BENCH_ITERATIONS_DEFAULT;
+    options.seed = 1;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "s:n:r:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                options.seconds = atof (optarg);
+                break;
+            case 'n':
+                options.iterations = atoi (optarg);
+                break;
+            case 'r':
+                options.seed = (unsigned) atoi (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (options.seconds < 3.0 || options.iterations <= 0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    runScenario (options);
+    runBench (options);
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "channel_analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+
+static void fft (std::vector<double>& _re, std::vector<double>& _im)
+{
+    size_t n = _re.size ();
+
+    // Bit reversal permutation
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap (_re[i], _re[j]);
+            std::swap (_im[i], _im[j]);
+        }
+    }
+
+    // Iterative radix-2 butterflies
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        double angle = -2.0 * M_PI / len;
+        double wRe = cos (angle);
+        double wIm = sin (angle);
+        for (size_t i = 0; i < n; i += len)
+        {
+            double curRe = 1.0;
+            double curIm = 0.0;
+            for (size_t j = 0; j < len / 2; j++)
+            {
+                size_t a = i + j;
+                size_t b = a + len / 2;
+                double tRe = _re[b] * curRe - _im[b] * curIm;
+                double tIm = _re[b] * curIm + _im[b] * curRe;
+                _re[b] = _re[a] - tRe;
+                _im[b] = _im[a] - tIm;
+                _re[a] += tRe;
+                _im[a] += tIm;
+                double nextRe = curRe * wRe - curIm * wIm;
+                curIm = curRe * wIm + curIm * wRe;
+                curRe = nextRe;
+            }
+        }
+    }
+}
+
+ChannelAnalyzer::ChannelAnalyzer (uint32_t _maxTauSamples, uint32_t _fftSize)
+    : m_thetaMask (0),
+      m_cumSum (0),
+      m_count (0),
+      m_mean (0.0),
+      m_m2 (0.0),
+      m_haveTime (false),
+      m_lastTimeuS (0),
+      m_elapseduS (0),
+      m_intervals (0),
+      m_fftSize (_fftSize),
+      m_segmentFill (0),
+      m_windowPower (0.0),
+      m_psdSegments (0)
+{
+    // Octave spaced cluster sizes up to the max tau
+    uint32_t maxCluster = 1;
+    while (maxCluster < _maxTauSamples)
+        maxCluster <<= 1;
+    for (uint32_t m = 1; m <= maxCluster; m <<= 1)
+        m_clusters.push_back (m);
+    m_allanSum.resize (m_clusters.size (), 0.0);
+    m_allanTerms.resize (m_clusters.size (), 0);
+
+    // Cumulative sums back to 2 * max cluster are needed for a whole chunk
+    uint64_t thetaSize = 1;
+    while (thetaSize < 2 * (uint64_t) maxCluster + 1 + CHUNK_SAMPLES)
+        thetaSize <<= 1;
+    m_theta.resize (thetaSize, 0);
+    m_thetaMask = thetaSize - 1;
+
+    m_segment.resize (m_fftSize, 0.0);
+    m_window.resize (m_fftSize);
+    for (uint32_t i = 0; i < m_fftSize; i++)
+    {
+        m_window[i] = 0.5 - 0.5 * cos (2.0 * M_PI * i / m_fftSize);
+        m_windowPower += m_window[i] * m_window[i];
+    }
+    m_psdSum.resize (m_fftSize / 2 + 1, 0.0);
+    m_re.resize (m_fftSize);
+    m_im.resize (m_fftSize);
+}
+
+void ChannelAnalyzer::addSamples (const int32_t* _values, const uint32_t* _timesuS, size_t _n)
+{
+    while (_n > 0)
+    {
+        size_t chunk = (_n < CHUNK_SAMPLES) ? _n : CHUNK_SAMPLES;
+        uint64_t first = m_count + 1;
+
+        for (size_t i = 0; i < chunk; i++)
+        {
+            if (m_haveTime)
+            {
+                // Unsigned difference survives the 71 minute micros () wrap
+                m_elapseduS += (uint32_t) (_timesuS[i] - m_lastTimeuS);
+                m_intervals++;
+            }
+            m_lastTimeuS = _timesuS[i];
+            m_haveTime = true;
+
+            addSample (_values[i]);
+        }
+
+        // Overlapping Allan variance from the exact integer cumulative sum:
+        // AVAR(m) = sum (theta[k] - 2 theta[k - m] + theta[k - 2m])^2 / (2 m^2 terms)
+        // One cluster size at a time over the chunk keeps the ring reads sequential
+        for (size_t c = 0; c < m_clusters.size (); c++)
+        {
+            uint64_t m = m_clusters[c];
+            uint64_t k = (first > 2 * m) ? first : 2 * m;
+            if (k > m_count)
+                break;
+            double sum = 0.0;
+            for (; k <= m_count; k++)
+            {
+                int64_t d = m_theta[k & m_thetaMask] - 2 * m_theta[(k - m) & m_thetaMask] + m_theta[(k - 2 * m) & m_thetaMask];
+                sum += (double) d * (double) d;
+            }
+            m_allanSum[c] += sum;
+            m_allanTerms[c] += m_count - ((first > 2 * m) ? first : 2 * m) + 1;
+        }
+
+        _values += chunk;
+        _timesuS += chunk;
+        _n -= chunk;
+    }
+}
+
+void ChannelAnalyzer::addSample (int32_t _value)
+{
+    m_count++;
+    m_cumSum += _value;
+    m_theta[m_count & m_thetaMask] = m_cumSum;
+
+    // Running mean and variance
+    double delta = _value - m_mean;
+    m_mean += delta / m_count;
+    m_m2 += delta * (_value - m_mean);
+
+    // PSD segments overlap by half
+    m_segment[m_segmentFill++] = _value;
+    if (m_segmentFill == m_fftSize)
+    {
+        processSegment ();
+        std::copy (m_segment.begin () + m_fftSize / 2, m_segment.end (), m_segment.begin ());
+        m_segmentFill = m_fftSize / 2;
+    }
+}
+
+void ChannelAnalyzer::processSegment ()
+{
+    double mean = 0.0;
+    for (uint32_t i = 0; i < m_fftSize; i++)
+        mean += m_segment[i];
+    mean /= m_fftSize;
+
+    for (uint32_t i = 0; i < m_fftSize; i++)
+    {
+        m_re[i] = (m_segment[i] - mean) * m_window[i];
+        m_im[i] = 0.0;
+    }
+    fft (m_re, m_im);
+
+    for (uint32_t i = 0; i <= m_fftSize / 2; i++)
+        m_psdSum[i] += m_re[i] * m_re[i] + m_im[i] * m_im[i];
+    m_psdSegments++;
+}
+
+ChannelAnalyzer::Result ChannelAnalyzer::finish (double _scale) const
+{
+    Result r;
+    r.samples = m_count;
+    r.sampleRateHz = (m_elapseduS > 0) ? (m_intervals * 1e6 / m_elapseduS) : 0.0;
+    r.mean = m_mean * _scale;
+    r.stdDev = (m_count > 1) ? sqrt (m_m2 / (m_count - 1)) * fabs (_scale) : 0.0;
+    r.randomWalk = 0.0;
+    r.biasInstability = 0.0;
+    r.biasInstabilityTauS = 0.0;
+    r.rateRandomWalk = 0.0;
+    r.psdNoiseDensity = 0.0;
+
+    if (r.sampleRateHz <= 0.0)
+        return r;
+
+    for (size_t c = 0; c < m_clusters.size (); c++)
+    {
+        if (m_allanTerms[c] == 0)
+            break;
+        double m = m_clusters[c];
+        AllanPoint p;
+        p.tauS = m / r.sampleRateHz;
+        p.adev = sqrt (m_allanSum[c] / (2.0 * m * m * m_allanTerms[c])) * fabs (_scale);
+        p.terms = m_allanTerms[c];
+        r.allan.push_back (p);
+    }
+
+    if (r.allan.size () > 1)
+    {
+        // Bias instability at the minimum of the curve
+        size_t minIndex = 0;
+        for (size_t i = 1; i < r.allan.size (); i++)
+            if (r.allan[i].adev < r.allan[minIndex].adev)
+                minIndex = i;
+        r.biasInstability = r.allan[minIndex].adev / 0.664;
+        r.biasInstabilityTauS = r.allan[minIndex].tauS;
+
+        // Random walk where the log-log slope is nearest -1/2, rate random walk
+        // where it is nearest +1/2 after the minimum
+        double bestWhite = 1e9;
+        double bestRate = 0.25;
+        for (size_t i = 0; i + 1 < r.allan.size (); i++)
+        {
+            if (r.allan[i].adev <= 0.0 || r.allan[i + 1].adev <= 0.0)
+                continue;
+            double slope = log (r.allan[i + 1].adev / r.allan[i].adev) / log (r.allan[i + 1].tauS / r.allan[i].tauS);
+            if (i < minIndex && fabs (slope + 0.5) < bestWhite)
+            {
+                bestWhite = fabs (slope + 0.5);
+                r.randomWalk = r.allan[i].adev * sqrt (r.allan[i].tauS);
+            }
+            if (i >= minIndex && fabs (slope - 0.5) < bestRate)
+            {
+                bestRate = fabs (slope - 0.5);
+                r.rateRandomWalk = r.allan[i + 1].adev * sqrt (3.0 / r.allan[i + 1].tauS);
+            }
+        }
+        if (r.randomWalk == 0.0)
+            r.randomWalk = r.allan[0].adev * sqrt (r.allan[0].tauS);
+    }
+
+    if (m_psdSegments > 0)
+    {
+        // One sided density
+        double norm = (_scale * _scale) / (m_psdSegments * r.sampleRateHz * m_windowPower);
+        r.psd.resize (m_psdSum.size ());
+        for (size_t i = 0; i < m_psdSum.size (); i++)
+        {
+            double oneSided = (i == 0 || i == m_psdSum.size () - 1) ? 1.0 : 2.0;
+            r.psd[i] = m_psdSum[i] * norm * oneSided;
+        }
+
+        // White noise floor from the median of the upper band
+        std::vector<double> band (r.psd.begin () + r.psd.size () / 5, r.psd.begin () + (4 * r.psd.size ()) / 5);
+        if (!band.empty ())
+        {
+            std::nth_element (band.begin (), band.begin () + band.size () / 2, band.end ());
+            r.psdNoiseDensity = sqrt (band[band.size () / 2]);
+        }
+    }
+
+    return r;
+}
@@ -0,0 +1,87 @@
+#ifndef CHANNEL_ANALYZER_H
+#define CHANNEL_ANALYZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Single pass noise characterization of one sensor axis.  Memory is bounded by
+// the largest Allan cluster size and the FFT size, not by the capture length.
+class ChannelAnalyzer
+{
+public:
+    struct AllanPoint
+    {
+        double      tauS;
+        double      adev;
+        uint64_t    terms;
+    };
+
+    struct Result
+    {
+        uint64_t                samples;
+        double                  sampleRateHz;
+        double                  mean;
+        double                  stdDev;
+        // Velocity/angle random walk (white noise density), unit * sqrt(s)
+        double                  randomWalk;
+        // Bias instability from the flat part of the Allan curve, unit
+        double                  biasInstability;
+        double                  biasInstabilityTauS;
+        // Rate random walk, unit / sqrt(s), 0 if the capture is too short to show it
+        double                  rateRandomWalk;
+        // White noise floor from the PSD, unit / sqrt(Hz)
+        double                  psdNoiseDensity;
+        std::vector<AllanPoint> allan;
+        std::vector<double>     psd;        // unit^2 / Hz, bin i at i * fs / fftSize
+    };
+
+    // Samples handled per Allan pass
+    static const size_t CHUNK_SAMPLES = 65536;
+
+    // _maxTauSamples is rounded up to a power of two, _fftSize must be one
+    ChannelAnalyzer (uint32_t _maxTauSamples, uint32_t _fftSize);
+
+    void addSamples (const int32_t* _values, const uint32_t* _timesuS, size_t _n);
+
+    // Compute the estimates in physical units (raw * _scale)
+    Result finish (double _scale) const;
+
+    uint64_t getSamples () const {return m_count;}
+
+private:
+    void addSample (int32_t _value);
+    void processSegment ();
+
+    // Allan variance, history of the cumulative sum for all cluster sizes
+    std::vector<int64_t>        m_theta;
+    uint64_t                    m_thetaMask;
+    int64_t                     m_cumSum;
+    uint64_t                    m_count;
+    std::vector<uint32_t>       m_clusters;
+    std::vector<double>         m_allanSum;
+    std::vector<uint64_t>       m_allanTerms;
+
+    // Running mean and variance (Welford)
+    double                      m_mean;
+    double                      m_m2;
+
+    // Sample timing with 32 bit microsecond wrap handling
+    bool                        m_haveTime;
+    uint32_t                    m_lastTimeuS;
+    uint64_t                    m_elapseduS;
+    uint64_t                    m_intervals;
+
+    // Welch PSD with 50% overlapped Hann segments
+    uint32_t                    m_fftSize;
+    std::vector<double>         m_segment;
+    uint32_t                    m_segmentFill;
+    std::vector<double>         m_window;
+    double                      m_windowPower;
+    std::vector<double>         m_psdSum;
+    uint64_t                    m_psdSegments;
+    std::vector<double>         m_re;
+    std::vector<double>         m_im;
+};
+
+#endif // CHANNEL_ANALYZER_H
@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Allan deviation / PSD noise characterization of raw captures
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_noise_tool
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    channel_analyzer.cpp
+
+HEADERS += channel_analyzer.h
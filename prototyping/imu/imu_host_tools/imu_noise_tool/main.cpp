@@ -0,0 +1,239 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "capture_reader.h"
+#include "channel_analyzer.h"
+#include "worker_pool.h"
+
+static const size_t   BATCH_SAMPLES = 65536;
+static const size_t   QUEUE_DEPTH = 4;
+static const uint32_t MAX_TAU_SAMPLES_DEFAULT = 1 << 20;
+static const uint32_t FFT_SIZE_DEFAULT = 4096;
+static const char     AXIS_NAMES[3] = {'x', 'y', 'z'};
+
+struct Batch
+{
+    std::vector<int32_t>    values;
+    std::vector<uint32_t>   timesuS;
+};
+
+struct Channel
+{
+    CAPTURE_SENSOR                      sensor;
+    int                                 axis;
+    ChannelAnalyzer*                    analyzer;
+    std::shared_ptr<Batch>              batch;
+};
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-j threads] [-m max_tau_samples] [-n fft_size] [-o csv_prefix] capture.bin|-\n", _prog);
+    fprintf (stderr, "  Overlapping Allan deviation, PSD and bias instability per sensor axis of a\n");
+    fprintf (stderr, "  raw CaptureRecord stream (see imu_embedded_sw/CaptureRecord.h).\n");
+    fprintf (stderr, "  -m  largest Allan cluster, default %u samples, at most half the records\n", MAX_TAU_SAMPLES_DEFAULT);
+    fprintf (stderr, "      of a capture file\n");
+}
+
+static void writeCsv (const std::string& _prefix, const Channel& _ch, const ChannelAnalyzer::Result& _r)
+{
+    std::string base = _prefix + "_" + CaptureReader::sensorName (_ch.sensor) + "_" + AXIS_NAMES[_ch.axis];
+
+    FILE* f = fopen ((base + "_adev.csv").c_str (), "w");
+    if (f)
+    {
+        fprintf (f, "tau_s,adev,terms\n");
+        for (size_t i = 0; i < _r.allan.size (); i++)
+            fprintf (f, "%.9g,%.9g,%llu\n", _r.allan[i].tauS, _r.allan[i].adev, (unsigned long long) _r.allan[i].terms);
+        fclose (f);
+    }
+
+    f = fopen ((base + "_psd.csv").c_str (), "w");
+    if (f && !_r.psd.empty ())
+    {
+        double binHz = _r.sampleRateHz / (2.0 * (_r.psd.size () - 1));
+        fprintf (f, "freq_hz,psd\n");
+        for (size_t i = 0; i < _r.psd.size (); i++)
+            fprintf (f, "%.9g,%.9g\n", i * binHz, _r.psd[i]);
+    }
+    if (f)
+        fclose (f);
+}
+
+int main (int argc, char* argv[])
+{
+    unsigned threads = std::thread::hardware_concurrency ();
+    uint32_t maxTau = MAX_TAU_SAMPLES_DEFAULT;
+    uint32_t fftSize = FFT_SIZE_DEFAULT;
+    std::string csvPrefix;
+
+    int opt;
+    while ((opt = getopt (argc, argv, "j:m:n:o:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j':
+                threads = atoi (optarg);
+                break;
+            case 'm':
+                maxTau = strtoul (optarg, NULL, 0);
+                break;
+            case 'n':
+                fftSize = strtoul (optarg, NULL, 0);
+                break;
+            case 'o':
+                csvPrefix = optarg;
+                break;
+            default:
+                usage (argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || fftSize < 16 || (fftSize & (fftSize - 1)) != 0)
+    {
+        usage (argv[0]);
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (!reader.open (argv[optind]))
+    {
+        fprintf (stderr, "Could not open %s\n", argv[optind]);
+        return 1;
+    }
+
+    // A channel can't have more samples than the file has records, and the
+    // largest Allan cluster that fits takes half of them.  The cumulative sum
+    // ring is sized from the cap, so short captures don't pay for long ones.
+    struct stat st;
+    if (std::string (argv[optind]) != "-" && stat (argv[optind], &st) == 0)
+    {
+        uint64_t tauCap = (uint64_t) st.st_size / sizeof (CaptureRecord) / 2;
+        if (tauCap < 1)
+            tauCap = 1;
+        if (maxTau > tauCap)
+            maxTau = (uint32_t) tauCap;
+    }
+
+    // One analyzer per sensor axis, each pinned to a worker so its batches
+    // are processed in order without locking
+    std::vector<Channel> channels;
+    int channelIndex[CAPTURE_SENSOR_NUM][3];
+    for (int s = 0; s < CAPTURE_SENSOR_NUM; s++)
+    {
+        int axes = (s == CAPTURE_PRESSURE || s == CAPTURE_TEMP) ? 1 : 3;
+        for (int a = 0; a < 3; a++)
+        {
+            channelIndex[s][a] = -1;
+            if (a >= axes)
+                continue;
+            Channel ch;
+            ch.sensor = (CAPTURE_SENSOR) s;
+            ch.axis = a;
+            ch.analyzer = new ChannelAnalyzer (maxTau, fftSize);
+            channelIndex[s][a] = channels.size ();
+            channels.push_back (ch);
+        }
+    }
+    if (threads == 0)
+        threads = 1;
+    if (threads > channels.size ())
+        threads = channels.size ();
+    WorkerPool pool (threads, QUEUE_DEPTH);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+    std::vector<CaptureRecord> records;
+    records.reserve (BATCH_SAMPLES);
+    for (;;)
+    {
+        records.clear ();
+        if (!reader.read (records, BATCH_SAMPLES))
+            break;
+
+        for (size_t i = 0; i < records.size (); i++)
+        {
+            const CaptureRecord& rec = records[i];
+            for (int a = 0; a < rec.axes; a++)
+            {
+                int c = channelIndex[rec.sensor][a];
+                if (c < 0)
+                    continue;
+                Channel& ch = channels[c];
+                if (!ch.batch)
+                {
+                    ch.batch.reset (new Batch);
+                    ch.batch->values.reserve (BATCH_SAMPLES);
+                    ch.batch->timesuS.reserve (BATCH_SAMPLES);
+                }
+                ch.batch->values.push_back (rec.value[a]);
+                ch.batch->timesuS.push_back (rec.timeuS);
+
+                if (ch.batch->values.size () == BATCH_SAMPLES)
+                {
+                    std::shared_ptr<Batch> batch = ch.batch;
+                    ChannelAnalyzer* analyzer = ch.analyzer;
+                    pool.post (c, [batch, analyzer] () {
+                        analyzer->addSamples (&batch->values[0], &batch->timesuS[0], batch->values.size ());
+                    });
+                    ch.batch.reset ();
+                }
+            }
+        }
+    }
+
+    // Flush partial batches
+    for (size_t c = 0; c < channels.size (); c++)
+    {
+        if (!channels[c].batch || channels[c].batch->values.empty ())
+            continue;
+        std::shared_ptr<Batch> batch = channels[c].batch;
+        ChannelAnalyzer* analyzer = channels[c].analyzer;
+        pool.post (c, [batch, analyzer] () {
+            analyzer->addSamples (&batch->values[0], &batch->timesuS[0], batch->values.size ());
+        });
+        channels[c].batch.reset ();
+    }
+    pool.wait ();
+
+    double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+    double megabytes = reader.getRecords () * sizeof (CaptureRecord) / 1e6;
+    printf ("# records=%llu skipped_bytes=%llu threads=%u time_s=%.3f throughput_MBps=%.1f\n",
+            reader.getRecords (), reader.getSkippedBytes (), threads, seconds, megabytes / seconds);
+
+    // Parameters per axis in the driver's default physical units
+    for (size_t c = 0; c < channels.size (); c++)
+    {
+        const Channel& ch = channels[c];
+        if (ch.analyzer->getSamples () == 0)
+            continue;
+        ChannelAnalyzer::Result r = ch.analyzer->finish (CaptureReader::sensorScale (ch.sensor));
+        const char* unit = CaptureReader::sensorUnit (ch.sensor);
+
+        printf ("[%s %c]\n", CaptureReader::sensorName (ch.sensor), AXIS_NAMES[ch.axis]);
+        printf ("Samples=%llu\n", (unsigned long long) r.samples);
+        printf ("SampleRateHz=%.3f\n", r.sampleRateHz);
+        printf ("Mean=%.9g %s\n", r.mean, unit);
+        printf ("StdDev=%.9g %s\n", r.stdDev, unit);
+        printf ("MeasurementVariance=%.9g %s^2\n", r.stdDev * r.stdDev, unit);
+        printf ("RandomWalk=%.9g %s/sqrt(Hz)\n", r.randomWalk, unit);
+        printf ("PSDNoiseDensity=%.9g %s/sqrt(Hz)\n", r.psdNoiseDensity, unit);
+        printf ("BiasInstability=%.9g %s at %.3f s\n", r.biasInstability, unit, r.biasInstabilityTauS);
+        printf ("RateRandomWalk=%.9g %s*sqrt(Hz)\n", r.rateRandomWalk, unit);
+        printf ("\n");
+
+        if (!csvPrefix.empty ())
+            writeCsv (csvPrefix, ch, r);
+    }
+
+    for (size_t c = 0; c < channels.size (); c++)
+        delete channels[c].analyzer;
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# Pre-integration: drift under vibration and cost per second
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_preint_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/InsEKF.cpp \
+    $$PWD/../../imu_embedded_sw/PreIntegrator.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/InsEKF.h \
+    $$PWD/../../imu_embedded_sw/PreIntegrator.h \
+    $$PWD/../../imu_embedded_sw/VectorMath.h
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "InsEKF.h"
+#include "PreIntegrator.h"
+
+// The truth steps at a multiple of every sensor rate
+static const int      TRUTH_HZ = 25600;
+static const int      SENSOR_HZ[] = {100, 200, 400, 800, 1600};
+static const int      SENSOR_RATES = sizeof (SENSOR_HZ) / sizeof (SENSOR_HZ[0]);
+static const int      FILTER_HZ_DEFAULT = 100;
+static const double   SECONDS_DEFAULT = 60.0;
+static const int      BENCH_ITERATIONS_DEFAULT = 200000;
+static const double   PI = 3.14159265358979;
+
+// Vibration, small angles at a high frequency, the case the corrections are
+// for.  Coning sweeps the rate vector around z, sculling rolls about x in
+// phase with an acceleration along y.
+static const double   VIBRATION_HZ = 20.0;
+static const double   ANGLE_AMPLITUDE_RAD = 0.01;
+static const double   ACC_AMPLITUDE_MPS2 = 5.0;
+
+typedef Vec3<double> vectord;
+
+typedef enum MOTION_ENUM
+{
+    MOTION_CONING = 0,
+    MOTION_SCULLING,
+    MOTION_BOTH,
+    MOTION_NUM
+} MOTION;
+
+static const char* MOTION_NAMES[MOTION_NUM] = {"coning", "sculling", "both"};
+
+typedef struct options_struct
+{
+    MOTION      motion;
+    int         filterHz;
+    double      seconds;
+    int         iterations;
+} Options;
+
+// Body rate and the non-gravity part of the specific force, body frame
+static void motion (MOTION _motion, double _t, vectord& _rate, vectord& _force)
+{
+    double w = 2 * PI * VIBRATION_HZ;
+    double a = ANGLE_AMPLITUDE_RAD * w;
+    _rate = makeVec3<double> (0.0, 0.0, 0.0);
+    _force = makeVec3<double> (0.0, 0.0, 0.0);
+    if (_motion == MOTION_CONING || _motion == MOTION_BOTH)
+        _rate += makeVec3<double> (a * cos (w * _t), a * sin (w * _t), 0.0);
+    if (_motion == MOTION_SCULLING || _motion == MOTION_BOTH)
+    {
+        _rate.x += a * cos (w * _t);
+        _force.y += ACC_AMPLITUDE_MPS2 * sin (w * _t);
+    }
+}
+
+static InsEKF::vectorf toFloat (const vectord& _v)
+{
+    return makeVec3<float> ((float) _v.x, (float) _v.y, (float) _v.z);
+}
+
+static vectord toDouble (const InsEKF::vectorf& _v)
+{
+    return makeVec3<double> (_v.x, _v.y, _v.z);
+}
+
+// Angle of the rotation between the two, from the vector part of the
+// difference as acos loses small angles in float
+static double angleDeg (const Quaternion<float>& _a, const Quaternion<double>& _b)
+{
+    Quaternion<double> a = {_a.w, _a.x, _a.y, _a.z};
+    Quaternion<double> d = conjugate (normalize (a)) * _b;
+    return 2.0 * atan2 (sqrt (d.x * d.x + d.y * d.y + d.z * d.z), fabs (d.w)) * 180.0 / PI;
+}
+
+// Mean time of one call
+template <typename Call>
+static double timeCalls (int _iterations, Call _call)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    for (int i = 0; i < _iterations; i++)
+        _call (i);
+    return std::chrono::duration<double, std::micro> (std::chrono::steady_clock::now () - start).count () / _iterations;
+}
+
+// One sensor rate: the filter predicting from the mean rate and force of
+// each step (what the sketch did), from pre-integrated increments, and at
+// the sensor rate itself as the most it could do
+static void runRate (const Options& _options, int _sensorHz, double _predictuS, double _addGyrouS, double _takeuS)
+{
+    int substeps = TRUTH_HZ / _sensorHz;
+    int perStep = _sensorHz / _options.filterHz;
+    double h = 1.0 / TRUTH_HZ;
+    double sampleDt = 1.0 / _sensorHz;
+    vectord gravity = makeVec3<double> (0.0, 0.0, InsEKF::GRAVITY_MPS2);
+
+    InsEKF::vectorf up = makeVec3<float> (0.0f, 0.0f, InsEKF::GRAVITY_MPS2);
+    InsEKF::vectorf north = makeVec3<float> (1.0f, 0.0f, 0.0f);
+    InsEKF mean, pre, full;
+    mean.reset (up, north, 0.0f);
+    pre.reset (up, north, 0.0f);
+    full.reset (up, north, 0.0f);
+    PreIntegrator preint;
+
+    Quaternion<double> q = Quaternion<double>::identity ();
+    vectord v = makeVec3<double> (0.0, 0.0, 0.0);
+    vectord gyroSum = v, accSum = v;
+    int sampleCount = 0;
+    long samples = (long) (_options.seconds * _sensorHz);
+    double t = 0.0;
+    for (long n = 0; n < samples; n++)
+    {
+        // An integrating sensor, the mean over the sample
+        vectord dAngle = makeVec3<double> (0.0, 0.0, 0.0);
+        vectord dVel = dAngle;
+        for (int s = 0; s < substeps; s++)
+        {
+            vectord rate, force;
+            motion (_options.motion, t + h / 2, rate, force);
+            Quaternion<double> qMid = q * Quaternion<double>::fromRotationVector (rate * (h / 2));
+            vectord specific = force + rotate (conjugate (qMid), gravity);
+            v += rotate (qMid, force) * h;
+            q = normalize (q * Quaternion<double>::fromRotationVector (rate * h));
+            dAngle += rate * h;
+            dVel += specific * h;
+            t += h;
+        }
+        InsEKF::vectorf gyro = toFloat (dAngle * (1.0 / sampleDt));
+        InsEKF::vectorf acc = toFloat (dVel * (1.0 / sampleDt));
+
+        full.predict ((float) sampleDt, gyro, acc);
+        preint.addAcc (acc);
+        preint.addGyro (gyro, (float) sampleDt);
+        gyroSum += toDouble (gyro);
+        accSum += toDouble (acc);
+        if (++sampleCount < perStep)
+            continue;
+
+        mean.predict ((float) (sampleCount * sampleDt), toFloat (gyroSum * (1.0 / sampleCount)),
+                      toFloat (accSum * (1.0 / sampleCount)));
+        PreIntegrator::Increment increment;
+        preint.take (increment);
+        pre.predictDelta (increment.dt, increment.dAngle, increment.dVelocity);
+        gyroSum = makeVec3<double> (0.0, 0.0, 0.0);
+        accSum = gyroSum;
+        sampleCount = 0;
+    }
+
+    printf ("[%d Hz]\n", _sensorHz);
+    printf ("SamplesPerStep=%d\n", perStep);
+    printf ("MeanRateAttErrDeg=%.4f\n", angleDeg (mean.getAttitude (), q));
+    printf ("PreIntAttErrDeg=%.4f\n", angleDeg (pre.getAttitude (), q));
+    printf ("FullRateAttErrDeg=%.4f\n", angleDeg (full.getAttitude (), q));
+    printf ("MeanRateVelErr=%.4f\n", norm (toDouble (mean.getVelocity ()) - v));
+    printf ("PreIntVelErr=%.4f\n", norm (toDouble (pre.getVelocity ()) - v));
+    printf ("FullRateVelErr=%.4f\n", norm (toDouble (full.getVelocity ()) - v));
+    printf ("FullRatePredictuSPerS=%.0f\n", _predictuS * _sensorHz);
+    printf ("PreIntPredictuSPerS=%.0f\n", _predictuS * _options.filterHz + _addGyrouS * _sensorHz +
+                                          _takeuS * _options.filterHz);
+    printf ("\n");
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-m motion] [-f filter Hz] [-s seconds] [-n iterations]\n", _prog);
+    fprintf (stderr, "  Dead reckons a vibrating IMU with InsEKF (imu_embedded_sw) at each sensor rate,\n");
+    fprintf (stderr, "  stepping the filter on mean rates, on PreIntegrator increments and at every\n");
+    fprintf (stderr, "  sample, and reports the drift from the truth and the time each costs per\n");
+    fprintf (stderr, "  second.\n");
+    fprintf (stderr, "  -m  coning, sculling or both (default both)\n");
+    fprintf (stderr, "  -f  filter rate, a divisor of 100, default %d\n", FILTER_HZ_DEFAULT);
+    fprintf (stderr, "  -s  length, default %.0f s\n", SECONDS_DEFAULT);
+    fprintf (stderr, "  -n  benchmark calls of each kind, default %d\n", BENCH_ITERATIONS_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    Options options;
+    options.motion = MOTION_BOTH;
+    options.filterHz = FILTER_HZ_DEFAULT;
+    options.seconds = SECONDS_DEFAULT;
+    options.iterations = BENCH_ITERATIONS_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "m:f:s:n:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                options.motion = MOTION_NUM;
+                for (int m = 0; m < MOTION_NUM; m++)
+                    if (strcmp (optarg, MOTION_NAMES[m]) == 0)
+                        options.motion = (MOTION) m;
+                break;
+            case 'f':
+                options.filterHz = atoi (optarg);
+                break;
+            case 's':
+                options.seconds = atof (optarg);
+                break;
+            case 'n':
+                options.iterations = atoi (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind != _argc || options.motion == MOTION_NUM || options.filterHz <= 0 ||
+        SENSOR_HZ[0] % options.filterHz != 0 || options.seconds <= 0.0 || options.iterations <= 0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    // Slow rotation so the covariance blocks stay populated
+    InsEKF ekf;
+    InsEKF::vectorf gyro = makeVec3<float> (0.02f, -0.01f, 0.03f);
+    InsEKF::vectorf acc = makeVec3<float> (0.1f, -0.2f, InsEKF::GRAVITY_MPS2);
+    float dt = 1.0f / options.filterHz;
+    double predictuS = timeCalls (options.iterations, [&] (int) {ekf.predict (dt, gyro, acc);});
+    PreIntegrator preint;
+    preint.addAcc (acc);
+    double addGyrouS = timeCalls (options.iterations, [&] (int) {preint.addGyro (gyro, 0.0025f);});
+    PreIntegrator::Increment increment;
+    double takeuS = timeCalls (options.iterations, [&] (int) {preint.addGyro (gyro, 0.0025f); preint.take (increment);}) - addGyrouS;
+
+    printf ("Motion=%s\n", MOTION_NAMES[options.motion]);
+    printf ("FilterHz=%d\n", options.filterHz);
+    printf ("Seconds=%.1f\n", options.seconds);
+    printf ("\n");
+
+    printf ("[timing]\n");
+    printf ("PredictuS=%.3f\n", predictuS);
+    printf ("AddGyrouS=%.4f\n", addGyrouS);
+    printf ("TakeuS=%.4f\n", takeuS);
+    printf ("\n");
+
+    for (int r = 0; r < SENSOR_RATES; r++)
+        runRate (options, SENSOR_HZ[r], predictuS, addGyrouS, takeuS);
+    return 0;
+}
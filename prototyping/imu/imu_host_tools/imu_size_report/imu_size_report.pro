@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# Flash and RAM per object file for each driver configuration
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_size_report
+TEMPLATE = app
+
+
+SOURCES += main.cpp
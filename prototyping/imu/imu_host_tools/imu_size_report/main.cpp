@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// Data objects smaller than this aren't listed, the driver instances and
+// buffers are what matter
+static const uint32_t SYMBOL_MIN_DEFAULT = 64;
+
+// ELF header fields and constants, both classes, little endian only (ARM and
+// the host alike)
+static const uint8_t  ELF_CLASS_32 = 1;
+static const uint8_t  ELF_CLASS_64 = 2;
+static const uint8_t  ELF_DATA_LSB = 1;
+static const uint32_t SHT_SYMTAB = 2;
+static const uint32_t SHT_NOBITS = 8;
+static const uint64_t SHF_WRITE = 0x1;
+static const uint64_t SHF_ALLOC = 0x2;
+static const uint8_t  STT_OBJECT = 1;
+static const uint16_t SHN_LORESERVE = 0xFF00;
+
+typedef struct section_struct
+{
+    uint32_t    type;
+    uint64_t    flags;
+    uint64_t    offset;
+    uint64_t    size;
+    uint32_t    link;
+    uint64_t    entSize;
+} Section;
+
+// What an object file puts in flash (code, constants and the initial values
+// of .data) and in RAM (.data and .bss)
+typedef struct object_size_struct
+{
+    uint64_t    flash;
+    uint64_t    ram;
+    std::map<std::string, uint64_t> data;
+} ObjectSize;
+
+typedef struct config_struct
+{
+    std::string name;
+    std::string dir;
+    std::map<std::string, ObjectSize> objects;
+} Config;
+
+static uint64_t readLE (const std::vector<uint8_t>& _buf, uint64_t _offset, int _bytes)
+{
+    uint64_t value = 0;
+    for (int i = _bytes - 1; i >= 0; i--)
+        value = (value << 8) | _buf[_offset + i];
+    return value;
+}
+
+static bool readFile (const std::string& _path, std::vector<uint8_t>& _buf)
+{
+    FILE* file = fopen (_path.c_str (), "rb");
+    if (!file)
+        return false;
+    fseek (file, 0, SEEK_END);
+    long size = ftell (file);
+    fseek (file, 0, SEEK_SET);
+    _buf.resize (size > 0 ? size : 0);
+    bool ok = size > 0 && fread (&_buf[0], 1, size, file) == (size_t) size;
+    fclose (file);
+    return ok;
+}
+
+static bool parseObject (const std::string& _path, ObjectSize& _size)
+{
+    std::vector<uint8_t> buf;
+    if (!readFile (_path, buf) || buf.size () < 64 || memcmp (&buf[0], "\x7f" "ELF", 4) != 0)
+        return false;
+    bool elf64 = buf[4] == ELF_CLASS_64;
+    if ((buf[4] != ELF_CLASS_32 && !elf64) || buf[5] != ELF_DATA_LSB)
+        return false;
+
+    int addr = elf64 ? 8 : 4;
+    uint64_t shOff = readLE (buf, elf64 ? 0x28 : 0x20, addr);
+    uint64_t shEntSize = readLE (buf, elf64 ? 0x3A : 0x2E, 2);
+    uint64_t shNum = readLE (buf, elf64 ? 0x3C : 0x30, 2);
+    if (shOff == 0 || shOff + shNum * shEntSize > buf.size ())
+        return false;
+
+    std::vector<Section> sections (shNum);
+    for (uint64_t i = 0; i < shNum; i++)
+    {
+        uint64_t base = shOff + i * shEntSize;
+        Section& s = sections[i];
+        s.type = readLE (buf, base + 4, 4);
+        s.flags = readLE (buf, base + 8, addr);
+        s.offset = readLE (buf, base + 8 + 2 * addr, addr);
+        s.size = readLE (buf, base + 8 + 3 * addr, addr);
+        s.link = readLE (buf, base + 8 + 4 * addr, 4);
+        s.entSize = readLE (buf, base + 16 + 5 * addr, addr);
+    }
+
+    _size.flash = 0;
+    _size.ram = 0;
+    for (uint64_t i = 0; i < shNum; i++)
+    {
+        const Section& s = sections[i];
+        if (!(s.flags & SHF_ALLOC))
+            continue;
+        if (s.flags & SHF_WRITE)
+            _size.ram += s.size;
+        if (s.type != SHT_NOBITS)
+            _size.flash += s.size;
+    }
+
+    // Data objects in writable sections: globals such as the driver
+    // instances, and static members
+    for (uint64_t i = 0; i < shNum; i++)
+    {
+        const Section& symtab = sections[i];
+        if (symtab.type != SHT_SYMTAB || symtab.entSize == 0 || symtab.link >= shNum)
+            continue;
+        const Section& strtab = sections[symtab.link];
+        if (symtab.offset + symtab.size > buf.size () || strtab.offset + strtab.size > buf.size ())
+            continue;
+        for (uint64_t e = 0; e < symtab.size / symtab.entSize; e++)
+        {
+            uint64_t base = symtab.offset + e * symtab.entSize;
+            uint32_t name = readLE (buf, base, 4);
+            uint8_t info = buf[base + (elf64 ? 4 : 12)];
+            uint16_t shndx = readLE (buf, base + (elf64 ? 6 : 14), 2);
+            uint64_t size = readLE (buf, base + (elf64 ? 16 : 8), elf64 ? 8 : 4);
+            if ((info & 0xF) != STT_OBJECT || shndx == 0 || shndx >= SHN_LORESERVE || shndx >= shNum)
+                continue;
+            if (!(sections[shndx].flags & SHF_WRITE) || name >= strtab.size)
+                continue;
+            const char* str = (const char*) &buf[strtab.offset + name];
+            _size.data[std::string (str, strnlen (str, strtab.size - name))] = size;
+        }
+    }
+    return true;
+}
+
+// The Arduino build names objects after their source, ADXL345.cpp.o and
+// imu_embedded_sw.ino.cpp.o, so the name is everything up to the first dot
+static bool loadConfig (Config& _config)
+{
+    DIR* dir = opendir (_config.dir.c_str ());
+    if (!dir)
+    {
+        fprintf (stderr, "Can't open %s\n", _config.dir.c_str ());
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir (dir)) != NULL)
+    {
+        std::string file = entry->d_name;
+        if (file.size () < 3 || file.compare (file.size () - 2, 2, ".o") != 0)
+            continue;
+        ObjectSize size;
+        if (!parseObject (_config.dir + "/" + file, size))
+        {
+            fprintf (stderr, "Skipping %s/%s, not a little endian ELF object\n", _config.dir.c_str (), file.c_str ());
+            continue;
+        }
+        _config.objects[file.substr (0, file.find ('.'))] = size;
+    }
+    closedir (dir);
+    if (_config.objects.empty ())
+    {
+        fprintf (stderr, "No objects in %s\n", _config.dir.c_str ());
+        return false;
+    }
+    return true;
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-m min bytes] name=dir [name=dir ...]\n", _prog);
+    fprintf (stderr, "  Lists the flash and RAM each object file takes in each build of the sketch,\n");
+    fprintf (stderr, "  and against the first build.  Build imu_embedded_sw once per ImuConfig.h\n");
+    fprintf (stderr, "  setting, with the IMU_CFG_* defines set there or added to the compiler\n");
+    fprintf (stderr, "  flags of every file, keeping the objects (the IDE's build path, sketch/).\n");
+    fprintf (stderr, "  Flash is counted before the linker drops unused functions.  Driver members\n");
+    fprintf (stderr, "  are RAM of the sketch, its globals are listed under [Data].\n");
+    fprintf (stderr, "  -m  smallest data object listed, default %u bytes\n", SYMBOL_MIN_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    uint32_t symbolMin = SYMBOL_MIN_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "m:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                symbolMin = atoi (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= _argc)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    std::vector<Config> configs;
+    for (int i = optind; i < _argc; i++)
+    {
+        const char* eq = strchr (_argv[i], '=');
+        if (!eq || eq == _argv[i] || !eq[1])
+        {
+            usage (_argv[0]);
+            return 1;
+        }
+        Config config;
+        config.name = std::string (_argv[i], eq - _argv[i]);
+        config.dir = eq + 1;
+        if (!loadConfig (config))
+            return 1;
+        configs.push_back (config);
+    }
+
+    // Objects and data symbols of all builds, a file built out of one
+    // counts as empty there
+    std::vector<std::string> objects;
+    std::vector<std::string> symbols;
+    for (size_t c = 0; c < configs.size (); c++)
+    {
+        std::map<std::string, ObjectSize>::const_iterator o;
+        for (o = configs[c].objects.begin (); o != configs[c].objects.end (); ++o)
+        {
+            objects.push_back (o->first);
+            std::map<std::string, uint64_t>::const_iterator d;
+            for (d = o->second.data.begin (); d != o->second.data.end (); ++d)
+            {
+                if (d->second >= symbolMin)
+                    symbols.push_back (o->first + ":" + d->first);
+            }
+        }
+    }
+    std::sort (objects.begin (), objects.end ());
+    objects.erase (std::unique (objects.begin (), objects.end ()), objects.end ());
+    std::sort (symbols.begin (), symbols.end ());
+    symbols.erase (std::unique (symbols.begin (), symbols.end ()), symbols.end ());
+
+    printf ("Builds=%u\n", (unsigned) configs.size ());
+    for (size_t c = 0; c < configs.size (); c++)
+        printf ("%sDir=%s\n", configs[c].name.c_str (), configs[c].dir.c_str ());
+    printf ("\n");
+
+    std::vector<uint64_t> totalFlash (configs.size (), 0);
+    std::vector<uint64_t> totalRAM (configs.size (), 0);
+    for (size_t i = 0; i < objects.size (); i++)
+    {
+        printf ("[%s]\n", objects[i].c_str ());
+        for (size_t c = 0; c < configs.size (); c++)
+        {
+            std::map<std::string, ObjectSize>::const_iterator o = configs[c].objects.find (objects[i]);
+            uint64_t flash = (o != configs[c].objects.end ()) ? o->second.flash : 0;
+            uint64_t ram = (o != configs[c].objects.end ()) ? o->second.ram : 0;
+            totalFlash[c] += flash;
+            totalRAM[c] += ram;
+            printf ("%sFlash=%llu\n", configs[c].name.c_str (), (unsigned long long) flash);
+            printf ("%sRAM=%llu\n", configs[c].name.c_str (), (unsigned long long) ram);
+        }
+        printf ("\n");
+    }
+
+    printf ("[Total]\n");
+    for (size_t c = 0; c < configs.size (); c++)
+    {
+        printf ("%sFlash=%llu\n", configs[c].name.c_str (), (unsigned long long) totalFlash[c]);
+        printf ("%sRAM=%llu\n", configs[c].name.c_str (), (unsigned long long) totalRAM[c]);
+        if (c > 0)
+        {
+            printf ("%sFlashSaved=%lld\n", configs[c].name.c_str (), (long long) (totalFlash[0] - totalFlash[c]));
+            printf ("%sRAMSaved=%lld\n", configs[c].name.c_str (), (long long) (totalRAM[0] - totalRAM[c]));
+        }
+    }
+    printf ("\n");
+
+    // Each data object with its size in every build, 0 where it's gone
+    printf ("[Data]\n");
+    for (size_t i = 0; i < symbols.size (); i++)
+    {
+        size_t colon = symbols[i].find (':');
+        std::string object = symbols[i].substr (0, colon);
+        std::string symbol = symbols[i].substr (colon + 1);
+        printf ("%s=", symbols[i].c_str ());
+        for (size_t c = 0; c < configs.size (); c++)
+        {
+            uint64_t size = 0;
+            std::map<std::string, ObjectSize>::const_iterator o = configs[c].objects.find (object);
+            if (o != configs[c].objects.end ())
+            {
+                std::map<std::string, uint64_t>::const_iterator d = o->second.data.find (symbol);
+                if (d != o->second.data.end ())
+                    size = d->second;
+            }
+            printf ("%s%s:%llu", c ? " " : "", configs[c].name.c_str (), (unsigned long long) size);
+        }
+        printf ("\n");
+    }
+    return 0;
+}
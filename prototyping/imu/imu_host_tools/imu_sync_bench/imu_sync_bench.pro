@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Synchronized sampling: interrupts and bus transactions against independent ISRs
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+include(../common/arduino_host.pri)
+
+TARGET = imu_sync_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/SyncSampler.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/SyncSampler.h
@@ -0,0 +1,452 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "SyncSampler.h"
+#include "sim_sensors.h"
+
+// What the sketch's setup () configures: the gyro at its 100 Hz default,
+// the accelerometer at 50 Hz and the barometer at OSSR 3 with a temperature
+// every 16 pressures, all on one I2C bus
+static const double   GYRO_HZ_DEFAULT = 100.0;
+static const double   ACC_HZ_DEFAULT = 50.0;
+static const int      BAR_OSSR_DEFAULT = BMP085::OSSR_ULTRA_HIGH_RES;
+static const uint8_t  BAR_TEMP_DECIMATION = 16;
+static const uint32_t I2C_CLOCK_HZ_DEFAULT = 100000;
+static const double   SECONDS_DEFAULT = 10.0;
+
+// The sketch's data ready pins
+static const uint8_t  INT1_PIN = 11;
+static const uint8_t  EOC_PIN = 14;
+
+// The sensors run off their own oscillators, so their phases drift against
+// the MCU's timer and each other
+static const double   GYRO_CLOCK_ERROR = 0.004;
+static const double   ACC_CLOCK_ERROR = -0.006;
+
+// Entry, exit and the pin dispatch of an ISR on a Teensy 3, and a digitalRead
+static const double   ISR_ENTRY_US = 1.5;
+static const double   PIN_READ_US = 0.1;
+
+typedef struct options_struct
+{
+    L3G4200D::OUTPUT_RATE   gyroRate;
+    ADXL345::OUTPUT_RATE    accRate;
+    BMP085::OSSR_SETTING    barOSSR;
+    uint32_t                i2cHz;
+    double                  seconds;
+} Options;
+
+typedef struct result_struct
+{
+    uint64_t    interrupts;
+    uint64_t    transactions;
+    uint64_t    bytes;
+    double      busuS;
+    double      isruS;
+    uint64_t    delayedEntries;
+    double      delaySumuS;
+    double      delayMaxuS;
+    double      accLatencyMeanuS;
+    double      accLatencyMaxuS;
+    uint64_t    gyroSamples;
+    uint64_t    gyroLost;
+    uint64_t    accSamples;
+    uint64_t    accLost;
+    uint64_t    pressureSamples;
+} Result;
+
+static double accRateHz (ADXL345::OUTPUT_RATE _rate)
+{
+    return 3200.0 / (1 << (ADXL345::RATE_3200HZ - _rate));
+}
+
+// The drivers set up as the sketch does, with and without IMU_SYNC_SAMPLING,
+// over one simulated part each on one bus.  The tool moves the clock from
+// one sample, conversion or interrupt to the next.  Same priority ISRs don't
+// preempt each other on the board, a late one waits for the running one to
+// finish, so that wait is what the independent setup loses.
+class Simulation
+{
+public:
+    Simulation (const Options& _options, bool _sync);
+    ~Simulation ();
+
+    Result run ();
+private:
+    // The sketch's ISRs and callbacks
+    static void gyroISR ();
+    static void accISR ();
+    static void barISR ();
+    static void tickISR ();
+    static void gyroCallback (L3G4200D::vector16b _rawRotVel);
+    static void frameCallback (const SyncSampler::Frame& _frame);
+
+    // Bus time of all three since the last call
+    double busTime ();
+
+    // Starts an interrupt due at _dueuS, returns when it can run
+    double enter (double _dueuS);
+    void leave (double _startuS, double _durationuS);
+
+    static Simulation*  s_sim;
+
+    Options         m_options;
+    bool            m_sync;
+    Result          m_result;
+    SimL3G4200D     m_gyroBus;
+    SimADXL345      m_accBus;
+    SimBMP085       m_barBus;
+    L3G4200D        m_gyro;
+    ADXL345         m_acc;
+    BMP085          m_bar;
+    SyncSampler     m_sampler;
+    double          m_busyUntiluS;
+};
+
+Simulation* Simulation::s_sim = NULL;
+
+Simulation::Simulation (const Options& _options, bool _sync)
+    : m_options (_options),
+      m_sync (_sync),
+      m_gyroBus (SimTransport::BUS_I2C, _options.i2cHz),
+      m_accBus (SimTransport::BUS_I2C, _options.i2cHz, INT1_PIN),
+      m_barBus (_options.i2cHz, EOC_PIN),
+      m_gyro (&m_gyroBus),
+      m_acc (&m_accBus),
+      m_bar (&m_barBus),
+      m_sampler (&m_gyro),
+      m_busyUntiluS (0.0)
+{
+    memset (&m_result, 0, sizeof (m_result));
+    s_sim = this;
+    hostSetMicros (0);
+
+    m_gyro.setOutputRate (_options.gyroRate);
+    m_gyro.init ();
+    m_acc.setRange (ADXL345::RANGE_4G);
+    m_acc.setFullRes (true);
+    m_acc.setLPFilter (true);
+    m_acc.setOutputRate (_options.accRate);
+    m_bar.setAsyncOSSR (_options.barOSSR);
+    m_bar.setAvgFilter (true);
+    m_bar.setTempDecimation (BAR_TEMP_DECIMATION);
+    if (m_sync)
+    {
+        m_acc.initAsync (INT1_PIN, NULL);
+        m_bar.initAsync (EOC_PIN, NULL);
+        m_sampler.setAccelerometer (&m_acc, INT1_PIN);
+        m_sampler.setBarometer (&m_bar, EOC_PIN);
+        m_sampler.registerFrameCallback (frameCallback);
+        m_sampler.begin (tickISR);
+    }
+    else
+    {
+        // Polled at its output rate as the rate governor sets it, at the
+        // driver's default the gyro would only be read at 10 Hz
+        m_gyro.registerRotationalVelocityCallback (gyroCallback);
+        m_gyro.initAsync (0, gyroISR);
+        m_gyro.setPollInterval ((uint32_t) (1000000.0 / L3G4200D::getOutputRateHz (_options.gyroRate)));
+        m_acc.initAsync (INT1_PIN, accISR);
+        m_bar.initAsync (EOC_PIN, barISR);
+    }
+
+    // Setup's traffic isn't counted
+    m_gyroBus.resetStats ();
+    m_accBus.resetStats ();
+    m_barBus.resetStats ();
+    busTime ();
+    m_result.busuS = 0.0;
+}
+
+Simulation::~Simulation ()
+{
+    // The other setup's run mustn't find these attached
+    detachInterrupt (INT1_PIN);
+    detachInterrupt (EOC_PIN);
+}
+
+void Simulation::gyroISR ()
+{
+    s_sim->m_gyro.int2ISR ();
+}
+
+void Simulation::accISR ()
+{
+    s_sim->m_acc.int1ISR ();
+}
+
+void Simulation::barISR ()
+{
+    s_sim->m_bar.eocISR ();
+}
+
+void Simulation::tickISR ()
+{
+    s_sim->m_sampler.tick ();
+}
+
+void Simulation::gyroCallback (L3G4200D::vector16b)
+{
+    s_sim->m_result.gyroSamples++;
+}
+
+void Simulation::frameCallback (const SyncSampler::Frame& _frame)
+{
+    if (_frame.fresh & SyncSampler::FRESH_GYRO)
+        s_sim->m_result.gyroSamples++;
+}
+
+double Simulation::busTime ()
+{
+    double uS = (m_gyroBus.getBusTimeNs () + m_accBus.getBusTimeNs () + m_barBus.getBusTimeNs ()) / 1000.0;
+    m_gyroBus.resetBusTime ();
+    m_accBus.resetBusTime ();
+    m_barBus.resetBusTime ();
+    m_result.busuS += uS;
+    return uS;
+}
+
+double Simulation::enter (double _dueuS)
+{
+    double startuS = std::max (_dueuS, m_busyUntiluS);
+    if (startuS > _dueuS)
+    {
+        m_result.delayedEntries++;
+        m_result.delaySumuS += startuS - _dueuS;
+        m_result.delayMaxuS = std::max (m_result.delayMaxuS, startuS - _dueuS);
+    }
+    m_result.interrupts++;
+    return startuS;
+}
+
+void Simulation::leave (double _startuS, double _durationuS)
+{
+    m_busyUntiluS = _startuS + _durationuS;
+    m_result.isruS += _durationuS;
+}
+
+Result Simulation::run ()
+{
+    double enduS = m_options.seconds * 1e6;
+    HostISR timerISR = m_sync ? tickISR : gyroISR;
+    double gyroSampleuS = 1e6 / (L3G4200D::getOutputRateHz (m_options.gyroRate) * (1.0 + GYRO_CLOCK_ERROR));
+    double accSampleuS = 1e6 / (accRateHz (m_options.accRate) * (1.0 + ACC_CLOCK_ERROR));
+    double nextGyrouS = gyroSampleuS;
+    double nextAccuS = accSampleuS;
+    double nextTickuS = hostTimerPeriod (timerISR);
+
+    // Pin interrupts waiting to run, only the independent setup attaches any
+    bool accPending = false;
+    double accDueuS = 0.0;
+    bool barPending = false;
+    double barDueuS = 0.0;
+
+    Vec3<int16_t> rest = makeVec3<int16_t> (3, -2, 256);
+    while (true)
+    {
+        HostISR isr = timerISR;
+        double dueuS = nextTickuS;
+        if (accPending && accDueuS < dueuS)
+        {
+            isr = accISR;
+            dueuS = accDueuS;
+        }
+        if (barPending && barDueuS < dueuS)
+        {
+            isr = barISR;
+            dueuS = barDueuS;
+        }
+        double startuS = std::max (dueuS, m_busyUntiluS);
+
+        // Samples and conversions up to then land first
+        double deviceuS = std::min (nextGyrouS, nextAccuS);
+        if (m_barBus.converting ())
+            deviceuS = std::min (deviceuS, (double) m_barBus.getEOCuS ());
+        if (deviceuS <= startuS && deviceuS < enduS)
+        {
+            hostSetMicros ((uint32_t) deviceuS);
+            if (deviceuS == nextGyrouS)
+            {
+                m_gyroBus.produce (rest);
+                nextGyrouS += gyroSampleuS;
+            }
+            else if (deviceuS == nextAccuS)
+            {
+                if (m_accBus.produce (rest) && hostPinISR (INT1_PIN) && !accPending)
+                {
+                    accPending = true;
+                    accDueuS = deviceuS;
+                }
+                nextAccuS += accSampleuS;
+            }
+            else if (m_barBus.update () && hostPinISR (EOC_PIN) && !barPending)
+            {
+                barPending = true;
+                barDueuS = deviceuS;
+            }
+            continue;
+        }
+        if (dueuS >= enduS)
+            break;
+
+        startuS = enter (dueuS);
+        hostSetMicros ((uint32_t) startuS);
+        if (isr == accISR)
+            accPending = false;
+        else if (isr == barISR)
+            barPending = false;
+        else
+            nextTickuS += hostTimerPeriod (timerISR);
+        isr ();
+
+        // The sweep reads both pins
+        double uS = ISR_ENTRY_US + (m_sync ? 2 * PIN_READ_US : 0.0) + busTime ();
+        leave (startuS, uS);
+    }
+
+    m_result.transactions = m_gyroBus.getTransactions () + m_accBus.getTransactions () + m_barBus.getTransactions ();
+    m_result.bytes = m_gyroBus.getBytes () + m_accBus.getBytes () + m_barBus.getBytes ();
+    m_result.gyroLost = m_gyroBus.getDropped ();
+    m_result.accSamples = m_accBus.getRead ();
+    m_result.accLost = m_accBus.getDropped ();
+    m_result.accLatencyMeanuS = m_accBus.getLatencyMeanuS ();
+    m_result.accLatencyMaxuS = m_accBus.getLatencyMaxuS ();
+    m_result.pressureSamples = m_bar.getPressureSampleCount ();
+    return m_result;
+}
+
+static void printResult (const char* _name, const Result& _r, double _seconds)
+{
+    printf ("[%s]\n", _name);
+    printf ("InterruptsPerS=%.1f\n", _r.interrupts / _seconds);
+    printf ("TransactionsPerS=%.1f\n", _r.transactions / _seconds);
+    printf ("BusBytesPerS=%.1f\n", _r.bytes / _seconds);
+    printf ("BusLoad=%.4f\n", _r.busuS / (_seconds * 1e6));
+    printf ("ISRLoad=%.4f\n", _r.isruS / (_seconds * 1e6));
+    printf ("DelayedEntriesPerS=%.1f\n", _r.delayedEntries / _seconds);
+    printf ("DelayMeanuS=%.1f\n", _r.delayedEntries ? _r.delaySumuS / _r.delayedEntries : 0.0);
+    printf ("DelayMaxuS=%.1f\n", _r.delayMaxuS);
+    printf ("AccLatencyMeanuS=%.1f\n", _r.accLatencyMeanuS);
+    printf ("AccLatencyMaxuS=%.1f\n", _r.accLatencyMaxuS);
+    printf ("GyroHz=%.1f\n", _r.gyroSamples / _seconds);
+    printf ("GyroLostPerS=%.2f\n", _r.gyroLost / _seconds);
+    printf ("AccHz=%.1f\n", _r.accSamples / _seconds);
+    printf ("AccLostPerS=%.2f\n", _r.accLost / _seconds);
+    printf ("PressureHz=%.2f\n", _r.pressureSamples / _seconds);
+    printf ("\n");
+}
+
+static bool gyroRate (double _hz, L3G4200D::OUTPUT_RATE& _rate)
+{
+    for (int r = 0; r < L3G4200D::RATE_NUM; r++)
+    {
+        if (L3G4200D::getOutputRateHz ((L3G4200D::OUTPUT_RATE) r) == _hz)
+        {
+            _rate = (L3G4200D::OUTPUT_RATE) r;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The part's rates halve down from 3200 Hz, near enough takes the slowest
+// ones by their rounded names (0.1 for 0.098)
+static bool accRate (double _hz, ADXL345::OUTPUT_RATE& _rate)
+{
+    for (int r = 0; r < ADXL345::RATE_NUM; r++)
+    {
+        double hz = accRateHz ((ADXL345::OUTPUT_RATE) r);
+        if (_hz > hz * 0.95 && _hz < hz * 1.05)
+        {
+            _rate = (ADXL345::OUTPUT_RATE) r;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-g gyro Hz] [-a acc Hz] [-o OSSR] [-c I2C Hz] [-s seconds]\n", _prog);
+    fprintf (stderr, "  Runs the sketch's gyro, accelerometer and barometer drivers (imu_embedded_sw)\n");
+    fprintf (stderr, "  over simulated parts on one I2C bus, once from their own ISRs and once swept\n");
+    fprintf (stderr, "  from the gyro timer by SyncSampler, and reports interrupts, bus transactions\n");
+    fprintf (stderr, "  and latencies.\n");
+    fprintf (stderr, "  -g  gyro rate, 100, 200, 400 or 800, default %.0f Hz\n", GYRO_HZ_DEFAULT);
+    fprintf (stderr, "  -a  accelerometer rate, 3200 halved down to 0.1, default %.0f Hz\n", ACC_HZ_DEFAULT);
+    fprintf (stderr, "  -o  barometer OSSR, 0 to 3, default %d\n", BAR_OSSR_DEFAULT);
+    fprintf (stderr, "  -c  I2C clock, default %u Hz\n", I2C_CLOCK_HZ_DEFAULT);
+    fprintf (stderr, "  -s  length, default %.0f s\n", SECONDS_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    double gyroHz = GYRO_HZ_DEFAULT;
+    double accHz = ACC_HZ_DEFAULT;
+    int ossr = BAR_OSSR_DEFAULT;
+    Options options;
+    options.i2cHz = I2C_CLOCK_HZ_DEFAULT;
+    options.seconds = SECONDS_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "g:a:o:c:s:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'g':
+                gyroHz = atof (optarg);
+                break;
+            case 'a':
+                accHz = atof (optarg);
+                break;
+            case 'o':
+                ossr = atoi (optarg);
+                break;
+            case 'c':
+                options.i2cHz = (uint32_t) atol (optarg);
+                break;
+            case 's':
+                options.seconds = atof (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind != _argc || !gyroRate (gyroHz, options.gyroRate) || !accRate (accHz, options.accRate) ||
+        accHz > gyroHz || ossr < 0 || ossr >= BMP085::OSSR_NUM || options.i2cHz == 0 || options.seconds <= 0.0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+    options.barOSSR = (BMP085::OSSR_SETTING) ossr;
+
+    printf ("GyroHz=%.1f\n", gyroHz);
+    printf ("AccHz=%.1f\n", accRateHz (options.accRate));
+    printf ("BarOSSR=%d\n", ossr);
+    printf ("I2CHz=%u\n", options.i2cHz);
+    printf ("\n");
+
+    Result ri;
+    {
+        Simulation independent (options, false);
+        ri = independent.run ();
+    }
+    printResult ("independent", ri, options.seconds);
+    Result rs;
+    {
+        Simulation sync (options, true);
+        rs = sync.run ();
+    }
+    printResult ("synchronized", rs, options.seconds);
+
+    printf ("[synchronized over independent]\n");
+    printf ("Interrupts=%.3f\n", (double) rs.interrupts / ri.interrupts);
+    printf ("Transactions=%.3f\n", (double) rs.transactions / ri.transactions);
+    printf ("BusBytes=%.3f\n", (double) rs.bytes / ri.bytes);
+    printf ("ISRLoad=%.3f\n", rs.isruS / ri.isruS);
+    return 0;
+}
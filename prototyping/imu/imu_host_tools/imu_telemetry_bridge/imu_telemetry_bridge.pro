@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Fans the board's telemetry out to local clients (Linux, epoll)
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_telemetry_bridge
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    telemetry_bridge.cpp
+
+HEADERS += telemetry_bridge.h
@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "telemetry_bridge.h"
+
+static const int    BAUD_DEFAULT = 115200;
+static const size_t REPLAY_BYTES_PER_S_DEFAULT = 11520;    // 115200 baud, 8N1
+static const int    MULTICAST_TTL_DEFAULT = 1;
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s -i serial|fifo|file|- [-b baud] [-r replay_bytes_per_s] [-l]\n", _prog);
+    fprintf (stderr, "          [-t tcp_port] [-u unix_socket] [-m group:port] [-T ttl]\n");
+    fprintf (stderr, "          [-q client_queue_bytes] [-p drop|disconnect] [-s stats_seconds]\n");
+    fprintf (stderr, "  Reads the board's telemetry once and fans it out to every TCP, Unix socket\n");
+    fprintf (stderr, "  and multicast subscriber.  A regular file stands in for the board and is\n");
+    fprintf (stderr, "  replayed at the given rate (-l loops it).  -t, -u and -m may be repeated.\n");
+}
+
+int main (int argc, char* argv[])
+{
+    std::string input;
+    int baud = BAUD_DEFAULT;
+    size_t replayRate = REPLAY_BYTES_PER_S_DEFAULT;
+    bool loop = false;
+    std::vector<int> tcpPorts;
+    std::vector<std::string> unixPaths;
+    std::vector<std::string> groups;
+    int ttl = MULTICAST_TTL_DEFAULT;
+    size_t queueBytes = TelemetryBridge::CLIENT_QUEUE_BYTES_DEFAULT;
+    TelemetryBridge::OVERFLOW_POLICY policy = TelemetryBridge::OVERFLOW_DROP;
+    int statsS = 0;
+
+    int opt;
+    while ((opt = getopt (argc, argv, "i:b:r:lt:u:m:T:q:p:s:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i':
+                input = optarg;
+                break;
+            case 'b':
+                baud = atoi (optarg);
+                break;
+            case 'r':
+                replayRate = strtoul (optarg, NULL, 0);
+                break;
+            case 'l':
+                loop = true;
+                break;
+            case 't':
+                tcpPorts.push_back (atoi (optarg));
+                break;
+            case 'u':
+                unixPaths.push_back (optarg);
+                break;
+            case 'm':
+                groups.push_back (optarg);
+                break;
+            case 'T':
+                ttl = atoi (optarg);
+                break;
+            case 'q':
+                queueBytes = strtoul (optarg, NULL, 0);
+                break;
+            case 'p':
+                if (!strcmp (optarg, "drop"))
+                    policy = TelemetryBridge::OVERFLOW_DROP;
+                else if (!strcmp (optarg, "disconnect"))
+                    policy = TelemetryBridge::OVERFLOW_DISCONNECT;
+                else
+                {
+                    usage (argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                statsS = atoi (optarg);
+                break;
+            default:
+                usage (argv[0]);
+                return 1;
+        }
+    }
+    if (input.empty () || (tcpPorts.empty () && unixPaths.empty () && groups.empty ()) || replayRate == 0)
+    {
+        usage (argv[0]);
+        return 1;
+    }
+
+    TelemetryBridge bridge;
+    bridge.setClientQueueBytes (queueBytes);
+    bridge.setOverflowPolicy (policy);
+    bridge.setStatsInterval (statsS);
+
+    if (!bridge.openInput (input, baud, replayRate, loop))
+        return 1;
+    for (size_t i = 0; i < tcpPorts.size (); i++)
+        if (!bridge.listenTcp (tcpPorts[i]))
+            return 1;
+    for (size_t i = 0; i < unixPaths.size (); i++)
+        if (!bridge.listenUnix (unixPaths[i]))
+            return 1;
+    for (size_t i = 0; i < groups.size (); i++)
+    {
+        size_t colon = groups[i].find (':');
+        if (colon == std::string::npos ||
+            !bridge.addMulticast (groups[i].substr (0, colon), atoi (groups[i].c_str () + colon + 1), ttl))
+        {
+            usage (argv[0]);
+            return 1;
+        }
+    }
+
+    return bridge.run ();
+}
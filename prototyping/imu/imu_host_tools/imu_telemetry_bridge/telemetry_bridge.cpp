@@ -0,0 +1,598 @@
+#include "telemetry_bridge.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serial_port.h"
+
+// Bounds the work done per wakeup so one busy fd can't starve the rest
+static const int MAX_READS_PER_EVENT = 16;
+static const int MAX_EVENTS = 64;
+static const int MAX_IOVECS = 64;
+
+static bool setNonBlocking (int _fd)
+{
+    int flags = fcntl (_fd, F_GETFL);
+    return flags >= 0 && fcntl (_fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int startTimer (int _intervalMs)
+{
+    int fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = _intervalMs / 1000;
+    spec.it_interval.tv_nsec = (_intervalMs % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    timerfd_settime (fd, 0, &spec, NULL);
+    return fd;
+}
+
+TelemetryBridge::TelemetryBridge ()
+    : m_epollFd (epoll_create1 (EPOLL_CLOEXEC)),
+      m_signalFd (-1),
+      m_inputFd (-1),
+      m_inputReplay (false),
+      m_inputLoop (false),
+      m_inputDone (false),
+      m_replayTimerFd (-1),
+      m_replayBytesPerTick (0),
+      m_statsTimerFd (-1),
+      m_statsIntervalS (0),
+      m_clientQueueBytes (CLIENT_QUEUE_BYTES_DEFAULT),
+      m_overflowPolicy (OVERFLOW_DROP),
+      m_inputBytes (0)
+{
+}
+
+TelemetryBridge::~TelemetryBridge ()
+{
+    for (std::unordered_map<int, Client*>::iterator it = m_clients.begin (); it != m_clients.end (); ++it)
+    {
+        close (it->first);
+        delete it->second;
+    }
+    for (size_t i = 0; i < m_listenFds.size (); i++)
+        close (m_listenFds[i]);
+    for (size_t i = 0; i < m_multicasts.size (); i++)
+        close (m_multicasts[i].fd);
+    if (!m_unixPath.empty ())
+        unlink (m_unixPath.c_str ());
+
+    int fds[] = {m_inputFd, m_replayTimerFd, m_statsTimerFd, m_signalFd, m_epollFd};
+    for (size_t i = 0; i < sizeof (fds) / sizeof (fds[0]); i++)
+        if (fds[i] >= 0)
+            close (fds[i]);
+}
+
+bool TelemetryBridge::addFd (int _fd, uint32_t _events)
+{
+    struct epoll_event ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = _events;
+    ev.data.fd = _fd;
+    return epoll_ctl (m_epollFd, EPOLL_CTL_ADD, _fd, &ev) == 0;
+}
+
+bool TelemetryBridge::openInput (const std::string& _path, int _baud, size_t _replayBytesPerS, bool _loop)
+{
+    int fd = (_path == "-") ? dup (STDIN_FILENO) : open (_path.c_str (), O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror (_path.c_str ());
+        return false;
+    }
+
+    struct stat st;
+    fstat (fd, &st);
+    if (S_ISREG (st.st_mode))
+    {
+        // epoll can't wait on regular files, pace the reads off a timer instead
+        m_inputReplay = true;
+        m_inputLoop = _loop;
+        m_replayBytesPerTick = std::max<size_t> (1, _replayBytesPerS * REPLAY_TICK_MS / 1000);
+        m_replayTimerFd = startTimer (REPLAY_TICK_MS);
+        m_inputFd = fd;
+        return m_replayTimerFd >= 0 && addFd (m_replayTimerFd, EPOLLIN);
+    }
+
+    if (isatty (fd) && !configureSerialPort (fd, _baud, _path.c_str ()))
+    {
+        close (fd);
+        return false;
+    }
+
+    setNonBlocking (fd);
+    m_inputFd = fd;
+    return addFd (fd, EPOLLIN);
+}
+
+bool TelemetryBridge::listenTcp (uint16_t _port)
+{
+    int fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_ANY);
+    addr.sin_port = htons (_port);
+    if (fd < 0 || bind (fd, (struct sockaddr*) &addr, sizeof (addr)) != 0 || listen (fd, 16) != 0 || !addFd (fd, EPOLLIN))
+    {
+        perror ("tcp listen");
+        if (fd >= 0)
+            close (fd);
+        return false;
+    }
+    m_listenFds.push_back (fd);
+    return true;
+}
+
+bool TelemetryBridge::listenUnix (const std::string& _path)
+{
+    struct sockaddr_un addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (_path.size () >= sizeof (addr.sun_path))
+    {
+        fprintf (stderr, "%s: socket path too long\n", _path.c_str ());
+        return false;
+    }
+    strcpy (addr.sun_path, _path.c_str ());
+
+    // A stale socket from a previous run would fail the bind
+    unlink (_path.c_str ());
+    int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind (fd, (struct sockaddr*) &addr, sizeof (addr)) != 0 || listen (fd, 16) != 0 || !addFd (fd, EPOLLIN))
+    {
+        perror (_path.c_str ());
+        if (fd >= 0)
+            close (fd);
+        return false;
+    }
+    m_listenFds.push_back (fd);
+    m_unixPath = _path;
+    return true;
+}
+
+bool TelemetryBridge::addMulticast (const std::string& _group, uint16_t _port, int _ttl)
+{
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (_port);
+    if (inet_pton (AF_INET, _group.c_str (), &addr.sin_addr) != 1 || !IN_MULTICAST (ntohl (addr.sin_addr.s_addr)))
+    {
+        fprintf (stderr, "%s: not an IPv4 multicast group\n", _group.c_str ());
+        return false;
+    }
+
+    int fd = socket (AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unsigned char ttl = _ttl;
+    unsigned char loop = 1;     // Subscribers on this host too
+    if (fd < 0 ||
+        setsockopt (fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof (ttl)) != 0 ||
+        setsockopt (fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof (loop)) != 0 ||
+        connect (fd, (struct sockaddr*) &addr, sizeof (addr)) != 0)
+    {
+        perror ("multicast");
+        if (fd >= 0)
+            close (fd);
+        return false;
+    }
+
+    Multicast mc;
+    mc.fd = fd;
+    mc.name = "udp " + _group + ":" + std::to_string (_port);
+    mc.sentBytes = 0;
+    mc.droppedBytes = 0;
+    m_multicasts.push_back (mc);
+    return true;
+}
+
+int TelemetryBridge::run ()
+{
+    if (m_inputFd < 0)
+        return 1;
+
+    // Clients going away show up as write errors, not signals
+    signal (SIGPIPE, SIG_IGN);
+    sigset_t mask;
+    sigemptyset (&mask);
+    sigaddset (&mask, SIGINT);
+    sigaddset (&mask, SIGTERM);
+    sigprocmask (SIG_BLOCK, &mask, NULL);
+    m_signalFd = signalfd (-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    addFd (m_signalFd, EPOLLIN);
+
+    if (m_statsIntervalS > 0)
+    {
+        m_statsTimerFd = startTimer (m_statsIntervalS * 1000);
+        addFd (m_statsTimerFd, EPOLLIN);
+    }
+
+    // Once the input ends, give the clients a moment to take what is queued
+    struct timespec drainStart;
+    bool draining = false;
+    bool stop = false;
+    while (!stop)
+    {
+        int timeoutMs = -1;
+        if (m_inputDone)
+        {
+            struct timespec now;
+            clock_gettime (CLOCK_MONOTONIC, &now);
+            if (!draining)
+            {
+                drainStart = now;
+                draining = true;
+            }
+            long elapsedMs = (now.tv_sec - drainStart.tv_sec) * 1000 + (now.tv_nsec - drainStart.tv_nsec) / 1000000;
+            if (drained () || elapsedMs > DRAIN_TIMEOUT_MS)
+                break;
+            timeoutMs = 100;
+        }
+
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait (m_epollFd, events, MAX_EVENTS, timeoutMs);
+        if (n < 0 && errno != EINTR)
+        {
+            perror ("epoll_wait");
+            return 1;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            uint64_t expirations;
+
+            if (fd == m_signalFd)
+            {
+                stop = true;
+            }
+            else if (fd == m_inputFd)
+            {
+                readInput ();
+            }
+            else if (fd == m_replayTimerFd)
+            {
+                if (read (fd, &expirations, sizeof (expirations)) == sizeof (expirations))
+                    replayTick ();
+            }
+            else if (fd == m_statsTimerFd)
+            {
+                if (read (fd, &expirations, sizeof (expirations)) == sizeof (expirations))
+                    printStats ();
+            }
+            else if (std::find (m_listenFds.begin (), m_listenFds.end (), fd) != m_listenFds.end ())
+            {
+                accept (fd);
+            }
+            else
+            {
+                std::unordered_map<int, Client*>::iterator it = m_clients.find (fd);
+                if (it == m_clients.end ())
+                    continue;
+                Client* client = it->second;
+                if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                {
+                    closeClient (client, "hung up");
+                    continue;
+                }
+                if (events[i].events & EPOLLIN)
+                {
+                    // Subscribers have nothing to say, drain and watch for EOF
+                    char scratch[256];
+                    ssize_t got = read (fd, scratch, sizeof (scratch));
+                    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR))
+                    {
+                        closeClient (client, "hung up");
+                        continue;
+                    }
+                }
+                if ((events[i].events & EPOLLOUT) && !flush (client))
+                    closeClient (client, strerror (errno));
+            }
+        }
+    }
+
+    printStats ();
+    return 0;
+}
+
+void TelemetryBridge::accept (int _listenFd)
+{
+    for (;;)
+    {
+        struct sockaddr_storage addr;
+        socklen_t addrLen = sizeof (addr);
+        int fd = accept4 (_listenFd, (struct sockaddr*) &addr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        Client* client = new Client;
+        client->fd = fd;
+        client->queuedBytes = 0;
+        client->headSent = 0;
+        client->wantWrite = false;
+        client->sentBytes = 0;
+        client->droppedBytes = 0;
+        if (addr.ss_family == AF_INET)
+        {
+            // Telemetry is latency sensitive, don't wait to fill segments
+            int one = 1;
+            setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+            struct sockaddr_in* in = (struct sockaddr_in*) &addr;
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop (AF_INET, &in->sin_addr, ip, sizeof (ip));
+            client->name = std::string ("tcp ") + ip + ":" + std::to_string (ntohs (in->sin_port));
+        }
+        else
+        {
+            client->name = "unix #" + std::to_string (fd);
+        }
+
+        if (!addFd (fd, EPOLLIN | EPOLLRDHUP))
+        {
+            close (fd);
+            delete client;
+            continue;
+        }
+        m_clients[fd] = client;
+        fprintf (stderr, "# %s connected\n", client->name.c_str ());
+    }
+}
+
+void TelemetryBridge::readInput ()
+{
+    for (int i = 0; i < MAX_READS_PER_EVENT; i++)
+    {
+        if (!m_buffer || m_buffer->used == BUFFER_BYTES)
+        {
+            m_buffer = std::make_shared<Buffer> ();
+            m_buffer->used = 0;
+        }
+
+        ssize_t n = read (m_inputFd, m_buffer->data + m_buffer->used, BUFFER_BYTES - m_buffer->used);
+        if (n > 0)
+        {
+            uint32_t offset = m_buffer->used;
+            m_buffer->used += n;
+            publish (offset, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+
+        // EOF or the device went away
+        if (n < 0)
+            perror ("input");
+        epoll_ctl (m_epollFd, EPOLL_CTL_DEL, m_inputFd, NULL);
+        m_inputDone = true;
+        return;
+    }
+}
+
+void TelemetryBridge::replayTick ()
+{
+    size_t budget = m_replayBytesPerTick;
+    bool rewound = false;
+    while (budget > 0 && !m_inputDone)
+    {
+        if (!m_buffer || m_buffer->used == BUFFER_BYTES)
+        {
+            m_buffer = std::make_shared<Buffer> ();
+            m_buffer->used = 0;
+        }
+
+        size_t want = std::min (budget, BUFFER_BYTES - m_buffer->used);
+        ssize_t n = read (m_inputFd, m_buffer->data + m_buffer->used, want);
+        if (n > 0)
+        {
+            uint32_t offset = m_buffer->used;
+            m_buffer->used += n;
+            budget -= n;
+            rewound = false;
+            publish (offset, n);
+            continue;
+        }
+
+        // An empty file would rewind forever
+        if (n == 0 && m_inputLoop && !rewound)
+        {
+            lseek (m_inputFd, 0, SEEK_SET);
+            rewound = true;
+            continue;
+        }
+        m_inputDone = true;
+        epoll_ctl (m_epollFd, EPOLL_CTL_DEL, m_replayTimerFd, NULL);
+    }
+}
+
+void TelemetryBridge::publish (uint32_t _offset, uint32_t _length)
+{
+    m_inputBytes += _length;
+    const char* data = m_buffer->data + _offset;
+
+    // Datagrams straight out of the shared buffer, a full socket buffer drops
+    for (size_t i = 0; i < m_multicasts.size (); i++)
+    {
+        Multicast& mc = m_multicasts[i];
+        for (uint32_t sent = 0; sent < _length; sent += DATAGRAM_BYTES)
+        {
+            size_t piece = std::min<size_t> (DATAGRAM_BYTES, _length - sent);
+            if (send (mc.fd, data + sent, piece, MSG_DONTWAIT) == (ssize_t) piece)
+                mc.sentBytes += piece;
+            else
+                mc.droppedBytes += piece;
+        }
+    }
+
+    Slice slice;
+    slice.buffer = m_buffer;
+    slice.offset = _offset;
+    slice.length = _length;
+
+    std::vector<Client*> clients;
+    clients.reserve (m_clients.size ());
+    for (std::unordered_map<int, Client*>::iterator it = m_clients.begin (); it != m_clients.end (); ++it)
+        clients.push_back (it->second);
+
+    for (size_t i = 0; i < clients.size (); i++)
+    {
+        Client* client = clients[i];
+        enqueue (client, slice);
+        if (m_overflowPolicy == OVERFLOW_DISCONNECT && client->queuedBytes > m_clientQueueBytes)
+        {
+            closeClient (client, "too slow");
+            continue;
+        }
+
+        // Clients that are keeping up get the data now, the rest wait for EPOLLOUT
+        if (!client->wantWrite && !flush (client))
+            closeClient (client, strerror (errno));
+    }
+}
+
+void TelemetryBridge::enqueue (Client* _client, const Slice& _slice)
+{
+    // Consecutive reads into the same buffer extend the last slice
+    if (!_client->queue.empty ())
+    {
+        Slice& last = _client->queue.back ();
+        if (last.buffer == _slice.buffer && last.offset + last.length == _slice.offset)
+            last.length += _slice.length;
+        else
+            _client->queue.push_back (_slice);
+    }
+    else
+    {
+        _client->queue.push_back (_slice);
+    }
+    _client->queuedBytes += _slice.length;
+
+    if (m_overflowPolicy != OVERFLOW_DROP)
+        return;
+
+    // Drop the oldest whole slices, never the one partly on the wire
+    while (_client->queuedBytes > m_clientQueueBytes)
+    {
+        size_t index = (_client->headSent > 0) ? 1 : 0;
+        if (index + 1 >= _client->queue.size ())
+            break;
+        _client->queuedBytes -= _client->queue[index].length;
+        _client->droppedBytes += _client->queue[index].length;
+        _client->queue.erase (_client->queue.begin () + index);
+    }
+}
+
+bool TelemetryBridge::flush (Client* _client)
+{
+    while (!_client->queue.empty ())
+    {
+        struct iovec iov[MAX_IOVECS];
+        int count = 0;
+        for (std::deque<Slice>::iterator it = _client->queue.begin (); it != _client->queue.end () && count < MAX_IOVECS; ++it, ++count)
+        {
+            uint32_t skip = (count == 0) ? _client->headSent : 0;
+            iov[count].iov_base = it->buffer->data + it->offset + skip;
+            iov[count].iov_len = it->length - skip;
+        }
+
+        ssize_t n = writev (_client->fd, iov, count);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                setWantWrite (_client, true);
+                return true;
+            }
+            return false;
+        }
+
+        _client->sentBytes += n;
+        _client->queuedBytes -= n;
+        size_t left = n;
+        while (left > 0)
+        {
+            Slice& head = _client->queue.front ();
+            size_t headLeft = head.length - _client->headSent;
+            if (left < headLeft)
+            {
+                _client->headSent += left;
+                break;
+            }
+            left -= headLeft;
+            _client->headSent = 0;
+            _client->queue.pop_front ();
+        }
+    }
+
+    setWantWrite (_client, false);
+    return true;
+}
+
+void TelemetryBridge::setWantWrite (Client* _client, bool _want)
+{
+    if (_client->wantWrite == _want)
+        return;
+    _client->wantWrite = _want;
+
+    struct epoll_event ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | (_want ? (uint32_t) EPOLLOUT : 0u);
+    ev.data.fd = _client->fd;
+    epoll_ctl (m_epollFd, EPOLL_CTL_MOD, _client->fd, &ev);
+}
+
+void TelemetryBridge::closeClient (Client* _client, const char* _reason)
+{
+    fprintf (stderr, "# %s closed (%s) sent=%llu dropped=%llu\n", _client->name.c_str (), _reason,
+             _client->sentBytes, _client->droppedBytes);
+    epoll_ctl (m_epollFd, EPOLL_CTL_DEL, _client->fd, NULL);
+    close (_client->fd);
+    m_clients.erase (_client->fd);
+    delete _client;
+}
+
+bool TelemetryBridge::drained () const
+{
+    for (std::unordered_map<int, Client*>::const_iterator it = m_clients.begin (); it != m_clients.end (); ++it)
+        if (!it->second->queue.empty ())
+            return false;
+    return true;
+}
+
+void TelemetryBridge::printStats ()
+{
+    fprintf (stderr, "# input_bytes=%llu clients=%zu multicast=%zu\n", m_inputBytes, m_clients.size (), m_multicasts.size ());
+    for (std::unordered_map<int, Client*>::iterator it = m_clients.begin (); it != m_clients.end (); ++it)
+    {
+        Client* client = it->second;
+        fprintf (stderr, "#   %s sent=%llu dropped=%llu queued=%zu\n", client->name.c_str (),
+                 client->sentBytes, client->droppedBytes, client->queuedBytes);
+    }
+    for (size_t i = 0; i < m_multicasts.size (); i++)
+        fprintf (stderr, "#   %s sent=%llu dropped=%llu\n", m_multicasts[i].name.c_str (),
+                 m_multicasts[i].sentBytes, m_multicasts[i].droppedBytes);
+}
@@ -0,0 +1,121 @@
+#ifndef TELEMETRY_BRIDGE_H
+#define TELEMETRY_BRIDGE_H
+
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reads the board's telemetry stream once and fans it out to any number of
+// TCP and Unix socket clients plus UDP multicast groups from one epoll loop.
+// Input is read into shared, immutable buffers; each client only queues
+// references into them and sends with writev, so the data is never copied per
+// client.  Every client has its own queue limit: a client that can't keep up
+// loses its oldest data (or is disconnected) without stalling the input or
+// the other clients.  Multicast is fire and forget.
+class TelemetryBridge
+{
+public:
+    typedef enum OVERFLOW_POLICY_ENUM
+    {
+        OVERFLOW_DROP = 0,      // Drop the oldest queued data, stream resyncs on CAPTURE_SYNC
+        OVERFLOW_DISCONNECT,    // Close the client
+        OVERFLOW_POLICY_NUM
+    } OVERFLOW_POLICY;
+
+    static const size_t BUFFER_BYTES = 64 * 1024;
+    static const size_t CLIENT_QUEUE_BYTES_DEFAULT = 1024 * 1024;
+    static const size_t DATAGRAM_BYTES = 1400;
+    static const int    REPLAY_TICK_MS = 10;
+    static const int    DRAIN_TIMEOUT_MS = 2000;
+
+    TelemetryBridge ();
+    ~TelemetryBridge ();
+
+    // A serial port is set to raw mode at _baud.  Pipes, FIFOs and "-" (stdin)
+    // are read as data arrives.  Regular files stand in for the board and are
+    // replayed at _replayBytesPerS, from the start again if _loop is set.
+    bool openInput (const std::string& _path, int _baud, size_t _replayBytesPerS, bool _loop);
+
+    bool listenTcp (uint16_t _port);
+    bool listenUnix (const std::string& _path);
+    bool addMulticast (const std::string& _group, uint16_t _port, int _ttl);
+
+    void setClientQueueBytes (size_t _bytes) {m_clientQueueBytes = _bytes;}
+    void setOverflowPolicy (OVERFLOW_POLICY _policy) {m_overflowPolicy = _policy;}
+    void setStatsInterval (int _seconds) {m_statsIntervalS = _seconds;}
+
+    // Runs until the input ends and the clients are drained, or SIGINT/SIGTERM
+    int run ();
+
+private:
+    struct Buffer
+    {
+        size_t  used;
+        char    data[BUFFER_BYTES];
+    };
+
+    // Reference to bytes of a shared buffer
+    struct Slice
+    {
+        std::shared_ptr<Buffer> buffer;
+        uint32_t                offset;
+        uint32_t                length;
+    };
+
+    struct Client
+    {
+        int                 fd;
+        std::string         name;
+        std::deque<Slice>   queue;
+        size_t              queuedBytes;
+        uint32_t            headSent;       // Bytes of queue.front () already sent
+        bool                wantWrite;
+        unsigned long long  sentBytes;
+        unsigned long long  droppedBytes;
+    };
+
+    struct Multicast
+    {
+        int                 fd;
+        std::string         name;
+        unsigned long long  sentBytes;
+        unsigned long long  droppedBytes;
+    };
+
+    bool addFd (int _fd, uint32_t _events);
+    void accept (int _listenFd);
+    void readInput ();
+    void replayTick ();
+    void publish (uint32_t _offset, uint32_t _length);
+    void enqueue (Client* _client, const Slice& _slice);
+    bool flush (Client* _client);
+    void setWantWrite (Client* _client, bool _want);
+    void closeClient (Client* _client, const char* _reason);
+    void printStats ();
+    bool drained () const;
+
+    int                                 m_epollFd;
+    int                                 m_signalFd;
+    int                                 m_inputFd;
+    bool                                m_inputReplay;
+    bool                                m_inputLoop;
+    bool                                m_inputDone;
+    int                                 m_replayTimerFd;
+    size_t                              m_replayBytesPerTick;
+    int                                 m_statsTimerFd;
+    int                                 m_statsIntervalS;
+    std::vector<int>                    m_listenFds;
+    std::string                         m_unixPath;
+    std::vector<Multicast>              m_multicasts;
+    std::unordered_map<int, Client*>    m_clients;
+
+    std::shared_ptr<Buffer>             m_buffer;
+    size_t                              m_clientQueueBytes;
+    OVERFLOW_POLICY                     m_overflowPolicy;
+    unsigned long long                  m_inputBytes;
+};
+
+#endif // TELEMETRY_BRIDGE_H
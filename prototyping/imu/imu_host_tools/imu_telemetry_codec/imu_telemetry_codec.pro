@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Delta compressed telemetry: conversion and codec benchmark
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_telemetry_codec
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/TelemetryEncoder.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/TelemetryEncoder.h
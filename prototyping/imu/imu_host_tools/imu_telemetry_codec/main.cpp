@@ -0,0 +1,227 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "TelemetryEncoder.h"
+#include "capture_reader.h"
+#include "telemetry_decoder.h"
+
+static const size_t READ_RECORDS = 65536;
+static const size_t READ_BYTES = 1024 * 1024;
+static const size_t BENCH_RECORDS_DEFAULT = 10000000;
+static const double LINK_BYTES_PER_S = 11520.0;    // 115200 baud, 8N1
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-k keyframe_blocks] [-n bench_records] encode|decode|bench in [out]\n", _prog);
+    fprintf (stderr, "  encode  raw capture to delta compressed telemetry, as the board sends it\n");
+    fprintf (stderr, "  decode  delta compressed telemetry back to a raw capture for the other tools\n");
+    fprintf (stderr, "  bench   encode and decode a raw capture in memory, check the round trip and\n");
+    fprintf (stderr, "          report ratio, codec throughput and whether it fits 115200 baud\n");
+}
+
+static void encodeRecords (TelemetryEncoder& _encoder, const std::vector<CaptureRecord>& _records, std::vector<uint8_t>& _out)
+{
+    for (size_t i = 0; i < _records.size (); i++)
+        if (_encoder.encode (_records[i]))
+            _out.insert (_out.end (), _encoder.getBlock (), _encoder.getBlock () + _encoder.getBlockSize ());
+}
+
+static void flushEncoder (TelemetryEncoder& _encoder, std::vector<uint8_t>& _out)
+{
+    if (_encoder.flush ())
+        _out.insert (_out.end (), _encoder.getBlock (), _encoder.getBlock () + _encoder.getBlockSize ());
+}
+
+static FILE* openOutput (const char* _path)
+{
+    if (!strcmp (_path, "-"))
+        return stdout;
+    return fopen (_path, "wb");
+}
+
+static int runEncode (const char* _in, const char* _out, uint8_t _keyframeBlocks)
+{
+    CaptureReader reader;
+    FILE* out = openOutput (_out);
+    if (!reader.open (_in) || !out)
+    {
+        fprintf (stderr, "Could not open %s or %s\n", _in, _out);
+        return 1;
+    }
+
+    TelemetryEncoder encoder;
+    encoder.setKeyframeInterval (_keyframeBlocks);
+    std::vector<CaptureRecord> records;
+    std::vector<uint8_t> bytes;
+    unsigned long long written = 0;
+    for (;;)
+    {
+        records.clear ();
+        bytes.clear ();
+        bool more = reader.read (records, READ_RECORDS);
+        encodeRecords (encoder, records, bytes);
+        if (!more)
+            flushEncoder (encoder, bytes);
+        if (!bytes.empty ())
+            fwrite (&bytes[0], 1, bytes.size (), out);
+        written += bytes.size ();
+        if (!more)
+            break;
+    }
+    if (out != stdout)
+        fclose (out);
+
+    fprintf (stderr, "Records=%llu\n", reader.getRecords ());
+    fprintf (stderr, "EncodedBytes=%llu\n", written);
+    return 0;
+}
+
+static int runDecode (const char* _in, const char* _out)
+{
+    FILE* in = strcmp (_in, "-") ? fopen (_in, "rb") : stdin;
+    FILE* out = openOutput (_out);
+    if (!in || !out)
+    {
+        fprintf (stderr, "Could not open %s or %s\n", _in, _out);
+        return 1;
+    }
+
+    TelemetryDecoder decoder;
+    std::vector<uint8_t> bytes (READ_BYTES);
+    std::vector<CaptureRecord> records;
+    unsigned long long count = 0;
+    size_t got;
+    while ((got = fread (&bytes[0], 1, bytes.size (), in)) > 0)
+    {
+        records.clear ();
+        decoder.decode (&bytes[0], got, records);
+        if (!records.empty ())
+            fwrite (&records[0], sizeof (CaptureRecord), records.size (), out);
+        count += records.size ();
+    }
+    if (in != stdin)
+        fclose (in);
+    if (out != stdout)
+        fclose (out);
+
+    fprintf (stderr, "Records=%llu\n", count);
+    fprintf (stderr, "Blocks=%llu\n", decoder.getBlocks ());
+    fprintf (stderr, "BadBlocks=%llu\n", decoder.getBadBlocks ());
+    fprintf (stderr, "DroppedBlocks=%llu\n", decoder.getDroppedBlocks ());
+    fprintf (stderr, "SkippedBytes=%llu\n", decoder.getSkippedBytes ());
+    return 0;
+}
+
+static int runBench (const char* _in, uint8_t _keyframeBlocks, size_t _maxRecords)
+{
+    CaptureReader reader;
+    if (!reader.open (_in))
+    {
+        fprintf (stderr, "Could not open %s\n", _in);
+        return 1;
+    }
+    std::vector<CaptureRecord> records;
+    while (records.size () < _maxRecords && reader.read (records, std::min (READ_RECORDS, _maxRecords - records.size ())))
+        ;
+    if (records.empty ())
+    {
+        fprintf (stderr, "No records in %s\n", _in);
+        return 1;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    TelemetryEncoder encoder;
+    encoder.setKeyframeInterval (_keyframeBlocks);
+    std::vector<uint8_t> encoded;
+    encoded.reserve (records.size () * sizeof (CaptureRecord) / 2);
+    Clock::time_point start = Clock::now ();
+    encodeRecords (encoder, records, encoded);
+    flushEncoder (encoder, encoded);
+    double encodeS = std::chrono::duration<double> (Clock::now () - start).count ();
+
+    // Fed in serial sized pieces, the way it arrives from the board
+    TelemetryDecoder decoder;
+    std::vector<CaptureRecord> decoded;
+    decoded.reserve (records.size ());
+    start = Clock::now ();
+    for (size_t pos = 0; pos < encoded.size (); pos += 4096)
+        decoder.decode (&encoded[pos], std::min<size_t> (4096, encoded.size () - pos), decoded);
+    double decodeS = std::chrono::duration<double> (Clock::now () - start).count ();
+
+    bool same = decoded.size () == records.size ();
+    for (size_t i = 0; same && i < records.size (); i++)
+    {
+        // Unused axes of single axis records aren't sent
+        CaptureRecord expect = records[i];
+        if (expect.axes != 3)
+            expect.axes = 1, expect.value[1] = expect.value[2] = 0;
+        same = !memcmp (&expect, &decoded[i], sizeof (CaptureRecord));
+    }
+
+    // Link load at the rate the capture was taken at
+    double rawBytes = (double) records.size () * sizeof (CaptureRecord);
+    double spanS = (uint32_t) (records.back ().timeuS - records.front ().timeuS) / 1e6;
+    printf ("Records=%zu\n", records.size ());
+    printf ("RawBytes=%.0f\n", rawBytes);
+    printf ("EncodedBytes=%zu\n", encoded.size ());
+    printf ("Ratio=%.3f\n", rawBytes / encoded.size ());
+    printf ("BytesPerRecord=%.3f\n", (double) encoded.size () / records.size ());
+    printf ("EncodeMBps=%.1f\n", rawBytes / encodeS / 1e6);
+    printf ("EncodeNsPerRecord=%.1f\n", encodeS * 1e9 / records.size ());
+    printf ("DecodeMBps=%.1f\n", rawBytes / decodeS / 1e6);
+    printf ("DecodeNsPerRecord=%.1f\n", decodeS * 1e9 / records.size ());
+    printf ("RoundTrip=%s\n", same ? "ok" : "mismatch");
+    if (spanS > 0.0)
+    {
+        printf ("CaptureSeconds=%.3f\n", spanS);
+        printf ("RawLinkBytesPerS=%.1f\n", rawBytes / spanS);
+        printf ("EncodedLinkBytesPerS=%.1f\n", encoded.size () / spanS);
+        printf ("Fits115200=%s\n", encoded.size () / spanS <= LINK_BYTES_PER_S ? "yes" : "no");
+    }
+    return same ? 0 : 2;
+}
+
+int main (int argc, char* argv[])
+{
+    int keyframeBlocks = TelemetryEncoder::KEYFRAME_INTERVAL_DEFAULT;
+    size_t benchRecords = BENCH_RECORDS_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (argc, argv, "k:n:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'k':
+                keyframeBlocks = atoi (optarg);
+                break;
+            case 'n':
+                benchRecords = strtoul (optarg, NULL, 0);
+                break;
+            default:
+                usage (argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || keyframeBlocks < 1 || keyframeBlocks > 255 || benchRecords == 0)
+    {
+        usage (argv[0]);
+        return 1;
+    }
+
+    std::string mode = argv[optind];
+    int args = argc - optind - 1;
+    if (mode == "encode" && args == 2)
+        return runEncode (argv[optind + 1], argv[optind + 2], (uint8_t) keyframeBlocks);
+    if (mode == "decode" && args == 2)
+        return runDecode (argv[optind + 1], argv[optind + 2]);
+    if (mode == "bench" && args == 1)
+        return runBench (argv[optind + 1], (uint8_t) keyframeBlocks, benchRecords);
+
+    usage (argv[0]);
+    return 1;
+}
@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# I2C against SPI: bus bytes and ISR time of the gyro and accelerometer
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+include(../common/arduino_host.pri)
+
+TARGET = imu_transport_bench
+TEMPLATE = app
+
+
+SOURCES += main.cpp
@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "ADXL345.h"
+#include "L3G4200D.h"
+#include "sim_sensors.h"
+
+// Sample rates of the sketch
+static const double   GYRO_HZ_DEFAULT = 400.0;
+static const double   ACC_HZ_DEFAULT = 100.0;
+
+// Entry, exit and the pin dispatch of an ISR on a Teensy 3, as imu_sync_bench
+static const double   ISR_ENTRY_US = 1.5;
+
+static const uint8_t  ACC_INT1_PIN = 11;
+
+// The two sensors on one bus, as the sketch wires them with and without
+// IMU_USE_SPI, and I2C at both speeds the sketch can run it
+typedef struct bus_config_struct
+{
+    const char*             name;
+    SimTransport::BUS_TYPE  type;
+    uint32_t                gyroClockHz;
+    uint32_t                accClockHz;
+} BusConfig;
+
+static const int BUS_CONFIG_NUM = 3;
+static const BusConfig BUS_CONFIGS[BUS_CONFIG_NUM] =
+{
+    {"I2CStandard", SimTransport::BUS_I2C, 100000,                 100000},
+    {"I2CFast",     SimTransport::BUS_I2C, 400000,                 400000},
+    {"SPI",         SimTransport::BUS_SPI, L3G4200D::SPI_CLOCK_HZ, ADXL345::SPI_CLOCK_HZ}
+};
+
+typedef struct sample_cost_struct
+{
+    uint32_t    bytes;
+    double      busuS;
+} SampleCost;
+
+// What the drivers' callbacks were handed
+static L3G4200D::vector16b g_gyroSample;
+static uint32_t            g_gyroSamples = 0;
+static ADXL345::vector16b  g_accSample;
+static uint32_t            g_accSamples = 0;
+
+static void gyroCallback (L3G4200D::vector16b _rawRotVel)
+{
+    g_gyroSample = _rawRotVel;
+    g_gyroSamples++;
+}
+
+static void accCallback (ADXL345::vector16b _rawAcc)
+{
+    g_accSample = _rawAcc;
+    g_accSamples++;
+}
+
+static bool sameSample (const Vec3<int16_t>& _a, const Vec3<int16_t>& _b)
+{
+    return _a.x == _b.x && _a.y == _b.y && _a.z == _b.z;
+}
+
+// One L3G4200D::int2ISR with a sample waiting, STATUS_REG then the outputs
+static SampleCost gyroSample (L3G4200D& _gyro, SimL3G4200D& _bus, const Vec3<int16_t>& _sample)
+{
+    _bus.produce (_sample);
+    _bus.resetStats ();
+    _bus.resetBusTime ();
+    _gyro.int2ISR ();
+    SampleCost cost = {_bus.getBytes (), _bus.getBusTimeNs () / 1000.0};
+    return cost;
+}
+
+// One ADXL345::int1ISR on DATA_READY, INT_SOURCE then the outputs
+static SampleCost accSample (ADXL345& _acc, SimADXL345& _bus, const Vec3<int16_t>& _sample)
+{
+    _bus.produce (_sample);
+    _bus.resetStats ();
+    _bus.resetBusTime ();
+    _acc.int1ISR ();
+    SampleCost cost = {_bus.getBytes (), _bus.getBusTimeNs () / 1000.0};
+    return cost;
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-g gyro Hz] [-a acc Hz]\n", _prog);
+    fprintf (stderr, "  Runs the L3G4200D and ADXL345 drivers' ISRs (imu_embedded_sw) over\n");
+    fprintf (stderr, "  SimTransport on I2C at 100 and 400 kHz and on SPI at each part's fastest\n");
+    fprintf (stderr, "  clock, checks they deliver the sample in the registers, and reports bus\n");
+    fprintf (stderr, "  bytes/s, bus time and ISR time per sample and the gain over I2C.\n");
+    fprintf (stderr, "  -g  gyro sample rate, default %.0f Hz\n", GYRO_HZ_DEFAULT);
+    fprintf (stderr, "  -a  accelerometer sample rate, default %.0f Hz\n", ACC_HZ_DEFAULT);
+}
+
+int main (int _argc, char** _argv)
+{
+    double gyroHz = GYRO_HZ_DEFAULT;
+    double accHz = ACC_HZ_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "g:a:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'g':
+                gyroHz = atof (optarg);
+                break;
+            case 'a':
+                accHz = atof (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind != _argc || gyroHz <= 0.0 || accHz <= 0.0)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    printf ("GyroHz=%.1f\n", gyroHz);
+    printf ("AccHz=%.1f\n", accHz);
+    printf ("\n");
+
+    bool ok = true;
+    double baseGyroISRuS = 0.0;
+    double baseAccISRuS = 0.0;
+    for (int c = 0; c < BUS_CONFIG_NUM; c++)
+    {
+        const BusConfig& config = BUS_CONFIGS[c];
+        SimL3G4200D gyroBus (config.type, config.gyroClockHz);
+        SimADXL345 accBus (config.type, config.accClockHz, ACC_INT1_PIN);
+
+        // Set up as the sketch does, with the ISRs called from here in place
+        // of the poll timer and INT1
+        L3G4200D gyro (&gyroBus);
+        gyro.registerRotationalVelocityCallback (gyroCallback);
+        gyro.init ();
+        ADXL345 acc (&accBus);
+        acc.subscribe (accCallback);
+        acc.setRange (ADXL345::RANGE_4G);
+        acc.setFullRes (true);
+        acc.initAsync (ACC_INT1_PIN, NULL);
+
+        Vec3<int16_t> gyroIn = makeVec3<int16_t> (1234, -2345, 3456);
+        Vec3<int16_t> accIn = makeVec3<int16_t> (-123, 234, -345);
+        g_gyroSamples = 0;
+        g_accSamples = 0;
+        SampleCost gyroCost = gyroSample (gyro, gyroBus, gyroIn);
+        SampleCost accCost = accSample (acc, accBus, accIn);
+        bool reads = g_gyroSamples == 1 && sameSample (g_gyroSample, gyroIn) &&
+                     g_accSamples == 1 && sameSample (g_accSample, accIn) && !digitalRead (ACC_INT1_PIN);
+        ok = ok && reads;
+
+        double gyroISRuS = ISR_ENTRY_US + gyroCost.busuS;
+        double accISRuS = ISR_ENTRY_US + accCost.busuS;
+        if (c == 0)
+        {
+            baseGyroISRuS = gyroISRuS;
+            baseAccISRuS = accISRuS;
+        }
+
+        printf ("[%s]\n", config.name);
+        printf ("Reads=%s\n", reads ? "ok" : "mismatch");
+        printf ("GyroBytesPerSample=%u\n", gyroCost.bytes);
+        printf ("GyroBytesPerS=%.0f\n", gyroCost.bytes * gyroHz);
+        printf ("GyroBusuS=%.2f\n", gyroCost.busuS);
+        printf ("GyroISRuS=%.2f\n", gyroISRuS);
+        printf ("AccBytesPerSample=%u\n", accCost.bytes);
+        printf ("AccBytesPerS=%.0f\n", accCost.bytes * accHz);
+        printf ("AccBusuS=%.2f\n", accCost.busuS);
+        printf ("AccISRuS=%.2f\n", accISRuS);
+        printf ("BusLoad=%.4f\n", (gyroCost.busuS * gyroHz + accCost.busuS * accHz) / 1e6);
+        if (c > 0)
+        {
+            printf ("GyroISRGain=%.2f\n", baseGyroISRuS / gyroISRuS);
+            printf ("AccISRGain=%.2f\n", baseAccISRuS / accISRuS);
+        }
+        printf ("\n");
+    }
+    return ok ? 0 : 1;
+}
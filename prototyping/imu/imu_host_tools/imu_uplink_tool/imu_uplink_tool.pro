@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Live configuration of the board over the uplink command channel
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_uplink_tool
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    uplink_client.cpp \
+    $$PWD/../../imu_embedded_sw/CommandParser.cpp
+
+HEADERS += uplink_client.h \
+    $$PWD/../../imu_embedded_sw/BusTrace.h \
+    $$PWD/../../imu_embedded_sw/CommandFrame.h \
+    $$PWD/../../imu_embedded_sw/CommandParser.h
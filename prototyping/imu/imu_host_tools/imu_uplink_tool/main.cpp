@@ -0,0 +1,413 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "capture_reader.h"
+#include "uplink_client.h"
+
+static const int BAUD_DEFAULT = 115200;
+static const int SETTLE_MS_DEFAULT = 500;
+static const int DWELL_MS_DEFAULT = 5000;
+
+// Names and value labels on the command line, values are the driver enums
+struct SettingInfo
+{
+    const char*         name;
+    COMMAND_SETTING     id;
+    const char* const*  labels;     // NULL for plain numbers
+    uint8_t             labelCount;
+};
+
+static const char* const ACC_RATE_LABELS[] = {"0.10", "0.20", "0.39", "0.78", "1.56", "3.13", "6.25", "12.5",
+                                              "25", "50", "100", "200", "400", "800", "1600", "3200"};
+static const char* const ACC_RANGE_LABELS[] = {"2", "4", "8", "16"};
+static const char* const BAR_OSSR_LABELS[] = {"low_power", "standard", "high_res", "ultra_high_res"};
+
+static const SettingInfo SETTINGS[SETTING_NUM] =
+{
+    {"acc.rate",     SETTING_ACC_OUTPUT_RATE,     ACC_RATE_LABELS,  16},
+    {"acc.range",    SETTING_ACC_RANGE,           ACC_RANGE_LABELS, 4},
+    {"acc.fullres",  SETTING_ACC_FULL_RES,        NULL,             0},
+    {"acc.lpf",      SETTING_ACC_LP_FILTER,       NULL,             0},
+    {"bar.ossr",     SETTING_BAR_OSSR,            BAR_OSSR_LABELS,  4},
+    {"bar.avg",      SETTING_BAR_AVG_FILTER,      NULL,             0},
+    {"bar.tempdec",  SETTING_BAR_TEMP_DECIMATION, NULL,             0}
+};
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s -d device [-b baud] [-t timeout_ms] [-n retries]\n", _prog);
+    fprintf (stderr, "          [-S settle_ms] [-w dwell_ms] command [args]\n");
+    fprintf (stderr, "  Changes the board's configuration live over the uplink command channel.\n");
+    fprintf (stderr, "  Commands:\n");
+    fprintf (stderr, "    ping\n");
+    fprintf (stderr, "    get [setting ...]\n");
+    fprintf (stderr, "    set setting=value ...          applied together between samples\n");
+    fprintf (stderr, "    sweep setting=v1,v2,... [setting=value ...]\n");
+    fprintf (stderr, "                                   sets each value, waits settle_ms, then\n");
+    fprintf (stderr, "                                   measures the capture stream for dwell_ms\n");
+    fprintf (stderr, "                                   (needs IMU_CAPTURE_OUTPUT firmware)\n");
+    fprintf (stderr, "    cal blob.cal ...               stores imu_cal_tool blobs on the board\n");
+    fprintf (stderr, "    trace dump.bin                 saves the bus trace for imu_bus_trace\n");
+    fprintf (stderr, "                                   (needs IMU_BUS_TRACE firmware)\n");
+    fprintf (stderr, "  Settings:\n");
+    fprintf (stderr, "    acc.rate     Hz, 0.10 to 3200\n");
+    fprintf (stderr, "    acc.range    g, 2 4 8 16\n");
+    fprintf (stderr, "    acc.fullres  0 1\n");
+    fprintf (stderr, "    acc.lpf      0 1\n");
+    fprintf (stderr, "    bar.ossr     low_power standard high_res ultra_high_res\n");
+    fprintf (stderr, "    bar.avg      0 1\n");
+    fprintf (stderr, "    bar.tempdec  1 to 255\n");
+}
+
+static const char* statusName (COMMAND_STATUS _status)
+{
+    switch (_status)
+    {
+        case STATUS_OK:
+            return "ok";
+        case STATUS_UNKNOWN_COMMAND:
+            return "unknown_command";
+        case STATUS_BAD_LENGTH:
+            return "bad_length";
+        case STATUS_BAD_SETTING:
+            return "bad_setting";
+        case STATUS_BAD_VALUE:
+            return "bad_value";
+        default:
+            return "timeout";
+    }
+}
+
+static const SettingInfo* findSetting (const std::string& _name)
+{
+    for (int i = 0; i < SETTING_NUM; i++)
+        if (_name == SETTINGS[i].name)
+            return &SETTINGS[i];
+    return NULL;
+}
+
+static bool parseValue (const SettingInfo& _info, const std::string& _text, uint8_t& _value)
+{
+    if (_info.labels)
+    {
+        for (uint8_t i = 0; i < _info.labelCount; i++)
+        {
+            if (_text == _info.labels[i])
+            {
+                _value = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    char* end;
+    unsigned long v = strtoul (_text.c_str (), &end, 0);
+    if (_text.empty () || *end || v > 255)
+        return false;
+    _value = (uint8_t) v;
+    return true;
+}
+
+static std::string formatValue (uint8_t _id, uint8_t _value)
+{
+    if (_id < SETTING_NUM && SETTINGS[_id].labels && _value < SETTINGS[_id].labelCount)
+        return SETTINGS[_id].labels[_value];
+    char buf[8];
+    snprintf (buf, sizeof (buf), "%u", _value);
+    return buf;
+}
+
+// "name=value" or, with _values, "name=v1,v2,..."
+static bool parseAssignment (const std::string& _arg, const SettingInfo*& _info, std::vector<uint8_t>& _values)
+{
+    size_t eq = _arg.find ('=');
+    _info = findSetting (_arg.substr (0, eq));
+    if (!_info || eq == std::string::npos)
+    {
+        fprintf (stderr, "Bad setting: %s\n", _arg.c_str ());
+        return false;
+    }
+
+    _values.clear ();
+    size_t start = eq + 1;
+    for (;;)
+    {
+        size_t comma = _arg.find (',', start);
+        std::string text = _arg.substr (start, comma == std::string::npos ? std::string::npos : comma - start);
+        uint8_t value;
+        if (!parseValue (*_info, text, value))
+        {
+            fprintf (stderr, "Bad value for %s: %s\n", _info->name, text.c_str ());
+            return false;
+        }
+        _values.push_back (value);
+        if (comma == std::string::npos)
+            return true;
+        start = comma + 1;
+    }
+}
+
+static void printSettings (const std::vector<UplinkClient::Setting>& _settings)
+{
+    for (size_t i = 0; i < _settings.size (); i++)
+    {
+        const char* name = (_settings[i].first < SETTING_NUM) ? SETTINGS[_settings[i].first].name : "unknown";
+        printf ("%s=%s\n", name, formatValue (_settings[i].first, _settings[i].second).c_str ());
+    }
+}
+
+static void printStream (const UplinkClient::StreamStats& _stats, int _dwellMs)
+{
+    double seconds = _dwellMs / 1000.0;
+    for (int s = 0; s < CAPTURE_SENSOR_NUM; s++)
+    {
+        if (_stats.records[s] == 0)
+            continue;
+
+        // Board timestamps give the rate the samples were taken at, free of
+        // USB and host scheduling jitter
+        std::string key = CaptureReader::sensorName ((CAPTURE_SENSOR) s);
+        key[0] = toupper (key[0]);
+        const char* name = key.c_str ();
+        uint32_t spanuS = _stats.lastuS[s] - _stats.firstuS[s];
+        printf ("%sRecords=%llu\n", name, _stats.records[s]);
+        printf ("%sRateHz=%.3f\n", name, _stats.records[s] / seconds);
+        printf ("%sBoardRateHz=%.3f\n", name, spanuS ? (_stats.records[s] - 1) * 1e6 / spanuS : 0.0);
+        printf ("%sMaxGapMs=%.3f\n", name, _stats.maxGapuS[s] / 1000.0);
+    }
+    printf ("BytesPerS=%.1f\n", _stats.bytes / seconds);
+    printf ("SkippedBytes=%llu\n", _stats.skippedBytes);
+    printf ("CompressedBlocks=%llu\n", _stats.blocks);
+}
+
+static int runSweep (UplinkClient& _client, int _argc, char* _argv[], int _settleMs, int _dwellMs)
+{
+    // The first assignment is swept, the rest are held for every step
+    const SettingInfo* swept = NULL;
+    std::vector<uint8_t> sweptValues;
+    std::vector<UplinkClient::Setting> fixed;
+    for (int a = 0; a < _argc; a++)
+    {
+        const SettingInfo* info;
+        std::vector<uint8_t> values;
+        if (!parseAssignment (_argv[a], info, values))
+            return 1;
+        if (a == 0)
+        {
+            swept = info;
+            sweptValues = values;
+        }
+        else
+        {
+            fixed.push_back (UplinkClient::Setting (info->id, values[0]));
+        }
+    }
+    if (!swept)
+        return 1;
+
+    int failures = 0;
+    for (size_t i = 0; i < sweptValues.size (); i++)
+    {
+        std::vector<UplinkClient::Setting> settings = fixed;
+        settings.push_back (UplinkClient::Setting (swept->id, sweptValues[i]));
+
+        std::vector<UplinkClient::Setting> current;
+        double ackMs = 0.0;
+        COMMAND_STATUS status = _client.set (settings, current, ackMs);
+        printf ("[%s=%s]\n", swept->name, formatValue (swept->id, sweptValues[i]).c_str ());
+        printf ("Status=%s\n", statusName (status));
+        if (status != STATUS_OK)
+        {
+            printf ("\n");
+            failures++;
+            continue;
+        }
+        printf ("AckMs=%.3f\n", ackMs);
+
+        // Let filters and the FIFOs settle before measuring
+        UplinkClient::StreamStats stats;
+        _client.monitor (_settleMs, stats);
+        _client.monitor (_dwellMs, stats);
+        printStream (stats, _dwellMs);
+        printf ("\n");
+        fflush (stdout);
+    }
+    return failures ? 2 : 0;
+}
+
+static int runCalibration (UplinkClient& _client, int _argc, char* _argv[])
+{
+    int failures = 0;
+    for (int a = 0; a < _argc; a++)
+    {
+        uint8_t blob[COMMAND_PAYLOAD_MAX + 1];
+        FILE* f = fopen (_argv[a], "rb");
+        size_t length = f ? fread (blob, 1, sizeof (blob), f) : 0;
+        if (f)
+            fclose (f);
+        if (length == 0 || length > COMMAND_PAYLOAD_MAX)
+        {
+            fprintf (stderr, "Could not read a calibration blob from %s\n", _argv[a]);
+            failures++;
+            continue;
+        }
+
+        double ackMs = 0.0;
+        COMMAND_STATUS status = _client.writeCalibration (blob, (uint8_t) length, ackMs);
+        printf ("[%s]\n", _argv[a]);
+        printf ("Status=%s\n", statusName (status));
+        if (status == STATUS_OK)
+            printf ("AckMs=%.3f\n", ackMs);
+        printf ("\n");
+        if (status != STATUS_OK)
+            failures++;
+    }
+    return failures ? 2 : 0;
+}
+
+static int runTrace (UplinkClient& _client, const char* _path)
+{
+    BusTraceHeader header;
+    std::vector<BusTraceRecord> records;
+    COMMAND_STATUS status = _client.readTrace (header, records);
+    printf ("Status=%s\n", statusName (status));
+    if (status != STATUS_OK)
+        return 2;
+
+    FILE* f = fopen (_path, "wb");
+    if (!f)
+    {
+        perror (_path);
+        return 1;
+    }
+    bool ok = fwrite (&header, sizeof (header), 1, f) == 1;
+    if (!records.empty ())
+        ok = ok && fwrite (&records[0], sizeof (BusTraceRecord), records.size (), f) == records.size ();
+    if (fclose (f) != 0 || !ok)
+    {
+        perror (_path);
+        return 1;
+    }
+    printf ("Records=%u\n", header.records);
+    printf ("Total=%u\n", header.total);
+    return 0;
+}
+
+int main (int argc, char* argv[])
+{
+    std::string device;
+    int baud = BAUD_DEFAULT;
+    int timeoutMs = UplinkClient::TIMEOUT_MS_DEFAULT;
+    int retries = UplinkClient::RETRIES_DEFAULT;
+    int settleMs = SETTLE_MS_DEFAULT;
+    int dwellMs = DWELL_MS_DEFAULT;
+
+    int opt;
+    while ((opt = getopt (argc, argv, "d:b:t:n:S:w:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                device = optarg;
+                break;
+            case 'b':
+                baud = atoi (optarg);
+                break;
+            case 't':
+                timeoutMs = atoi (optarg);
+                break;
+            case 'n':
+                retries = atoi (optarg);
+                break;
+            case 'S':
+                settleMs = atoi (optarg);
+                break;
+            case 'w':
+                dwellMs = atoi (optarg);
+                break;
+            default:
+                usage (argv[0]);
+                return 1;
+        }
+    }
+    if (device.empty () || optind >= argc || timeoutMs <= 0 || retries < 0 || settleMs < 0 || dwellMs <= 0)
+    {
+        usage (argv[0]);
+        return 1;
+    }
+
+    std::string command = argv[optind];
+    int args = argc - optind - 1;
+    char** argp = &argv[optind + 1];
+
+    UplinkClient client;
+    client.setTimeout (timeoutMs, retries);
+    if (!client.open (device, baud))
+        return 1;
+
+    if (command == "ping")
+    {
+        double ackMs = 0.0;
+        COMMAND_STATUS status = client.ping (ackMs);
+        printf ("Status=%s\n", statusName (status));
+        if (status == STATUS_OK)
+            printf ("AckMs=%.3f\n", ackMs);
+        return status == STATUS_OK ? 0 : 2;
+    }
+    if (command == "get" || command == "set")
+    {
+        std::vector<uint8_t> ids;
+        std::vector<UplinkClient::Setting> settings;
+        for (int a = 0; a < args; a++)
+        {
+            if (command == "get")
+            {
+                const SettingInfo* info = findSetting (argp[a]);
+                if (!info)
+                {
+                    fprintf (stderr, "Bad setting: %s\n", argp[a]);
+                    return 1;
+                }
+                ids.push_back (info->id);
+            }
+            else
+            {
+                const SettingInfo* info;
+                std::vector<uint8_t> values;
+                if (!parseAssignment (argp[a], info, values) || values.size () != 1)
+                    return 1;
+                settings.push_back (UplinkClient::Setting (info->id, values[0]));
+            }
+        }
+        if (command == "set" && settings.empty ())
+        {
+            usage (argv[0]);
+            return 1;
+        }
+
+        std::vector<UplinkClient::Setting> current;
+        double ackMs = 0.0;
+        COMMAND_STATUS status = (command == "get") ? client.get (ids, current, ackMs) : client.set (settings, current, ackMs);
+        printf ("Status=%s\n", statusName (status));
+        if (status != STATUS_OK)
+            return 2;
+        printf ("AckMs=%.3f\n", ackMs);
+        printSettings (current);
+        return 0;
+    }
+    if (command == "sweep" && args > 0)
+        return runSweep (client, args, argp, settleMs, dwellMs);
+    if (command == "cal" && args > 0)
+        return runCalibration (client, args, argp);
+    if (command == "trace" && args == 1)
+        return runTrace (client, argp[0]);
+
+    usage (argv[0]);
+    return 1;
+}
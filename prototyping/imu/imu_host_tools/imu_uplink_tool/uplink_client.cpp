@@ -0,0 +1,303 @@
+#include "uplink_client.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "serial_port.h"
+
+static const size_t READ_BYTES = 4096;
+
+UplinkClient::UplinkClient ()
+    : m_fd (-1),
+      m_timeoutMs (TIMEOUT_MS_DEFAULT),
+      m_retries (RETRIES_DEFAULT),
+      m_sequence (0)
+{
+    resetStats (m_stats);
+}
+
+UplinkClient::~UplinkClient ()
+{
+    if (m_fd >= 0)
+        close (m_fd);
+}
+
+bool UplinkClient::open (const std::string& _path, int _baud)
+{
+    m_fd = ::open (_path.c_str (), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0)
+    {
+        perror (_path.c_str ());
+        return false;
+    }
+    if (isatty (m_fd) && !configureSerialPort (m_fd, _baud, _path.c_str ()))
+    {
+        close (m_fd);
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void UplinkClient::resetStats (StreamStats& _stats)
+{
+    memset (&_stats, 0, sizeof (_stats));
+}
+
+bool UplinkClient::transact (CommandFrame& _request, CommandFrame& _ack, double& _roundTripMs)
+{
+    _request.sequence = m_sequence++;
+    uint8_t bytes[COMMAND_FRAME_MAX];
+    uint8_t length = encodeCommandFrame (_request, bytes);
+
+    for (int attempt = 0; attempt <= m_retries; attempt++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+        if (write (m_fd, bytes, length) != length)
+        {
+            perror ("uplink write");
+            return false;
+        }
+
+        // A late ack for an earlier attempt still matches, the board applies
+        // a frame the same way however often it arrives
+        if (pump (m_timeoutMs, _request.sequence, &_ack))
+        {
+            _roundTripMs = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - start).count ();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool UplinkClient::pump (int _ms, int _sequence, CommandFrame* _ack)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now () + std::chrono::milliseconds (_ms);
+    uint8_t buf[READ_BYTES];
+    bool acked = false;
+
+    while (!acked)
+    {
+        int remaining = (int) std::chrono::duration_cast<std::chrono::milliseconds> (deadline - std::chrono::steady_clock::now ()).count ();
+        if (remaining <= 0)
+            break;
+
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        if (poll (&pfd, 1, remaining) <= 0)
+            continue;
+
+        ssize_t n = read (m_fd, buf, sizeof (buf));
+        if (n <= 0)
+        {
+            // A closed pty or socket would spin otherwise
+            if (n == 0 || (pfd.revents & (POLLHUP | POLLERR)))
+                break;
+            continue;
+        }
+
+        scanRecords (buf, n);
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (!m_parser.feed (buf[i]))
+                continue;
+            const CommandFrame& frame = m_parser.getFrame ();
+            if (_ack && frame.command == COMMAND_ACK && frame.sequence == _sequence)
+            {
+                *_ack = frame;
+                acked = true;
+            }
+        }
+    }
+    return acked;
+}
+
+void UplinkClient::scanRecords (const uint8_t* _bytes, size_t _length)
+{
+    m_stats.bytes += _length;
+    m_recordBuf.insert (m_recordBuf.end (), _bytes, _bytes + _length);
+
+    // Acks and text output between records count as skipped
+    size_t i = 0;
+    while (i + sizeof (CaptureRecord) <= m_recordBuf.size ())
+    {
+        CaptureRecord rec;
+        memcpy (&rec, &m_recordBuf[i], sizeof (rec));
+        if (rec.sync != CAPTURE_SYNC || rec.sensor >= CAPTURE_SENSOR_NUM || (rec.axes != 1 && rec.axes != 3))
+        {
+            m_stats.skippedBytes++;
+            i++;
+            continue;
+        }
+
+        countRecord (rec);
+        i += sizeof (CaptureRecord);
+    }
+    m_recordBuf.erase (m_recordBuf.begin (), m_recordBuf.begin () + i);
+
+    unsigned long long blocks = m_decoder.getBlocks ();
+    m_decoded.clear ();
+    m_decoder.decode (_bytes, _length, m_decoded);
+    m_stats.blocks += m_decoder.getBlocks () - blocks;
+    for (size_t d = 0; d < m_decoded.size (); d++)
+        countRecord (m_decoded[d]);
+}
+
+void UplinkClient::countRecord (const CaptureRecord& _rec)
+{
+    uint8_t s = _rec.sensor;
+    if (m_stats.records[s] == 0)
+        m_stats.firstuS[s] = _rec.timeuS;
+    else if (_rec.timeuS - m_stats.lastuS[s] > m_stats.maxGapuS[s])
+        m_stats.maxGapuS[s] = _rec.timeuS - m_stats.lastuS[s];
+    m_stats.lastuS[s] = _rec.timeuS;
+    m_stats.records[s]++;
+}
+
+void UplinkClient::monitor (int _ms, StreamStats& _stats)
+{
+    resetStats (m_stats);
+    pump (_ms, -1, NULL);
+    _stats = m_stats;
+}
+
+COMMAND_STATUS UplinkClient::ackStatus (const CommandFrame& _request, const CommandFrame& _ack, std::vector<Setting>* _current)
+{
+    if (_ack.length < 2 || _ack.payload[0] != _request.command || _ack.payload[1] >= STATUS_NUM)
+        return STATUS_NUM;
+    if (_current)
+    {
+        _current->clear ();
+        for (uint8_t i = 2; i + 1 < _ack.length; i += 2)
+            _current->push_back (Setting (_ack.payload[i], _ack.payload[i + 1]));
+    }
+    return (COMMAND_STATUS) _ack.payload[1];
+}
+
+COMMAND_STATUS UplinkClient::ping (double& _roundTripMs)
+{
+    CommandFrame request;
+    CommandFrame ack;
+    request.command = COMMAND_PING;
+    request.length = 0;
+    if (!transact (request, ack, _roundTripMs))
+        return STATUS_NUM;
+    return ackStatus (request, ack, NULL);
+}
+
+COMMAND_STATUS UplinkClient::set (const std::vector<Setting>& _settings, std::vector<Setting>& _current, double& _roundTripMs)
+{
+    CommandFrame request;
+    CommandFrame ack;
+    if (_settings.size () > SETTING_NUM)
+        return STATUS_BAD_LENGTH;
+    request.command = COMMAND_SET;
+    request.length = 0;
+    for (size_t i = 0; i < _settings.size (); i++)
+    {
+        request.payload[request.length++] = _settings[i].first;
+        request.payload[request.length++] = _settings[i].second;
+    }
+    if (!transact (request, ack, _roundTripMs))
+        return STATUS_NUM;
+    return ackStatus (request, ack, &_current);
+}
+
+COMMAND_STATUS UplinkClient::get (const std::vector<uint8_t>& _ids, std::vector<Setting>& _current, double& _roundTripMs)
+{
+    CommandFrame request;
+    CommandFrame ack;
+    if (_ids.size () > SETTING_NUM)
+        return STATUS_BAD_LENGTH;
+    request.command = COMMAND_GET;
+    request.length = (uint8_t) _ids.size ();
+    if (!_ids.empty ())
+        memcpy (request.payload, &_ids[0], _ids.size ());
+    if (!transact (request, ack, _roundTripMs))
+        return STATUS_NUM;
+    return ackStatus (request, ack, &_current);
+}
+
+COMMAND_STATUS UplinkClient::writeCalibration (const uint8_t* _blob, uint8_t _length, double& _roundTripMs)
+{
+    CommandFrame request;
+    CommandFrame ack;
+    if (_length > COMMAND_PAYLOAD_MAX)
+        return STATUS_BAD_LENGTH;
+    request.command = COMMAND_WRITE_CALIBRATION;
+    request.length = _length;
+    memcpy (request.payload, _blob, _length);
+    if (!transact (request, ack, _roundTripMs))
+        return STATUS_NUM;
+    return ackStatus (request, ack, NULL);
+}
+
+COMMAND_STATUS UplinkClient::traceOp (TRACE_OP _op, uint16_t _index, CommandFrame& _ack)
+{
+    CommandFrame request;
+    double roundTripMs;
+    request.command = COMMAND_TRACE;
+    request.payload[0] = _op;
+    request.length = 1;
+    if (_op == TRACE_READ)
+    {
+        request.payload[request.length++] = _index & 0xFF;
+        request.payload[request.length++] = _index >> 8;
+    }
+    if (!transact (request, _ack, roundTripMs))
+        return STATUS_NUM;
+    return ackStatus (request, _ack, NULL);
+}
+
+COMMAND_STATUS UplinkClient::readTrace (BusTraceHeader& _header, std::vector<BusTraceRecord>& _records)
+{
+    CommandFrame ack;
+    _records.clear ();
+    COMMAND_STATUS status = traceOp (TRACE_FREEZE, 0, ack);
+    if (status != STATUS_OK)
+        return status;
+    if (ack.length != 12)
+        return STATUS_BAD_LENGTH;
+
+    uint16_t count;
+    memcpy (&count, &ack.payload[2], 2);
+    _header.magic = BUS_TRACE_MAGIC;
+    _header.records = count;
+    memcpy (&_header.total, &ack.payload[4], 4);
+    memcpy (&_header.i2cClockHz, &ack.payload[8], 4);
+
+    // Resent reads are harmless, the frozen ring doesn't move
+    while (_records.size () < count)
+    {
+        status = traceOp (TRACE_READ, (uint16_t) _records.size (), ack);
+        if (status != STATUS_OK)
+            break;
+        uint16_t index = 0;
+        size_t records = 0;
+        if (ack.length >= 4)
+        {
+            memcpy (&index, &ack.payload[2], 2);
+            records = (ack.length - 4) / sizeof (BusTraceRecord);
+        }
+        if (index != _records.size () || records == 0)
+        {
+            status = STATUS_BAD_LENGTH;
+            break;
+        }
+        for (size_t r = 0; r < records; r++)
+        {
+            BusTraceRecord rec;
+            memcpy (&rec, &ack.payload[4 + r * sizeof (BusTraceRecord)], sizeof (rec));
+            _records.push_back (rec);
+        }
+    }
+
+    // Resumed even after a failed read so the board doesn't stay frozen
+    COMMAND_STATUS resumed = traceOp (TRACE_RESUME, 0, ack);
+    return (status != STATUS_OK) ? status : resumed;
+}
@@ -0,0 +1,90 @@
+#ifndef UPLINK_CLIENT_H
+#define UPLINK_CLIENT_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BusTrace.h"
+#include "CaptureRecord.h"
+#include "CommandFrame.h"
+#include "CommandParser.h"
+#include "telemetry_decoder.h"
+
+// Host end of the uplink command channel (imu_embedded_sw/CommandFrame.h).
+// Sends a frame, then reads the board's stream until the ack with the same
+// sequence shows up, resending on timeout.  Everything else in the stream is
+// scanned for CaptureRecords, raw or delta compressed, so the effect of a
+// change can be measured on the same port.
+class UplinkClient
+{
+public:
+    typedef std::pair<uint8_t, uint8_t> Setting;   // (COMMAND_SETTING, value)
+
+    static const int TIMEOUT_MS_DEFAULT = 300;
+    static const int RETRIES_DEFAULT = 3;
+
+    // CaptureRecords seen while reading, per sensor
+    struct StreamStats
+    {
+        unsigned long long  records[CAPTURE_SENSOR_NUM];
+        uint32_t            firstuS[CAPTURE_SENSOR_NUM];
+        uint32_t            lastuS[CAPTURE_SENSOR_NUM];
+        uint32_t            maxGapuS[CAPTURE_SENSOR_NUM];
+        unsigned long long  bytes;
+        unsigned long long  skippedBytes;   // Outside raw records, so all of a compressed stream
+        unsigned long long  blocks;         // Compressed blocks decoded
+    };
+
+    UplinkClient ();
+    ~UplinkClient ();
+
+    // A serial port is set to raw mode at _baud, anything else (a pty, a
+    // socket) is used as is
+    bool open (const std::string& _path, int _baud);
+
+    void setTimeout (int _timeoutMs, int _retries) {m_timeoutMs = _timeoutMs; m_retries = _retries;}
+
+    // Sends _request and waits for its ack.  Returns false if none came back
+    // after every retry.  _roundTripMs covers the attempt that was acked.
+    bool transact (CommandFrame& _request, CommandFrame& _ack, double& _roundTripMs);
+
+    // Helpers over transact, return the board's COMMAND_STATUS or STATUS_NUM
+    // on timeout.  _current gets the values the board reports back.
+    COMMAND_STATUS ping (double& _roundTripMs);
+    COMMAND_STATUS set (const std::vector<Setting>& _settings, std::vector<Setting>& _current, double& _roundTripMs);
+    COMMAND_STATUS get (const std::vector<uint8_t>& _ids, std::vector<Setting>& _current, double& _roundTripMs);
+    COMMAND_STATUS writeCalibration (const uint8_t* _blob, uint8_t _length, double& _roundTripMs);
+
+    // Freezes the board's bus trace, reads every record it kept and resumes
+    // it.  _header is filled in for a dump file.
+    COMMAND_STATUS readTrace (BusTraceHeader& _header, std::vector<BusTraceRecord>& _records);
+
+    // Reads for _ms, counting records into _stats
+    void monitor (int _ms, StreamStats& _stats);
+    static void resetStats (StreamStats& _stats);
+
+    unsigned long long getBadFrames () {return m_parser.getErrorCount ();}
+
+private:
+    // Reads what arrives within _ms, returns true as soon as the ack for
+    // _sequence has been parsed into _ack
+    bool pump (int _ms, int _sequence, CommandFrame* _ack);
+    void scanRecords (const uint8_t* _bytes, size_t _length);
+    void countRecord (const CaptureRecord& _rec);
+    static COMMAND_STATUS ackStatus (const CommandFrame& _request, const CommandFrame& _ack, std::vector<Setting>* _current);
+    COMMAND_STATUS traceOp (TRACE_OP _op, uint16_t _index, CommandFrame& _ack);
+
+    int                     m_fd;
+    int                     m_timeoutMs;
+    int                     m_retries;
+    uint8_t                 m_sequence;
+    CommandParser           m_parser;
+    std::vector<uint8_t>    m_recordBuf;
+    TelemetryDecoder        m_decoder;
+    std::vector<CaptureRecord> m_decoded;
+    StreamStats             m_stats;
+};
+
+#endif // UPLINK_CLIENT_H
@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Redundant sensor voting: noise and fault rejection
+#
+#-------------------------------------------------
+
+include(../common/common.pri)
+
+TARGET = imu_vote_sim
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    $$PWD/../../imu_embedded_sw/SensorVoter.cpp
+
+HEADERS += $$PWD/../../imu_embedded_sw/SensorVoter.h
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "SensorVoter.h"
+
+// Gyro counts as the sketch votes them, 250 dps full scale
+static const double   SAMPLE_HZ = 400.0;
+static const double   SECONDS_DEFAULT = 10.0;
+static const double   FAULT_START_S = 2.0;
+static const double   FAULT_END_S = 6.0;
+static const double   NOISE_COUNTS = 40.0;          // About 0.35 dps rms
+static const float    RANGE_COUNTS = 32000.0f;
+static const float    THRESHOLD_COUNTS = 800.0f;    // 7 dps
+static const double   BIAS_FAULT_COUNTS = 3000.0;
+static const double   NOISE_FAULT_GAIN = 30.0;
+static const double   PI = 3.14159265358979;
+
+typedef enum FAULT_KIND_ENUM
+{
+    KIND_NONE = 0,
+    KIND_STUCK,         // Holds its last sample
+    KIND_BIAS,          // Jumps by BIAS_FAULT_COUNTS
+    KIND_DROPOUT,       // Stops reporting
+    KIND_SATURATE,      // Pinned at full scale
+    KIND_NOISE,         // NOISE_FAULT_GAIN times the noise
+    KIND_NUM
+} FAULT_KIND;
+
+static const char* KIND_NAMES[KIND_NUM] = {"none", "stuck", "bias", "dropout", "saturate", "noise"};
+
+struct Options
+{
+    uint8_t     units;
+    FAULT_KIND  kind;
+    double      seconds;
+    unsigned    seed;
+};
+
+// Two tones per axis, well inside the range
+static Vec3<double> truth (double _t)
+{
+    return makeVec3<double> (5000.0 * sin (2.0 * PI * 0.5 * _t) + 2000.0 * sin (2.0 * PI * 3.0 * _t),
+                             4000.0 * sin (2.0 * PI * 0.7 * _t + 1.0),
+                             3000.0 * sin (2.0 * PI * 1.3 * _t + 2.0) + 1500.0 * sin (2.0 * PI * 5.0 * _t));
+}
+
+static double maxAbs (const Vec3<double>& _v)
+{
+    return std::max (fabs (_v.x), std::max (fabs (_v.y), fabs (_v.z)));
+}
+
+static void usage (const char* _prog)
+{
+    fprintf (stderr, "Usage: %s [-n units] [-f fault] [-s seconds] [-r seed]\n", _prog);
+    fprintf (stderr, "  Feeds N noisy copies of a gyro signal through SensorVoter (imu_embedded_sw),\n");
+    fprintf (stderr, "  one of them failing from %.0f s to %.0f s, and reports the voted noise against\n",
+             FAULT_START_S, FAULT_END_S);
+    fprintf (stderr, "  a single unit's and how quickly the failed unit was left out.\n");
+    fprintf (stderr, "  -n  units, 2 to %u, default 3\n", SensorVoter::UNITS_MAX);
+    fprintf (stderr, "  -f  none, stuck, bias, dropout, saturate or noise (default bias)\n");
+    fprintf (stderr, "  -s  length, default %.0f s\n", SECONDS_DEFAULT);
+    fprintf (stderr, "  -r  noise seed\n");
+}
+
+int main (int _argc, char** _argv)
+{
+    Options options;
+    options.units = 3;
+    options.kind = KIND_BIAS;
+    options.seconds = SECONDS_DEFAULT;
+    options.seed = 1;
+
+    int opt;
+    while ((opt = getopt (_argc, _argv, "n:f:s:r:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                options.units = (uint8_t) atoi (optarg);
+                break;
+            case 'f':
+                options.kind = KIND_NUM;
+                for (int k = 0; k < KIND_NUM; k++)
+                    if (strcmp (optarg, KIND_NAMES[k]) == 0)
+                        options.kind = (FAULT_KIND) k;
+                break;
+            case 's':
+                options.seconds = atof (optarg);
+                break;
+            case 'r':
+                options.seed = (unsigned) atoi (optarg);
+                break;
+            default:
+                usage (_argv[0]);
+                return 1;
+        }
+    }
+    if (optind != _argc || options.units < 2 || options.units > SensorVoter::UNITS_MAX ||
+        options.kind == KIND_NUM || options.seconds <= FAULT_END_S)
+    {
+        usage (_argv[0]);
+        return 1;
+    }
+
+    std::mt19937 rng (options.seed);
+    std::normal_distribution<double> normal;
+    SensorVoter voter (options.units, RANGE_COUNTS, THRESHOLD_COUNTS);
+    std::vector<uint8_t> order (options.units);
+    for (uint8_t u = 0; u < options.units; u++)
+        order[u] = u;
+
+    // Error of the vote and of healthy unit 1 on its own, outside the fault
+    double votedSq = 0.0, singleSq = 0.0;
+    long cleanPeriods = 0;
+    double faultMaxErr = 0.0;
+    long faultPeriods = 0, pendingPeriods = 0, badUsed = 0, noOutput = 0;
+    long firstExcluded = -1;
+    Vec3<float> stuck = makeVec3<float> (0.0f, 0.0f, 0.0f);
+
+    long periods = (long) (options.seconds * SAMPLE_HZ);
+    for (long k = 0; k < periods; k++)
+    {
+        double t = k / SAMPLE_HZ;
+        Vec3<double> real = truth (t);
+        bool faulty = options.kind != KIND_NONE && t >= FAULT_START_S && t < FAULT_END_S;
+
+        // The units' timers aren't in step, so they report in any order
+        std::shuffle (order.begin (), order.end (), rng);
+        bool voted = false;
+        bool unit0Bad = false;
+        for (uint8_t i = 0; i < options.units; i++)
+        {
+            uint8_t u = order[i];
+            Vec3<double> noise = makeVec3<double> (normal (rng), normal (rng), normal (rng)) * NOISE_COUNTS;
+            Vec3<float> sample = makeVec3<float> ((float) (real.x + noise.x), (float) (real.y + noise.y), (float) (real.z + noise.z));
+            if (u == 0 && faulty)
+            {
+                switch (options.kind)
+                {
+                    case KIND_STUCK:    sample = stuck; break;
+                    case KIND_BIAS:     sample += makeVec3<float> ((float) BIAS_FAULT_COUNTS, 0.0f, 0.0f); break;
+                    case KIND_DROPOUT:  continue;
+                    case KIND_SATURATE: sample = makeVec3<float> (32767.0f, 32767.0f, 32767.0f); break;
+                    case KIND_NOISE:    sample += makeVec3<float> ((float) noise.x, (float) noise.y, (float) noise.z) * (float) (NOISE_FAULT_GAIN - 1.0); break;
+                    default:            break;
+                }
+                Vec3<double> err = makeVec3<double> (sample.x - real.x, sample.y - real.y, sample.z - real.z);
+                unit0Bad = maxAbs (err) > THRESHOLD_COUNTS;
+            }
+            else if (u == 0)
+            {
+                stuck = sample;
+            }
+            voted = voter.submit (u, sample);
+            if (u == 1)
+                singleSq += faulty ? 0.0 : dot (noise, noise) / 3.0;
+        }
+
+        // The last report of a period takes the vote, unless a unit is
+        // being waited for
+        if (!voted)
+        {
+            pendingPeriods++;
+            continue;
+        }
+        if (voter.getUsed () == 0)
+        {
+            noOutput++;
+            continue;
+        }
+        Vec3<float> out = voter.getVoted ();
+        Vec3<double> err = makeVec3<double> (out.x - real.x, out.y - real.y, out.z - real.z);
+        bool excluded = voter.getFault (0) != SensorVoter::FAULT_NONE;
+        if (faulty)
+        {
+            faultPeriods++;
+            faultMaxErr = std::max (faultMaxErr, maxAbs (err));
+            if (unit0Bad && !excluded)
+                badUsed++;
+            if (excluded && firstExcluded < 0)
+                firstExcluded = k - (long) (FAULT_START_S * SAMPLE_HZ);
+        }
+        else if (!excluded)
+        {
+            votedSq += dot (err, err) / 3.0;
+            cleanPeriods++;
+        }
+    }
+
+    long singlePeriods = periods - (options.kind != KIND_NONE ? (long) ((FAULT_END_S - FAULT_START_S) * SAMPLE_HZ) : 0);
+    double singleRms = sqrt (singleSq / singlePeriods);
+    double votedRms = cleanPeriods ? sqrt (votedSq / cleanPeriods) : 0.0;
+    printf ("Units=%u\n", options.units);
+    printf ("Fault=%s\n", KIND_NAMES[options.kind]);
+    printf ("Votes=%u\n", voter.getVotes ());
+    printf ("\n");
+
+    printf ("[noise]\n");
+    printf ("SingleRmsCounts=%.2f\n", singleRms);
+    printf ("VotedRmsCounts=%.2f\n", votedRms);
+    printf ("Ratio=%.3f\n", singleRms > 0.0 ? votedRms / singleRms : 0.0);
+    printf ("ExpectedRatio=%.3f\n", 1.0 / sqrt ((double) options.units));
+    printf ("\n");
+
+    printf ("[fault]\n");
+    printf ("Periods=%ld\n", faultPeriods);
+    printf ("DetectedAfterPeriods=%ld\n", firstExcluded);
+    printf ("BadSamplesUsed=%ld\n", badUsed);
+    printf ("MaxVotedErrCounts=%.1f\n", faultMaxErr);
+    printf ("PendingPeriods=%ld\n", pendingPeriods);
+    printf ("NoOutputPeriods=%ld\n", noOutput);
+    for (uint8_t u = 0; u < options.units; u++)
+        printf ("Unit%uRejected=%u\n", u, voter.getRejected (u));
+    return 0;
+}